@@ -33,20 +33,46 @@
 #include "translation.hpp"
 #include "get_printable_password.hpp"
 
+// Two wire formats are supported, both framed by a 32 bits big endian length.
+//
+// Text (default): "key\nASK\n" or "key\n!value\n" items.
+//
+// Binary: the length header has BINARY_FLAG set and each item is
+//     authid    (uint16_be, authid_t numeric value)
+//     flags     (uint8, ITEM_ASK when the value is asked)
+//     length    (uint16_be, value length without terminal zero)
+//     value     (length bytes followed by a zero byte)
+// The authentifier opts in by sending a binary message, every message sent
+// by the proxy after that one uses the binary format too.
+
 class AclSerializer{
     enum {
         HEADER_SIZE = 4
     };
 
+    enum : uint32_t {
+        BINARY_FLAG = 0x80000000
+    };
+
+    enum {
+        ITEM_ASK = 0x01
+    };
+
+    enum {
+        BINARY_ITEM_HEADER_SIZE = 5
+    };
+
     Inifile * ini;
     Transport & auth_trans;
     uint32_t verbose;
+    bool binary;
 
 public:
     AclSerializer(Inifile * ini, Transport & auth_trans, uint32_t verbose)
         : ini(ini)
         , auth_trans(auth_trans)
         , verbose(verbose)
+        , binary(false)
     {
         if (this->verbose & 0x10){
             LOG(LOG_INFO, "auth::AclSerializer");
@@ -61,6 +87,10 @@ public:
         }
     }
 
+    bool is_binary() const {
+        return this->binary;
+    }
+
     void in_items(Stream & stream)
     {
         if (this->verbose & 0x40){
@@ -87,8 +117,12 @@ public:
             if (*stream.p == '\n') {
                 *stream.p = 0;
 
-                if ((0 == strncasecmp(value, "ask", 3))) {
-                    this->ini->ask_from_acl(keyword);
+                const authid_t authid = authid_from_string(keyword);
+                if (authid == AUTHID_UNKNOWN) {
+                    LOG(LOG_WARNING, "auth::in_item: unknown strauthid=\"%s\"", keyword);
+                }
+                else if ((0 == strncasecmp(value, "ask", 3))) {
+                    this->ini->ask_from_acl(authid);
                     LOG(LOG_INFO, "receiving %s '%s'", value, keyword);
                 }
                 else {
@@ -100,16 +134,8 @@ public:
                     // output[out_len] = 0;
                     // this->ini->set_from_acl((char *)keyword,
                     //                         (char *)output);
-                    this->ini->set_from_acl(keyword, value + (value[0] == '!' ? 1 : 0));
-                    const char * val         = this->ini->context_get_value_by_string(keyword);
-                    const char * display_val = val;
-                    if ((strncasecmp("password", keyword, 9 ) == 0) ||
-                        (strncasecmp("target_application_password", keyword, 27) == 0) ||
-                        (strncasecmp("target_password", keyword, 16) == 0) ||
-                        ((strncasecmp("auth_channel_answer", keyword, 19) == 0) && (strcasestr(val, "password") != 0))) {
-                        display_val = ::get_printable_password(val, this->ini->debug.password);
-                    }
-                    LOG(LOG_INFO, "receiving '%s'='%s'", keyword, display_val);
+                    this->ini->set_from_acl(authid, value + (value[0] == '!' ? 1 : 0));
+                    this->log_received(authid);
                 }
 
                 stream.p = stream.p+1;
@@ -121,12 +147,74 @@ public:
         throw Error(ERR_ACL_UNEXPECTED_IN_ITEM_OUT);
     }
 
+    void in_binary_items(Stream & stream)
+    {
+        if (this->verbose & 0x40){
+            LOG(LOG_INFO, "auth::in_binary_items");
+        }
+        for (; stream.p < stream.end ; this->in_binary_item(stream)){
+            ;
+        }
+    }
+
+    void in_binary_item(Stream & stream)
+    {
+        const uint8_t * start = stream.p;
+        if (!stream.in_check_rem(BINARY_ITEM_HEADER_SIZE)) {
+            LOG(LOG_WARNING, "Truncated binary ACL item header");
+            hexdump(start, stream.end - start);
+            throw Error(ERR_ACL_UNEXPECTED_IN_ITEM_OUT);
+        }
+        const unsigned id     = stream.in_uint16_be();
+        const uint8_t  flags  = stream.in_uint8();
+        const unsigned length = stream.in_uint16_be();
+        if (!stream.in_check_rem(length + 1) || stream.p[length] != 0) {
+            LOG(LOG_WARNING, "Truncated binary ACL item value");
+            hexdump(start, stream.end - start);
+            throw Error(ERR_ACL_UNEXPECTED_IN_ITEM_OUT);
+        }
+        const char * value = reinterpret_cast<const char*>(stream.p);
+        stream.in_skip_bytes(length + 1);
+
+        if ((id == AUTHID_UNKNOWN) || (id >= MAX_AUTHID)) {
+            LOG(LOG_WARNING, "auth::in_binary_item: unknown authid=%u", id);
+            return;
+        }
+
+        const authid_t authid = static_cast<authid_t>(id);
+        if (flags & ITEM_ASK) {
+            this->ini->ask_from_acl(authid);
+            LOG(LOG_INFO, "receiving ASK '%s'", string_from_authid(authid));
+        }
+        else {
+            this->ini->set_from_acl(authid, value);
+            this->log_received(authid);
+        }
+    }
+
+private:
+    void log_received(authid_t authid)
+    {
+        const char * val         = this->ini->context_get_value(authid);
+        const char * display_val = val;
+        if ((authid == AUTHID_PASSWORD) ||
+            (authid == AUTHID_TARGET_APPLICATION_PASSWORD) ||
+            (authid == AUTHID_TARGET_PASSWORD) ||
+            ((authid == AUTHID_AUTHCHANNEL_ANSWER) && (strcasestr(val, "password") != 0))) {
+            display_val = ::get_printable_password(val, this->ini->debug.password);
+        }
+        LOG(LOG_INFO, "receiving '%s'='%s'", string_from_authid(authid), display_val);
+    }
+
+public:
     void incoming()
     {
         BStream stream(HEADER_SIZE);
         this->auth_trans.recv(&stream.end, HEADER_SIZE);
 
-        size_t size = stream.in_uint32_be();
+        const uint32_t header = stream.in_uint32_be();
+        const bool binary_message = (header & BINARY_FLAG);
+        size_t size = header & ~BINARY_FLAG;
 
         if (size > 65536){
             LOG(LOG_WARNING, "Error: ACL message too big (got %u max 64 K)", size);
@@ -142,7 +230,16 @@ public:
             LOG(LOG_INFO, "ACL SERIALIZER : Data size without header (receive) = %u", size);
         }
         bool flag = this->ini->context.session_id.get().empty();
-        this->in_items(stream);
+        if (binary_message) {
+            if (!this->binary) {
+                LOG(LOG_INFO, "ACL SERIALIZER : switching to binary protocol");
+                this->binary = true;
+            }
+            this->in_binary_items(stream);
+        }
+        else {
+            this->in_items(stream);
+        }
         if (flag && !this->ini->context.session_id.get().empty()) {
             int child_pid = getpid();
             char old_session_file[256];
@@ -191,23 +288,63 @@ public:
         stream.out_copy_bytes(serialized,strlen(serialized));
     }
 
+    void out_binary_item(Stream & stream, Inifile::BaseField * bfield)
+    {
+        const authid_t authid = bfield->get_authid();
+        const char * key = string_from_authid(authid);
+        const bool asked = bfield->is_asked();
+        const char * val = asked ? "" : bfield->get_value();
+        const size_t length = strlen(val);
+        if ((length > 0xFFFF) || !stream.has_room(BINARY_ITEM_HEADER_SIZE + length + 1)) {
+            LOG(LOG_ERR, "Sending Data to ACL Error: Buffer overflow,"
+                " should have write %u bytes but buffer size is %u bytes",
+                BINARY_ITEM_HEADER_SIZE + length + 1, stream.tailroom());
+            throw Error(ERR_ACL_MESSAGE_TOO_BIG);
+        }
+        stream.out_uint16_be(authid);
+        stream.out_uint8(asked ? ITEM_ASK : 0);
+        stream.out_uint16_be(length);
+        stream.out_copy_bytes(val, length);
+        stream.out_uint8(0);
+        bfield->use();
+
+        if (asked) {
+            LOG(LOG_INFO, "sending %s=ASK", key);
+        }
+        else {
+            const char * display_val = val;
+            if ((authid == AUTHID_PASSWORD) || (authid == AUTHID_TARGET_PASSWORD)) {
+                display_val = ::get_printable_password(val, this->ini->debug.password);
+            }
+            LOG(LOG_INFO, "sending %s=%s", key, display_val);
+        }
+    }
+
     //void send_new(std::set<Inifile::BaseField *>& list)
     void send(Inifile::SetField const & list)
     {
         try {
-            BStream stream(8192);
+            BStream stream(this->binary ? 65536 + HEADER_SIZE : 8192);
             stream.out_uint32_be(0);
 
-            Inifile::SetField(list).foreach([&stream, this](Inifile::BaseField * bfield) {
-                this->out_item_new(stream, bfield);
-            });
+            if (this->binary) {
+                Inifile::SetField(list).foreach([&stream, this](Inifile::BaseField * bfield) {
+                    this->out_binary_item(stream, bfield);
+                });
+            }
+            else {
+                Inifile::SetField(list).foreach([&stream, this](Inifile::BaseField * bfield) {
+                    this->out_item_new(stream, bfield);
+                });
+            }
 
             stream.mark_end();
             int total_length = stream.get_offset();
             if (this->verbose & 0x40){
                 LOG(LOG_INFO, "ACL SERIALIZER : Data size without header (send) %u", total_length - HEADER_SIZE);
             }
-            stream.set_out_uint32_be(total_length - HEADER_SIZE, 0); /* size in header */
+            /* size in header */
+            stream.set_out_uint32_be((total_length - HEADER_SIZE) | (this->binary ? uint32_t(BINARY_FLAG) : 0), 0);
             this->auth_trans.send(stream.get_data(), total_length);
         } catch (Error const &) {
             this->ini->context.authenticated.set(false);
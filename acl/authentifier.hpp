@@ -309,11 +309,13 @@ public:
                         throw;
                     }
                 }
-                if (!this->keepalive.is_started() && mm.connected) {
-                    this->keepalive.start(now);
-                }
             }
         }
+        // also when the target connection was established by the session
+        // loop (async_connect)
+        if (!this->keepalive.is_started() && mm.connected) {
+            this->keepalive.start(now);
+        }
         if (this->wait_for_capture &&
             mm.is_up_and_running()) {
             mm.record(this);
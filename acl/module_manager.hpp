@@ -28,6 +28,7 @@
 #include "socket_transport.hpp"
 #include "config.hpp"
 #include "netutils.hpp"
+#include "async_connect.hpp"
 #include "mod_api.hpp"
 #include "auth_api.hpp"
 #include "null/null.hpp"
@@ -434,6 +435,20 @@ public:
     null_mod no_mod;
     SocketTransport * mod_transport = nullptr;
 
+private:
+    // target connection started by new_mod() with async_connect, the module
+    // is created by check_target_connect() once it is established
+    AsyncConnect target_connect;
+    int          pending_module = MODULE_EXIT;
+    auth_api *   pending_acl    = nullptr;
+
+    // target connection opened in advance while an internal module is shown
+    // (preconnect_timeout), given to the target module by connect_target()
+    AsyncConnect standby_connect;
+    time_t       standby_expire = 0;
+
+public:
+
     ModuleManager(Front & front, Inifile & ini)
         : MMIni(ini)
         , front(front)
@@ -445,6 +460,9 @@ public:
 
     virtual void remove_mod()
     {
+        this->target_connect.cancel();
+        this->pending_module = MODULE_EXIT;
+
         delete this->osd;
 
         if (this->mod != &this->no_mod){
@@ -463,6 +481,7 @@ public:
     {
         LOG(LOG_INFO, "target_module=%u", target_module);
         if (this->last_module) this->front.stop_capture();
+        this->prepare_standby_connect(target_module, now);
         switch (target_module)
         {
         case MODULE_INTERNAL_BOUNCER2:
@@ -684,14 +703,10 @@ public:
                     LOG(LOG_INFO, "ModuleManager::Creation of new mod 'XUP'\n");
                 }
 
-                int client_sck = ip_connect(this->ini.context.target_host.get_cstr(),
-                                            this->ini.context.target_port.get(),
-                                            4, 1000,
-                                            this->ini.debug.mod_xup);
-
-                if (client_sck == -1){
-                    this->ini.context.auth_error_message = "failed to connect to remote TCP host";
-                    throw Error(ERR_SOCKET_CONNECT_FAILED);
+                int client_sck = this->connect_target(target_module, acl, 4, this->ini.debug.mod_xup);
+                if (client_sck == -1) {
+                    // connection in progress
+                    break;
                 }
 
                 this->ini.context.auth_error_message = "failed authentification on remote X host";
@@ -746,14 +761,10 @@ public:
 
                 static const char * name = "RDP Target";
 
-                int client_sck = ip_connect(this->ini.context.target_host.get_cstr(),
-                                            this->ini.context.target_port.get(),
-                                            3, 1000,
-                                            this->ini.debug.mod_rdp);
-
-                if (client_sck == -1){
-                    this->ini.context.auth_error_message = "failed to connect to remote TCP host";
-                    throw Error(ERR_SOCKET_CONNECT_FAILED);
+                int client_sck = this->connect_target(target_module, acl, 3, this->ini.debug.mod_rdp);
+                if (client_sck == -1) {
+                    // connection in progress
+                    break;
                 }
 
                 this->ini.context.auth_error_message = "failed authentification on remote RDP host";
@@ -807,6 +818,8 @@ public:
 
                 mod_rdp_params.allow_channels                      = &(this->ini.mod_rdp.allow_channels);
                 mod_rdp_params.deny_channels                       = &(this->ini.mod_rdp.deny_channels);
+                mod_rdp_params.channel_scheduler                   = this->ini.globals.channel_scheduler;
+                mod_rdp_params.channel_rate_limits                 = this->ini.globals.channel_rate_limits.get_cstr();
 
                 UdevRandom gen;
 
@@ -839,15 +852,10 @@ public:
                 static const char * name = "VNC Target";
 
 
-                int client_sck = ip_connect(this->ini.context.target_host.get_cstr(),
-                                            //this->ini.context_get_value(AUTHID_TARGET_HOST, NULL, 0),
-                                            this->ini.context.target_port.get(),
-                                            3, 1000,
-                                            this->ini.debug.mod_vnc);
-
-                if (client_sck == -1){
-                    this->ini.context.auth_error_message = "failed to connect to remote TCP host";
-                    throw Error(ERR_SOCKET_CONNECT_FAILED);
+                int client_sck = this->connect_target(target_module, acl, 3, this->ini.debug.mod_vnc);
+                if (client_sck == -1) {
+                    // connection in progress
+                    break;
                 }
 
                 this->ini.context.auth_error_message = "failed authentification on remote VNC host";
@@ -888,6 +896,201 @@ public:
         }
     }
 
+private:
+    // Socket connected to the target, throws when the connection failed.
+    // With async_connect the connection is only started and -1 is returned,
+    // a wait message is shown until check_target_connect() calls new_mod()
+    // again with the connected socket.
+    int connect_target(int target_module, auth_api * acl, int nbretry, uint32_t verbose)
+    {
+        if (this->target_connect.get_state() == AsyncConnect::CONNECTED) {
+            return this->target_connect.release();
+        }
+
+        const int standby_sck = this->take_standby_connect();
+        if (standby_sck != -1) {
+            return standby_sck;
+        }
+
+        if (!this->ini.globals.async_connect) {
+            int client_sck = ip_connect(this->ini.context.target_host.get_cstr(),
+                                        this->ini.context.target_port.get(),
+                                        nbretry, 1000,
+                                        verbose);
+
+            if (client_sck == -1){
+                this->ini.context.auth_error_message = "failed to connect to remote TCP host";
+                throw Error(ERR_SOCKET_CONNECT_FAILED);
+            }
+            return client_sck;
+        }
+
+        this->target_connect.start(this->ini.context.target_host.get_cstr(),
+                                   this->ini.context.target_port.get(),
+                                   nbretry * 1000, tvtime());
+        this->pending_module = target_module;
+        this->pending_acl    = acl;
+
+        std::string message = TR("connecting", this->ini);
+        message += ' ';
+        message += this->ini.globals.target_device.get_cstr();
+        this->osd_message(std::move(message), true);
+        return -1;
+    }
+
+    // The authentifier gives the target before the internal modules shown
+    // ahead of the connection (interactive target, messages, challenge), the
+    // TCP connection is opened meanwhile. TLS and NLA cannot be done in
+    // advance, they follow the X.224 negotiation of the target module.
+    void prepare_standby_connect(int target_module, time_t now)
+    {
+        switch (target_module) {
+        case MODULE_XUP:
+        case MODULE_RDP:
+        case MODULE_VNC:
+            // taken or dropped by connect_target()
+            return;
+        case MODULE_INTERNAL_TARGET:
+        case MODULE_INTERNAL_DIALOG_VALID_MESSAGE:
+        case MODULE_INTERNAL_WIDGET2_DIALOG:
+        case MODULE_INTERNAL_DIALOG_DISPLAY_MESSAGE:
+        case MODULE_INTERNAL_WIDGET2_MESSAGE:
+        case MODULE_INTERNAL_DIALOG_CHALLENGE:
+        case MODULE_INTERNAL_WAIT_INFO:
+            break;
+        default:
+            // target_host is left from a previous target at login, selector
+            // or close box
+            this->standby_connect.cancel();
+            return;
+        }
+
+        const char * host = this->ini.context.target_host.get_cstr();
+        const int    port = this->ini.context.target_port.get();
+
+        if (!this->ini.globals.preconnect_timeout
+         || this->ini.context_is_asked(AUTHID_TARGET_HOST)
+         || !*host || port <= 0) {
+            this->standby_connect.cancel();
+            return;
+        }
+        if (this->standby_connect.targets(host, port)) {
+            // already opened by a previous internal module
+            return;
+        }
+
+        LOG(LOG_INFO, "ModuleManager::pre-connection to %s:%d", host, port);
+        this->standby_connect.start(host, port, 3000, tvtime());
+        this->standby_expire = now + this->ini.globals.preconnect_timeout;
+    }
+
+    // Socket of the pre-connection when it is established to the current
+    // target and still open, -1 otherwise. The pre-connection is dropped in
+    // any case.
+    int take_standby_connect()
+    {
+        int sck = -1;
+        if (this->standby_connect.get_state() == AsyncConnect::CONNECTED
+         && this->standby_connect.targets(this->ini.context.target_host.get_cstr(),
+                                          this->ini.context.target_port.get())) {
+            sck = this->standby_connect.release();
+
+            // a RFB server sends its ProtocolVersion as soon as accepted,
+            // pending data is left to the module, only EOF or error means
+            // the target gave up the connection while it was waiting
+            char c;
+            const ssize_t res = recv(sck, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+            if (res == 0 || (res == -1 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                LOG(LOG_INFO, "ModuleManager::pre-connection closed by target");
+                close(sck);
+                sck = -1;
+            }
+            else {
+                LOG(LOG_INFO, "ModuleManager::using pre-connection to %s:%d",
+                    this->ini.context.target_host.get_cstr(),
+                    int(this->ini.context.target_port.get()));
+            }
+        }
+        this->standby_connect.cancel();
+        return sck;
+    }
+
+    void check_standby_connect(const fd_set & wfds, time_t now)
+    {
+        if (this->standby_connect.is_pending()) {
+            this->standby_connect.process(wfds, tvtime());
+        }
+
+        switch (this->standby_connect.get_state()) {
+        case AsyncConnect::FAILED:
+            // connect_target() will report the error if the target is used
+            LOG(LOG_INFO, "ModuleManager::pre-connection failed");
+            this->standby_connect.cancel();
+            break;
+        case AsyncConnect::CONNECTED:
+            if (now >= this->standby_expire) {
+                LOG(LOG_INFO, "ModuleManager::pre-connection unused, closed");
+                this->standby_connect.cancel();
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+public:
+    void add_to_fd_set(fd_set & wfds, unsigned & max, timeval & timeout)
+    {
+        if (this->pending_module != MODULE_EXIT) {
+            this->target_connect.add_to_fd_set(wfds, max, timeout, tvtime());
+        }
+        // an established pre-connection waits for the target module, its
+        // expiry is checked at select timeout
+        if (this->standby_connect.is_pending()) {
+            this->standby_connect.add_to_fd_set(wfds, max, timeout, tvtime());
+        }
+    }
+
+    // Creates the module of the pending target connection when it is
+    // established. A failure is handled as a failure of the synchronous
+    // connection: reported to the authentifier which then gives the next
+    // module. Also follows the pre-connection.
+    void check_target_connect(const fd_set & wfds, time_t now, BackEvent_t & signal)
+    {
+        this->check_standby_connect(wfds, now);
+
+        if (this->pending_module == MODULE_EXIT) {
+            return;
+        }
+        if (this->target_connect.is_pending()) {
+            this->target_connect.process(wfds, tvtime());
+        }
+
+        switch (this->target_connect.get_state()) {
+        case AsyncConnect::CONNECTED:
+            {
+                const int target_module = this->pending_module;
+                this->pending_module = MODULE_EXIT;
+                this->clear_osd_message();
+                this->new_mod(target_module, now, this->pending_acl);
+            }
+            break;
+        case AsyncConnect::FAILED:
+            this->pending_module = MODULE_EXIT;
+            this->target_connect.cancel();
+            this->clear_osd_message();
+            this->ini.context.auth_error_message = "failed to connect to remote TCP host";
+            this->ini.context.module.set_from_cstr(STRMODULE_TRANSITORY);
+            if (this->pending_acl) {
+                this->pending_acl->report("CONNECTION_FAILED", "Failed to connect to remote TCP host.");
+            }
+            signal = BACK_EVENT_NEXT;
+            break;
+        default:
+            break;
+        }
+    }
+
     // Check movie start/stop/pause
     virtual void record(auth_api * acl)
     {
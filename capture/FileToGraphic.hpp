@@ -58,6 +58,8 @@
 #include "wrm_label.hpp"
 #include "png.hpp"
 
+#include <vector>
+
 struct FileToGraphic
 {
     enum {
@@ -169,6 +171,89 @@ public:
 
     bool ignore_frame_in_timeval;
 
+    // When set, play() sends orders of a RDP_UPDATE_ORDERS chunk to consumers
+    // batch by batch instead of order by order (see interpret_orders_batch()).
+    bool batch_orders;
+
+private:
+    // Primary orders decoded once, kept in one array per order type, the
+    // sequence of orders is kept in items.
+    struct OrderBatch {
+        enum : uint8_t {
+            FRAME_MARKER = 0xFF  // not a primary order type
+        };
+
+        struct Item {
+            uint8_t  order;  // primary order type or FRAME_MARKER
+            uint16_t index;  // in array of this order type
+            Rect     clip;
+        };
+
+        std::vector<Item>                items;
+        std::vector<RDPDestBlt>          destblt;
+        std::vector<RDPMultiDstBlt>      multidstblt;
+        std::vector<RDPMultiOpaqueRect>  multiopaquerect;
+        std::vector<RDP::RDPMultiPatBlt> multipatblt;
+        std::vector<RDP::RDPMultiScrBlt> multiscrblt;
+        std::vector<RDPPatBlt>           patblt;
+        std::vector<RDPScrBlt>           scrblt;
+        std::vector<RDPOpaqueRect>       opaquerect;
+        std::vector<RDPMemBlt>           memblt;
+        std::vector<RDPMem3Blt>          mem3blt;
+        std::vector<RDPLineTo>           lineto;
+        std::vector<RDPGlyphIndex>       glyphindex;
+        std::vector<RDPPolyline>         polyline;
+        std::vector<RDPEllipseSC>        ellipseSC;
+        std::vector<RDP::FrameMarker>    frame_marker;
+
+        std::vector<RDPDestBlt>          & array(const RDPDestBlt &)          { return this->destblt; }
+        std::vector<RDPMultiDstBlt>      & array(const RDPMultiDstBlt &)      { return this->multidstblt; }
+        std::vector<RDPMultiOpaqueRect>  & array(const RDPMultiOpaqueRect &)  { return this->multiopaquerect; }
+        std::vector<RDP::RDPMultiPatBlt> & array(const RDP::RDPMultiPatBlt &) { return this->multipatblt; }
+        std::vector<RDP::RDPMultiScrBlt> & array(const RDP::RDPMultiScrBlt &) { return this->multiscrblt; }
+        std::vector<RDPPatBlt>           & array(const RDPPatBlt &)           { return this->patblt; }
+        std::vector<RDPScrBlt>           & array(const RDPScrBlt &)           { return this->scrblt; }
+        std::vector<RDPOpaqueRect>       & array(const RDPOpaqueRect &)       { return this->opaquerect; }
+        std::vector<RDPMemBlt>           & array(const RDPMemBlt &)           { return this->memblt; }
+        std::vector<RDPMem3Blt>          & array(const RDPMem3Blt &)          { return this->mem3blt; }
+        std::vector<RDPLineTo>           & array(const RDPLineTo &)           { return this->lineto; }
+        std::vector<RDPGlyphIndex>       & array(const RDPGlyphIndex &)       { return this->glyphindex; }
+        std::vector<RDPPolyline>         & array(const RDPPolyline &)         { return this->polyline; }
+        std::vector<RDPEllipseSC>        & array(const RDPEllipseSC &)        { return this->ellipseSC; }
+        std::vector<RDP::FrameMarker>    & array(const RDP::FrameMarker &)    { return this->frame_marker; }
+
+        template<class Order>
+        void push(uint8_t order, const Order & cmd, const Rect & clip) {
+            std::vector<Order> & a = this->array(cmd);
+            Item item = { order, static_cast<uint16_t>(a.size()), clip };
+            this->items.push_back(item);
+            a.push_back(cmd);
+        }
+
+        // keep capacity, batches of a movie have almost the same size
+        void clear() {
+            this->items.clear();
+            this->destblt.clear();
+            this->multidstblt.clear();
+            this->multiopaquerect.clear();
+            this->multipatblt.clear();
+            this->multiscrblt.clear();
+            this->patblt.clear();
+            this->scrblt.clear();
+            this->opaquerect.clear();
+            this->memblt.clear();
+            this->mem3blt.clear();
+            this->lineto.clear();
+            this->glyphindex.clear();
+            this->polyline.clear();
+            this->ellipseSC.clear();
+            this->frame_marker.clear();
+        }
+    } batch;
+
+    bool batching;
+
+public:
     struct Statistics {
         uint32_t DstBlt;
         uint32_t MultiDstBlt;
@@ -268,6 +353,8 @@ public:
         , info_cache_4_persistent(false)
         , info_compression_algorithm(0)
         , ignore_frame_in_timeval(false)
+        , batch_orders(false)
+        , batching(false)
         , statistics()
     {
         while (this->next_order()){
@@ -283,6 +370,118 @@ public:
         delete this->bmp_cache;
     }
 
+private:
+    template<class Order>
+    void draw_order(const Order & cmd, const Rect & clip) {
+        if (this->batching) {
+            this->batch.push(this->common.order, cmd, clip);
+            return;
+        }
+        for (size_t i = 0; i < this->nbconsumers; i++) {
+            this->consumers[i].graphic_device->draw(cmd, clip);
+        }
+    }
+
+    void draw_order(const RDPGlyphIndex & cmd, const Rect & clip) {
+        if (this->batching) {
+            this->batch.push(this->common.order, cmd, clip);
+            return;
+        }
+        for (size_t i = 0; i < this->nbconsumers; i++) {
+            this->consumers[i].graphic_device->draw(cmd, clip, &this->gly_cache);
+        }
+    }
+
+    REDOC("Batched bitmap is read again from cache when batch is flushed,"
+          " cache is never modified before that.")
+    template<class MemBlt>
+    void draw_order(const MemBlt & cmd, const Rect & clip, const Bitmap & bmp) {
+        if (this->batching) {
+            this->batch.push(this->common.order, cmd, clip);
+            return;
+        }
+        for (size_t i = 0; i < this->nbconsumers; i++) {
+            this->consumers[i].graphic_device->draw(cmd, clip, bmp);
+        }
+    }
+
+    void draw_order(const RDP::FrameMarker & order) {
+        if (this->batching) {
+            this->batch.push(OrderBatch::FRAME_MARKER, order, this->screen_rect);
+            return;
+        }
+        for (size_t i = 0; i < this->nbconsumers; i++) {
+            this->consumers[i].graphic_device->draw(order);
+        }
+    }
+
+    REDOC("Send batched orders to consumers, each consumer receives the whole batch before next one.")
+    void flush_batch() {
+        if (this->batch.items.empty()) {
+            return;
+        }
+        for (size_t i = 0; i < this->nbconsumers; i++) {
+            RDPGraphicDevice & gd = *this->consumers[i].graphic_device;
+            for (const OrderBatch::Item & item : this->batch.items) {
+                switch (item.order) {
+                case RDP::DESTBLT:
+                    gd.draw(this->batch.destblt[item.index], item.clip);
+                    break;
+                case RDP::MULTIDSTBLT:
+                    gd.draw(this->batch.multidstblt[item.index], item.clip);
+                    break;
+                case RDP::MULTIOPAQUERECT:
+                    gd.draw(this->batch.multiopaquerect[item.index], item.clip);
+                    break;
+                case RDP::MULTIPATBLT:
+                    gd.draw(this->batch.multipatblt[item.index], item.clip);
+                    break;
+                case RDP::MULTISCRBLT:
+                    gd.draw(this->batch.multiscrblt[item.index], item.clip);
+                    break;
+                case RDP::PATBLT:
+                    gd.draw(this->batch.patblt[item.index], item.clip);
+                    break;
+                case RDP::SCREENBLT:
+                    gd.draw(this->batch.scrblt[item.index], item.clip);
+                    break;
+                case RDP::RECT:
+                    gd.draw(this->batch.opaquerect[item.index], item.clip);
+                    break;
+                case RDP::MEMBLT:
+                {
+                    const RDPMemBlt & cmd = this->batch.memblt[item.index];
+                    gd.draw(cmd, item.clip, this->bmp_cache->get(cmd.cache_id, cmd.cache_idx));
+                }
+                    break;
+                case RDP::MEM3BLT:
+                {
+                    const RDPMem3Blt & cmd = this->batch.mem3blt[item.index];
+                    gd.draw(cmd, item.clip, this->bmp_cache->get(cmd.cache_id, cmd.cache_idx));
+                }
+                    break;
+                case RDP::LINE:
+                    gd.draw(this->batch.lineto[item.index], item.clip);
+                    break;
+                case RDP::GLYPHINDEX:
+                    gd.draw(this->batch.glyphindex[item.index], item.clip, &this->gly_cache);
+                    break;
+                case RDP::POLYLINE:
+                    gd.draw(this->batch.polyline[item.index], item.clip);
+                    break;
+                case RDP::ELLIPSESC:
+                    gd.draw(this->batch.ellipseSC[item.index], item.clip);
+                    break;
+                case OrderBatch::FRAME_MARKER:
+                    gd.draw(this->batch.frame_marker[item.index]);
+                    break;
+                }
+            }
+        }
+        this->batch.clear();
+    }
+
+public:
     void add_consumer(RDPGraphicDevice * graphic_device, RDPCaptureDevice * capture_device) {
         this->consumers[this->nbconsumers  ].graphic_device = graphic_device;
         this->consumers[this->nbconsumers++].capture_device = capture_device;
@@ -384,9 +583,7 @@ public:
                         if (this->verbose > 32){
                             order.log(LOG_INFO);
                         }
-                        for (size_t i = 0; i < this->nbconsumers; i++){
-                            this->consumers[i].graphic_device->draw(order);
-                        }
+                        this->draw_order(order);
                     }
                     break;
                     default:
@@ -402,6 +599,9 @@ public:
                 switch (header.type) {
                 case TS_CACHE_BITMAP_COMPRESSED:
                 case TS_CACHE_BITMAP_UNCOMPRESSED:
+                // recorded from the client order stream (shared serializer)
+                case TS_CACHE_BITMAP_COMPRESSED_REV2:
+                case TS_CACHE_BITMAP_UNCOMPRESSED_REV2:
                 {
                     this->statistics.CacheBitmap++;
                     RDPBmpCache cmd;
@@ -409,7 +609,9 @@ public:
                     if (this->verbose > 32){
                         cmd.log(LOG_INFO);
                     }
-                    this->bmp_cache->put(cmd.id, cmd.idx, cmd.bmp, cmd.key1, cmd.key2);
+                    // orders of batch may use the previous bitmap at this place
+                    this->flush_batch();
+                    this->bmp_cache->put(cmd.id, cmd.idx, std::move(cmd.bmp), cmd.key1, cmd.key2);
                 }
                 break;
                 case TS_CACHE_COLOR_TABLE:
@@ -425,16 +627,11 @@ public:
                         cmd.log(LOG_INFO);
                     }
                     FontChar fc(cmd.x, cmd.y, cmd.cx, cmd.cy, -1);
-                    memcpy(fc.data.get(), cmd.aj, fc.datasize());
+                    memcpy(fc.writable_data(), cmd.aj, fc.datasize());
+                    this->flush_batch();
                     this->gly_cache.set_glyph(std::move(fc), cmd.cacheId, cmd.cacheIndex);
                 }
                 break;
-                case TS_CACHE_BITMAP_COMPRESSED_REV2:
-                    LOG(LOG_ERR, "unsupported SECONDARY ORDER TS_CACHE_BITMAP_COMPRESSED_REV2 (%d)", header.type);
-                  break;
-                case TS_CACHE_BITMAP_UNCOMPRESSED_REV2:
-                    LOG(LOG_ERR, "unsupported SECONDARY ORDER TS_CACHE_BITMAP_UNCOMPRESSED_REV2 (%d)", header.type);
-                  break;
                 case TS_CACHE_BITMAP_COMPRESSED_REV3:
                     LOG(LOG_ERR, "unsupported SECONDARY ORDER TS_CACHE_BITMAP_COMPRESSED_REV3 (%d)", header.type);
                   break;
@@ -452,9 +649,7 @@ public:
                 case RDP::GLYPHINDEX:
                     this->statistics.GlyphIndex++;
                     this->glyphindex.receive(this->stream, header);
-                    for (size_t i = 0; i < this->nbconsumers; i++){
-                        this->consumers[i].graphic_device->draw(this->glyphindex, clip, &this->gly_cache);
-                    }
+                    this->draw_order(this->glyphindex, clip);
                     break;
                 case RDP::DESTBLT:
                     this->statistics.DstBlt++;
@@ -462,9 +657,7 @@ public:
                     if (this->verbose > 32){
                         this->destblt.log(LOG_INFO, clip);
                     }
-                    for (size_t i = 0; i < this->nbconsumers; i++){
-                        this->consumers[i].graphic_device->draw(this->destblt, clip);
-                    }
+                    this->draw_order(this->destblt, clip);
                     break;
                 case RDP::MULTIDSTBLT:
                     this->statistics.MultiDstBlt++;
@@ -472,9 +665,7 @@ public:
                     if (this->verbose > 32){
                         this->multidstblt.log(LOG_INFO, clip);
                     }
-                    for (size_t i = 0; i < this->nbconsumers; i++) {
-                        this->consumers[i].graphic_device->draw(this->multidstblt, clip);
-                    }
+                    this->draw_order(this->multidstblt, clip);
                     break;
                 case RDP::MULTIOPAQUERECT:
                     this->statistics.MultiOpaqueRect++;
@@ -482,9 +673,7 @@ public:
                     if (this->verbose > 32){
                         this->multiopaquerect.log(LOG_INFO, clip);
                     }
-                    for (size_t i = 0; i < this->nbconsumers; i++) {
-                        this->consumers[i].graphic_device->draw(this->multiopaquerect, clip);
-                    }
+                    this->draw_order(this->multiopaquerect, clip);
                     break;
                 case RDP::MULTIPATBLT:
                     this->statistics.MultiPatBlt++;
@@ -492,9 +681,7 @@ public:
                     if (this->verbose > 32){
                         this->multipatblt.log(LOG_INFO, clip);
                     }
-                    for (size_t i = 0; i < this->nbconsumers; i++) {
-                        this->consumers[i].graphic_device->draw(this->multipatblt, clip);
-                    }
+                    this->draw_order(this->multipatblt, clip);
                     break;
                 case RDP::MULTISCRBLT:
                     this->statistics.MultiScrBlt++;
@@ -502,9 +689,7 @@ public:
                     if (this->verbose > 32){
                         this->multiscrblt.log(LOG_INFO, clip);
                     }
-                    for (size_t i = 0; i < this->nbconsumers; i++) {
-                        this->consumers[i].graphic_device->draw(this->multiscrblt, clip);
-                    }
+                    this->draw_order(this->multiscrblt, clip);
                     break;
                 case RDP::PATBLT:
                     this->statistics.PatBlt++;
@@ -512,9 +697,7 @@ public:
                     if (this->verbose > 32){
                         this->patblt.log(LOG_INFO, clip);
                     }
-                    for (size_t i = 0; i < this->nbconsumers; i++){
-                        this->consumers[i].graphic_device->draw(this->patblt, clip);
-                    }
+                    this->draw_order(this->patblt, clip);
                     break;
                 case RDP::SCREENBLT:
                     this->statistics.ScrBlt++;
@@ -522,9 +705,7 @@ public:
                     if (this->verbose > 32){
                         this->scrblt.log(LOG_INFO, clip);
                     }
-                    for (size_t i = 0; i < this->nbconsumers; i++){
-                        this->consumers[i].graphic_device->draw(this->scrblt, clip);
-                    }
+                    this->draw_order(this->scrblt, clip);
                     break;
                 case RDP::LINE:
                     this->statistics.LineTo++;
@@ -532,9 +713,7 @@ public:
                     if (this->verbose > 32){
                         this->lineto.log(LOG_INFO, clip);
                     }
-                    for (size_t i = 0; i < this->nbconsumers; i++) {
-                        this->consumers[i].graphic_device->draw(this->lineto, clip);
-                    }
+                    this->draw_order(this->lineto, clip);
                     break;
                 case RDP::RECT:
                     this->statistics.OpaqueRect++;
@@ -542,9 +721,7 @@ public:
                     if (this->verbose > 32){
                         this->opaquerect.log(LOG_INFO, clip);
                     }
-                    for (size_t i = 0; i < this->nbconsumers; i++){
-                        this->consumers[i].graphic_device->draw(this->opaquerect, clip);
-                    }
+                    this->draw_order(this->opaquerect, clip);
                     break;
                 case RDP::MEMBLT:
                     {
@@ -559,9 +736,7 @@ public:
                             throw Error(ERR_WRM);
                         }
                         else {
-                            for (size_t i = 0; i < this->nbconsumers; i++){
-                                this->consumers[i].graphic_device->draw(this->memblt, clip, bmp);
-                            }
+                            this->draw_order(this->memblt, clip, bmp);
                         }
                     }
                     break;
@@ -578,9 +753,7 @@ public:
                             throw Error(ERR_WRM);
                         }
                         else {
-                            for (size_t i = 0; i < this->nbconsumers; i++){
-                                this->consumers[i].graphic_device->draw(this->mem3blt, clip, bmp);
-                            }
+                            this->draw_order(this->mem3blt, clip, bmp);
                         }
                     }
                     break;
@@ -590,9 +763,7 @@ public:
                     if (this->verbose > 32){
                         this->polyline.log(LOG_INFO, clip);
                     }
-                    for (size_t i = 0; i < this->nbconsumers; i++) {
-                        this->consumers[i].graphic_device->draw(this->polyline, clip);
-                    }
+                    this->draw_order(this->polyline, clip);
                     break;
                 case RDP::ELLIPSESC:
                     this->statistics.EllipseSC++;
@@ -600,9 +771,7 @@ public:
                     if (this->verbose > 32){
                         this->ellipseSC.log(LOG_INFO, clip);
                     }
-                    for (size_t i = 0; i < this->nbconsumers; i++) {
-                        this->consumers[i].graphic_device->draw(this->ellipseSC, clip);
-                    }
+                    this->draw_order(this->ellipseSC, clip);
                     break;
                 default:
                     /* error unknown order */
@@ -1168,6 +1337,32 @@ public:
         }
     }
 
+    REDOC("Interpret current order and all remaining orders of current RDP_UPDATE_ORDERS chunk."
+          " Orders are decoded in a batch sent to consumers when the chunk is finished or"
+          " before a cache update.")
+    void interpret_orders_batch()
+    {
+        this->batch.clear();
+        this->batching = true;
+        try {
+            for (;;) {
+                this->interpret_order();
+                if (!this->remaining_order_count
+                 || (this->max_order_count && this->max_order_count <= this->total_orders_count)
+                 || !this->next_order()) {
+                    break;
+                }
+            }
+        }
+        catch (...) {
+            this->batching = false;
+            this->batch.clear();
+            throw;
+        }
+        this->batching = false;
+        this->flush_batch();
+    }
+
     void play() {
         this->privplay([](time_t){});
     }
@@ -1191,7 +1386,12 @@ private:
                 LOG( LOG_INFO, "replay TIMESTAMP (first timestamp) = %u order=%u\n"
                    , (unsigned)this->record_now.tv_sec, (unsigned)this->total_orders_count);
             }
-            this->interpret_order();
+            if (this->batch_orders && (this->chunk_type == RDP_UPDATE_ORDERS)) {
+                this->interpret_orders_batch();
+            }
+            else {
+                this->interpret_order();
+            }
             if (  (this->begin_capture.tv_sec == 0) || this->begin_capture <= this->record_now ) {
                 for (size_t i = 0; i < this->nbconsumers; i++) {
                     if (this->consumers[i].capture_device) {
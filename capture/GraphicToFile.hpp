@@ -93,7 +93,7 @@ private:
     }
 };
 
-class GraphicToFile : public RDPSerializer, public RDPCaptureDevice
+class GraphicToFile : public RDPSerializer, public RDPCaptureDevice, public RDPSerializerMirror
 REDOC("To keep things easy all chunks have 8 bytes headers"
       " starting with chunk_type, chunk_size"
       " and order_count (whatever it means, depending on chunks")
@@ -124,6 +124,10 @@ REDOC("To keep things easy all chunks have 8 bytes headers"
 
     const uint8_t wrm_format_version;
 
+    // When set, orders are not encoded again but copied from the chunks
+    // already encoded by source (see mirror_orders()), caches are shared.
+    RDPSerializer * source;
+
     //const uint32_t verbose;
 
 public:
@@ -161,6 +165,7 @@ public:
     , keyboard_buffer_32(GTF_SIZE_KEYBUF_REC * sizeof(uint32_t))
     , ini(ini)
     , wrm_format_version(this->compression_wrapper.get_index_algorithm() ? 4 : 3)
+    , source(nullptr)
     //, verbose(verbose)
     {
         if (this->ini.video.wrm_compression_algorithm != this->compression_wrapper.get_index_algorithm()) {
@@ -176,6 +181,95 @@ public:
         this->send_image_chunk();
     }
 
+    REDOC("Shared serializer: record the orders already encoded for the client by source."
+          " Caches of source are used as they are, recorded bpp is the bpp of source."
+          " Caller must register the recorder with source.set_mirror().");
+    GraphicToFile(const timeval & now
+                , Transport * trans
+                , const uint16_t width
+                , const uint16_t height
+                , RDPSerializer & source
+                , RDPDrawable & drawable
+                , const Inifile & ini
+                , SendInput send_input = SendInput::NO
+                , uint32_t verbose = 0)
+    : RDPSerializer( trans, this->buffer_stream_orders, this->buffer_stream_bitmaps, source.get_bpp()
+                   , source.get_bmp_cache(), source.get_glyph_cache(), source.get_pointer_cache()
+                   , source.get_bitmap_cache_version(), source.get_use_bitmap_comp(), source.get_op2(), ini)
+    , RDPCaptureDevice()
+    , compression_wrapper(*trans, ini.video.wrm_compression_algorithm)
+    , trans_target(*trans)
+    , trans(this->compression_wrapper.get())
+    , buffer_stream_orders(65536)
+    , buffer_stream_bitmaps(65536)
+    , last_sent_timer()
+    , timer(now)
+    , width(width)
+    , height(height)
+    , capture_bpp(source.get_bpp())
+    , mouse_x(0)
+    , mouse_y(0)
+    , send_input(send_input == SendInput::YES)
+    , drawable(drawable)
+    , keyboard_buffer_32(GTF_SIZE_KEYBUF_REC * sizeof(uint32_t))
+    , ini(ini)
+    // client caches may use more than 3 caches, persistence or waiting list
+    , wrm_format_version(4)
+    , source(&source)
+    //, verbose(verbose)
+    {
+        if (this->ini.video.wrm_compression_algorithm != this->compression_wrapper.get_index_algorithm()) {
+            LOG( LOG_WARNING, "compression algorithm %u not fount. Compression disable."
+               , this->ini.video.wrm_compression_algorithm);
+        }
+
+        last_sent_timer.tv_sec = 0;
+        last_sent_timer.tv_usec = 0;
+        this->order_count = 0;
+
+        this->send_meta_chunk();
+        this->send_source_state();
+    }
+
+    bool is_shared() const {
+        return this->source;
+    }
+
+    REDOC("Shared serializer: orders sent to client are no longer recorded (capture paused).")
+    void detach_source() {
+        REDASSERT(this->source);
+        // orders drawn before the pause are still recorded
+        this->source->flush();
+        this->source->set_mirror(nullptr);
+    }
+
+    REDOC("Shared serializer: record orders sent to client again, delta state and caches"
+          " of source may have changed while detached.")
+    void attach_source() {
+        REDASSERT(this->source);
+        this->send_source_state();
+        this->source->set_mirror(this);
+    }
+
+private:
+    // same layout as after breakpoint(): the player reads the chunks up to
+    // the first timestamp before its consumers are added, the image has to
+    // come after it.
+    void send_source_state() {
+        this->source->flush();
+        this->copy_orders_state(*this->source);
+        this->send_timestamp_chunk();
+        this->send_save_state_chunk();
+
+        OutChunkedBufferingTransport<65536> png_trans(this->trans);
+
+        this->drawable.dump_png24(png_trans, true);
+
+        this->send_caches_chunk();
+    }
+
+public:
+
     void dump_png24(Transport & trans, bool bgr) const {
         this->drawable.dump_png24(trans, bgr);
     }
@@ -525,8 +619,44 @@ public:
         }
     }
 
+    REDOC("Shared serializer: entries already sent to the client are never emitted again,"
+          " the whole content of caches is written at start of each file.");
+    void dump_caches()
+    {
+        for (uint8_t cache_id = 0
+        ; cache_id < this->bmp_cache.number_of_cache
+        ; ++cache_id) {
+            const size_t entries = this->bmp_cache.get_cache(cache_id).entries();
+            for (size_t i = 0; i < entries; i++) {
+                this->emit_bmp_cache(cache_id, i, false);
+            }
+        }
+
+        for (uint8_t cacheId = 0; cacheId < NUMBER_OF_GLYPH_CACHES; ++cacheId) {
+            for (uint8_t cacheIndex = 0; cacheIndex < NUMBER_OF_GLYPH_CACHE_ENTRIES; ++cacheIndex) {
+                if (this->glyph_cache.is_cached(cacheId, cacheIndex)) {
+                    this->emit_glyph_cache(cacheId, cacheIndex);
+                }
+            }
+        }
+
+        if (this->order_count > 0) {
+            this->send_orders_chunk();
+        }
+
+        for (int index = 0; index < MAX_POINTER_COUNT; ++index) {
+            if (this->pointer_cache.is_cached(index)) {
+                this->send_pointer(index, this->pointer_cache.Pointers[index]);
+            }
+        }
+    }
+
     void send_caches_chunk()
     {
+        if (this->source) {
+            this->dump_caches();
+            return;
+        }
         this->save_bmp_caches();
         this->save_glyph_caches();
         this->save_ptr_cache();
@@ -537,6 +667,10 @@ public:
 
     void breakpoint()
     {
+        if (this->source) {
+            this->source->flush();
+            this->copy_orders_state(*this->source);
+        }
         this->flush_orders();
         this->flush_bitmaps();
         this->send_timestamp_chunk();
@@ -766,6 +900,35 @@ public:
         payload.mark_end();
         this->trans.send(payload);
     }
+
+    virtual void mirror_orders(const uint8_t * data, size_t size, size_t order_count) {
+        if (this->timer.tv_sec - this->last_sent_timer.tv_sec > 0) {
+            this->send_timestamp_chunk();
+        }
+        BStream header(8);
+        WRMChunk_Send chunk(header, RDP_UPDATE_ORDERS, size, order_count);
+        this->trans.send(header);
+        this->trans.send(data, size);
+    }
+
+    virtual void mirror_bitmaps(const uint8_t * data, size_t size, size_t bitmap_count) {
+        if (this->timer.tv_sec - this->last_sent_timer.tv_sec > 0) {
+            this->send_timestamp_chunk();
+        }
+        BStream header(8);
+        WRMChunk_Send chunk(header, RDP_UPDATE_BITMAP, size, bitmap_count);
+        this->trans.send(header);
+        this->trans.send(data, size);
+    }
+
+    virtual void mirror_pointer(int cache_idx, const Pointer * cursor) {
+        if (cursor) {
+            this->send_pointer(cache_idx, *cursor);
+        }
+        else {
+            this->set_pointer(cache_idx);
+        }
+    }
 };  // struct GraphicToFile
 
 #endif
@@ -29,6 +29,7 @@
 
 #include "nativecapture.hpp"
 #include "staticcapture.hpp"
+#include "flvcapture.hpp"
 
 #include "RDP/compress_and_draw_bitmap_update.hpp"
 
@@ -39,12 +40,16 @@ public:
     const bool capture_wrm;
     const bool capture_drawable;
     const bool capture_png;
+    const bool capture_flv;
 
     const bool enable_file_encryption;
 
     OutFilenameSequenceTransport * png_trans;
     StaticCapture                * psc;
 
+    OutFilenameSequenceTransport * flv_trans;
+    FlvCapture                   * pfc;
+
     Transport                    * wrm_trans;
 
 private:
@@ -81,13 +86,17 @@ private:
 public:
     Capture( const timeval & now, int width, int height, int order_bpp, int capture_bpp, const char * wrm_path
            , const char * png_path, const char * hash_path, const char * basename
-           , bool clear_png, bool no_timestamp, auth_api * authentifier, Inifile & ini, bool externally_generated_breakpoint = false)
+           , bool clear_png, bool no_timestamp, auth_api * authentifier, Inifile & ini, bool externally_generated_breakpoint = false
+           , RDPSerializer * shared_serializer = nullptr)
     : capture_wrm(ini.video.capture_wrm)
-    , capture_drawable(ini.video.capture_wrm||(ini.video.png_limit > 0))
+    , capture_drawable(ini.video.capture_wrm||(ini.video.png_limit > 0)||ini.video.capture_flv)
     , capture_png(ini.video.png_limit > 0)
+    , capture_flv(ini.video.capture_flv)
     , enable_file_encryption(ini.globals.enable_file_encryption.get())
     , png_trans(nullptr)
     , psc(nullptr)
+    , flv_trans(nullptr)
+    , pfc(nullptr)
     , wrm_trans(nullptr)
     , pnc_bmp_cache(nullptr)
     , pnc_gly_cache(nullptr)
@@ -119,6 +128,16 @@ public:
                                          , clear_png, ini, this->drawable->impl());
         }
 
+        if (this->capture_flv) {
+            if (recursive_create_directory(png_path, S_IRWXU|S_IRWXG, ini.video.capture_groupid) != 0) {
+                LOG(LOG_ERR, "Failed to create directory: \"%s\"", png_path);
+            }
+
+            this->flv_trans = new OutFilenameSequenceTransport( FilenameGenerator::PATH_FILE_PID_COUNT_EXTENSION, png_path
+                                                              , basename, ".flv", ini.video.capture_groupid, authentifier);
+            this->pfc = new FlvCapture(now, *this->flv_trans, width, height, ini, this->drawable->impl());
+        }
+
         if (this->capture_wrm) {
             if (recursive_create_directory( wrm_path
                                           , S_IRWXU | S_IRGRP | S_IXGRP, ini.video.capture_groupid) != 0) {
@@ -139,14 +158,16 @@ public:
             TODO("Also we may wonder why we are encrypting wrm and not png"
                  "(This is related to the path split between png and wrm)."
                  "We should stop and consider what we should actually do")
-            this->pnc_bmp_cache = new BmpCache( BmpCache::Recorder, capture_bpp, 3, false
-                                              , BmpCache::CacheOption(600, 768, false)
-                                              , BmpCache::CacheOption(300, 3072, false)
-                                              , BmpCache::CacheOption(262, 12288, false)
-                                              );
-            this->pnc_gly_cache = new GlyphCache();
-            const int pointerCacheSize = 0x19;
-            this->pnc_ptr_cache = new PointerCache(pointerCacheSize);
+            if (!shared_serializer) {
+                this->pnc_bmp_cache = new BmpCache( BmpCache::Recorder, capture_bpp, 3, false
+                                                  , BmpCache::CacheOption(600, 768, false)
+                                                  , BmpCache::CacheOption(300, 3072, false)
+                                                  , BmpCache::CacheOption(262, 12288, false)
+                                                  );
+                this->pnc_gly_cache = new GlyphCache();
+                const int pointerCacheSize = 0x19;
+                this->pnc_ptr_cache = new PointerCache(pointerCacheSize);
+            }
 
             if (this->enable_file_encryption) {
                 this->wrm_trans = new CryptoOutMetaSequenceTransport( &this->crypto_ctx, wrm_path, hash_path, basename, now
@@ -154,16 +175,29 @@ public:
                                                                     , authentifier);
             }
             else {
-                this->wrm_trans = new OutMetaSequenceTransport( wrm_path, basename, now
+                OutMetaSequenceTransport * wrm_trans = new OutMetaSequenceTransport( wrm_path, basename, now
                                                               , width, height, ini.video.capture_groupid, authentifier);
+                if (ini.video.wrm_meta_index) {
+                    wrm_trans->open_index(width, height);
+                }
+                this->wrm_trans = wrm_trans;
+            }
+            if (shared_serializer) {
+                REDASSERT(shared_serializer->get_bpp() == capture_bpp);
+                this->pnc = new NativeCapture( now, *this->wrm_trans, width, height, *shared_serializer
+                                             , *this->drawable, ini, externally_generated_breakpoint
+                                             , NativeCapture::SendInput::YES);
+                shared_serializer->set_mirror(&this->pnc->recorder);
+            }
+            else {
+                this->pnc = new NativeCapture( now, *this->wrm_trans, width, height, capture_bpp
+                                             , *this->pnc_bmp_cache, *this->pnc_gly_cache, *this->pnc_ptr_cache
+                                             , *this->drawable, ini, externally_generated_breakpoint
+                                             , NativeCapture::SendInput::YES);
             }
-            this->pnc = new NativeCapture( now, *this->wrm_trans, width, height, capture_bpp
-                                         , *this->pnc_bmp_cache, *this->pnc_gly_cache, *this->pnc_ptr_cache
-                                         , *this->drawable, ini, externally_generated_breakpoint
-                                         , NativeCapture::SendInput::YES);
         }
 
-        if (this->capture_wrm) {
+        if (this->capture_wrm && !shared_serializer) {
             this->gd = this->pnc;
         }
         else if (this->capture_drawable) {
@@ -174,6 +208,8 @@ public:
     virtual ~Capture() {
         delete this->psc;
         delete this->png_trans;
+        delete this->pfc;
+        delete this->flv_trans;
 
         if (this->pnc) {
             timeval now = tvtime();
@@ -192,6 +228,12 @@ public:
         }
     }
 
+    // orders are recorded from the client stream of serializer, which must
+    // not outlive the capture without calling set_mirror(nullptr)
+    bool is_shared_serializer() const {
+        return this->pnc && this->pnc->recorder.is_shared();
+    }
+
     void request_full_cleaning()
     {
         this->wrm_trans->request_full_cleaning();
@@ -202,6 +244,9 @@ public:
             timeval now = tvtime();
             this->psc->pause_snapshot(now);
         }
+        if (this->is_shared_serializer()) {
+            this->pnc->recorder.detach_source();
+        }
     }
 
     void resume() {
@@ -210,6 +255,9 @@ public:
             timeval now = tvtime();
             this->pnc->recorder.timestamp(now);
             this->pnc->recorder.send_timestamp_chunk(true);
+            if (this->pnc->recorder.is_shared()) {
+                this->pnc->recorder.attach_source();
+            }
         }
     }
 
@@ -220,6 +268,9 @@ public:
         if (this->capture_wrm) {
             this->pnc->update_config(ini);
         }
+        if (this->capture_flv) {
+            this->pfc->update_config(ini);
+        }
     }
 
     virtual void set_row(size_t rownum, const uint8_t * data)
@@ -244,6 +295,10 @@ public:
             this->psc->snapshot(now, x, y, ignore_frame_in_timeval);
             this->capture_event.update(this->psc->time_to_wait);
         }
+        if (this->capture_flv) {
+            this->pfc->snapshot(now, x, y, ignore_frame_in_timeval);
+            this->capture_event.update(this->pfc->time_to_wait);
+        }
         if (this->capture_wrm) {
             this->pnc->snapshot(now, x, y, ignore_frame_in_timeval);
             this->capture_event.update(this->pnc->time_to_wait);
@@ -0,0 +1,125 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Capture device encoding drawable into FLV movies at a fixed frame rate.
+*/
+
+#ifndef _REDEMPTION_CAPTURE_FLVCAPTURE_HPP_
+#define _REDEMPTION_CAPTURE_FLVCAPTURE_HPP_
+
+#include "flv_screen_video.hpp"
+#include "drawable.hpp"
+#include "difftimeval.hpp"
+#include "config.hpp"
+#include "CaptureDevice.hpp"
+
+class FlvCapture : public RDPCaptureDevice {
+    Transport & trans;
+    const Drawable & drawable;
+
+    FlvScreenVideoEncoder encoder;
+
+    timeval  start_video;            // beginning of current flv file
+    uint64_t inter_frame_interval;   // in us
+    uint64_t break_interval;         // in us, 0: only one file
+    uint64_t next_frame;             // in us, relative to start_video
+    uint64_t last_frame;             // in us, relative to start_video
+
+public:
+    uint64_t time_to_wait;
+
+    FlvCapture(const timeval & now, Transport & trans, unsigned width, unsigned height,
+               const Inifile & ini, const Drawable & drawable)
+    : trans(trans)
+    , drawable(drawable)
+    , encoder(trans, width, height, params_from_ini(ini))
+    , start_video(now)
+    , inter_frame_interval(1000000 / params_from_ini(ini).frame_rate)
+    , break_interval(ini.video.flv_break_interval * 1000000)
+    , next_frame(0)
+    , last_frame(0)
+    , time_to_wait(0)
+    {
+        this->encoder.write_header();
+    }
+
+    virtual ~FlvCapture() {
+        try {
+            // last frame sets duration of movie
+            this->encode_frame(this->last_frame, true);
+        }
+        catch (...) {}
+    }
+
+    // frame rate depends on video quality (low, medium or high)
+    static FlvParams params_from_ini(const Inifile & ini) {
+        const char * quality = ini.globals.video_quality.get_cstr();
+        FlvParams params;
+        params.frame_rate = (0 == strcmp(quality, "low"))  ? ini.video.l_framerate
+                          : (0 == strcmp(quality, "high")) ? ini.video.h_framerate
+                          :                                  ini.video.m_framerate;
+        if (!params.frame_rate) {
+            params.frame_rate = 1;
+        }
+        // one key frame every 10 seconds for seeking
+        params.key_frame_interval = params.frame_rate * 10;
+        return params;
+    }
+
+    void update_config(const Inifile & ini) {
+        this->break_interval = ini.video.flv_break_interval * 1000000;
+    }
+
+    virtual void snapshot(const timeval & now, int x, int y, bool ignore_frame_in_timeval) {
+        uint64_t elapsed = difftimeval(now, this->start_video);
+        if (this->break_interval && elapsed >= this->break_interval) {
+            this->encode_frame(this->last_frame, true);
+            this->trans.next();
+            this->encoder.write_header();
+            this->start_video = now;
+            this->next_frame  = 0;
+            elapsed           = 0;
+        }
+
+        if (elapsed >= this->next_frame) {
+            this->encode_frame(elapsed, false);
+            this->last_frame = elapsed;
+            // late frames are dropped, not encoded several times
+            this->next_frame = (elapsed / this->inter_frame_interval + 1) * this->inter_frame_interval;
+        }
+        this->time_to_wait = this->next_frame - elapsed;
+    }
+
+private:
+    void encode_frame(uint64_t elapsed, bool force) {
+        const timeval frame_time = addusectimeval(elapsed, this->start_video);
+        time_t rawtime = frame_time.tv_sec;
+        tm ptm;
+        localtime_r(&rawtime, &ptm);
+
+        Drawable & drawable = const_cast<Drawable&>(this->drawable);
+        drawable.trace_mouse();
+        drawable.trace_timestamp(ptm);
+        this->encoder.write_frame(drawable.data(), drawable.rowsize(), elapsed / 1000, force);
+        drawable.clear_timestamp();
+        drawable.clear_mouse();
+    }
+};
+
+#endif
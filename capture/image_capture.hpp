@@ -26,6 +26,7 @@
 #define _REDEMPTION_CAPTURE_IMAGE_CAPTURE_HPP_
 
 #include "png.hpp"
+#include "parallel_png.hpp"
 #include "drawable.hpp"
 
 #include <memory>
@@ -38,6 +39,8 @@ public:
     unsigned scaled_width;
     unsigned scaled_height;
     const Drawable & drawable;
+    // png_params.nb_threads = 0: libpng encoder
+    PngParallelParams png_params;
 
     ImageCapture(Transport & trans, unsigned width, unsigned height, const Drawable & drawable)
     : trans(trans)
@@ -67,10 +70,18 @@ public:
     }
 
     void dump24() const {
-        ::transport_dump_png24(this->trans, this->drawable.data(),
+        this->dump_png24(this->drawable.data(),
             this->drawable.width(), this->drawable.height(),
-            this->drawable.rowsize(),
-            true);
+            this->drawable.rowsize());
+    }
+
+    void dump_png24(const uint8_t * data, size_t width, size_t height, size_t rowsize) const {
+        if (this->png_params.nb_threads) {
+            ::transport_dump_png24_parallel(this->trans, data, width, height, rowsize, true, this->png_params);
+        }
+        else {
+            ::transport_dump_png24(this->trans, data, width, height, rowsize, true);
+        }
     }
 
     void scale_dump24() const {
@@ -79,9 +90,9 @@ public:
                    this->scaled_width, this->drawable.width(),
                    this->scaled_height, this->drawable.height(),
                    this->drawable.rowsize());
-        ::transport_dump_png24(this->trans, scaled_data.get(),
+        this->dump_png24(scaled_data.get(),
                      this->scaled_width, this->scaled_height,
-                     this->scaled_width * 3, true);
+                     this->scaled_width * 3);
     }
 
     static void scale_data(uint8_t *dest, const uint8_t *src,
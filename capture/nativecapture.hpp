@@ -56,6 +56,25 @@ public:
     , time_to_wait(0)
     , disable_keyboard_log_wrm(ini.video.disable_keyboard_log_wrm)
     , externally_generated_breakpoint(externally_generated_breakpoint)
+    {
+        this->init_intervals(now, ini);
+    }
+
+    // recorder copies the orders encoded by source for the client
+    NativeCapture( const timeval & now, Transport & trans, int width, int height, RDPSerializer & source
+                 , RDPDrawable & drawable, const Inifile & ini
+                 , bool externally_generated_breakpoint = false, SendInput send_input = SendInput::NO)
+    : recorder(now, &trans, width, height, source, drawable, ini, send_input, ini.debug.capture)
+    , nb_file(0)
+    , time_to_wait(0)
+    , disable_keyboard_log_wrm(ini.video.disable_keyboard_log_wrm)
+    , externally_generated_breakpoint(externally_generated_breakpoint)
+    {
+        this->init_intervals(now, ini);
+    }
+
+private:
+    void init_intervals(const timeval & now, const Inifile & ini)
     {
         // frame interval is in 1/100 s, default value, 1 timestamp mark every 40/100 s
         this->start_native_capture = now;
@@ -69,6 +88,7 @@ public:
         this->update_config(ini);
     }
 
+public:
     ~NativeCapture(){
         this->recorder.flush();
     }
@@ -100,6 +100,11 @@ public:
             this->conf.png_interval = ini.video.png_interval;
             this->inter_frame_interval_static_capture = this->conf.png_interval * 100000; // 1 000 000 us is 1 sec
         }
+        this->png_params.nb_threads   = ini.video.png_encoder_threads;
+        this->png_params.zlib_level   = ini.video.png_zlib_level;
+        this->png_params.filter       = ini.video.png_filter;
+        this->png_params.strip_height = ini.video.png_strip_height;
+
         uint32_t displayed = this->rt_display;
         this->rt_display = ini.video.rt_display.get();
         if (displayed && (this->rt_display == 0)) {
@@ -33,12 +33,16 @@ private:
 
     bool meta_ok;
 
+    // 1 to replay in real time, N to replay N times faster, 0 to replay
+    // as fast as possible
+    unsigned speed;
+
     timeval record_now;
     timeval replay_now;
 
 public:
-    TransparentPlayer(Transport * t, FrontAPI * consumer)
-    : t(t), consumer(consumer), meta_ok(false) {
+    TransparentPlayer(Transport * t, FrontAPI * consumer, unsigned speed = 1)
+    : t(t), consumer(consumer), meta_ok(false), speed(speed) {
         while (this->meta_ok) {
             this->interpret_chunk();
         }
@@ -122,13 +126,13 @@ public:
                     throw Error(ERR_TRM_UNKNOWN_CHUNK_TYPE);
             }
 
-            if (real_time && (chunk_type != CHUNK_TYPE_META)) {
+            if (real_time && this->speed && (chunk_type != CHUNK_TYPE_META)) {
                 timeval  now     = tvtime();
                 uint64_t elapsed = difftimeval(now, this->replay_now);
 
                 this->replay_now = now;
 
-                uint64_t record_elapsed = difftimeval(this->record_now, last_record_now);
+                uint64_t record_elapsed = difftimeval(this->record_now, last_record_now) / this->speed;
 
                 if (elapsed <= record_elapsed) {
                     struct timespec wtime     = {
@@ -30,6 +30,7 @@
 
 #include "log.hpp"
 #include "RDPSerializer.hpp"
+#include "surface_commands.hpp"
 #include "gcc.hpp"
 #include "sec.hpp"
 #include "mcs.hpp"
@@ -114,13 +115,65 @@ enum ServerUpdateType {
     SERVER_UPDATE_GRAPHICS_PALETTE,
     SERVER_UPDATE_GRAPHICS_SYNCHRONIZE,
     SERVER_UPDATE_POINTER_COLOR,
-    SERVER_UPDATE_POINTER_CACHED
+    SERVER_UPDATE_POINTER_CACHED,
+    SERVER_UPDATE_GRAPHICS_SURFCMDS     // fast-path only
 };
 
+// Fast-path updates larger than this are sent in several fragments
+// (FASTPATH_FRAGMENT_FIRST, NEXT and LAST) when the client accepts them.
+enum { FASTPATH_FRAGMENT_SIZE = 16384 };
+
+// Appends a Server Fast-Path Update PDU carrying one fragment of an update.
+// Each fragment is compressed on its own.
+static inline void emit_fastpath_fragment( Stream & out, uint8_t updateCode, uint8_t fragmentation
+                                         , const uint8_t * data, size_t size
+                                         , bool compression_support, rdp_mppc_enc * mppc_enc
+                                         , int encryptionLevel, CryptContext & encrypt) {
+    HStream fragment(1024, 65565);
+
+    uint8_t compressionFlags = 0;
+    uint8_t compression      = 0;
+
+    if (compression_support) {
+        uint16_t compressed_data_size;
+
+        mppc_enc->compress( data, size, compressionFlags, compressed_data_size
+                          , rdp_mppc_enc::MAX_COMPRESSED_DATA_SIZE_UNUSED);
+
+        if (compressionFlags & PACKET_COMPRESSED) {
+            compression = FastPath::FASTPATH_OUTPUT_COMPRESSION_USED;
+
+            mppc_enc->get_compressed_data(fragment);
+        }
+    }
+    if (!(compressionFlags & PACKET_COMPRESSED)) {
+        fragment.out_copy_bytes(data, size);
+    }
+    fragment.mark_end();
+
+    BStream update_header(256);
+    // Fast-Path Update (TS_FP_UPDATE)
+    FastPath::Update_Send Upd( update_header, fragment.size(), updateCode, fragmentation
+                             , compression, compressionFlags);
+    fragment.copy_to_head(update_header.get_data(), update_header.size());
+
+    BStream server_update_header(256);
+    // Server Fast-Path Update PDU (TS_FP_UPDATE_PDU)
+    FastPath::ServerUpdatePDU_Send SvrUpdPDU( server_update_header, fragment
+                                            , ((encryptionLevel > 1) ? FastPath::FASTPATH_OUTPUT_ENCRYPTED : 0)
+                                            , encrypt);
+
+    out.out_copy_bytes(server_update_header.get_data(), server_update_header.size());
+    out.out_copy_bytes(fragment.get_data(), fragment.size());
+}
+
+// multifragment: the client accepts fast-path updates in several fragments,
+// data_common is then no larger than its MaxRequestSize.
 void send_server_update( Transport & trans, bool fastpath_support, bool compression_support
                        , rdp_mppc_enc * mppc_enc, uint32_t shareId, int encryptionLevel
                        , CryptContext & encrypt, uint16_t initiator, ServerUpdateType type
-                       , uint16_t data_extra, HStream & data_common, uint32_t verbose) {
+                       , uint16_t data_extra, HStream & data_common, uint32_t verbose
+                       , bool multifragment = false) {
     if (verbose & 4) {
         LOG( LOG_INFO
            , "send_server_update: fastpath_support=%s compression_support=%s shareId=%u "
@@ -173,11 +226,46 @@ void send_server_update( Transport & trans, bool fastpath_support, bool compress
                 updateCode = FastPath::FASTPATH_UPDATETYPE_CACHED;
                 break;
 
+            case SERVER_UPDATE_GRAPHICS_SURFCMDS:
+                updateCode = FastPath::FASTPATH_UPDATETYPE_SURFCMDS;
+                break;
+
             default:
                 REDASSERT(false);
                 break;
         }
 
+        if (multifragment && (data_common.size() > FASTPATH_FRAGMENT_SIZE)) {
+            // all the fragments go out in a single write
+            const size_t fragment_count = (data_common.size() + FASTPATH_FRAGMENT_SIZE - 1) / FASTPATH_FRAGMENT_SIZE;
+            BStream fragments(fragment_count * (FASTPATH_FRAGMENT_SIZE + 1024));
+
+            for (size_t offset = 0; offset < data_common.size(); offset += FASTPATH_FRAGMENT_SIZE) {
+                const size_t size = std::min<size_t>(FASTPATH_FRAGMENT_SIZE, data_common.size() - offset);
+                const uint8_t fragmentation = (  (offset == 0)
+                                              ? FastPath::FASTPATH_FRAGMENT_FIRST
+                                              : (  (offset + size == data_common.size())
+                                                ? FastPath::FASTPATH_FRAGMENT_LAST
+                                                : FastPath::FASTPATH_FRAGMENT_NEXT));
+                ::emit_fastpath_fragment( fragments, updateCode, fragmentation
+                                        , data_common.get_data() + offset, size
+                                        , compression_support, mppc_enc, encryptionLevel, encrypt);
+            }
+            fragments.mark_end();
+
+            if (verbose & 4) {
+                LOG( LOG_INFO, "send_server_update: update of %u bytes sent in %u fragments"
+                   , static_cast<unsigned>(data_common.size()), static_cast<unsigned>(fragment_count));
+            }
+
+            trans.send(fragments);
+
+            if (verbose & 4) {
+                LOG(LOG_INFO, "send_server_update done");
+            }
+            return;
+        }
+
         uint8_t compression = 0;
 
         if (compression_support) {
@@ -385,6 +473,12 @@ class GraphicsUpdatePDU : public RDPSerializer {
     rdp_mppc_enc * mppc_enc;
     bool           compression;
 
+    size_t drawing_update_count;
+
+    // largest update the client reassembles from fast-path fragments,
+    // 0 when updates are not fragmented
+    size_t max_request_size;
+
 public:
     GraphicsUpdatePDU( Transport * trans
                      , uint16_t & userid
@@ -416,7 +510,9 @@ public:
         , offset_bitmap_count(0)
         , fastpath_support(fastpath_support)
         , mppc_enc(mppc_enc)
-        , compression(compression) {
+        , compression(compression)
+        , drawing_update_count(0)
+        , max_request_size(0) {
         this->init_orders();
         this->init_bitmaps();
     }
@@ -461,10 +557,17 @@ protected:
             }
             this->stream_orders.mark_end();
 
+            if (this->mirror) {
+                this->mirror->mirror_orders( this->stream_orders.get_data(), this->stream_orders.size()
+                                           , this->order_count);
+            }
+
             ::send_server_update( *this->trans, this->fastpath_support, this->compression
                                 , this->mppc_enc, this->shareid, this->encryptionLevel
                                 , this->encrypt, this->userid, SERVER_UPDATE_GRAPHICS_ORDERS
-                                , this->order_count, this->buffer_stream_orders, this->verbose);
+                                , this->order_count, this->buffer_stream_orders, this->verbose
+                                , (this->max_request_size != 0));
+            ++this->drawing_update_count;
 
             this->order_count = 0;
             this->stream_orders.reset();
@@ -482,10 +585,20 @@ protected:
             this->stream_bitmaps.set_out_uint16_le(this->bitmap_count, this->offset_bitmap_count);
             this->stream_bitmaps.mark_end();
 
+            if (this->mirror) {
+                // skip updateType and numberRectangles, recorder writes its own chunk header
+                const size_t header_size = this->offset_bitmap_count + 2;
+                this->mirror->mirror_bitmaps( this->stream_bitmaps.get_data() + header_size
+                                            , this->stream_bitmaps.size() - header_size
+                                            , this->bitmap_count);
+            }
+
             ::send_server_update( *this->trans, this->fastpath_support, this->compression
                                 , this->mppc_enc, this->shareid, this->encryptionLevel, this->encrypt
                                 , this->userid, SERVER_UPDATE_GRAPHICS_BITMAP, 0
-                                , this->buffer_stream_bitmaps, this->verbose);
+                                , this->buffer_stream_bitmaps, this->verbose
+                                , (this->max_request_size != 0));
+            ++this->drawing_update_count;
 
             this->bitmap_count = 0;
             this->stream_bitmaps.reset();
@@ -493,6 +606,50 @@ protected:
         }
     }
 
+public:
+    // Surface commands only exist in fast-path updates. Pending orders and
+    // bitmaps are sent first to keep the drawing order.
+    void send_surface_bits(const RDPSetSurfaceBits & cmd, const uint8_t * data) {
+        REDASSERT(this->fastpath_support);
+        this->flush();
+
+        HStream stream(1024, 1024 + 22 + cmd.bitmap_data_length);
+        cmd.emit(stream);
+        stream.out_copy_bytes(data, cmd.bitmap_data_length);
+        stream.mark_end();
+
+        if (this->ini.debug.primary_orders > 3) {
+            cmd.log(LOG_INFO, "GraphicsUpdatePDU::send_surface_bits:");
+        }
+
+        ::send_server_update( *this->trans, this->fastpath_support, this->compression
+                            , this->mppc_enc, this->shareid, this->encryptionLevel, this->encrypt
+                            , this->userid, SERVER_UPDATE_GRAPHICS_SURFCMDS, 0
+                            , stream, this->verbose, (this->max_request_size != 0));
+        ++this->drawing_update_count;
+    }
+
+    // Fast-path updates up to max_request_size bytes are sent in fragments
+    // (Multifragment Update), batches of orders and bitmaps can then be as
+    // large and are mostly sent at the end of a frame.
+    void set_max_request_size(size_t max_request_size) {
+        this->max_request_size = (  (this->fastpath_support && (max_request_size > FASTPATH_FRAGMENT_SIZE))
+                                 ? max_request_size : 0);
+        this->set_max_update_size(this->max_request_size);
+    }
+
+    // Largest update that can be sent to the client.
+    size_t max_update_size() const {
+        return this->max_request_size ? this->max_request_size : static_cast<size_t>(MAX_ORDERS_SIZE);
+    }
+
+    // Number of orders, bitmap and surface commands updates sent so far.
+    size_t drawing_updates() const {
+        return this->drawing_update_count;
+    }
+
+protected:
+
 //    2.2.9.1.1.4     Server Pointer Update PDU (TS_POINTER_PDU)
 //    ----------------------------------------------------------
 //    The Pointer Update PDU is sent from server to client and is used to convey
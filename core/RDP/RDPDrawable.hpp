@@ -408,7 +408,7 @@ private:
         const int16_t   local_offset_y     = offset_y + fc.baseline;
 
               uint8_t   fc_bit_mask        = 128;
-        const uint8_t * fc_data            = fc.data.get();
+        const uint8_t * fc_data            = fc.data;
         const bool      skip_padding_pixel = (fc.width % 8);
 
         for (int y = 0; y < fc.height; y++)
@@ -479,7 +479,7 @@ public:
                 uint8_t  data     = aj.in_uint8();
                 if (data <= 0xFD)
                 {
-                    FontChar const & fc = gly_cache->glyphs[cmd.cache_id][data].font_item;
+                    FontChar const & fc = gly_cache->glyph(cmd.cache_id, data);
                     if (!fc)
                     {
                         LOG( LOG_INFO
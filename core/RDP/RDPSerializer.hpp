@@ -113,6 +113,8 @@
 #include "orders/RDPOrdersSecondaryGlyphCache.hpp"
 #include "orders/RDPOrdersSecondaryBrushCache.hpp"
 #include "orders/RDPOrdersSecondaryFrameMarker.hpp"
+#include "orders/RDPOrdersSecondarySwitchSurface.hpp"
+#include "orders/RDPOrdersSecondaryCreateOffscrBitmap.hpp"
 #include "bitmapupdate.hpp"
 
 #include "config.hpp"
@@ -120,6 +122,18 @@
 #include "RDP/caches/pointercache.hpp"
 #include "stream.hpp"
 
+// Receives the chunks produced by a RDPSerializer once they are complete,
+// so that another output (session recording) can reuse them as they are.
+struct RDPSerializerMirror
+{
+    virtual ~RDPSerializerMirror() {}
+
+    virtual void mirror_orders(const uint8_t * data, size_t size, size_t order_count) = 0;
+    virtual void mirror_bitmaps(const uint8_t * data, size_t size, size_t bitmap_count) = 0;
+    // cursor is null when the pointer is only selected from cache
+    virtual void mirror_pointer(int cache_idx, const Pointer * cursor) = 0;
+};
+
 struct RDPSerializer : public RDPGraphicDevice
 {
     // Packet more than 16384 bytes can cause MSTSC to crash.
@@ -179,6 +193,17 @@ protected:
 
     const uint32_t verbose;
 
+    RDPSerializerMirror * mirror;
+
+    // entries of the client glyph fragment cache, 0 when fragments are not used
+    uint16_t glyph_fragment_entries;
+    uint16_t glyph_fragment_max_size;
+
+    // size of a batch of orders or bitmaps, larger when the output can send
+    // an update in several fragments
+    size_t max_orders_size;
+    size_t max_bitmaps_size;
+
 public:
     RDPSerializer( Transport * trans
                  , Stream & stream_orders
@@ -224,10 +249,67 @@ public:
     , bmp_cache(bmp_cache)
     , glyph_cache(glyph_cache)
     , pointer_cache(pointer_cache)
-    , verbose(verbose) {}
+    , verbose(verbose)
+    , mirror(nullptr)
+    , glyph_fragment_entries(0)
+    , glyph_fragment_max_size(0)
+    , max_orders_size(MAX_ORDERS_SIZE)
+    , max_bitmaps_size(MAX_BITMAP_SIZE_8K + 300) {}
 
     ~RDPSerializer() {}
 
+    void set_mirror(RDPSerializerMirror * mirror) {
+        this->mirror = mirror;
+    }
+
+    // Text runs already sent are then sent as a reference to the client
+    // glyph fragment cache.
+    void set_glyph_fragment_cache(uint16_t number_of_entries, uint16_t maximum_size) {
+        this->glyph_fragment_entries =
+            std::min<uint16_t>(number_of_entries, MAXIMUM_NUMBER_OF_FRAGMENT_CACHE_ENTRIES);
+        this->glyph_fragment_max_size =
+            std::min<uint16_t>(maximum_size, MAXIMUM_SIZE_OF_FRAGMENT_CACHE_ENTRIE - 1);
+    }
+
+    // Batches of orders and bitmaps are flushed when full or at the end of a
+    // frame, a larger batch makes fewer updates.
+    void set_max_update_size(size_t max_update_size) {
+        this->max_orders_size  = std::max<size_t>(max_update_size, MAX_ORDERS_SIZE);
+        this->max_bitmaps_size = std::max<size_t>(max_update_size, MAX_BITMAP_SIZE_8K + 300);
+    }
+
+    uint8_t get_bpp() const { return this->bpp; }
+    int get_bitmap_cache_version() const { return this->bitmap_cache_version; }
+    int get_use_bitmap_comp() const { return this->use_bitmap_comp; }
+    int get_op2() const { return this->op2; }
+
+    BmpCache & get_bmp_cache() const { return this->bmp_cache; }
+    GlyphCache & get_glyph_cache() const { return this->glyph_cache; }
+    PointerCache & get_pointer_cache() const { return this->pointer_cache; }
+
+    // Take over the delta encoding state of another serializer, next orders
+    // emitted by other can then be decoded from this state.
+    void copy_orders_state(const RDPSerializer & other) {
+        this->common          = other.common;
+        this->destblt         = other.destblt;
+        this->multidstblt     = other.multidstblt;
+        this->multiopaquerect = other.multiopaquerect;
+        this->multipatblt     = other.multipatblt;
+        this->multiscrblt     = other.multiscrblt;
+        this->patblt          = other.patblt;
+        this->scrblt          = other.scrblt;
+        this->opaquerect      = other.opaquerect;
+        this->memblt          = other.memblt;
+        this->mem3blt         = other.mem3blt;
+        this->lineto          = other.lineto;
+        this->glyphindex      = other.glyphindex;
+        this->polygonSC       = other.polygonSC;
+        this->polygonCB       = other.polygonCB;
+        this->polyline        = other.polyline;
+        this->ellipseSC       = other.ellipseSC;
+        this->ellipseCB       = other.ellipseCB;
+    }
+
 protected:
     virtual void flush_orders() = 0;
     virtual void flush_bitmaps() = 0;
@@ -243,7 +325,7 @@ public:
     {
         //LOG(LOG_INFO, "RDPSerializer::reserve_order %u (avail=%u)", asked_size, this->stream_orders.size());
         // To support 64x64 32-bit bitmap.
-        size_t max_packet_size = std::min(this->stream_orders.get_capacity(), static_cast<size_t>(MAX_ORDERS_SIZE));
+        size_t max_packet_size = std::min(this->stream_orders.get_capacity(), this->max_orders_size);
         size_t used_size = this->stream_orders.get_offset();
         if (this->ini.debug.primary_orders > 3) {
             LOG( LOG_INFO
@@ -392,8 +474,8 @@ protected:
     }
 
     void emit_glyph_cache(uint8_t cacheId, uint8_t cacheIndex) {
-        FontChar & fc = this->glyph_cache.glyphs[cacheId][cacheIndex].font_item;
-        RDPGlyphCache cmd(cacheId, /*1, */cacheIndex, fc.offset, fc.baseline, fc.width, fc.height, fc.data.get());
+        FontChar const & fc = this->glyph_cache.glyph(cacheId, cacheIndex);
+        RDPGlyphCache cmd(cacheId, /*1, */cacheIndex, fc.offset, fc.baseline, fc.width, fc.height, fc.data);
         this->reserve_order(cmd.total_order_size());
         cmd.emit(this->stream_orders);
 
@@ -466,16 +548,48 @@ public:
         }
     }
 
+private:
+    // The glyphs of a text run sent for the first time are followed by
+    // ADD_FRAGMENT, a text run sent again is replaced by USE_FRAGMENT.
+    void encode_glyph_fragment(RDPGlyphIndex & cmd, bool has_delta_byte) {
+        // a USE_FRAGMENT takes up to 3 bytes, ADD_FRAGMENT needs 3 more bytes
+        if (cmd.data_len <= 3 || cmd.data_len > this->glyph_fragment_max_size
+         || cmd.data_len + 3 > 255) {
+            return;
+        }
+
+        int fragment_index;
+        if (this->glyph_cache.add_fragment(cmd.cache_id, cmd.data, cmd.data_len,
+                                           this->glyph_fragment_entries, fragment_index) ==
+            GlyphCache::GLYPH_FOUND_IN_CACHE) {
+            cmd.data[0] = 0xFE;
+            cmd.data[1] = fragment_index;
+            cmd.data_len = 2;
+            if (has_delta_byte) {
+                // the fragment holds the delta of its first glyph
+                cmd.data[cmd.data_len++] = 0;
+            }
+        }
+        else {
+            cmd.data[cmd.data_len]     = 0xFF;
+            cmd.data[cmd.data_len + 1] = fragment_index;
+            cmd.data[cmd.data_len + 2] = cmd.data_len;
+            cmd.data_len += 3;
+        }
+    }
+
+public:
     virtual void draw(const RDPGlyphIndex & cmd, const Rect & clip,
         const GlyphCache * gly_cache) {
         REDASSERT(gly_cache);
 
         RDPGlyphIndex new_cmd = cmd;
         bool has_delta_byte = (!new_cmd.ui_charinc && !(new_cmd.fl_accel & SO_CHAR_INC_EQUAL_BM_BASE));
+        bool has_fragment = false;
         for (uint8_t i = 0; i < new_cmd.data_len; ) {
             if (new_cmd.data[i] <= 0xFD) {
                 //LOG(LOG_INFO, "Index in the fragment cache=%u", new_cmd.data[i]);
-                FontChar const & fc = gly_cache->glyphs[new_cmd.cache_id][new_cmd.data[i]].font_item;
+                FontChar const & fc = gly_cache->glyph(new_cmd.cache_id, new_cmd.data[i]);
                 REDASSERT(fc);
 
                 int cacheIndex;
@@ -510,9 +624,15 @@ public:
             else if (new_cmd.data[i] == 0xFF) {
                 i += 3;
                 REDASSERT(i == new_cmd.data_len);
+                has_fragment = true;
             }
         }
 
+        // A recording made of these orders (mirror) does not know fragments.
+        if (this->glyph_fragment_entries && !this->mirror && !has_fragment) {
+            this->encode_glyph_fragment(new_cmd, has_delta_byte);
+        }
+
         this->reserve_order(297);
         RDPOrderCommon newcommon(RDP::GLYPHINDEX, clip);
         new_cmd.emit(this->stream_orders, newcommon, this->common, this->glyphindex);
@@ -588,10 +708,42 @@ public:
         }
     }
 
+    // Offscreen bitmaps only exist on the client, recorders never see these
+    // orders.
+    void draw(const RDP::CreateOffscrBitmap & order) {
+        this->reserve_order(order.size());
+        order.emit(this->stream_orders);
+        if (this->ini.debug.secondary_orders) {
+            order.log(LOG_INFO);
+        }
+    }
+
+    void draw(const RDP::SwitchSurface & order) {
+        this->reserve_order(3);
+        order.emit(this->stream_orders);
+        if (this->ini.debug.secondary_orders) {
+            order.log(LOG_INFO);
+        }
+    }
+
+    // MemBlt from the offscreen bitmap cmd.cache_idx, cmd.cache_id is
+    // TS_BITMAPCACHE_SCREEN_ID.
+    void draw_offscreen(const RDPMemBlt & cmd, const Rect & clip) {
+        REDASSERT(cmd.cache_id == TS_BITMAPCACHE_SCREEN_ID);
+        this->reserve_order(30);
+        RDPOrderCommon newcommon(RDP::MEMBLT, clip);
+        cmd.emit(this->stream_orders, newcommon, this->common, this->memblt);
+        this->common = newcommon;
+        this->memblt = cmd;
+        if (this->ini.debug.primary_orders) {
+            cmd.log(LOG_INFO, common.clip);
+        }
+    }
+
     // check if the next bitmap will fit in available packet size
     // if not send previous bitmaps we got and init a new packet
     void reserve_bitmap(size_t asked_size) {
-        size_t max_packet_size = std::min(this->stream_bitmaps.get_capacity(), static_cast<size_t>(MAX_BITMAP_SIZE_8K + 300));
+        size_t max_packet_size = std::min(this->stream_bitmaps.get_capacity(), this->max_bitmaps_size);
         TODO("QuickFix, should set a max packet size according to RDP compression version of client, proxy and server");
         size_t used_size       = this->stream_bitmaps.get_offset();
         if (this->ini.debug.primary_orders > 3) {
@@ -638,6 +790,9 @@ public:
         switch (this->pointer_cache.add_pointer(cursor, cache_idx)) {
         case POINTER_TO_SEND:
             this->send_pointer(cache_idx, cursor);
+            if (this->mirror) {
+                this->mirror->mirror_pointer(cache_idx, &cursor);
+            }
         break;
         default:
         case POINTER_ALLREADY_SENT:
@@ -648,6 +803,9 @@ public:
             }
 
             this->set_pointer(cache_idx);
+            if (this->mirror) {
+                this->mirror->mirror_pointer(cache_idx, nullptr);
+            }
         break;
         }
     }
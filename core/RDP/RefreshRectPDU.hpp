@@ -27,6 +27,7 @@
 #include "RDP/sec.hpp"
 #include "RDP/gcc.hpp"
 #include "RDP/out_per_bstream.hpp"
+#include "region.hpp"
 
 namespace RDP {
 
@@ -183,6 +184,19 @@ struct RefreshRectPDU {
         area_count++;
     }
 
+    // numberOfAreas is 8 bits wide, a region with more rectangles than that
+    //  is refreshed as a whole.
+    void addInclusiveRects(const Region & region) {
+        if (region.rects.size() > 255) {
+            const Rect bounds = region.bounds();
+            this->addInclusiveRect(bounds.x, bounds.y, bounds.right() - 1, bounds.bottom() - 1);
+            return;
+        }
+        for (const Rect & r : region.rects) {
+            this->addInclusiveRect(r.x, r.y, r.right() - 1, r.bottom() - 1);
+        }
+    }
+
     void emit(Transport & trans) {
         this->buffer_stream.set_out_uint8(this->area_count,
                                           this->offset_area_count);
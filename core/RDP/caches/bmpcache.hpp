@@ -494,6 +494,12 @@ public:
     }
 
     void put(uint8_t id, uint16_t idx, const Bitmap & bmp, uint32_t key1, uint32_t key2) {
+        this->put(id, idx, Bitmap(bmp), key1, key2);
+    }
+
+    // bmp is taken over without touching its reference counter, previous
+    // bitmap at this place (if any) is released with bmp
+    void put(uint8_t id, uint16_t idx, Bitmap && bmp, uint32_t key1, uint32_t key2) {
         REDASSERT(((id & IN_WAIT_LIST) == 0) && (id < MAXIMUM_NUMBER_OF_CACHES));
         Cache<cache_element> & r = this->caches[id];
         if (idx == RDPBmpCache::BITMAPCACHE_WAITING_LIST_INDEX) {
@@ -506,7 +512,7 @@ public:
         if (e) {
             r.remove(e);
         }
-        e.bmp = bmp;
+        e.bmp.swap(bmp);
         e.bmp.compute_sha1(e.sha1);
         e.stamp = ++this->stamp;
         e.cached = true;
@@ -315,7 +315,7 @@ private:
 
                 Bitmap bmp(bmp_cache.bpp, original_bpp, &original_palette, cx, cy, stream.get_data(), stream.size());
 
-                bmp_cache.put(cache_id, i, bmp, sig.sig_32[0], sig.sig_32[1]);
+                bmp_cache.put(cache_id, i, std::move(bmp), sig.sig_32[0], sig.sig_32[1]);
             }
 
             stream.reset();
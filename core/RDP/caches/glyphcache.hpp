@@ -21,26 +21,55 @@
 #ifndef _REDEMPTION_CORE_RDP_CACHES_GLYPHCACHE_HPP_
 #define _REDEMPTION_CORE_RDP_CACHES_GLYPHCACHE_HPP_
 
+#include <array>
+#include <memory>
+#include <algorithm>
+
 #include "font.hpp"
 #include "noncopyable.hpp"
 #include "RDP/capabilities/glyphcache.hpp"
 
 /* difference caches */
+// Glyphs and glyph fragments belong to a generation: reset() starts a new
+// generation, entries of previous generations are empty.
 class GlyphCache : noncopyable {
     class Glyph {
         friend class GlyphCache;
 
+        unsigned generation = 0;
+
         int stamp = 0;
 
         bool cached = false;
 
-    public:
+        // view on the arena of its cache id
         FontChar font_item;
     };
 
+    // Glyph data of a cache id. Adding a glyph appends its data, live
+    // glyphs are moved to a new buffer when it is full.
+    struct Arena {
+        std::unique_ptr<uint8_t[]> data;
+        size_t capacity = 0;
+        size_t used = 0;
+    };
+
+    // glyph indexes and deltas of a GlyphIndex order (see RDPSerializer)
+    struct Fragment {
+        unsigned generation = 0;
+        int stamp = 0;
+        uint8_t cache_id = 0;
+        uint8_t size = 0;
+        uint8_t data[MAXIMUM_SIZE_OF_FRAGMENT_CACHE_ENTRIE - 1];
+    };
+
+    unsigned generation = 1;
+
     /* font */
     int glyph_stamp = 0;
 
+    int fragment_stamp = 0;
+
 public:
     using number_of_entries_t = std::array<uint8_t, NUMBER_OF_GLYPH_CACHES>;
 
@@ -52,19 +81,43 @@ private:
         , NUMBER_OF_GLYPH_CACHE_ENTRIES
     } };
 
-public:
     Glyph glyphs[NUMBER_OF_GLYPH_CACHES][NUMBER_OF_GLYPH_CACHE_ENTRIES];
 
+    Arena arenas[NUMBER_OF_GLYPH_CACHES];
+
+    // allocated on first use
+    std::unique_ptr<Fragment[]> fragments;
+
+    bool is_live(Glyph const & glyph) const {
+        return glyph.generation == this->generation;
+    }
+
+    bool is_live(Fragment const & fragment) const {
+        return fragment.generation == this->generation;
+    }
+
+public:
     int reset(number_of_entries_t const & number_of_entries_in_glyph_cache) {
-        /* free all the cached font items */
-        this->~GlyphCache();
-        new (this)GlyphCache();
+        /* forget all the cached font items, buffers are kept */
+        ++this->generation;
+        for (Arena & arena : this->arenas) {
+            arena.used = 0;
+        }
+        this->glyph_stamp = 0;
+        this->fragment_stamp = 0;
 
         this->number_of_entries_in_cache = number_of_entries_in_glyph_cache;
 
         return 0;
     }
 
+    // empty FontChar when there is no glyph at this index
+    FontChar const & glyph(uint8_t cacheId, uint8_t cacheIndex) const {
+        static const FontChar no_glyph;
+        Glyph const & glyph = this->glyphs[cacheId][cacheIndex];
+        return this->is_live(glyph) ? glyph.font_item : no_glyph;
+    }
+
     enum t_glyph_cache_result {
           GLYPH_FOUND_IN_CACHE
         , GLYPH_ADDED_TO_CACHE
@@ -73,15 +126,8 @@ public:
     t_glyph_cache_result add_glyph(FontChar const & font_item, int cacheid, int & cacheidx) {
         const t_glyph_cache_result ret = priv_add_glyph(font_item, cacheid, cacheidx);
         if (ret == GLYPH_ADDED_TO_CACHE) {
-            this->glyphs[cacheid][cacheidx].font_item = FontChar(font_item);
-        }
-        return ret;
-    }
-
-    t_glyph_cache_result add_glyph(FontChar && font_item, int cacheid, int & cacheidx) {
-        const t_glyph_cache_result ret = priv_add_glyph(font_item, cacheid, cacheidx);
-        if (ret == GLYPH_ADDED_TO_CACHE) {
-            this->glyphs[cacheid][cacheidx].font_item = std::move(font_item);
+            this->store_glyph(font_item, cacheid, cacheidx);
+            this->glyphs[cacheid][cacheidx].cached = true;
         }
         return ret;
     }
@@ -95,6 +141,14 @@ private:
         int oldest = 0x7fffffff;
         for (uint8_t cacheIndex = 0; cacheIndex < this->number_of_entries_in_cache[cacheid]; ++ cacheIndex) {
             Glyph & item = this->glyphs[cacheid][cacheIndex];
+            if (!this->is_live(item)) {
+                // empty entries are the oldest ones
+                if (oldest > 0) {
+                    oldest = 0;
+                    ci     = cacheIndex;
+                }
+                continue;
+            }
             if (item.font_item && item.font_item.item_compare(font_item)) {
                 item.stamp = this->glyph_stamp;
                 cacheidx   = &item - std::begin(this->glyphs[cacheid]);
@@ -109,43 +163,109 @@ private:
             }
         }
 
-        this->glyphs[cacheid][ci].stamp = this->glyph_stamp;
-
         cacheidx = ci;
 
-        this->glyphs[cacheid][ci].cached = true;
-
         return GLYPH_ADDED_TO_CACHE;
     }
 
-public:
-    void set_glyph(FontChar && fc, size_t cacheid, size_t cacheidx) {
-        this->glyph_stamp++;
-        this->glyphs[cacheid][cacheidx].font_item = std::move(fc);
-        this->glyphs[cacheid][cacheidx].stamp     = this->glyph_stamp;
+    // one bump allocation in the arena of cacheid
+    uint8_t * alloc_glyph_data(int cacheid, size_t size) {
+        Arena & arena = this->arenas[cacheid];
+        if (arena.used + size > arena.capacity) {
+            size_t live_size = size;
+            for (Glyph const & glyph : this->glyphs[cacheid]) {
+                if (this->is_live(glyph)) {
+                    live_size += glyph.font_item.datasize();
+                }
+            }
+            const size_t capacity = std::max<size_t>(live_size * 2, 4096);
+            std::unique_ptr<uint8_t[]> data(new uint8_t[capacity]);
+            size_t used = 0;
+            for (Glyph & glyph : this->glyphs[cacheid]) {
+                if (this->is_live(glyph)) {
+                    FontChar & fc = glyph.font_item;
+                    memcpy(data.get() + used, fc.data, fc.datasize());
+                    fc = FontChar(fc.offset, fc.baseline, fc.width, fc.height, fc.incby, data.get() + used);
+                    used += fc.datasize();
+                }
+            }
+            arena.data = std::move(data);
+            arena.capacity = capacity;
+            arena.used = used;
+        }
+        uint8_t * p = arena.data.get() + arena.used;
+        arena.used += size;
+        return p;
     }
 
-/*
-    int find_glyph(FontChar & font_item, int cacheid) {
-        // look for match
-        for (uint8_t cacheIndex = 0; cacheIndex < this->number_of_entries_in_cache[cacheid]; ++cacheIndex) {
-            Glyph & item = this->glyphs[cacheid][cacheIndex];
-            if (item.font_item && item.font_item.item_compare(font_item)) {
-                return cacheIndex;
-            }
+    void store_glyph(FontChar const & fc, int cacheid, int cacheidx) {
+        Glyph & glyph = this->glyphs[cacheid][cacheidx];
+        if (!this->is_live(glyph)) {
+            glyph.cached = false;
         }
+        // the previous glyph data is not kept when the arena is full
+        glyph.generation = 0;
+        uint8_t * data = this->alloc_glyph_data(cacheid, fc.datasize());
+        memcpy(data, fc.data, fc.datasize());
+        glyph.font_item = FontChar(fc.offset, fc.baseline, fc.width, fc.height, fc.incby, data);
+        glyph.generation = this->generation;
+        glyph.stamp = this->glyph_stamp;
+    }
 
-        return -1;
+public:
+    void set_glyph(FontChar && fc, size_t cacheid, size_t cacheidx) {
+        this->glyph_stamp++;
+        this->store_glyph(fc, cacheid, cacheidx);
     }
-*/
 
     bool is_cached(uint8_t cacheId, uint8_t cacheIndex) const {
-        return this->glyphs[cacheId][cacheIndex].cached;
+        Glyph const & glyph = this->glyphs[cacheId][cacheIndex];
+        return this->is_live(glyph) && glyph.cached;
     }
 
     void set_cached(uint8_t cacheId, uint8_t cacheIndex, bool cached) {
         this->glyphs[cacheId][cacheIndex].cached = cached;
     }
+
+    // Looks for a fragment with the same glyph data for cacheId in the
+    // number_of_entries first entries of the fragment cache, or replaces
+    // the oldest one.
+    t_glyph_cache_result add_fragment( uint8_t cacheId, const uint8_t * data, uint8_t size
+                                     , uint16_t number_of_entries, int & fragmentidx) {
+        REDASSERT(size < MAXIMUM_SIZE_OF_FRAGMENT_CACHE_ENTRIE);
+        REDASSERT(number_of_entries && number_of_entries <= MAXIMUM_NUMBER_OF_FRAGMENT_CACHE_ENTRIES);
+        if (!this->fragments) {
+            this->fragments.reset(new Fragment[MAXIMUM_NUMBER_OF_FRAGMENT_CACHE_ENTRIES]);
+        }
+
+        this->fragment_stamp++;
+
+        int fi     = 0;
+        int oldest = 0x7fffffff;
+        for (uint16_t index = 0; index < number_of_entries; ++index) {
+            Fragment & fragment = this->fragments[index];
+            const int stamp = this->is_live(fragment) ? fragment.stamp : 0;
+            if (stamp && fragment.cache_id == cacheId && fragment.size == size
+             && !memcmp(fragment.data, data, size)) {
+                fragment.stamp = this->fragment_stamp;
+                fragmentidx = index;
+                return GLYPH_FOUND_IN_CACHE;
+            }
+            if (stamp < oldest) {
+                oldest = stamp;
+                fi     = index;
+            }
+        }
+
+        Fragment & fragment = this->fragments[fi];
+        fragment.generation = this->generation;
+        fragment.stamp = this->fragment_stamp;
+        fragment.cache_id = cacheId;
+        fragment.size = size;
+        memcpy(fragment.data, data, size);
+        fragmentidx = fi;
+        return GLYPH_ADDED_TO_CACHE;
+    }
 };  // class GlyphCache
 
 #endif  // #ifndef _REDEMPTION_CORE_RDP_CACHES_GLYPHCACHE_HPP_
@@ -0,0 +1,186 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Offscreen bitmaps allocated on the client ([MS-RDPEGDI] section 3.1.1.1.5)
+*/
+
+#ifndef _REDEMPTION_CORE_RDP_CACHES_OFFSCREENCACHE_HPP_
+#define _REDEMPTION_CORE_RDP_CACHES_OFFSCREENCACHE_HPP_
+
+#include <string.h>
+#include <stdint.h>
+
+#include "noncopyable.hpp"
+
+// Server side view of the client offscreen bitmap cache. Each offscreen
+// bitmap holds content identified by a signature, bitmaps are allocated
+// within the offscreenCacheSize and offscreenCacheEntries limits of the
+// client and the least recently used ones are deleted to make room.
+//
+// Content is only worth an offscreen bitmap when it is drawn again: the
+// signatures of recent content are kept so that the second drawing of the
+// same content allocates the bitmap.
+class OffscreenCache : noncopyable {
+public:
+    enum {
+        MAX_ENTRIES  = 500,     // largest offscreenCacheEntries
+        MAX_SIZE_KB  = 7680,    // largest offscreenCacheSize
+        RECENT_COUNT = 64
+    };
+
+    typedef uint8_t Signature[20];
+
+private:
+    struct Entry {
+        bool      used;
+        Signature sig;
+        uint16_t  cx;
+        uint16_t  cy;
+        uint32_t  size;
+        uint32_t  stamp;
+    };
+
+    Entry    entries[MAX_ENTRIES];
+    uint16_t max_entries;
+    uint32_t max_size;
+    uint32_t used_size;
+    uint32_t stamp;
+
+    Signature recent[RECENT_COUNT];
+    unsigned  recent_count;
+    unsigned  recent_next;
+
+public:
+    OffscreenCache()
+    : max_entries(0)
+    , max_size(0)
+    , used_size(0)
+    , stamp(0)
+    , recent_count(0)
+    , recent_next(0) {
+        this->clear();
+    }
+
+    // offscreenCacheSize (KB) and offscreenCacheEntries of the client
+    void reset(uint16_t size_kb, uint16_t entries) {
+        this->max_entries = (entries < MAX_ENTRIES) ? entries : uint16_t(MAX_ENTRIES);
+        this->max_size    = ((size_kb < MAX_SIZE_KB) ? size_kb : uint32_t(MAX_SIZE_KB)) * 1024;
+        this->clear();
+    }
+
+    void clear() {
+        for (Entry & entry : this->entries) {
+            entry.used = false;
+        }
+        this->used_size    = 0;
+        this->stamp        = 0;
+        this->recent_count = 0;
+        this->recent_next  = 0;
+    }
+
+    bool enabled() const {
+        return this->max_entries && this->max_size;
+    }
+
+    uint32_t size() const {
+        return this->used_size;
+    }
+
+    // Offscreen bitmap holding the content, -1 when there is none.
+    int find(const Signature & sig, uint16_t cx, uint16_t cy) {
+        for (uint16_t id = 0; id < this->max_entries; ++id) {
+            Entry & entry = this->entries[id];
+            if (entry.used && entry.cx == cx && entry.cy == cy && !memcmp(entry.sig, sig, sizeof(Signature))) {
+                entry.stamp = ++this->stamp;
+                return id;
+            }
+        }
+        return -1;
+    }
+
+    // true when the content was seen recently, remembers it otherwise.
+    bool seen(const Signature & sig) {
+        for (unsigned i = 0; i < this->recent_count; ++i) {
+            if (!memcmp(this->recent[i], sig, sizeof(Signature))) {
+                return true;
+            }
+        }
+        memcpy(this->recent[this->recent_next], sig, sizeof(Signature));
+        this->recent_next = (this->recent_next + 1) % RECENT_COUNT;
+        if (this->recent_count < RECENT_COUNT) {
+            ++this->recent_count;
+        }
+        return false;
+    }
+
+    // Allocates an offscreen bitmap of size bytes for the content. The ids of
+    // the bitmaps deleted to make room are appended to deleted (at most
+    // MAX_ENTRIES). -1 when the bitmap can not fit in the client cache.
+    int allocate( const Signature & sig, uint16_t cx, uint16_t cy, uint32_t size
+                , uint16_t * deleted, uint16_t & delete_count) {
+        if (!this->enabled() || size > this->max_size) {
+            return -1;
+        }
+
+        int free_id = -1;
+        for (;;) {
+            if (free_id < 0) {
+                for (uint16_t id = 0; id < this->max_entries; ++id) {
+                    if (!this->entries[id].used) {
+                        free_id = id;
+                        break;
+                    }
+                }
+            }
+            if (free_id >= 0 && this->used_size + size <= this->max_size) {
+                break;
+            }
+
+            // delete the least recently used bitmap
+            int lru = -1;
+            for (uint16_t id = 0; id < this->max_entries; ++id) {
+                const Entry & entry = this->entries[id];
+                if (entry.used && (lru < 0 || entry.stamp < this->entries[lru].stamp)) {
+                    lru = id;
+                }
+            }
+            if (lru < 0) {
+                return -1;
+            }
+            this->entries[lru].used = false;
+            this->used_size -= this->entries[lru].size;
+            deleted[delete_count++] = lru;
+            if (free_id < 0) {
+                free_id = lru;
+            }
+        }
+
+        Entry & entry = this->entries[free_id];
+        entry.used  = true;
+        memcpy(entry.sig, sig, sizeof(Signature));
+        entry.cx    = cx;
+        entry.cy    = cy;
+        entry.size  = size;
+        entry.stamp = ++this->stamp;
+        this->used_size += size;
+        return free_id;
+    }
+};
+
+#endif
@@ -26,6 +26,7 @@
 
 #include <string.h>
 #include "common.hpp"
+#include "stream.hpp"
 
 // 2.2.7.2.10 Bitmap Codecs Capability Set (TS_BITMAPCODECS_CAPABILITYSET)
 // =======================================================================
@@ -422,6 +423,81 @@ struct RFXClntCaps : public RFXGenCaps {
     }
 };
 
+enum {
+       RFX_ICAPS_MAX = 8
+     };
+
+// codecProperties of CODEC_GUID_REMOTEFX sent by the client
+// (TS_RFX_CLNT_CAPS_CONTAINER). Only the first capset is kept.
+struct RemoteFXCaps {
+
+    uint32_t captureFlags;
+    uint16_t numIcaps;
+    RFXICap  icaps[RFX_ICAPS_MAX];
+
+    RemoteFXCaps()
+    : captureFlags(0)
+    , numIcaps(0)
+    {
+    }
+
+    // nullptr if no icap uses this entropy algorithm
+    const RFXICap * find(uint8_t entropyBits) const {
+        for (uint16_t i = 0; i < this->numIcaps; i++) {
+            if (this->icaps[i].entropyBits == entropyBits
+             && this->icaps[i].version == CLW_VERSION_1_0
+             && this->icaps[i].tileSize == CT_TILE_64X64) {
+                return &this->icaps[i];
+            }
+        }
+        return nullptr;
+    }
+
+    // end is the end of codecProperties
+    void recv(Stream & stream, const uint8_t * end) {
+        this->numIcaps = 0;
+
+        // length, captureFlags, capsLength, TS_RFX_CAPS then TS_RFX_CAPSET header
+        const unsigned expected = 12 + 8 + 13;
+        if (static_cast<size_t>(end - stream.p) < expected) {
+            LOG(LOG_ERR, "Truncated RemoteFX caps, need=%u remains=%u",
+                expected, static_cast<unsigned>(end - stream.p));
+            return;
+        }
+        stream.in_skip_bytes(4);    /* length */
+        this->captureFlags = stream.in_uint32_le();
+        stream.in_skip_bytes(4);    /* capsLength */
+
+        const uint16_t capsBlockType = stream.in_uint16_le();
+        stream.in_skip_bytes(4);    /* blockLen */
+        stream.in_skip_bytes(2);    /* numCapsets */
+
+        const uint16_t capsetBlockType = stream.in_uint16_le();
+        stream.in_skip_bytes(4);    /* blockLen */
+        stream.in_skip_bytes(1);    /* codecId */
+        stream.in_skip_bytes(2);    /* capsetType */
+        const uint16_t numIcaps = stream.in_uint16_le();
+        const uint16_t icapLen = stream.in_uint16_le();
+        if (capsBlockType != CBY_CAPS || capsetBlockType != CBY_CAPSET || icapLen < 8) {
+            LOG(LOG_ERR, "Bad RemoteFX caps, blockType=0x%04X capset blockType=0x%04X icapLen=%u",
+                capsBlockType, capsetBlockType, icapLen);
+            return;
+        }
+
+        for (uint16_t i = 0; i < numIcaps && i < RFX_ICAPS_MAX && end - stream.p >= icapLen; i++) {
+            RFXICap & icap = this->icaps[i];
+            icap.version       = stream.in_uint16_le();
+            icap.tileSize      = stream.in_uint16_le();
+            icap.flags         = stream.in_uint8();
+            icap.colConvBits   = stream.in_uint8();
+            icap.transformBits = stream.in_uint8();
+            icap.entropyBits   = stream.in_uint8();
+            stream.in_skip_bytes(icapLen - 8);
+            this->numIcaps = i + 1;
+        }
+    }
+};
+
 struct BitmapCodec {
 
     uint8_t  codecGUID[16];
@@ -430,11 +506,15 @@ struct BitmapCodec {
 
     RFXGenCaps * codecProperties;
 
+    NSCodecCaps nscodecProperties;  // codecProperties when codecGUID is CODEC_GUID_NSCODEC
+    RemoteFXCaps remotefxProperties;  // codecProperties of a client when codecGUID is CODEC_GUID_REMOTEFX
+
     BitmapCodec()
     : codecID(0)                // CS : a bitmap data identifier code
                                 // SC :
                                 //    - if codecGUID == CODEC_GUID_NSCODEC, MUST be set to 1
     , codecPropertiesLength(0)  // size in bytes of the next field
+    , codecProperties(nullptr)
     {
         memset(this->codecGUID, 0, 16); // 16 bits array filled with fixed lists of values
     }
@@ -444,12 +524,22 @@ struct BitmapCodec {
         if (codecGUID == CODEC_GUID_NSCODEC) {
             memcpy(this->codecGUID, "\xCA\x8D\x1B\xB9\x00\x0F\x15\x4F\x58\x9F\xAE\x2D\x1A\x87\xE2\xD6", 16);
             this->codecID = 1;
+            this->codecPropertiesLength = 3;
         }
-        else if (codecGUID == CODEC_GUID_REMOTEFX)
+        else if (codecGUID == CODEC_GUID_REMOTEFX) {
             memcpy(this->codecGUID, "\x76\x77\x2F\x12\xBD\x72\x44\x63\xAF\xB3\xB7\x3C\x9C\x6F\x78\x86", 16);
+            // TS_RFX_SRVR_CAPS_CONTAINER
+            this->codecPropertiesLength = 4;
+        }
         else
             memset(this->codecGUID, 0, 16);
     }
+
+    bool isCodecGUID(uint8_t codecGUID) const {
+        BitmapCodec codec;
+        codec.setCodecGUID(codecGUID);
+        return !memcmp(this->codecGUID, codec.codecGUID, 16);
+    }
 };
 
 
@@ -467,7 +557,7 @@ struct BitmapCodecs {
 };
 
 enum {
-    CAPLEN_BITMAP_CODECS = 1
+    CAPLEN_BITMAP_CODECS = 5
 };
 
 struct BitmapCodecCaps : public Capability {
@@ -475,7 +565,7 @@ struct BitmapCodecCaps : public Capability {
     BitmapCodecs * supportedBitmapCodecs;
 
     BitmapCodecCaps()
-    : Capability(CAPSTYPE_SHARE, CAPLEN_BITMAP_CODECS)
+    : Capability(CAPSETTYPE_BITMAP_CODECS, CAPLEN_BITMAP_CODECS)
     {
         this->supportedBitmapCodecs = new BitmapCodecs;
     }
@@ -484,17 +574,92 @@ struct BitmapCodecCaps : public Capability {
         delete this->supportedBitmapCodecs;
     }
 
+    // nullptr if the codec is not supported
+    const BitmapCodec * find(uint8_t codecGUID) const {
+        for (uint8_t i = 0; i < this->supportedBitmapCodecs->bitmapCodecCount; i++) {
+            if (this->supportedBitmapCodecs->bitmapCodecArray[i].isCodecGUID(codecGUID)) {
+                return &this->supportedBitmapCodecs->bitmapCodecArray[i];
+            }
+        }
+        return nullptr;
+    }
+
     void emit(Stream & stream){
-        LOG(LOG_INFO, "BitmapCodec caps emit not implemented");
+        this->len = CAPLEN_BITMAP_CODECS;
+        for (uint8_t i = 0; i < this->supportedBitmapCodecs->bitmapCodecCount; i++) {
+            this->len += 19 + this->supportedBitmapCodecs->bitmapCodecArray[i].codecPropertiesLength;
+        }
+
+        stream.out_uint16_le(this->capabilityType);
+        stream.out_uint16_le(this->len);
+        stream.out_uint8(this->supportedBitmapCodecs->bitmapCodecCount);
+        for (uint8_t i = 0; i < this->supportedBitmapCodecs->bitmapCodecCount; i++) {
+            const BitmapCodec & codec = this->supportedBitmapCodecs->bitmapCodecArray[i];
+            stream.out_copy_bytes(codec.codecGUID, 16);
+            stream.out_uint8(codec.codecID);
+            stream.out_uint16_le(codec.codecPropertiesLength);
+            if (codec.isCodecGUID(CODEC_GUID_NSCODEC)) {
+                stream.out_uint8(codec.nscodecProperties.fAllowDynamicFidelity);
+                stream.out_uint8(codec.nscodecProperties.fAllowSubsampling);
+                stream.out_uint8(codec.nscodecProperties.colorLossLevel);
+            }
+            else {
+                stream.out_clear_bytes(codec.codecPropertiesLength);
+            }
+        }
     }
 
     void recv(Stream & stream, uint16_t len){
-        LOG(LOG_INFO, "BitmapCodec caps recv not implemented");
+        this->len = len;
+        this->supportedBitmapCodecs->bitmapCodecCount = 0;
+
+        if (!stream.in_check_rem(1)) {
+            LOG(LOG_ERR, "Truncated BitmapCodec caps, need=1 remains=%u", stream.in_remain());
+            return;
+        }
+        const uint8_t bitmapCodecCount = stream.in_uint8();
+        for (uint8_t i = 0; i < bitmapCodecCount && i < BITMAPCODECS_MAX_SIZE; i++) {
+            if (!stream.in_check_rem(19)) {
+                LOG(LOG_ERR, "Truncated BitmapCodec, need=19 remains=%u", stream.in_remain());
+                return;
+            }
+            BitmapCodec & codec = this->supportedBitmapCodecs->bitmapCodecArray[i];
+            stream.in_copy_bytes(codec.codecGUID, 16);
+            codec.codecID = stream.in_uint8();
+            codec.codecPropertiesLength = stream.in_uint16_le();
+            if (!stream.in_check_rem(codec.codecPropertiesLength)) {
+                LOG(LOG_ERR, "Truncated BitmapCodec properties, need=%u remains=%u",
+                    codec.codecPropertiesLength, stream.in_remain());
+                return;
+            }
+            uint8_t * properties_end = stream.p + codec.codecPropertiesLength;
+            if (codec.isCodecGUID(CODEC_GUID_NSCODEC) && codec.codecPropertiesLength >= 3) {
+                codec.nscodecProperties.fAllowDynamicFidelity = stream.in_uint8();
+                codec.nscodecProperties.fAllowSubsampling = stream.in_uint8();
+                codec.nscodecProperties.colorLossLevel = stream.in_uint8();
+            }
+            else if (codec.isCodecGUID(CODEC_GUID_REMOTEFX)) {
+                codec.remotefxProperties.recv(stream, properties_end);
+            }
+            stream.p = properties_end;
+            this->supportedBitmapCodecs->bitmapCodecCount = i + 1;
+        }
     }
 
     void log(const char * msg){
         LOG(LOG_INFO, "%s BitmapCodec caps (%u bytes)", msg, this->len);
-        LOG(LOG_INFO, "BitmapCodec caps::supportedBitmapCodecs %u", this->supportedBitmapCodecs);
+        LOG(LOG_INFO, "BitmapCodec caps::bitmapCodecCount %u", this->supportedBitmapCodecs->bitmapCodecCount);
+        for (uint8_t i = 0; i < this->supportedBitmapCodecs->bitmapCodecCount; i++) {
+            const BitmapCodec & codec = this->supportedBitmapCodecs->bitmapCodecArray[i];
+            LOG(LOG_INFO, "BitmapCodec caps::codec %u codecID=%u nscodec=%s remotefx=%s codecPropertiesLength=%u",
+                i, codec.codecID, (codec.isCodecGUID(CODEC_GUID_NSCODEC) ? "yes" : "no"),
+                (codec.isCodecGUID(CODEC_GUID_REMOTEFX) ? "yes" : "no"), codec.codecPropertiesLength);
+            for (uint16_t j = 0; j < codec.remotefxProperties.numIcaps; j++) {
+                const RFXICap & icap = codec.remotefxProperties.icaps[j];
+                LOG(LOG_INFO, "BitmapCodec caps::codec %u icap %u version=0x%04X tileSize=%u flags=0x%02X entropyBits=%u",
+                    i, j, icap.version, icap.tileSize, icap.flags, icap.entropyBits);
+            }
+        }
     }
 };
 
@@ -59,7 +59,7 @@
 //    traffic.
 
 enum {
-    CAPLEN_SURFACE_COMMANDS = 8
+    CAPLEN_SURFACE_COMMANDS = 12
 };
 
 enum {
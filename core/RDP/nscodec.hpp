@@ -0,0 +1,450 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   NSCodec bitmap codec ([MS-RDPNSC]): BGR pixels are converted to YCoCg,
+   chroma planes are optionally subsampled 2x2, then each plane is run
+   length encoded. Color conversion rows are computed 8 or 16 pixels at a
+   time with vector kernels, 16 pixels (AVX2) when the CPU supports them.
+*/
+
+#ifndef _REDEMPTION_CORE_RDP_NSCODEC_HPP_
+#define _REDEMPTION_CORE_RDP_NSCODEC_HPP_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <vector>
+
+#include "stream.hpp"
+#include "rop_kernels.hpp"
+
+// 2.2.1 NSCodec Bitmap Stream (NSCODEC_BITMAP_STREAM)
+// ===================================================
+
+// PlaneByteCount (16 bytes): An array of 4 32-bit unsigned integers. Each
+//  integer contains the number of bytes in the corresponding plane of
+//  PlaneData: luma (Y), orange chroma (Co), green chroma (Cg) and alpha.
+//  A plane whose byte count is smaller than its raw size is run length
+//  encoded, otherwise it is stored raw. An alpha byte count of 0 means
+//  that all alpha values are 0xFF.
+
+// ColorLossLevel (1 byte): The Color Loss Level (between 1 and 7) used to
+//  reduce the chroma values.
+
+// ChromaSubsamplingLevel (1 byte): Non zero when the chroma planes are
+//  subsampled 2x2. Luma rows are then padded to a multiple of 8 pixels and
+//  the number of rows to a multiple of 2, by replicating the last pixel
+//  and the last row.
+
+// Reserved (2 bytes)
+
+// PlaneData (variable): The planes, one after the other.
+
+// 2.2.2 RLE Compressed Plane
+// ==========================
+// A sequence of segments, then the last 4 bytes of the plane stored raw.
+// A segment is either a single raw byte, or a byte repeated: the byte
+// twice, then the run length minus 2 on one byte, or 0xFF followed by the
+// run length on 4 bytes (little endian) when it does not fit. A segment
+// starting on the byte just before the last 4 bytes is a raw byte.
+
+namespace nscodec {
+
+enum {
+    HEADER_SIZE = 20
+};
+
+struct Params {
+    uint8_t color_loss_level;
+    bool    subsampling;
+};
+
+struct PlaneGeometry {
+    uint16_t luma_width;
+    uint16_t luma_height;
+    uint16_t chroma_width;
+    uint16_t chroma_height;
+
+    PlaneGeometry(uint16_t cx, uint16_t cy, bool subsampling)
+    : luma_width(subsampling ? (cx + 7) & ~7 : cx)
+    , luma_height(cy)
+    , chroma_width(subsampling ? this->luma_width / 2 : cx)
+    , chroma_height(subsampling ? (cy + 1) / 2 : cy)
+    {}
+
+    size_t luma_size() const
+    { return size_t(this->luma_width) * this->luma_height; }
+
+    size_t chroma_size() const
+    { return size_t(this->chroma_width) * this->chroma_height; }
+};
+
+// Largest stream for cx x cy pixels (all planes stored raw).
+inline size_t max_encoded_size(uint16_t cx, uint16_t cy, bool subsampling)
+{
+    const PlaneGeometry geometry(cx, cy, subsampling);
+    return HEADER_SIZE + geometry.luma_size() + 2 * geometry.chroma_size();
+}
+
+typedef int16_t vec8i16 __attribute__((vector_size(16)));
+typedef int16_t vec16i16 __attribute__((vector_size(32)));
+
+// Y, Co and Cg of n pixels of Bpp bytes (B, G, R[, X]). Co and Cg are
+// already reduced by the color loss level: the decoder shifts them left by
+// color_loss_level - 1 and gets (R - B) / 2 and (2G - R - B) / 4.
+template<class V, size_t Bpp>
+inline void ycocg_row( const uint8_t * src, size_t n, int16_t * y, int16_t * co, int16_t * cg
+                     , int color_loss_level) noexcept
+{
+    enum { lanes = sizeof(V) / sizeof(int16_t) };
+    const size_t vector_end = n - n % lanes;
+    size_t x = 0;
+    for (; x != vector_end; x += lanes, src += lanes * Bpp) {
+        V b;
+        V g;
+        V r;
+        for (size_t i = 0; i < lanes; ++i) {
+            b[i] = src[i * Bpp];
+            g[i] = src[i * Bpp + 1];
+            r[i] = src[i * Bpp + 2];
+        }
+        const V vy = (r >> 2) + (g >> 1) + (b >> 2);
+        const V vco = (r - b) >> color_loss_level;
+        const V vcg = ((g << 1) - r - b) >> (color_loss_level + 1);
+        memcpy(y + x, &vy, sizeof(V));
+        memcpy(co + x, &vco, sizeof(V));
+        memcpy(cg + x, &vcg, sizeof(V));
+    }
+    for (; x < n; ++x, src += Bpp) {
+        const int b = src[0];
+        const int g = src[1];
+        const int r = src[2];
+        y[x] = (r >> 2) + (g >> 1) + (b >> 2);
+        co[x] = (r - b) >> color_loss_level;
+        cg[x] = ((g << 1) - r - b) >> (color_loss_level + 1);
+    }
+}
+
+#ifdef REDEMPTION_ROP_KERNELS_AVX2
+template<size_t Bpp>
+__attribute__((target("avx2")))
+void ycocg_row_avx2( const uint8_t * src, size_t n, int16_t * y, int16_t * co, int16_t * cg
+                   , int color_loss_level) noexcept
+{
+    ycocg_row<vec16i16, Bpp>(src, n, y, co, cg, color_loss_level);
+}
+#endif
+
+template<size_t Bpp>
+void ycocg(const uint8_t * src, size_t n, int16_t * y, int16_t * co, int16_t * cg, int color_loss_level) noexcept
+{
+#ifdef REDEMPTION_ROP_KERNELS_AVX2
+    if (n >= 16 && rop_kernels::has_avx2()) {
+        ycocg_row_avx2<Bpp>(src, n, y, co, cg, color_loss_level);
+        return;
+    }
+#endif
+    ycocg_row<vec8i16, Bpp>(src, n, y, co, cg, color_loss_level);
+}
+
+// Encodes size bytes of in to out, which has room for size bytes.
+// Returns the encoded size, size when the plane must be stored raw.
+inline size_t rle_encode(const uint8_t * in, size_t size, uint8_t * out) noexcept
+{
+    if (size <= 4) {
+        return size;
+    }
+    const uint8_t * const end_segments = in + size - 4;
+    // an encoded plane must be smaller than the raw plane
+    const uint8_t * const out_limit = out + size - 4;
+    uint8_t * o = out;
+    for (const uint8_t * p = in; p != end_segments; ) {
+        const uint8_t value = *p;
+        const uint8_t * q = p + 1;
+        while (q != end_segments && *q == value) {
+            ++q;
+        }
+        const size_t len = q - p;
+        if (len == 1) {
+            if (o == out_limit) {
+                return size;
+            }
+            *o++ = value;
+        }
+        else if (len <= 256) {
+            if (out_limit - o < 3) {
+                return size;
+            }
+            o[0] = value;
+            o[1] = value;
+            o[2] = uint8_t(len - 2);
+            o += 3;
+        }
+        else {
+            if (out_limit - o < 7) {
+                return size;
+            }
+            o[0] = value;
+            o[1] = value;
+            o[2] = 0xFF;
+            o[3] = uint8_t(len);
+            o[4] = uint8_t(len >> 8);
+            o[5] = uint8_t(len >> 16);
+            o[6] = uint8_t(len >> 24);
+            o += 7;
+        }
+        p = q;
+    }
+    if (o == out_limit) {
+        return size;
+    }
+    memcpy(o, end_segments, 4);
+    return o + 4 - out;
+}
+
+// Decodes an encoded plane of size bytes to original_size bytes of out.
+inline bool rle_decode(const uint8_t * in, size_t size, uint8_t * out, size_t original_size) noexcept
+{
+    if (original_size < 4) {
+        return false;
+    }
+    const uint8_t * const in_end = in + size;
+    size_t left = original_size;
+    while (left > 4) {
+        if (in_end - in < 1) {
+            return false;
+        }
+        const uint8_t value = *in++;
+        if (left == 5 || in == in_end || *in != value) {
+            *out++ = value;
+            --left;
+            continue;
+        }
+        ++in;
+        if (in == in_end) {
+            return false;
+        }
+        size_t len;
+        if (*in < 0xFF) {
+            len = *in + 2;
+            ++in;
+        }
+        else {
+            if (in_end - in < 5) {
+                return false;
+            }
+            len = in[1] | (in[2] << 8) | (in[3] << 16) | (uint32_t(in[4]) << 24);
+            in += 5;
+        }
+        if (len > left - 4) {
+            return false;
+        }
+        memset(out, value, len);
+        out += len;
+        left -= len;
+    }
+    if (in_end - in != 4) {
+        return false;
+    }
+    memcpy(out, in, 4);
+    return true;
+}
+
+class Encoder
+{
+    std::vector<uint8_t> planes;
+    std::vector<int16_t> rows;
+    std::vector<uint8_t> rle;
+
+    // one row of pixels, padded to width pixels by replicating the last pixel
+    template<size_t Bpp>
+    static void convert_row( const uint8_t * src, uint16_t cx, uint16_t width
+                           , int16_t * y, int16_t * co, int16_t * cg, int color_loss_level)
+    {
+        ycocg<Bpp>(src, cx, y, co, cg, color_loss_level);
+        for (uint16_t x = cx; x < width; ++x) {
+            y[x] = y[cx - 1];
+            co[x] = co[cx - 1];
+            cg[x] = cg[cx - 1];
+        }
+    }
+
+    template<size_t Bpp>
+    void planes_of( const uint8_t * first_row, ptrdiff_t row_step, uint16_t cx, uint16_t cy
+                  , Params params, PlaneGeometry const & geometry)
+    {
+        const uint16_t width = geometry.luma_width;
+        this->rows.resize(size_t(width) * 6);
+        int16_t * y0  = &this->rows[0];
+        int16_t * co0 = y0 + width;
+        int16_t * cg0 = co0 + width;
+        int16_t * y1  = cg0 + width;
+        int16_t * co1 = y1 + width;
+        int16_t * cg1 = co1 + width;
+
+        uint8_t * luma = &this->planes[0];
+        uint8_t * co_plane = luma + geometry.luma_size();
+        uint8_t * cg_plane = co_plane + geometry.chroma_size();
+
+        const int cll = params.color_loss_level;
+        const uint8_t * row = first_row;
+        const uint16_t step = params.subsampling ? 2 : 1;
+        for (uint16_t line = 0; line < cy; line += step) {
+            convert_row<Bpp>(row, cx, width, y0, co0, cg0, cll);
+            for (uint16_t x = 0; x < width; ++x) {
+                *luma++ = uint8_t(y0[x]);
+            }
+            if (!params.subsampling) {
+                for (uint16_t x = 0; x < width; ++x) {
+                    *co_plane++ = uint8_t(co0[x]);
+                    *cg_plane++ = uint8_t(cg0[x]);
+                }
+                row += row_step;
+                continue;
+            }
+
+            // the last row is replicated when cy is odd
+            if (line + 1 < cy) {
+                row += row_step;
+                convert_row<Bpp>(row, cx, width, y1, co1, cg1, cll);
+                for (uint16_t x = 0; x < width; ++x) {
+                    *luma++ = uint8_t(y1[x]);
+                }
+                row += row_step;
+            }
+            else {
+                memcpy(co1, co0, width * sizeof(int16_t));
+                memcpy(cg1, cg0, width * sizeof(int16_t));
+            }
+            for (uint16_t x = 0; x < width; x += 2) {
+                *co_plane++ = uint8_t((co0[x] + co0[x + 1] + co1[x] + co1[x + 1]) >> 2);
+                *cg_plane++ = uint8_t((cg0[x] + cg0[x + 1] + cg1[x] + cg1[x + 1]) >> 2);
+            }
+        }
+    }
+
+public:
+    // Appends the NSCodec bitmap stream of cx x cy pixels of Bpp (3 or 4)
+    // bytes to out. Rows are row_step bytes apart from first_row (negative
+    // for bottom-up bitmaps). out must have room for max_encoded_size().
+    void encode( Stream & out, const uint8_t * first_row, ptrdiff_t row_step, uint8_t Bpp
+               , uint16_t cx, uint16_t cy, Params params)
+    {
+        REDASSERT(cx && cy);
+        REDASSERT(params.color_loss_level >= 1 && params.color_loss_level <= 7);
+
+        const PlaneGeometry geometry(cx, cy, params.subsampling);
+        const size_t plane_sizes[3] = {
+            geometry.luma_size(), geometry.chroma_size(), geometry.chroma_size()
+        };
+        this->planes.resize(plane_sizes[0] + plane_sizes[1] + plane_sizes[2]);
+        this->rle.resize(plane_sizes[0]);
+
+        if (Bpp == 4) {
+            this->planes_of<4>(first_row, row_step, cx, cy, params, geometry);
+        }
+        else {
+            this->planes_of<3>(first_row, row_step, cx, cy, params, geometry);
+        }
+
+        const size_t header_offset = out.get_offset();
+        out.out_clear_bytes(16);
+        out.out_uint8(params.color_loss_level);
+        out.out_uint8(params.subsampling ? 1 : 0);
+        out.out_clear_bytes(2);
+
+        const uint8_t * plane = &this->planes[0];
+        for (size_t i = 0; i < 3; plane += plane_sizes[i], ++i) {
+            const size_t size = rle_encode(plane, plane_sizes[i], &this->rle[0]);
+            out.out_copy_bytes((size < plane_sizes[i]) ? &this->rle[0] : plane, size);
+            out.set_out_uint32_le(size, header_offset + i * 4);
+        }
+        // alpha plane byte count stays 0: opaque pixels
+    }
+};
+
+// Decodes a NSCodec bitmap stream of cx x cy pixels to 24 bpp (B, G, R)
+// rows, dest_step bytes apart.
+inline bool decode( const uint8_t * data, size_t size, uint16_t cx, uint16_t cy
+                  , uint8_t * dest, ptrdiff_t dest_step)
+{
+    if (size < HEADER_SIZE || !cx || !cy) {
+        return false;
+    }
+    uint32_t byte_counts[4];
+    for (size_t i = 0; i < 4; ++i) {
+        byte_counts[i] = data[i * 4] | (data[i * 4 + 1] << 8) | (data[i * 4 + 2] << 16)
+                       | (uint32_t(data[i * 4 + 3]) << 24);
+    }
+    const uint8_t color_loss_level = data[16];
+    const bool subsampling = data[17];
+    if (color_loss_level < 1 || color_loss_level > 7) {
+        return false;
+    }
+
+    const PlaneGeometry geometry(cx, cy, subsampling);
+    const size_t plane_sizes[3] = {
+        geometry.luma_size(), geometry.chroma_size(), geometry.chroma_size()
+    };
+    std::vector<uint8_t> planes(plane_sizes[0] + plane_sizes[1] + plane_sizes[2]);
+
+    const uint8_t * in = data + HEADER_SIZE;
+    const uint8_t * const in_end = data + size;
+    uint8_t * plane = &planes[0];
+    for (size_t i = 0; i < 3; plane += plane_sizes[i], ++i) {
+        if (size_t(in_end - in) < byte_counts[i]) {
+            return false;
+        }
+        if (byte_counts[i] < plane_sizes[i]) {
+            if (!rle_decode(in, byte_counts[i], plane, plane_sizes[i])) {
+                return false;
+            }
+        }
+        else {
+            memcpy(plane, in, plane_sizes[i]);
+        }
+        in += byte_counts[i];
+    }
+
+    const uint8_t * luma = &planes[0];
+    const uint8_t * co_plane = luma + plane_sizes[0];
+    const uint8_t * cg_plane = co_plane + plane_sizes[1];
+    const int shift = color_loss_level - 1;
+    auto clamp = [](int v) { return uint8_t(v < 0 ? 0 : v > 255 ? 255 : v); };
+    for (uint16_t line = 0; line < cy; ++line, dest += dest_step) {
+        const uint8_t * y_row = luma + size_t(line) * geometry.luma_width;
+        const size_t chroma_row = size_t(subsampling ? line / 2 : line) * geometry.chroma_width;
+        uint8_t * d = dest;
+        for (uint16_t x = 0; x < cx; ++x, d += 3) {
+            const size_t chroma_x = chroma_row + (subsampling ? x / 2 : x);
+            const int y = y_row[x];
+            const int co = int8_t(co_plane[chroma_x]) * (1 << shift);
+            const int cg = int8_t(cg_plane[chroma_x]) * (1 << shift);
+            d[0] = clamp(y - co - cg);
+            d[1] = clamp(y + cg);
+            d[2] = clamp(y + co - cg);
+        }
+    }
+    return true;
+}
+
+}
+
+#endif
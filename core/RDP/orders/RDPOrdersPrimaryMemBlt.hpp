@@ -90,6 +90,10 @@
 
 #include "RDPOrdersCommon.hpp"
 
+enum {
+    TS_BITMAPCACHE_SCREEN_ID = 0xFF
+};
+
 class RDPMemBlt {
     public:
     TODO("Change to cache_id")
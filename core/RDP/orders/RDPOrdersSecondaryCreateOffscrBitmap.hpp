@@ -0,0 +1,171 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2014
+    Author(s): Christophe Grosjean
+*/
+
+#ifndef _REDEMPTION_CORE_RDP_ORDERS_RDPORDERSSECONDARYCREATEOFFSCRBITMAP_HPP_
+#define _REDEMPTION_CORE_RDP_ORDERS_RDPORDERSSECONDARYCREATEOFFSCRBITMAP_HPP_
+
+#include "log.hpp"
+#include "RDPOrdersCommon.hpp"
+
+namespace RDP {
+
+// [MS-RDPEGDI] - 2.2.2.2.1.3.2 Create Offscreen Bitmap
+// ====================================================
+
+// The Create Offscreen Bitmap Alternate Secondary Drawing Order is used by the
+//  server to instruct the client to create an offscreen bitmap of the given
+//  size, and to delete a list of offscreen bitmaps it no longer uses.
+
+// +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+// | | | | | | | | | | |1| | | | | | | | | |2| | | | | | | | | |3| |
+// |0|1|2|3|4|5|6|7|8|9|0|1|2|3|4|5|6|7|8|9|0|1|2|3|4|5|6|7|8|9|0|1|
+// +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+// |     header    |             flags             |       cx      |
+// +---------------+-------------------------------+---------------+
+// |      ...      |               cy              |   deleteList  |
+// |               |                               |   (variable)  |
+// +---------------+-------------------------------+---------------+
+// |                              ...                              |
+// +---------------------------------------------------------------+
+
+// header (1 byte): An Alternate Secondary Drawing Order Header, as defined
+//  in section 2.2.2.2.1.3.1.1. The embedded orderType field MUST be set to
+//  TS_ALTSEC_CREATE_OFFSCR_BITMAP (0x01).
+
+// flags (2 bytes): A 16-bit, unsigned integer. The low 15 bits
+//  (offscreenBitmapId) are the ID of the offscreen bitmap, lower than the
+//  offscreenCacheEntries of the client. The high bit (0x8000) is set when
+//  the deleteList field is present.
+
+// cx (2 bytes): A 16-bit, unsigned integer. The width of the offscreen bitmap
+//  in pixels.
+
+// cy (2 bytes): A 16-bit, unsigned integer. The height of the offscreen bitmap
+//  in pixels.
+
+// deleteList (variable): An Offscreen Cache Delete List (OFFSCR_DELETE_LIST)
+//  structure, present when the high bit of flags is set.
+
+//  cIndices (2 bytes): A 16-bit, unsigned integer. The number of offscreen
+//   bitmap IDs of the indices field.
+
+//  indices (variable): An array of 16-bit, unsigned integers, the IDs of the
+//   offscreen bitmaps to delete before the new one is created.
+
+class CreateOffscrBitmap {
+public:
+    enum {
+          DeleteListPresent = 0x8000
+        , MaxDeleteIndices  = 500       /* largest offscreenCacheEntries */
+    };
+
+    uint16_t offscreen_bitmap_id;
+    uint16_t cx;
+    uint16_t cy;
+    uint16_t delete_count;
+    uint16_t delete_indices[MaxDeleteIndices];
+
+    CreateOffscrBitmap()
+    : offscreen_bitmap_id(0)
+    , cx(0)
+    , cy(0)
+    , delete_count(0) {
+    }
+
+    CreateOffscrBitmap(uint16_t offscreen_bitmap_id, uint16_t cx, uint16_t cy)
+    : offscreen_bitmap_id(offscreen_bitmap_id)
+    , cx(cx)
+    , cy(cy)
+    , delete_count(0) {
+    }
+
+    // header(1) + flags(2) + cx(2) + cy(2) + deleteList
+    size_t size() const {
+        return 7 + (this->delete_count ? 2 + this->delete_count * 2 : 0);
+    }
+
+    void emit(Stream & stream) const {
+        uint8_t controlFlags = SECONDARY | (AltsecDrawingOrderHeader::CreateOffscrBitmap << 2);
+        stream.out_uint8(controlFlags);
+        stream.out_uint16_le( (this->offscreen_bitmap_id & 0x7FFF)
+                            | (this->delete_count ? DeleteListPresent : 0));
+        stream.out_uint16_le(this->cx);
+        stream.out_uint16_le(this->cy);
+        if (this->delete_count) {
+            stream.out_uint16_le(this->delete_count);
+            for (uint16_t i = 0; i < this->delete_count; ++i) {
+                stream.out_uint16_le(this->delete_indices[i]);
+            }
+        }
+    }
+
+    void receive(Stream & stream, const AltsecDrawingOrderHeader & header) {
+        const uint16_t flags = stream.in_uint16_le();
+        this->offscreen_bitmap_id = flags & 0x7FFF;
+        this->cx = stream.in_uint16_le();
+        this->cy = stream.in_uint16_le();
+        this->delete_count = 0;
+        if (flags & DeleteListPresent) {
+            const uint16_t count = stream.in_uint16_le();
+            if (count > MaxDeleteIndices) {
+                LOG(LOG_ERR, "CreateOffscrBitmap::receive: too many indices to delete (%u)", count);
+                throw Error(ERR_RDP_PROTOCOL);
+            }
+            this->delete_count = count;
+            for (uint16_t i = 0; i < count; ++i) {
+                this->delete_indices[i] = stream.in_uint16_le();
+            }
+        }
+    }
+
+    bool operator==(const CreateOffscrBitmap & other) const {
+        return (this->offscreen_bitmap_id == other.offscreen_bitmap_id)
+            && (this->cx == other.cx)
+            && (this->cy == other.cy)
+            && (this->delete_count == other.delete_count)
+            && !memcmp(this->delete_indices, other.delete_indices, this->delete_count * sizeof(uint16_t));
+    }
+
+    size_t str(char * buffer, size_t sz) const {
+        size_t lg = snprintf( buffer, sz
+                            , "CreateOffscrBitmap(offscreenBitmapId=%u cx=%u cy=%u deleteList=%u)\n"
+                            , this->offscreen_bitmap_id, this->cx, this->cy, this->delete_count);
+        if (lg >= sz) {
+            return sz;
+        }
+        return lg;
+    }
+
+    void log(int level) const {
+        char buffer[1024];
+        this->str(buffer, 1024);
+        LOG(level, buffer);
+    }
+
+    void print() const {
+        char buffer[1024];
+        this->str(buffer, 1024);
+        printf("%s", buffer);
+    }
+};  // class CreateOffscrBitmap
+
+}   // namespace RDP
+
+#endif  // #ifndef _REDEMPTION_CORE_RDP_ORDERS_RDPORDERSSECONDARYCREATEOFFSCRBITMAP_HPP_
@@ -0,0 +1,105 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2014
+    Author(s): Christophe Grosjean
+*/
+
+#ifndef _REDEMPTION_CORE_RDP_ORDERS_RDPORDERSSECONDARYSWITCHSURFACE_HPP_
+#define _REDEMPTION_CORE_RDP_ORDERS_RDPORDERSSECONDARYSWITCHSURFACE_HPP_
+
+#include "log.hpp"
+#include "RDPOrdersCommon.hpp"
+
+namespace RDP {
+
+// [MS-RDPEGDI] - 2.2.2.2.1.3.3 Switch Surface
+// ===========================================
+
+// The Switch Surface Alternate Secondary Drawing Order is used by the server
+//  to instruct the client to change the target surface for all subsequent
+//  drawing operations. The target surface can be an offscreen bitmap created
+//  with a Create Offscreen Bitmap order or the screen. Support for offscreen
+//  bitmaps is specified in the Offscreen Bitmap Cache Capability Set (see
+//  [MS-RDPBCGR] section 2.2.7.1.9).
+
+// +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+// | | | | | | | | | | |1| | | | | | | | | |2| | | |
+// |0|1|2|3|4|5|6|7|8|9|0|1|2|3|4|5|6|7|8|9|0|1|2|3|
+// +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+// |     header    |            bitmapId           |
+// +---------------+-------------------------------+
+
+// header (1 byte): An Alternate Secondary Drawing Order Header, as defined
+//  in section 2.2.2.2.1.3.1.1. The embedded orderType field MUST be set to
+//  TS_ALTSEC_SWITCH_SURFACE (0x00).
+
+// bitmapId (2 bytes): A 16-bit, unsigned integer. The ID of the offscreen
+//  bitmap that becomes the target surface, or SCREEN_BITMAP_SURFACE (0xFFFF)
+//  to target the screen again.
+
+class SwitchSurface {
+public:
+    enum {
+        ScreenBitmapSurface = 0xFFFF    /* SCREEN_BITMAP_SURFACE */
+    };
+
+    uint16_t bitmap_id;
+
+    SwitchSurface() : bitmap_id(ScreenBitmapSurface) {}
+
+    explicit SwitchSurface(uint16_t bitmap_id) : bitmap_id(bitmap_id) {}
+
+    void emit(Stream & stream) const {
+        uint8_t controlFlags = SECONDARY | (AltsecDrawingOrderHeader::SwitchSurface << 2);
+        stream.out_uint8(controlFlags);
+        stream.out_uint16_le(this->bitmap_id);
+    }
+
+    void receive(Stream & stream, const AltsecDrawingOrderHeader & header) {
+        this->bitmap_id = stream.in_uint16_le();
+    }
+
+    bool operator==(const SwitchSurface & other) const {
+        return this->bitmap_id == other.bitmap_id;
+    }
+
+    size_t str(char * buffer, size_t sz) const {
+        size_t lg = (  (this->bitmap_id == ScreenBitmapSurface)
+                    ? snprintf(buffer, sz, "SwitchSurface(bitmapId=SCREEN_BITMAP_SURFACE)\n")
+                    : snprintf(buffer, sz, "SwitchSurface(bitmapId=%u)\n", this->bitmap_id));
+        if (lg >= sz) {
+            return sz;
+        }
+        return lg;
+    }
+
+    void log(int level) const {
+        char buffer[1024];
+        this->str(buffer, 1024);
+        LOG(level, buffer);
+    }
+
+    void print() const {
+        char buffer[1024];
+        this->str(buffer, 1024);
+        printf("%s", buffer);
+    }
+};  // class SwitchSurface
+
+}   // namespace RDP
+
+#endif  // #ifndef _REDEMPTION_CORE_RDP_ORDERS_RDPORDERSSECONDARYSWITCHSURFACE_HPP_
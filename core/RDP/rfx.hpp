@@ -0,0 +1,1140 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   RemoteFX codec ([MS-RDPRFX]), non progressive: the screen is cut in
+   64x64 tiles, each one converted to YCbCr, transformed by a 3 levels
+   DWT, quantized and RLGR encoded. Tiles are independent, they are
+   encoded on a pool of worker threads. Color conversion and DWT lifting
+   are computed with vector kernels, AVX2 when the CPU supports them.
+*/
+
+#ifndef _REDEMPTION_CORE_RDP_RFX_HPP_
+#define _REDEMPTION_CORE_RDP_RFX_HPP_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "stream.hpp"
+#include "rect.hpp"
+#include "log.hpp"
+#include "rop_kernels.hpp"
+#include "RDP/capabilities/bitmapcodecs.hpp"
+
+// 2.2.2 Encode Messages
+// =====================
+// A RemoteFX message is a sequence of blocks, all starting with
+// blockType (2 bytes) and blockLen (4 bytes, the size of the whole block).
+// Blocks of the codec channel then have codecId (1 byte, 0x01) and
+// channelId (1 byte).
+
+// TS_RFX_SYNC (WBT_SYNC): magic (4 bytes) WF_MAGIC, version (2 bytes)
+//  WF_VERSION_1_0.
+// TS_RFX_CODEC_VERSIONS (WBT_CODEC_VERSIONS): numCodecs (1 byte), then
+//  codecId (1 byte) and version (2 bytes) of each codec.
+// TS_RFX_CHANNELS (WBT_CHANNELS): numChannels (1 byte), then channelId
+//  (1 byte), width (2 bytes) and height (2 bytes) of each channel.
+// TS_RFX_CONTEXT (WBT_CONTEXT, channelId 0xFF): ctxId (1 byte), tileSize
+//  (2 bytes) CT_TILE_64x64, properties (2 bytes): flags (3 bits), cct
+//  (2 bits), xft (4 bits), et (4 bits), qt (2 bits).
+
+// Image mode needs these four blocks before each frame, they are sent in
+// every message.
+
+// TS_RFX_FRAME_BEGIN (WBT_FRAME_BEGIN): frameIdx (4 bytes), numRegions
+//  (2 bytes).
+// TS_RFX_REGION (WBT_REGION): regionFlags (1 byte), numRects (2 bytes),
+//  rects (x, y, width, height, 2 bytes each), regionType (2 bytes)
+//  CBT_REGION, numTilesets (2 bytes).
+// TS_RFX_TILESET (WBT_EXTENSION): subtype (2 bytes) CBT_TILESET, idx
+//  (2 bytes), properties (2 bytes): lt (1 bit), flags (3 bits), cct (2 bits),
+//  xft (4 bits), et (4 bits), qt (2 bits), numQuant (1 byte), tileSize
+//  (1 byte), numTiles (2 bytes), tilesDataSize (4 bytes), quantVals
+//  (5 bytes each), tiles.
+// TS_RFX_TILE (CBT_TILE): quantIdxY, quantIdxCb, quantIdxCr (1 byte each),
+//  xIdx, yIdx (2 bytes each), YLen, CbLen, CrLen (2 bytes each), then the
+//  RLGR encoded components.
+// TS_RFX_FRAME_END (WBT_FRAME_END)
+
+// TS_RFX_CODEC_QUANT: 10 quantization factors of 4 bits, LL3, LH3, HL3,
+// HH3, LH2, HL2, HH2, LH1, HL1, HH1, the first one in the low bits.
+
+namespace rfx {
+
+enum {
+    TILE_SIZE   = 64,
+    TILE_PIXELS = TILE_SIZE * TILE_SIZE
+};
+
+enum {
+    WBT_SYNC           = 0xCCC0,
+    WBT_CODEC_VERSIONS = 0xCCC1,
+    WBT_CHANNELS       = 0xCCC2,
+    WBT_CONTEXT        = 0xCCC3,
+    WBT_FRAME_BEGIN    = 0xCCC4,
+    WBT_FRAME_END      = 0xCCC5,
+    WBT_REGION         = 0xCCC6,
+    WBT_EXTENSION      = 0xCCC7,
+    CBT_REGION         = 0xCAC1,
+    CBT_TILESET        = 0xCAC2,
+    CBT_TILE           = 0xCAC3
+};
+
+enum {
+    WF_MAGIC            = 0xCACCACCA,
+    WF_VERSION_1_0      = 0x0100,
+    SCALAR_QUANTIZATION = 0x01
+};
+
+// Sizes of the blocks of a message with one region, one quant and one tileset.
+enum {
+    HEADERS_SIZE     = 12 + 10 + 12 + 13,  // sync, codec versions, channels, context
+    FRAME_SIZE       = 14 + 15 + 22 + 8,   // frame begin, region, tileset, frame end
+    QUANT_SIZE       = 5,
+    RECT_SIZE        = 8,
+    TILE_HEADER_SIZE = 19
+};
+
+struct Quant {
+    uint8_t values[10];  // LL3, LH3, HL3, HH3, LH2, HL2, HH2, LH1, HL1, HH1
+};
+
+inline Quant default_quant()
+{
+    return Quant{{6, 6, 6, 6, 7, 7, 8, 8, 8, 9}};
+}
+
+struct Params {
+    uint8_t entropy;  // CLW_ENTROPY_RLGR1 or CLW_ENTROPY_RLGR3
+    uint8_t flags;    // CODEC_MODE for image mode
+    Quant   quant;
+};
+
+typedef int16_t vec8i16 __attribute__((vector_size(16)));
+typedef int16_t vec16i16 __attribute__((vector_size(32)));
+typedef int32_t vec4i32 __attribute__((vector_size(16)));
+typedef int32_t vec8i32 __attribute__((vector_size(32)));
+
+// 3.1.8.1.3 Color Conversion
+// Y - 128, Cb and Cr of n pixels of Bpp bytes (B, G, R[, X]), with 5
+// fractional bits (11.5 fixed point, between -4096 and 4095).
+template<class V, size_t Bpp>
+inline void ycbcr_row(const uint8_t * src, size_t n, int16_t * y, int16_t * cb, int16_t * cr) noexcept
+{
+    enum { lanes = sizeof(V) / sizeof(int32_t) };
+    const size_t vector_end = n - n % lanes;
+    size_t x = 0;
+    for (; x != vector_end; x += lanes, src += lanes * Bpp) {
+        V b;
+        V g;
+        V r;
+        for (size_t i = 0; i < lanes; ++i) {
+            b[i] = src[i * Bpp];
+            g[i] = src[i * Bpp + 1];
+            r[i] = src[i * Bpp + 2];
+        }
+        const V vy = ((r * 9798 + g * 19235 + b * 3735 + 512) >> 10) - 4096;
+        const V vcb = (r * -5536 + g * -10868 + b * 16403 + 512) >> 10;
+        const V vcr = (r * 16378 + g * -13715 + b * -2663 + 512) >> 10;
+        for (size_t i = 0; i < lanes; ++i) {
+            y[x + i] = int16_t(vy[i]);
+            cb[x + i] = int16_t(vcb[i]);
+            cr[x + i] = int16_t(vcr[i]);
+        }
+    }
+    for (; x < n; ++x, src += Bpp) {
+        const int b = src[0];
+        const int g = src[1];
+        const int r = src[2];
+        y[x] = int16_t(((r * 9798 + g * 19235 + b * 3735 + 512) >> 10) - 4096);
+        cb[x] = int16_t((r * -5536 + g * -10868 + b * 16403 + 512) >> 10);
+        cr[x] = int16_t((r * 16378 + g * -13715 + b * -2663 + 512) >> 10);
+    }
+}
+
+// 3.1.8.1.4 DWT, lifting steps of the 5/3 wavelet on n coefficients:
+// h[i] = (odd[i] - (even[i] + even_next[i]) / 2) / 2
+template<class V>
+inline void lift_high( const int16_t * odd, const int16_t * even, const int16_t * even_next
+                     , int16_t * h, size_t n) noexcept
+{
+    enum { lanes = sizeof(V) / sizeof(int16_t) };
+    const size_t vector_end = n - n % lanes;
+    size_t i = 0;
+    for (; i != vector_end; i += lanes) {
+        V o;
+        V e;
+        V en;
+        memcpy(&o, odd + i, sizeof(V));
+        memcpy(&e, even + i, sizeof(V));
+        memcpy(&en, even_next + i, sizeof(V));
+        const V vh = (o - ((e + en) >> 1)) >> 1;
+        memcpy(h + i, &vh, sizeof(V));
+    }
+    for (; i < n; ++i) {
+        h[i] = int16_t((odd[i] - ((even[i] + even_next[i]) >> 1)) >> 1);
+    }
+}
+
+// l[i] = even[i] + (h_prev[i] + h[i]) / 2
+template<class V>
+inline void lift_low( const int16_t * even, const int16_t * h_prev, const int16_t * h
+                    , int16_t * l, size_t n) noexcept
+{
+    enum { lanes = sizeof(V) / sizeof(int16_t) };
+    const size_t vector_end = n - n % lanes;
+    size_t i = 0;
+    for (; i != vector_end; i += lanes) {
+        V e;
+        V hp;
+        V vh;
+        memcpy(&e, even + i, sizeof(V));
+        memcpy(&hp, h_prev + i, sizeof(V));
+        memcpy(&vh, h + i, sizeof(V));
+        const V vl = e + ((hp + vh) >> 1);
+        memcpy(l + i, &vl, sizeof(V));
+    }
+    for (; i < n; ++i) {
+        l[i] = int16_t(even[i] + ((h_prev[i] + h[i]) >> 1));
+    }
+}
+
+// One level on a block of 2 * half x 2 * half coefficients, replaced by
+// the HL, LH, HH and LL sub-bands of half x half coefficients, in this
+// order. The last even coefficient is mirrored past the end.
+template<class V>
+void dwt_block(int16_t * buffer, int16_t * tmp, size_t half) noexcept
+{
+    const size_t width = half * 2;
+
+    // vertical: rows of L then rows of H in tmp
+    for (size_t n = 0; n < half; ++n) {
+        const int16_t * even = buffer + 2 * n * width;
+        const int16_t * even_next = (n + 1 < half) ? even + 2 * width : even;
+        int16_t * h = tmp + (half + n) * width;
+        lift_high<V>(even + width, even, even_next, h, width);
+        lift_low<V>(even, n ? h - width : h, h, tmp + n * width, width);
+    }
+
+    // horizontal: L rows give HL and LL, H rows give HH and LH
+    int16_t even[TILE_SIZE / 2 + 1];
+    int16_t odd[TILE_SIZE / 2];
+    int16_t high[TILE_SIZE / 2 + 1];
+    const size_t band = half * half;
+    for (size_t row = 0; row < width; ++row) {
+        const int16_t * src = tmp + row * width;
+        for (size_t i = 0; i < half; ++i) {
+            even[i] = src[2 * i];
+            odd[i] = src[2 * i + 1];
+        }
+        even[half] = even[half - 1];
+
+        const bool low_row = row < half;
+        const size_t r = low_row ? row : row - half;
+        int16_t * h = buffer + (low_row ? 0 : 2 * band) + r * half;
+        int16_t * l = buffer + (low_row ? 3 * band : band) + r * half;
+        lift_high<V>(odd, even, even + 1, high + 1, half);
+        high[0] = high[1];
+        lift_low<V>(even, high, high + 1, l, half);
+        memcpy(h, high + 1, half * sizeof(int16_t));
+    }
+}
+
+template<class V>
+void dwt_2d(int16_t * buffer, int16_t * tmp) noexcept
+{
+    dwt_block<V>(buffer, tmp, 32);
+    dwt_block<V>(buffer + 3072, tmp, 16);
+    dwt_block<V>(buffer + 3840, tmp, 8);
+}
+
+#ifdef REDEMPTION_ROP_KERNELS_AVX2
+template<size_t Bpp>
+__attribute__((target("avx2")))
+void ycbcr_row_avx2(const uint8_t * src, size_t n, int16_t * y, int16_t * cb, int16_t * cr) noexcept
+{
+    ycbcr_row<vec8i32, Bpp>(src, n, y, cb, cr);
+}
+
+__attribute__((target("avx2")))
+inline void dwt_2d_avx2(int16_t * buffer, int16_t * tmp) noexcept
+{
+    dwt_2d<vec16i16>(buffer, tmp);
+}
+#endif
+
+template<size_t Bpp>
+void ycbcr(const uint8_t * src, size_t n, int16_t * y, int16_t * cb, int16_t * cr) noexcept
+{
+#ifdef REDEMPTION_ROP_KERNELS_AVX2
+    if (n >= 8 && rop_kernels::has_avx2()) {
+        ycbcr_row_avx2<Bpp>(src, n, y, cb, cr);
+        return;
+    }
+#endif
+    ycbcr_row<vec4i32, Bpp>(src, n, y, cb, cr);
+}
+
+// Sub-bands of a 64x64 tile of coefficients: HL1, LH1, HH1, HL2, LH2,
+// HH2, HL3, LH3, HH3 and LL3. tmp has room for TILE_PIXELS coefficients.
+inline void dwt_2d_encode(int16_t * buffer, int16_t * tmp) noexcept
+{
+#ifdef REDEMPTION_ROP_KERNELS_AVX2
+    if (rop_kernels::has_avx2()) {
+        dwt_2d_avx2(buffer, tmp);
+        return;
+    }
+#endif
+    dwt_2d<vec8i16>(buffer, tmp);
+}
+
+// One level of inverse DWT, block laid out as by dwt_block.
+inline void idwt_block(int16_t * buffer, int16_t * tmp, size_t half) noexcept
+{
+    const size_t width = half * 2;
+    const size_t band = half * half;
+
+    // horizontal: LL and HL give L rows, LH and HH give H rows
+    for (size_t row = 0; row < width; ++row) {
+        const bool low_row = row < half;
+        const size_t r = low_row ? row : row - half;
+        const int16_t * h = buffer + (low_row ? 0 : 2 * band) + r * half;
+        const int16_t * l = buffer + (low_row ? 3 * band : band) + r * half;
+        int16_t * dst = tmp + row * width;
+        for (size_t i = 0; i < half; ++i) {
+            dst[2 * i] = int16_t(l[i] - ((h[i ? i - 1 : 0] + h[i]) >> 1));
+        }
+        for (size_t i = 0; i < half; ++i) {
+            const int even_next = dst[(i + 1 < half) ? 2 * i + 2 : 2 * i];
+            dst[2 * i + 1] = int16_t((h[i] << 1) + ((dst[2 * i] + even_next) >> 1));
+        }
+    }
+
+    // vertical
+    for (size_t x = 0; x < width; ++x) {
+        for (size_t n = 0; n < half; ++n) {
+            const int h = tmp[(half + n) * width + x];
+            const int h_prev = tmp[(half + (n ? n - 1 : 0)) * width + x];
+            buffer[2 * n * width + x] = int16_t(tmp[n * width + x] - ((h_prev + h) >> 1));
+        }
+        for (size_t n = 0; n < half; ++n) {
+            const int h = tmp[(half + n) * width + x];
+            const int even = buffer[2 * n * width + x];
+            const int even_next = buffer[((n + 1 < half) ? 2 * n + 2 : 2 * n) * width + x];
+            buffer[(2 * n + 1) * width + x] = int16_t((h << 1) + ((even + even_next) >> 1));
+        }
+    }
+}
+
+inline void dwt_2d_decode(int16_t * buffer, int16_t * tmp) noexcept
+{
+    idwt_block(buffer + 3840, tmp, 8);
+    idwt_block(buffer + 3072, tmp, 16);
+    idwt_block(buffer, tmp, 32);
+}
+
+// 3.1.8.1.5 Quantization
+// offset and size of each sub-band, and index of its factor in Quant
+struct SubBand {
+    uint16_t offset;
+    uint16_t size;
+    uint8_t  quant_index;
+};
+
+static const SubBand sub_bands[10] = {
+    {0, 1024, 8}, {1024, 1024, 7}, {2048, 1024, 9},  // HL1, LH1, HH1
+    {3072, 256, 5}, {3328, 256, 4}, {3584, 256, 6},  // HL2, LH2, HH2
+    {3840, 64, 2}, {3904, 64, 1}, {3968, 64, 3},     // HL3, LH3, HH3
+    {4032, 64, 0}                                    // LL3
+};
+
+// Coefficients keep the 5 fractional bits of the color conversion, a
+// factor q divides them by 2^(q - 1) as the decoder multiplies them by
+// 2^(q - 1) before the inverse DWT.
+inline void quantize(int16_t * buffer, Quant const & quant) noexcept
+{
+    for (SubBand const & sub_band : sub_bands) {
+        const int shift = quant.values[sub_band.quant_index] - 1;
+        if (shift <= 0) {
+            continue;
+        }
+        const int half = 1 << (shift - 1);
+        int16_t * p = buffer + sub_band.offset;
+        for (size_t i = 0; i < sub_band.size; ++i) {
+            p[i] = int16_t((p[i] + half) >> shift);
+        }
+    }
+}
+
+inline void dequantize(int16_t * buffer, Quant const & quant) noexcept
+{
+    for (SubBand const & sub_band : sub_bands) {
+        const int shift = quant.values[sub_band.quant_index] - 1;
+        if (shift <= 0) {
+            continue;
+        }
+        int16_t * p = buffer + sub_band.offset;
+        for (size_t i = 0; i < sub_band.size; ++i) {
+            p[i] = int16_t(p[i] * (1 << shift));
+        }
+    }
+}
+
+// 3.1.8.1.6 The LL3 sub-band is differentially encoded.
+inline void differential_encode(int16_t * buffer) noexcept
+{
+    int16_t * ll3 = buffer + 4032;
+    for (size_t i = 63; i > 0; --i) {
+        ll3[i] = int16_t(ll3[i] - ll3[i - 1]);
+    }
+}
+
+inline void differential_decode(int16_t * buffer) noexcept
+{
+    int16_t * ll3 = buffer + 4032;
+    for (size_t i = 1; i < 64; ++i) {
+        ll3[i] = int16_t(ll3[i] + ll3[i - 1]);
+    }
+}
+
+// 3.1.8.1.7 RLGR entropy coding
+enum {
+    KPMAX = 80,
+    LSGR  = 3,
+    UP_GR = 4,
+    DN_GR = 6,
+    UQ_GR = 3,
+    DQ_GR = 3
+};
+
+inline void update_param(int & param, int delta, int & k) noexcept
+{
+    param += delta;
+    if (param > KPMAX) {
+        param = KPMAX;
+    }
+    if (param < 0) {
+        param = 0;
+    }
+    k = param >> LSGR;
+}
+
+// most significant bit first
+class BitWriter
+{
+    std::vector<uint8_t> & out;
+    uint64_t acc;
+    unsigned nbits;
+
+public:
+    explicit BitWriter(std::vector<uint8_t> & out)
+    : out(out)
+    , acc(0)
+    , nbits(0)
+    {}
+
+    // n <= 32
+    void put(uint32_t value, unsigned n)
+    {
+        this->acc = (this->acc << n) | (value & ((uint64_t(1) << n) - 1));
+        this->nbits += n;
+        while (this->nbits >= 8) {
+            this->nbits -= 8;
+            this->out.push_back(uint8_t(this->acc >> this->nbits));
+        }
+    }
+
+    void put_ones(size_t n)
+    {
+        for (; n >= 32; n -= 32) {
+            this->put(0xFFFFFFFF, 32);
+        }
+        this->put(0xFFFFFFFF, n);
+    }
+
+    void flush()
+    {
+        if (this->nbits) {
+            this->out.push_back(uint8_t(this->acc << (8 - this->nbits)));
+            this->nbits = 0;
+        }
+    }
+};
+
+class BitReader
+{
+    const uint8_t * p;
+    const uint8_t * end;
+    unsigned bit;
+
+public:
+    bool overrun;
+
+    BitReader(const uint8_t * data, size_t size)
+    : p(data)
+    , end(data + size)
+    , bit(0)
+    , overrun(false)
+    {}
+
+    uint32_t get(unsigned n)
+    {
+        uint32_t value = 0;
+        for (; n; --n) {
+            if (this->p == this->end) {
+                this->overrun = true;
+                return value;
+            }
+            value = (value << 1) | ((*this->p >> (7 - this->bit)) & 1);
+            if (++this->bit == 8) {
+                this->bit = 0;
+                ++this->p;
+            }
+        }
+        return value;
+    }
+};
+
+// Golomb-Rice code of val with the adaptive parameter krp
+inline void code_gr(BitWriter & bits, int & krp, uint32_t val)
+{
+    int kr = krp >> LSGR;
+    const uint32_t vk = val >> kr;
+    bits.put_ones(vk);
+    bits.put(0, 1);
+    if (kr) {
+        bits.put(val & ((1u << kr) - 1), kr);
+    }
+    if (vk == 0) {
+        update_param(krp, -2, kr);
+    }
+    else if (vk > 1) {
+        update_param(krp, vk, kr);
+    }
+}
+
+inline uint32_t get_gr(BitReader & bits, int & krp)
+{
+    int kr = krp >> LSGR;
+    uint32_t vk = 0;
+    while (bits.get(1) && !bits.overrun) {
+        ++vk;
+    }
+    const uint32_t val = kr ? (vk << kr) | bits.get(kr) : vk;
+    if (vk == 0) {
+        update_param(krp, -2, kr);
+    }
+    else if (vk > 1) {
+        update_param(krp, vk, kr);
+    }
+    return val;
+}
+
+inline uint32_t two_mag_sign(int value) noexcept
+{
+    return value >= 0 ? 2 * value : -2 * value - 1;
+}
+
+inline int16_t from_two_mag_sign(uint32_t value) noexcept
+{
+    return int16_t((value & 1) ? -int((value + 1) >> 1) : int(value >> 1));
+}
+
+inline unsigned min_bits(uint32_t value) noexcept
+{
+    unsigned n = 0;
+    for (; value; value >>= 1) {
+        ++n;
+    }
+    return n;
+}
+
+// Appends the RLGR1 or RLGR3 (entropy is CLW_ENTROPY_RLGR*) code of n
+// coefficients to out.
+inline void rlgr_encode(uint8_t entropy, const int16_t * data, size_t n, std::vector<uint8_t> & out)
+{
+    BitWriter bits(out);
+    int k = 1;
+    int kp = k << LSGR;
+    int krp = 1 << LSGR;
+
+    size_t i = 0;
+    while (i < n) {
+        if (k) {
+            // run mode: a run of zeros then a non zero value
+            size_t zeros = 0;
+            while (i < n && data[i] == 0) {
+                ++zeros;
+                ++i;
+            }
+            size_t run = size_t(1) << k;
+            while (zeros >= run) {
+                bits.put(0, 1);
+                zeros -= run;
+                update_param(kp, UP_GR, k);
+                run = size_t(1) << k;
+            }
+            bits.put(1, 1);
+            bits.put(zeros, k);
+
+            // a run up to the end is followed by a value past the end the
+            // decoder drops, clients expect these bits
+            const int value = (i < n) ? data[i++] : 0;
+            const uint32_t mag = value < 0 ? -value : value;
+            bits.put(value < 0 ? 1 : 0, 1);
+            code_gr(bits, krp, mag ? mag - 1 : 0);
+            update_param(kp, -DN_GR, k);
+        }
+        else if (entropy == CLW_ENTROPY_RLGR1) {
+            const uint32_t two_ms = two_mag_sign(data[i++]);
+            code_gr(bits, krp, two_ms);
+            if (two_ms == 0) {
+                update_param(kp, UP_GR, k);
+            }
+            else {
+                update_param(kp, -DQ_GR, k);
+            }
+        }
+        else {
+            // RLGR3: two values, their sum then the bits of the first one
+            const uint32_t two_ms1 = two_mag_sign(data[i++]);
+            const uint32_t two_ms2 = (i < n) ? two_mag_sign(data[i++]) : 0;
+            const uint32_t sum = two_ms1 + two_ms2;
+            code_gr(bits, krp, sum);
+            bits.put(two_ms1, min_bits(sum));
+            if (two_ms1 && two_ms2) {
+                update_param(kp, -2 * DQ_GR, k);
+            }
+            else if (!two_ms1 && !two_ms2) {
+                update_param(kp, 2 * UQ_GR, k);
+            }
+        }
+    }
+    bits.flush();
+}
+
+inline bool rlgr_decode(uint8_t entropy, const uint8_t * in, size_t size, int16_t * data, size_t n)
+{
+    BitReader bits(in, size);
+    int k = 1;
+    int kp = k << LSGR;
+    int krp = 1 << LSGR;
+
+    size_t i = 0;
+    while (i < n && !bits.overrun) {
+        if (k) {
+            size_t zeros = 0;
+            while (!bits.get(1) && !bits.overrun) {
+                zeros += size_t(1) << k;
+                update_param(kp, UP_GR, k);
+            }
+            zeros += bits.get(k);
+            const bool negative = bits.get(1);
+            const int mag = int(get_gr(bits, krp)) + 1;
+            if (zeros > n - i) {
+                return false;
+            }
+            memset(data + i, 0, zeros * sizeof(int16_t));
+            i += zeros;
+            if (i < n) {
+                data[i++] = int16_t(negative ? -mag : mag);
+            }
+            update_param(kp, -DN_GR, k);
+        }
+        else if (entropy == CLW_ENTROPY_RLGR1) {
+            const uint32_t two_ms = get_gr(bits, krp);
+            data[i++] = from_two_mag_sign(two_ms);
+            if (two_ms == 0) {
+                update_param(kp, UP_GR, k);
+            }
+            else {
+                update_param(kp, -DQ_GR, k);
+            }
+        }
+        else {
+            const uint32_t sum = get_gr(bits, krp);
+            const uint32_t two_ms1 = bits.get(min_bits(sum));
+            if (two_ms1 > sum) {
+                return false;
+            }
+            const uint32_t two_ms2 = sum - two_ms1;
+            data[i++] = from_two_mag_sign(two_ms1);
+            if (i < n) {
+                data[i++] = from_two_mag_sign(two_ms2);
+            }
+            if (two_ms1 && two_ms2) {
+                update_param(kp, -2 * DQ_GR, k);
+            }
+            else if (!two_ms1 && !two_ms2) {
+                update_param(kp, 2 * UQ_GR, k);
+            }
+        }
+    }
+    return i == n && !bits.overrun;
+}
+
+struct Tile {
+    uint16_t x_idx;
+    uint16_t y_idx;
+    uint16_t component_lengths[3];  // Y, Cb, Cr
+    std::vector<uint8_t> data;
+
+    Tile()
+    : x_idx(0)
+    , y_idx(0)
+    , component_lengths{0, 0, 0}
+    {}
+};
+
+// Pixels of a tile, at (x, y) in the tile. The tile is completed by
+// replicating the border pixels, clients only draw the region rects.
+struct TileSource {
+    const uint8_t * first_row;
+    uint16_t x;
+    uint16_t y;
+    uint16_t cx;
+    uint16_t cy;
+    uint16_t x_idx;
+    uint16_t y_idx;
+};
+
+template<size_t Bpp>
+void tile_to_ycbcr( TileSource const & source, ptrdiff_t row_step
+                  , int16_t * y, int16_t * cb, int16_t * cr) noexcept
+{
+    int16_t * planes[3] = { y, cb, cr };
+    const uint8_t * row = source.first_row;
+    for (uint16_t line = source.y; line < source.y + source.cy; ++line, row += row_step) {
+        const size_t offset = line * TILE_SIZE;
+        ycbcr<Bpp>(row, source.cx, y + offset + source.x, cb + offset + source.x, cr + offset + source.x);
+        for (int16_t * plane : planes) {
+            int16_t * p = plane + offset;
+            for (uint16_t x = 0; x < source.x; ++x) {
+                p[x] = p[source.x];
+            }
+            for (uint16_t x = source.x + source.cx; x < TILE_SIZE; ++x) {
+                p[x] = p[source.x + source.cx - 1];
+            }
+        }
+    }
+    for (int16_t * plane : planes) {
+        for (uint16_t line = 0; line < source.y; ++line) {
+            memcpy(plane + line * TILE_SIZE, plane + source.y * TILE_SIZE, TILE_SIZE * sizeof(int16_t));
+        }
+        const int16_t * last = plane + (source.y + source.cy - 1) * TILE_SIZE;
+        for (uint16_t line = source.y + source.cy; line < TILE_SIZE; ++line) {
+            memcpy(plane + line * TILE_SIZE, last, TILE_SIZE * sizeof(int16_t));
+        }
+    }
+}
+
+// false when a component does not fit in 64K
+inline bool encode_tile( TileSource const & source, ptrdiff_t row_step, uint8_t Bpp
+                       , Params const & params, Tile & tile)
+{
+    int16_t planes[3][TILE_PIXELS];
+    int16_t tmp[TILE_PIXELS];
+    if (Bpp == 4) {
+        tile_to_ycbcr<4>(source, row_step, planes[0], planes[1], planes[2]);
+    }
+    else {
+        tile_to_ycbcr<3>(source, row_step, planes[0], planes[1], planes[2]);
+    }
+
+    tile.x_idx = source.x_idx;
+    tile.y_idx = source.y_idx;
+    tile.data.clear();
+    for (size_t i = 0; i < 3; ++i) {
+        dwt_2d_encode(planes[i], tmp);
+        quantize(planes[i], params.quant);
+        differential_encode(planes[i]);
+        const size_t start = tile.data.size();
+        rlgr_encode(params.entropy, planes[i], TILE_PIXELS, tile.data);
+        if (tile.data.size() - start > 0xFFFF) {
+            return false;
+        }
+        tile.component_lengths[i] = tile.data.size() - start;
+    }
+    return true;
+}
+
+// Decodes the components of a tile to 64x64 pixels of 24 bpp (B, G, R).
+inline bool decode_tile( const uint8_t * data, const uint16_t (&component_lengths)[3]
+                       , uint8_t entropy, Quant const & quant, uint8_t * dest)
+{
+    int16_t planes[3][TILE_PIXELS];
+    int16_t tmp[TILE_PIXELS];
+    for (size_t i = 0; i < 3; ++i) {
+        if (!rlgr_decode(entropy, data, component_lengths[i], planes[i], TILE_PIXELS)) {
+            return false;
+        }
+        data += component_lengths[i];
+        differential_decode(planes[i]);
+        dequantize(planes[i], quant);
+        dwt_2d_decode(planes[i], tmp);
+    }
+
+    auto clamp = [](int v) { return uint8_t(v < 0 ? 0 : v > 255 ? 255 : v); };
+    for (size_t i = 0; i < TILE_PIXELS; ++i, dest += 3) {
+        const int y = planes[0][i] + 4096;
+        const int cb = planes[1][i];
+        const int cr = planes[2][i];
+        dest[0] = clamp((y * 32768 + cb * 57996 + (16 << 15)) >> 20);
+        dest[1] = clamp((y * 32768 - cb * 11263 - cr * 23410 + (16 << 15)) >> 20);
+        dest[2] = clamp((y * 32768 + cr * 45958 + (16 << 15)) >> 20);
+    }
+    return true;
+}
+
+inline void emit_quant(Stream & out, Quant const & quant)
+{
+    for (size_t i = 0; i < 10; i += 2) {
+        out.out_uint8(quant.values[i] | (quant.values[i + 1] << 4));
+    }
+}
+
+// Sync, codec versions, channels and context blocks for a channel of
+// width x height pixels.
+inline void emit_headers(Stream & out, uint16_t width, uint16_t height, Params const & params)
+{
+    out.out_uint16_le(WBT_SYNC);
+    out.out_uint32_le(12);
+    out.out_uint32_le(WF_MAGIC);
+    out.out_uint16_le(WF_VERSION_1_0);
+
+    out.out_uint16_le(WBT_CODEC_VERSIONS);
+    out.out_uint32_le(10);
+    out.out_uint8(1);       /* numCodecs */
+    out.out_uint8(1);       /* codecId */
+    out.out_uint16_le(WF_VERSION_1_0);
+
+    out.out_uint16_le(WBT_CHANNELS);
+    out.out_uint32_le(12);
+    out.out_uint8(1);       /* numChannels */
+    out.out_uint8(0);       /* channelId */
+    out.out_uint16_le(width);
+    out.out_uint16_le(height);
+
+    out.out_uint16_le(WBT_CONTEXT);
+    out.out_uint32_le(13);
+    out.out_uint8(1);       /* codecId */
+    out.out_uint8(0xFF);    /* channelId */
+    out.out_uint8(0);       /* ctxId */
+    out.out_uint16_le(CT_TILE_64X64);
+    out.out_uint16_le( (params.flags & 0x07)
+                     | (CLW_COL_CONV_ICT << 3)
+                     | (CLW_XFORM_DWT_53_A << 5)
+                     | (params.entropy << 9)
+                     | (SCALAR_QUANTIZATION << 13));
+}
+
+// A frame of one region made of rects, with one tileset of tiles all
+// using the quant of params.
+inline void emit_frame( Stream & out, uint32_t frame_idx, const Rect * rects, size_t nb_rects
+                      , const Tile * const * tiles, size_t nb_tiles, Params const & params)
+{
+    out.out_uint16_le(WBT_FRAME_BEGIN);
+    out.out_uint32_le(14);
+    out.out_uint8(1);       /* codecId */
+    out.out_uint8(0);       /* channelId */
+    out.out_uint32_le(frame_idx);
+    out.out_uint16_le(1);   /* numRegions */
+
+    out.out_uint16_le(WBT_REGION);
+    out.out_uint32_le(15 + nb_rects * RECT_SIZE);
+    out.out_uint8(1);       /* codecId */
+    out.out_uint8(0);       /* channelId */
+    out.out_uint8(1);       /* regionFlags */
+    out.out_uint16_le(nb_rects);
+    for (size_t i = 0; i < nb_rects; ++i) {
+        out.out_uint16_le(rects[i].x);
+        out.out_uint16_le(rects[i].y);
+        out.out_uint16_le(rects[i].cx);
+        out.out_uint16_le(rects[i].cy);
+    }
+    out.out_uint16_le(CBT_REGION);
+    out.out_uint16_le(1);   /* numTilesets */
+
+    size_t tiles_size = 0;
+    for (size_t i = 0; i < nb_tiles; ++i) {
+        tiles_size += TILE_HEADER_SIZE + tiles[i]->data.size();
+    }
+    out.out_uint16_le(WBT_EXTENSION);
+    out.out_uint32_le(22 + QUANT_SIZE + tiles_size);
+    out.out_uint8(1);       /* codecId */
+    out.out_uint8(0);       /* channelId */
+    out.out_uint16_le(CBT_TILESET);
+    out.out_uint16_le(0);   /* idx */
+    out.out_uint16_le( 1    /* lt */
+                     | ((params.flags & 0x07) << 1)
+                     | (CLW_COL_CONV_ICT << 4)
+                     | (CLW_XFORM_DWT_53_A << 6)
+                     | (params.entropy << 10)
+                     | (SCALAR_QUANTIZATION << 14));
+    out.out_uint8(1);       /* numQuant */
+    out.out_uint8(CT_TILE_64X64);
+    out.out_uint16_le(nb_tiles);
+    out.out_uint32_le(tiles_size);
+    emit_quant(out, params.quant);
+    for (size_t i = 0; i < nb_tiles; ++i) {
+        const Tile & tile = *tiles[i];
+        out.out_uint16_le(CBT_TILE);
+        out.out_uint32_le(TILE_HEADER_SIZE + tile.data.size());
+        out.out_uint8(0);   /* quantIdxY */
+        out.out_uint8(0);   /* quantIdxCb */
+        out.out_uint8(0);   /* quantIdxCr */
+        out.out_uint16_le(tile.x_idx);
+        out.out_uint16_le(tile.y_idx);
+        out.out_uint16_le(tile.component_lengths[0]);
+        out.out_uint16_le(tile.component_lengths[1]);
+        out.out_uint16_le(tile.component_lengths[2]);
+        out.out_copy_bytes(tile.data.data(), tile.data.size());
+    }
+
+    out.out_uint16_le(WBT_FRAME_END);
+    out.out_uint32_le(8);
+    out.out_uint8(1);       /* codecId */
+    out.out_uint8(0);       /* channelId */
+}
+
+// Runs tasks on worker threads and on the calling thread. Threads are
+// started once and wait for the next batch.
+class Workers
+{
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t)> * task;
+    size_t next;
+    size_t count;
+    size_t running;
+    bool stop;
+
+    // mutex is locked
+    void work(std::unique_lock<std::mutex> & lock)
+    {
+        while (this->task && this->next < this->count) {
+            const std::function<void(size_t)> & task = *this->task;
+            const size_t i = this->next++;
+            ++this->running;
+            lock.unlock();
+            task(i);
+            lock.lock();
+            if (--this->running == 0 && this->next == this->count) {
+                this->done.notify_all();
+            }
+        }
+    }
+
+    void worker()
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        for (;;) {
+            this->wake.wait(lock, [this]{
+                return this->stop || (this->task && this->next < this->count);
+            });
+            if (this->stop) {
+                return;
+            }
+            this->work(lock);
+        }
+    }
+
+public:
+    Workers()
+    : task(nullptr)
+    , next(0)
+    , count(0)
+    , running(0)
+    , stop(false)
+    {}
+
+    Workers(Workers const &) = delete;
+    Workers & operator=(Workers const &) = delete;
+
+    ~Workers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stop = true;
+        }
+        this->wake.notify_all();
+        for (std::thread & t : this->threads) {
+            t.join();
+        }
+    }
+
+    // nb_threads counts the calling thread
+    void start(unsigned nb_threads)
+    {
+        while (this->threads.size() + 1 < nb_threads) {
+            try {
+                this->threads.emplace_back(&Workers::worker, this);
+            }
+            catch (const std::system_error &) {
+                LOG(LOG_WARNING, "rfx::Workers: failed to start encoder thread");
+                break;
+            }
+        }
+    }
+
+    size_t size() const
+    { return this->threads.size() + 1; }
+
+    // task(i) for i in [0, count), task must not throw
+    void run(size_t count, std::function<void(size_t)> const & task)
+    {
+        if (this->threads.empty() || count < 2) {
+            for (size_t i = 0; i < count; ++i) {
+                task(i);
+            }
+            return;
+        }
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->task = &task;
+        this->next = 0;
+        this->count = count;
+        this->wake.notify_all();
+        this->work(lock);
+        this->done.wait(lock, [this]{ return this->running == 0; });
+        this->task = nullptr;
+    }
+};
+
+class Encoder
+{
+    Workers workers;
+    std::vector<Tile> tiles;
+
+public:
+    Params params;
+
+    Encoder()
+    : params{CLW_ENTROPY_RLGR3, 0, default_quant()}
+    {}
+
+    void start_workers(unsigned nb_threads)
+    {
+        this->workers.start(nb_threads);
+    }
+
+    // Encodes a tile for each source, sources share row_step and Bpp (3 or 4).
+    // false when a tile could not be encoded.
+    bool encode(const TileSource * sources, size_t count, ptrdiff_t row_step, uint8_t Bpp)
+    {
+        if (this->tiles.size() < count) {
+            this->tiles.resize(count);
+        }
+        bool failed = false;
+        std::mutex failed_mutex;
+        const std::function<void(size_t)> task = [&](size_t i) {
+            bool ok;
+            try {
+                ok = encode_tile(sources[i], row_step, Bpp, this->params, this->tiles[i]);
+            }
+            catch (const std::exception &) {
+                ok = false;
+            }
+            if (!ok) {
+                std::lock_guard<std::mutex> lock(failed_mutex);
+                failed = true;
+            }
+        };
+        this->workers.run(count, task);
+        return !failed;
+    }
+
+    Tile const & tile(size_t i) const
+    { return this->tiles[i]; }
+};
+
+// Hash of the pixels last sent in each tile of the screen, with the rect
+// they cover in the tile. 0 is an unknown tile.
+class TileCache
+{
+    uint16_t columns;
+    uint16_t rows;
+    std::vector<uint64_t> hashes;
+
+public:
+    TileCache()
+    : columns(0)
+    , rows(0)
+    {}
+
+    void reset(uint16_t width, uint16_t height)
+    {
+        this->columns = (width + TILE_SIZE - 1) / TILE_SIZE;
+        this->rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+        this->hashes.assign(size_t(this->columns) * this->rows, 0);
+    }
+
+    void clear()
+    {
+        this->hashes.assign(this->hashes.size(), 0);
+    }
+
+    bool contains(uint16_t x_idx, uint16_t y_idx, uint64_t hash) const
+    {
+        return x_idx < this->columns && y_idx < this->rows
+            && this->hashes[size_t(y_idx) * this->columns + x_idx] == hash;
+    }
+
+    void set(uint16_t x_idx, uint16_t y_idx, uint64_t hash)
+    {
+        if (x_idx < this->columns && y_idx < this->rows) {
+            this->hashes[size_t(y_idx) * this->columns + x_idx] = hash;
+        }
+    }
+};
+
+// cy rows of row_size bytes and the rect they cover, never 0
+inline uint64_t tile_hash(const uint8_t * first_row, ptrdiff_t row_step, size_t row_size, uint16_t cy, Rect const & rect)
+{
+    const uint64_t prime = 0x9E3779B97F4A7C15ull;
+    uint64_t h = (uint64_t(uint16_t(rect.x)) << 48) | (uint64_t(uint16_t(rect.y)) << 32)
+               | (uint64_t(rect.cx) << 16) | rect.cy;
+    h *= prime;
+    const uint8_t * row = first_row;
+    for (uint16_t line = 0; line < cy; ++line, row += row_step) {
+        size_t i = 0;
+        for (; i + 8 <= row_size; i += 8) {
+            uint64_t word;
+            memcpy(&word, row + i, 8);
+            h = (h ^ word) * prime;
+            h ^= h >> 29;
+        }
+        for (; i < row_size; ++i) {
+            h = (h ^ row[i]) * prime;
+        }
+    }
+    return h ? h : 1;
+}
+
+}
+
+#endif
@@ -0,0 +1,203 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   RDP Surface Commands ([MS-RDPBCGR] section 2.2.9.2)
+*/
+
+#ifndef _REDEMPTION_CORE_RDP_SURFACE_COMMANDS_HPP_
+#define _REDEMPTION_CORE_RDP_SURFACE_COMMANDS_HPP_
+
+#include "stream.hpp"
+#include "error.hpp"
+#include "log.hpp"
+
+// 2.2.9.1.2.1.10 Fast-Path Surface Commands Update (TS_FP_SURFCMDS)
+// =================================================================
+// updateHeader (1 byte): the updateCode is FASTPATH_UPDATETYPE_SURFCMDS (0x4).
+// surfaceCommands (variable): An array of Set Surface Bits, Stream Surface
+//  Bits or Frame Marker commands. Surface commands are only sent in fast-path
+//  updates.
+
+// 2.2.9.2.1 Set Surface Bits Command (TS_SURFCMD_SET_SURF_BITS)
+// =============================================================
+// The Set Surface Bits Command is used to transport encoded bitmap data
+// destined for a rectangular region of the current target surface.
+
+// cmdType (2 bytes): A 16-bit, unsigned integer. This field MUST be set to
+//  CMDTYPE_SET_SURFACE_BITS (0x0001).
+
+// destLeft (2 bytes): A 16-bit, unsigned integer. Left bound of the
+//  destination rectangle.
+
+// destTop (2 bytes): A 16-bit, unsigned integer. Top bound of the destination
+//  rectangle.
+
+// destRight (2 bytes): A 16-bit, unsigned integer. Right bound of the
+//  destination rectangle (exclusive).
+
+// destBottom (2 bytes): A 16-bit, unsigned integer. Bottom bound of the
+//  destination rectangle (exclusive).
+
+// bitmapData (variable): An Extended Bitmap Data (TS_BITMAP_DATA_EX) structure.
+
+// 2.2.9.2.1.1 Extended Bitmap Data (TS_BITMAP_DATA_EX)
+// ====================================================
+
+// bpp (1 byte): An 8-bit, unsigned integer. The color depth of the bitmap
+//  data in bits-per-pixel.
+
+// flags (1 byte): An 8-bit, unsigned integer. EX_COMPRESSED_BITMAP_HEADER_PRESENT
+//  (0x01) when exBitmapDataHeader is present.
+
+// reserved (1 byte)
+
+// codecID (1 byte): An 8-bit, unsigned integer. The client-assigned ID that
+//  identifies the bitmap codec that was used to encode the bitmap data
+//  (Bitmap Codecs Capability Set, section 2.2.7.2.10).
+
+// width (2 bytes), height (2 bytes): size of the bitmap in pixels.
+
+// bitmapDataLength (4 bytes): A 32-bit, unsigned integer. The size in bytes
+//  of the bitmapData field.
+
+// exBitmapDataHeader (24 bytes): optional, not used by the server.
+
+// bitmapData (variable): The encoded bitmap data.
+
+// 2.2.9.2.3 Frame Marker Command (TS_FRAME_MARKER)
+// ================================================
+// cmdType (2 bytes): CMDTYPE_FRAME_MARKER (0x0004).
+// frameAction (2 bytes): SURFACECMD_FRAMEACTION_BEGIN (0x0000) or
+//  SURFACECMD_FRAMEACTION_END (0x0001).
+// frameId (4 bytes): A 32-bit, unsigned integer. The ID of the frame.
+
+enum {
+    CMDTYPE_SET_SURFACE_BITS    = 0x0001,
+    CMDTYPE_FRAME_MARKER        = 0x0004,
+    CMDTYPE_STREAM_SURFACE_BITS = 0x0006
+};
+
+enum {
+    EX_COMPRESSED_BITMAP_HEADER_PRESENT = 0x01
+};
+
+struct RDPSetSurfaceBits {
+    uint16_t dest_left;
+    uint16_t dest_top;
+    uint16_t dest_right;
+    uint16_t dest_bottom;
+    uint8_t  bpp;
+    uint8_t  flags;
+    uint8_t  codec_id;
+    uint16_t width;
+    uint16_t height;
+    uint32_t bitmap_data_length;
+
+    RDPSetSurfaceBits()
+    : dest_left(0)
+    , dest_top(0)
+    , dest_right(0)
+    , dest_bottom(0)
+    , bpp(0)
+    , flags(0)
+    , codec_id(0)
+    , width(0)
+    , height(0)
+    , bitmap_data_length(0) {
+    }
+
+    // the bitmap data follows
+    void emit(Stream & stream) const {
+        const unsigned expected = 22; /* cmdType(2) + destLeft(2) + destTop(2) + destRight(2) +
+                                         destBottom(2) + bpp(1) + flags(1) + reserved(1) +
+                                         codecID(1) + width(2) + height(2) + bitmapDataLength(4) */
+        if (!stream.has_room(expected)) {
+            LOG( LOG_ERR
+               , "SetSurfaceBits::emit - stream too small, need=%u, remains=%u"
+               , expected
+               , static_cast<unsigned>(stream.tailroom()));
+            throw Error(ERR_STREAM_MEMORY_TOO_SMALL);
+        }
+
+        stream.out_uint16_le(CMDTYPE_SET_SURFACE_BITS);
+        stream.out_uint16_le(this->dest_left);
+        stream.out_uint16_le(this->dest_top);
+        stream.out_uint16_le(this->dest_right);
+        stream.out_uint16_le(this->dest_bottom);
+        stream.out_uint8(this->bpp);
+        stream.out_uint8(this->flags);
+        stream.out_uint8(0);    /* reserved */
+        stream.out_uint8(this->codec_id);
+        stream.out_uint16_le(this->width);
+        stream.out_uint16_le(this->height);
+        stream.out_uint32_le(this->bitmap_data_length);
+    }
+
+    // cmdType already read, the stream is left on the bitmap data
+    void receive(Stream & stream) {
+        const unsigned expected = 20; /* destLeft(2) + destTop(2) + destRight(2) + destBottom(2) +
+                                         bpp(1) + flags(1) + reserved(1) + codecID(1) + width(2) +
+                                         height(2) + bitmapDataLength(4) */
+        if (!stream.in_check_rem(expected)) {
+            LOG( LOG_ERR
+               , "SetSurfaceBits::receive - Truncated data, need=%u, remains=%u"
+               , expected, stream.in_remain());
+            throw Error(ERR_RDP_DATA_TRUNCATED);
+        }
+
+        this->dest_left          = stream.in_uint16_le();
+        this->dest_top           = stream.in_uint16_le();
+        this->dest_right         = stream.in_uint16_le();
+        this->dest_bottom        = stream.in_uint16_le();
+        this->bpp                = stream.in_uint8();
+        this->flags              = stream.in_uint8();
+        stream.in_skip_bytes(1);    /* reserved */
+        this->codec_id           = stream.in_uint8();
+        this->width              = stream.in_uint16_le();
+        this->height             = stream.in_uint16_le();
+        this->bitmap_data_length = stream.in_uint32_le();
+
+        if (this->flags & EX_COMPRESSED_BITMAP_HEADER_PRESENT) {
+            if (!stream.in_check_rem(24)) {
+                LOG( LOG_ERR
+                   , "SetSurfaceBits::receive exBitmapDataHeader - Truncated data, need=24, remains=%u"
+                   , stream.in_remain());
+                throw Error(ERR_RDP_DATA_TRUNCATED);
+            }
+            stream.in_skip_bytes(24);
+        }
+
+        if (!stream.in_check_rem(this->bitmap_data_length)) {
+            LOG( LOG_ERR
+               , "SetSurfaceBits::receive bitmapData - Truncated data, need=%u, remains=%u"
+               , this->bitmap_data_length, stream.in_remain());
+            throw Error(ERR_RDP_DATA_TRUNCATED);
+        }
+    }
+
+    void log(int level, const char * message) const {
+        LOG( level, "%s SetSurfaceBits(dest=(%u, %u, %u, %u) bpp=%u flags=0x%02X codecID=%u "
+             "width=%u height=%u bitmapDataLength=%u)"
+           , message, this->dest_left, this->dest_top, this->dest_right, this->dest_bottom
+           , this->bpp, this->flags, this->codec_id, this->width, this->height
+           , this->bitmap_data_length);
+    }
+};
+
+#endif
@@ -28,6 +28,7 @@
 
 #include "darray.hpp"
 #include "rect.hpp"
+#include "region.hpp"
 
 class Stream;
 class Keymap2;
@@ -74,10 +75,13 @@ struct RdpInput
     virtual void rdp_input_synchronize(uint32_t time, uint16_t device_flags, int16_t param1, int16_t param2) = 0;
     virtual void rdp_input_invalidate(const Rect & r) = 0;
     virtual void rdp_input_invalidate2(const DArray<Rect> & vr) {
+        // overlapping rects are drawn once
+        Region region;
         for (size_t i = 0; i < vr.size(); i++) {
-            if (!vr[i].isempty()) {
-                this->rdp_input_invalidate(vr[i]);
-            }
+            region.add_rect(vr[i]);
+        }
+        for (const Rect & rect : region.rects) {
+            this->rdp_input_invalidate(rect);
         }
     }
     // Client calls this member function when it became up and running.
@@ -21,6 +21,8 @@
 #ifndef REDEMPTION_CORE_CHANNEL_NAMES_HPP
 #define REDEMPTION_CORE_CHANNEL_NAMES_HPP
 
+#include <stdint.h>
+
 namespace CHANNELS {
 #define DEF_NAME(name) static constexpr const char * name = #name
     struct channel_names {
@@ -30,9 +32,18 @@ namespace CHANNELS {
         DEF_NAME(drdynvc);
     };
 #undef DEF_NAME
+
+    // Static virtual channel names (at most 7 characters) packed in an
+    // integer, compared or switched on instead of the string.
+    constexpr uint64_t channel_name_id(const char * name, unsigned i = 0) {
+        return (i == 8 || !name[i])
+             ? 0
+             : (uint64_t(uint8_t(name[i])) << (i * 8)) | channel_name_id(name, i + 1);
+    }
 }
 
 using CHANNELS::channel_names;
+using CHANNELS::channel_name_id;
 
 //         DEF_NAME(dynamique = "drdynvc";
 //         DEF_NAME(plug_and_play_devices = "pnpdr";
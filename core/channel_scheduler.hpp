@@ -0,0 +1,347 @@
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+  Product name: redemption, a FLOSS RDP proxy
+  Copyright (C) Wallix 2014
+  Author(s): Christophe Grosjean
+
+  Outbound virtual channel scheduler
+*/
+
+#ifndef _REDEMPTION_CORE_CHANNEL_SCHEDULER_HPP_
+#define _REDEMPTION_CORE_CHANNEL_SCHEDULER_HPP_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include "log.hpp"
+#include "difftimeval.hpp"
+#include "noncopyable.hpp"
+#include "channel_names.hpp"
+
+// Virtual channel chunks are sent inline with the graphics, a large file
+// transfer (rdpdr, cliprdr file contents) then delays the screen updates and
+// the input echo sharing the same connection.
+//
+// The scheduler lets at most QUANTUM bytes of channel data through between
+// two rounds of the session loop, the rest waits in per channel queues until
+// the graphics and input of the round are done. Queued channels share the
+// quantum by weight (deficit round robin), bulk channels (rdpdr, cliprdr) get
+// a lower weight than the others. A channel may also be limited to a number
+// of bytes per second. Chunks of a channel are always sent in order.
+class ChannelScheduler : noncopyable {
+public:
+    enum {
+        QUANTUM          = 16384,           // channel bytes sent between two rounds
+        DRR_UNIT         = 1600,            // deficit granted per round and unit of weight
+        BULK_WEIGHT      = 1,
+        DEFAULT_WEIGHT   = 4,
+        MAX_QUEUED_BYTES = 8 * 1024 * 1024, // per channel, rate limit ignored beyond that
+        MAX_NAME_LENGTH  = 7                // static virtual channel names
+    };
+
+    struct Chunk {
+        int                  chanid;
+        uint32_t             channel_flags;  // flags of the ChannelDef
+        uint32_t             length;         // total length of the channel data
+        uint32_t             flags;
+        std::vector<uint8_t> data;
+    };
+
+    struct Counters {
+        uint64_t bytes_sent;
+        uint64_t chunks_sent;
+        uint64_t chunks_delayed;
+        uint64_t max_queued_bytes;
+    };
+
+private:
+    struct Channel {
+        char              name[MAX_NAME_LENGTH + 1];
+        uint32_t          weight;
+        uint32_t          rate;         // bytes per second, 0 for no limit
+        int64_t           tokens;
+        uint64_t          refill_time;
+        size_t            deficit;
+        bool              overflow;
+        std::deque<Chunk> queue;
+        size_t            queued_bytes;
+        Counters          counters;
+    };
+
+    struct Limit {
+        char     name[MAX_NAME_LENGTH + 1];
+        uint32_t rate;
+    };
+
+    bool                 enabled;
+    size_t               budget;    // channel bytes left for this round
+    size_t               next;      // first channel served next round
+    std::vector<Channel> channels;
+    std::vector<Limit>   limits;
+
+public:
+    explicit ChannelScheduler(bool enabled = false)
+    : enabled(enabled)
+    , budget(QUANTUM)
+    , next(0) {
+    }
+
+    void enable(bool enabled) {
+        this->enabled = enabled;
+    }
+
+    bool is_enabled() const {
+        return this->enabled;
+    }
+
+    // "name:bytes_per_second,name:bytes_per_second", malformed entries are
+    // ignored. Channels not listed are not limited.
+    void set_rate_limits(const char * spec) {
+        this->limits.clear();
+        while (spec && *spec) {
+            const char * sep = strchr(spec, ':');
+            const char * end = strchr(spec, ',');
+            if (!end) {
+                end = spec + strlen(spec);
+            }
+            if (sep && sep < end && size_t(sep - spec) <= MAX_NAME_LENGTH) {
+                Limit limit;
+                memcpy(limit.name, spec, sep - spec);
+                limit.name[sep - spec] = 0;
+                limit.rate = strtoul(sep + 1, nullptr, 10);
+                this->limits.push_back(limit);
+            }
+            spec = *end ? end + 1 : end;
+        }
+
+        for (Channel & channel : this->channels) {
+            channel.rate = this->rate_limit(channel.name);
+        }
+    }
+
+    uint32_t rate_limit(const char * name) const {
+        for (const Limit & limit : this->limits) {
+            if (!strcmp(limit.name, name)) {
+                return limit.rate;
+            }
+        }
+        return 0;
+    }
+
+    // true when the chunk was queued, to be sent by send_pending(), false
+    // when it is to be sent right away. ChannelDef gives the name, chanid and
+    // flags of the channel.
+    template<class ChannelDef>
+    bool queue( const ChannelDef & def, const uint8_t * data, size_t size
+              , size_t length, uint32_t flags, const timeval & now) {
+        if (!this->enabled) {
+            return false;
+        }
+
+        Channel & channel = this->get_channel(def.name);
+        this->refill(channel, ustime(now));
+
+        if (channel.queue.empty() && channel.tokens > 0 && this->budget > 0) {
+            this->consume(channel, size);
+            return false;
+        }
+
+        channel.queue.push_back(Chunk());
+        Chunk & chunk = channel.queue.back();
+        chunk.chanid        = def.chanid;
+        chunk.channel_flags = def.flags;
+        chunk.length        = length;
+        chunk.flags         = flags;
+        chunk.data.assign(data, data + size);
+
+        channel.queued_bytes += size;
+        channel.counters.chunks_delayed++;
+        if (channel.queued_bytes > channel.counters.max_queued_bytes) {
+            channel.counters.max_queued_bytes = channel.queued_bytes;
+        }
+        if (!channel.overflow && channel.queued_bytes > MAX_QUEUED_BYTES) {
+            LOG(LOG_WARNING, "ChannelScheduler: %u bytes queued on channel %s, rate limit ignored"
+               , static_cast<unsigned>(channel.queued_bytes), channel.name);
+            channel.overflow = true;
+        }
+        return true;
+    }
+
+    // Starts a new round: sends the queued chunks allowed by the quantum, the
+    // weights and the rate limits. timeout is lowered to the time the next
+    // pending chunk can be sent.
+    template<class Send>
+    void send_pending(const timeval & now, timeval & timeout, Send && send) {
+        this->budget = QUANTUM;
+        if (this->channels.empty()) {
+            return;
+        }
+
+        const uint64_t now_us = ustime(now);
+        for (Channel & channel : this->channels) {
+            this->refill(channel, now_us);
+        }
+
+        const size_t count = this->channels.size();
+        for (bool eligible = true; eligible && this->budget > 0; ) {
+            eligible = false;
+            for (size_t i = 0; i < count && this->budget > 0; ++i) {
+                Channel & channel = this->channels[(this->next + i) % count];
+                if (channel.queue.empty() || !(channel.overflow || channel.tokens > 0)) {
+                    continue;
+                }
+                eligible = true;
+                channel.deficit += DRR_UNIT * channel.weight;
+                while (!channel.queue.empty()
+                    && (channel.overflow || channel.tokens > 0)
+                    && this->budget > 0
+                    && channel.queue.front().data.size() <= channel.deficit) {
+                    Chunk & chunk = channel.queue.front();
+                    const size_t size = chunk.data.size();
+                    send(chunk);
+                    channel.deficit -= size;
+                    channel.queued_bytes -= size;
+                    this->consume(channel, size);
+                    channel.queue.pop_front();
+                    if (channel.overflow && channel.queued_bytes < MAX_QUEUED_BYTES / 2) {
+                        channel.overflow = false;
+                    }
+                }
+                if (channel.queue.empty()) {
+                    channel.deficit = 0;
+                }
+            }
+        }
+        this->next = (this->next + 1) % count;
+
+        uint64_t wait_us = UINT64_MAX;
+        for (const Channel & channel : this->channels) {
+            if (channel.queue.empty()) {
+                continue;
+            }
+            if (channel.overflow || channel.tokens > 0) {
+                // only held back by the quantum, next round as soon as possible
+                wait_us = 0;
+                break;
+            }
+            const uint64_t us = (uint64_t(1 - channel.tokens) * 1000000 + channel.rate - 1) / channel.rate;
+            if (us < wait_us) {
+                wait_us = us;
+            }
+        }
+        if (wait_us != UINT64_MAX && wait_us < ustime(timeout)) {
+            timeout.tv_sec  = wait_us / 1000000;
+            timeout.tv_usec = wait_us % 1000000;
+        }
+    }
+
+    bool has_pending() const {
+        for (const Channel & channel : this->channels) {
+            if (!channel.queue.empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const Counters * counters(const char * name) const {
+        for (const Channel & channel : this->channels) {
+            if (!strcmp(channel.name, name)) {
+                return &channel.counters;
+            }
+        }
+        return nullptr;
+    }
+
+    void log_counters(const char * owner) const {
+        for (const Channel & channel : this->channels) {
+            LOG(LOG_INFO, "%s: channel %s sent=%llu bytes chunks=%llu delayed=%llu max_queued=%llu bytes"
+               , owner, channel.name
+               , static_cast<unsigned long long>(channel.counters.bytes_sent)
+               , static_cast<unsigned long long>(channel.counters.chunks_sent)
+               , static_cast<unsigned long long>(channel.counters.chunks_delayed)
+               , static_cast<unsigned long long>(channel.counters.max_queued_bytes));
+        }
+    }
+
+private:
+    Channel & get_channel(const char * name) {
+        for (Channel & channel : this->channels) {
+            if (!strcmp(channel.name, name)) {
+                return channel;
+            }
+        }
+
+        this->channels.push_back(Channel());
+        Channel & channel = this->channels.back();
+        strncpy(channel.name, name, sizeof(channel.name) - 1);
+        channel.name[sizeof(channel.name) - 1] = 0;
+        channel.weight       = (  !strcmp(channel.name, channel_names::rdpdr)
+                               || !strcmp(channel.name, channel_names::cliprdr))
+                             ? BULK_WEIGHT : DEFAULT_WEIGHT;
+        channel.rate         = this->rate_limit(channel.name);
+        channel.tokens       = 1;
+        channel.refill_time  = 0;
+        channel.deficit      = 0;
+        channel.overflow     = false;
+        channel.queued_bytes = 0;
+        memset(&channel.counters, 0, sizeof(channel.counters));
+        return channel;
+    }
+
+    // token bucket holding at most 1/8 second of traffic, the time of the
+    // fraction of token not yet credited is kept for the next refill
+    static void refill(Channel & channel, uint64_t now_us) {
+        if (!channel.rate || !channel.refill_time) {
+            if (!channel.rate) {
+                channel.tokens = 1;
+            }
+            channel.refill_time = now_us;
+            return;
+        }
+        if (now_us <= channel.refill_time) {
+            return;
+        }
+        const int64_t added = (now_us - channel.refill_time) * channel.rate / 1000000;
+        if (!added) {
+            return;
+        }
+        const int64_t burst = std::max<int64_t>(channel.rate / 8, 1);
+        channel.tokens += added;
+        if (channel.tokens >= burst) {
+            channel.tokens = burst;
+            channel.refill_time = now_us;
+        }
+        else {
+            channel.refill_time += added * 1000000 / channel.rate;
+        }
+    }
+
+    void consume(Channel & channel, size_t size) {
+        if (channel.rate) {
+            channel.tokens -= size;
+        }
+        this->budget -= std::min(size, this->budget);
+        channel.counters.bytes_sent += size;
+        channel.counters.chunks_sent++;
+    }
+};
+
+#endif
@@ -26,6 +26,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <stdexcept>
 #include <string>
@@ -158,6 +159,8 @@ enum authid_t {
 
     AUTHID_RT_DISPLAY,
 
+    AUTHID_CHANNEL_RATE_LIMITS,
+
     MAX_AUTHID
 };
 
@@ -266,6 +269,8 @@ enum authid_t {
 #define STRAUTHID_DISABLE_KEYBOARD_LOG          "disable_keyboard_log"
 #define STRAUTHID_RT_DISPLAY                    "rt_display"
 
+#define STRAUTHID_CHANNEL_RATE_LIMITS           "channel_rate_limits"
+
 static const char * const authstr[MAX_AUTHID - 1] = {
     // Translation text
     STRAUTHID_TRANS_BUTTON_OK,
@@ -378,18 +383,59 @@ static const char * const authstr[MAX_AUTHID - 1] = {
     STRAUTHID_PROXY_OPT,
 
     STRAUTHID_DISABLE_KEYBOARD_LOG,
-    STRAUTHID_RT_DISPLAY
+    STRAUTHID_RT_DISPLAY,
+
+    STRAUTHID_CHANNEL_RATE_LIMITS
 };
 
-static inline authid_t authid_from_string(const char * strauthid) {
-    authid_t res = AUTHID_UNKNOWN;
-    for (int i = 0; i < MAX_AUTHID - 1 ; i++) {
-        if (0 == strcmp(authstr[i], strauthid)) {
-            res = static_cast<authid_t>(i + 1);
-            break;
+// FNV-1a hash of an authid key, usable in constant expressions.
+constexpr uint32_t authid_hash(const char * strauthid, uint32_t h = 2166136261u) {
+    return *strauthid
+         ? authid_hash(strauthid + 1, (h ^ static_cast<uint8_t>(*strauthid)) * 16777619u)
+         : h;
+}
+
+// Open addressing table from key hash to authid, built once per process.
+// Table is sparse enough for (nearly) every key to sit in its home slot,
+// so a lookup costs one hash and a single strcmp.
+class AuthidIndex {
+    enum {
+        INDEX_SIZE = 512,
+        INDEX_MASK = INDEX_SIZE - 1
+    };
+
+    static_assert(MAX_AUTHID < 256, "authid must fit in uint8_t slots");
+    static_assert(MAX_AUTHID * 4 < INDEX_SIZE, "authid index too small");
+
+    uint8_t slots[INDEX_SIZE];
+
+public:
+    AuthidIndex() {
+        memset(this->slots, 0, sizeof(this->slots));
+        for (unsigned i = 0; i < MAX_AUTHID - 1; i++) {
+            uint32_t pos = authid_hash(authstr[i]) & INDEX_MASK;
+            while (this->slots[pos]) {
+                pos = (pos + 1) & INDEX_MASK;
+            }
+            this->slots[pos] = i + 1;
+        }
+    }
+
+    authid_t find(const char * strauthid) const {
+        uint32_t pos = authid_hash(strauthid) & INDEX_MASK;
+        while (uint8_t id = this->slots[pos]) {
+            if (0 == strcmp(authstr[id - 1], strauthid)) {
+                return static_cast<authid_t>(id);
+            }
+            pos = (pos + 1) & INDEX_MASK;
         }
+        return AUTHID_UNKNOWN;
     }
-    return res;
+};
+
+static inline authid_t authid_from_string(const char * strauthid) {
+    static const AuthidIndex index;
+    return index.find(strauthid);
 }
 
 static inline const char * string_from_authid(authid_t authid) {
@@ -552,6 +598,19 @@ public:
         bool        enable_close_box = true;
         bool        enable_osd = true;
         bool        enable_osd_display_remote_target = true;
+
+        // virtual channel data sent between graphics rounds, limited per
+        // channel by "name:bytes_per_second,..."
+        bool        channel_scheduler = false;
+        StringField channel_rate_limits;      // AUTHID_CHANNEL_RATE_LIMITS //
+
+        // target and authentifier connections established by the session
+        // loop instead of blocking it
+        bool        async_connect = false;
+
+        // seconds a target connection opened while an internal module is
+        // shown is kept for the target module (0 to desactivate)
+        unsigned    preconnect_timeout = 0;
         // END globals
 
         StaticPath<1024> persistent_path = PERSISTENT_PATH;
@@ -586,6 +645,25 @@ public:
 
         bool bitmap_compression = true;
 
+        // MemBlt tiles sized from client cache cells, uniform tiles sent as OpaqueRect
+        bool adaptive_bitmap_tiling = false;
+
+        // text runs sent again are references to the client glyph fragment cache
+        bool glyph_fragment_cache = false;
+
+        // photographic bitmaps sent as NSCodec Set Surface Bits commands
+        bool nscodec = false;
+
+        // bitmaps sent as RemoteFX Set Surface Bits commands, tiles encoded by n threads
+        bool     remotefx                 = false;
+        unsigned remotefx_encoder_threads = 1;
+
+        // fast-path updates up to this size sent as fragments, 0 to disable multi-fragment updates
+        uint32_t multifragment_max_request_size = 0;
+
+        // large bitmaps drawn again kept in client offscreen bitmaps
+        bool offscreen_bitmap_cache = false;
+
         Inifile_client() = default;
     } client;
 
@@ -648,6 +726,13 @@ public:
         Inifile_mod_replay() = default;
     } mod_replay;
 
+    // section "internal_mod"
+    struct Inifile_internal_mod {
+        bool widget_render_cache = false; // labels are drawn from cached bitmaps
+
+        Inifile_internal_mod() = default;
+    } internal_mod;
+
     // Section "video"
     struct Inifile_video {
         unsigned capture_flags  = 3; // 1 png, 2 wrm, 4 flv, 8 ocr
@@ -715,6 +800,19 @@ public:
 
         unsigned wrm_compression_algorithm = 0; // 0: uncompressed, 1: GZip, 2: Snappy
 
+        // Record the orders encoded for the client instead of encoding them
+        // again, only when client color depth is the capture color depth.
+        bool wrm_shared_serializer = false;
+
+        // Binary index of the .mwrm for time lookups (not for encrypted files)
+        bool wrm_meta_index = false;
+
+        // PNG snapshots encoder, 0: libpng, n: strips deflated by n threads
+        unsigned png_encoder_threads = 0;
+        int      png_zlib_level      = -1;  // -1: zlib default, 0 to 9
+        unsigned png_filter          = 1;   // 0: None, 1: Sub, 2: Up, 3: Average, 4: Paeth
+        unsigned png_strip_height    = 64;
+
         Inifile_video() = default;
     } video;
 
@@ -936,6 +1034,7 @@ public:
         this->globals.movie.attach_ini(this, AUTHID_OPT_MOVIE);
         this->globals.movie_path.attach_ini(this, AUTHID_OPT_MOVIE_PATH);
         this->globals.video_quality.attach_ini(this, AUTHID_VIDEO_QUALITY);
+        this->globals.channel_rate_limits.attach_ini(this, AUTHID_CHANNEL_RATE_LIMITS);
 
         this->globals.codec_id.set_from_cstr("flv");
         this->globals.movie.set(false);
@@ -1237,6 +1336,18 @@ public:
             else if (0 == strcmp(key, "enable_osd_display_remote_target")) {
                 this->globals.enable_osd_display_remote_target = bool_from_cstr(value);
             }
+            else if (0 == strcmp(key, "channel_scheduler")) {
+                this->globals.channel_scheduler = bool_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "channel_rate_limits")) {
+                this->globals.channel_rate_limits.set_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "async_connect")) {
+                this->globals.async_connect = bool_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "preconnect_timeout")) {
+                this->globals.preconnect_timeout = ulong_from_cstr(value);
+            }
             else if (0 == strcmp(key, "persistent_path")) {
                 this->globals.persistent_path = value;
             }
@@ -1300,6 +1411,27 @@ public:
             else if (0 == strcmp(key, "persist_bitmap_cache_on_disk")) {
                 this->client.persist_bitmap_cache_on_disk = bool_from_cstr(value);
             }
+            else if (0 == strcmp(key, "adaptive_bitmap_tiling")) {
+                this->client.adaptive_bitmap_tiling = bool_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "glyph_fragment_cache")) {
+                this->client.glyph_fragment_cache = bool_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "nscodec")) {
+                this->client.nscodec = bool_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "remotefx")) {
+                this->client.remotefx = bool_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "remotefx_encoder_threads")) {
+                this->client.remotefx_encoder_threads = ulong_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "multifragment_max_request_size")) {
+                this->client.multifragment_max_request_size = ulong_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "offscreen_bitmap_cache")) {
+                this->client.offscreen_bitmap_cache = bool_from_cstr(value);
+            }
             else if (this->debug.config) {
                 LOG(LOG_ERR, "unknown parameter %s in section [%s]", key, context);
             }
@@ -1406,6 +1538,9 @@ public:
             else if (0 == strcmp(key, "break_interval")) {
                 this->video.break_interval   = ulong_from_cstr(value);
             }
+            else if (0 == strcmp(key, "flv_break_interval")) {
+                this->video.flv_break_interval = ulong_from_cstr(value);
+            }
             else if (0 == strcmp(key, "png_limit")) {
                 this->video.png_limit   = ulong_from_cstr(value);
             }
@@ -1484,6 +1619,26 @@ public:
             else if (0 == strcmp(key, "wrm_compression_algorithm")) {
                 this->video.wrm_compression_algorithm = ulong_from_cstr(value);
             }
+            else if (0 == strcmp(key, "wrm_shared_serializer")) {
+                this->video.wrm_shared_serializer = bool_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "wrm_meta_index")) {
+                this->video.wrm_meta_index = bool_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "png_encoder_threads")) {
+                this->video.png_encoder_threads = ulong_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "png_zlib_level")) {
+                const int level = _long_from_cstr(value);
+                this->video.png_zlib_level = ((level < -1) || (level > 9)) ? -1 : level;
+            }
+            else if (0 == strcmp(key, "png_filter")) {
+                const unsigned filter = ulong_from_cstr(value);
+                this->video.png_filter = (filter > 4) ? 1 : filter;
+            }
+            else if (0 == strcmp(key, "png_strip_height")) {
+                this->video.png_strip_height = ulong_from_cstr(value);
+            }
             else if (this->debug.config) {
                 LOG(LOG_ERR, "unknown parameter %s in section [%s]", key, context);
             }
@@ -1668,6 +1823,9 @@ public:
                     }
                 }
             }
+            else if (0 == strcmp(key, "widget_render_cache")) {
+                this->internal_mod.widget_render_cache = bool_from_cstr(value);
+            }
             else if (this->debug.config) {
                 LOG(LOG_ERR, "unknown parameter %s in section [%s]", key, context);
             }
@@ -1694,41 +1852,49 @@ public:
     void set_from_acl(const char * strauthid, const char * value) {
         authid_t authid = authid_from_string(strauthid);
         if (authid != AUTHID_UNKNOWN) {
-            if (authid == AUTHID_AUTH_ERROR_MESSAGE) {
-                this->context.auth_error_message = value;
-            }
-            else {
-                if (BaseField * field = this->get_field(authid)) {
-                    field->set_from_acl(value);
-                }
-                else {
-                    LOG(LOG_WARNING, "Inifile::set_from_acl(id): unknown authid=%d", authid);
-                }
-            }
+            this->set_from_acl(authid, value);
         }
         else {
             LOG(LOG_WARNING, "Inifile::set_from_acl(strid): unknown strauthid=\"%s\"", strauthid);
         }
     }
 
+    void set_from_acl(authid_t authid, const char * value) {
+        if (authid == AUTHID_AUTH_ERROR_MESSAGE) {
+            this->context.auth_error_message = value;
+        }
+        else {
+            if (BaseField * field = this->get_field(authid)) {
+                field->set_from_acl(value);
+            }
+            else {
+                LOG(LOG_WARNING, "Inifile::set_from_acl(id): unknown authid=%d", authid);
+            }
+        }
+    }
+
     /******************
      * ask_from_acl sets a value to corresponding field but does not mark it as changed
      */
     void ask_from_acl(const char * strauthid) {
         authid_t authid = authid_from_string(strauthid);
         if (authid != AUTHID_UNKNOWN) {
-            if (BaseField * field = this->get_field(authid)) {
-                field->ask_from_acl();
-            }
-            else {
-                LOG(LOG_WARNING, "Inifile::ask_from_acl(id): unknown authid=%d", authid);
-            }
+            this->ask_from_acl(authid);
         }
         else {
             LOG(LOG_WARNING, "Inifile::ask_from_acl(strid): unknown strauthid=\"%s\"", strauthid);
         }
     }
 
+    void ask_from_acl(authid_t authid) {
+        if (BaseField * field = this->get_field(authid)) {
+            field->ask_from_acl();
+        }
+        else {
+            LOG(LOG_WARNING, "Inifile::ask_from_acl(id): unknown authid=%d", authid);
+        }
+    }
+
     void context_set_value(authid_t authid, const char * value) {
         switch (authid)
             {
@@ -24,6 +24,8 @@
 #include "font.hpp"
 #include "RDP/RDPGraphicDevice.hpp"
 
+class WidgetRenderCache;
+
 class DrawApi : public RDPGraphicDevice
 {
 public:
@@ -36,6 +38,9 @@ public:
                                   uint32_t fgcolor, uint32_t bgcolor, const Rect & clip) = 0;
 
     virtual void flush() {};
+
+    // widgets draw themselves with orders when there is no render cache
+    virtual WidgetRenderCache * get_render_cache() { return nullptr; }
 };
 
 #endif
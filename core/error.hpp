@@ -64,6 +64,8 @@ enum error_type {
 
     ERR_TRANSPORT_TLS_CONNECT_FAILED = 1600,
     ERR_TRANSPORT_TLS_CERTIFICATE_CHANGED,
+    ERR_TRANSPORT_TLS_SERVER,
+    ERR_TRANSPORT_TLS_CLIENT,
 
     ERR_ACL_UNEXPECTED_IN_ITEM_OUT = 1700,
     ERR_ACL_MESSAGE_TOO_BIG,
@@ -243,6 +245,7 @@ enum error_type {
     ERR_BITMAP_LOAD_FAILED = 17000,
     ERR_BITMAP_LOAD_UNKNOWN_TYPE_FILE,
     ERR_BITMAP_PNG_LOAD_FAILED,
+    ERR_BITMAP_PNG_SAVE_FAILED,
 
     ERR_BITMAP_CACHE = 18000,
     ERR_BITMAP_CACHE_TOO_BIG,
@@ -334,6 +337,10 @@ public:
             return "Open file failed";
         case ERR_TRANSPORT_TLS_CERTIFICATE_CHANGED:
             return "TLS certificate changed";
+        case ERR_TRANSPORT_TLS_SERVER:
+            return "TLS server handshake failed";
+        case ERR_TRANSPORT_TLS_CLIENT:
+            return "TLS client handshake failed";
         case ERR_VNC_CONNECTION_ERROR:
             return "VNC connection error.";
         case ERR_WIDGET_INVALID_COMPOSITE_DESTROY:
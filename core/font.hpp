@@ -27,6 +27,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
@@ -47,39 +48,84 @@ struct FontChar
     int       width = 0;    // width of glyph actually containing pixels
     int       height = 0;   // height of glyph (in pixels)
     int       incby = 0;    // width of glyph (in pixels) including leading and trailing whitespaces
-    std::unique_ptr<uint8_t[]> data;
+    const uint8_t * data = nullptr; // owned_data or glyph data of a mapped font file
 
+private:
+    std::unique_ptr<uint8_t[]> owned_data;
+
+public:
     FontChar(int offset, int baseline, int width, int height, int incby)
         : offset(offset)
         , baseline(baseline)
         , width(width)
         , height(height)
         , incby(incby)
-        , data(std::make_unique<uint8_t[]>(this->datasize()))
+        , owned_data(std::make_unique<uint8_t[]>(this->datasize()))
+    {
+        this->data = this->owned_data.get();
+    }
+
+    // view on glyph data owned by someone else (Font)
+    FontChar(int offset, int baseline, int width, int height, int incby, const uint8_t * data)
+        : offset(offset)
+        , baseline(baseline)
+        , width(width)
+        , height(height)
+        , incby(incby)
+        , data(data)
     {
     }
 
     FontChar() = default;
 
-    FontChar(FontChar && other) = default;
-    FontChar & operator=(FontChar &&) = default;
+    FontChar(FontChar && other) noexcept
+        : offset(other.offset)
+        , baseline(other.baseline)
+        , width(other.width)
+        , height(other.height)
+        , incby(other.incby)
+        , data(other.data)
+        , owned_data(std::move(other.owned_data))
+    {
+        other.data = nullptr;
+    }
+
+    FontChar & operator=(FontChar && other) noexcept {
+        this->offset = other.offset;
+        this->baseline = other.baseline;
+        this->width = other.width;
+        this->height = other.height;
+        this->incby = other.incby;
+        this->data = other.data;
+        this->owned_data = std::move(other.owned_data);
+        other.data = nullptr;
+        return *this;
+    }
+
     void * operator new (size_t) = delete;
 
+    // a copy owns its data, glyph caches may outlive the font
     FontChar(const FontChar & other)
         : offset(other.offset)
         , baseline(other.baseline)
         , width(other.width)
         , height(other.height)
         , incby(other.incby)
-        , data(std::make_unique<uint8_t[]>(other.datasize()))
+        , owned_data(std::make_unique<uint8_t[]>(other.datasize()))
     {
-        memcpy(this->data.get(), other.data.get(), other.datasize());
+        memcpy(this->owned_data.get(), other.data, other.datasize());
+        this->data = this->owned_data.get();
     }
 
     explicit operator bool () const noexcept {
         return bool(this->data);
     }
 
+    // only for a glyph created with its own data
+    uint8_t * writable_data() noexcept {
+        return this->owned_data.get();
+    }
+
     //==============================================================================
     inline int datasize() const noexcept
     //==============================================================================
@@ -89,7 +135,7 @@ struct FontChar
 
     /* compare the two font items returns 1 if they match */
     //==============================================================================
-    int item_compare(FontChar const & glyph, bool ignore_incby = true) noexcept
+    int item_compare(FontChar const & glyph, bool ignore_incby = true) const noexcept
     //==============================================================================
     {
         REDASSERT(ignore_incby);
@@ -100,7 +146,7 @@ struct FontChar
             && (this->width == glyph.width)
             && (this->height == glyph.height)
             && (ignore_incby || (this->incby == glyph.incby))
-            && (0 == memcmp(this->data.get(), glyph.data.get(), glyph.datasize()));
+            && (0 == memcmp(this->data, glyph.data, glyph.datasize()));
 
 /*
         if (result && ignore_incby)
@@ -161,7 +207,14 @@ struct Font
     int size;
     int style;
 
+private:
+    // The font file is mapped read-only and glyphs are views on their data
+    // in the mapping: no copy per glyph and the pages are shared by every
+    // process using the same font file.
+    void * file_map = nullptr;
+    size_t file_map_size = 0;
 
+public:
     // Constructor
     // Params :
     //    - file_path : path to the font definition file (*.fv1)
@@ -169,9 +222,6 @@ struct Font
     Font(const char * file_path) {
     //==============================================================================
         int fd;
-        int b;
-         // we start at space, no glyph for chars below 32
-        int file_size;
 
         TODO("Temporary disabling font to avoid useless messages in watchdog");
 //        LOG(LOG_INFO, "Reading font file %s", file_path);
@@ -197,39 +247,29 @@ struct Font
             goto ErrorReadingFontFile;
         }
 
-        // Allocate a buffer to read the whole file into
-        file_size = st.st_size;
-
         if (-1 == (fd = open(file_path, O_RDONLY))){
             LOG(LOG_ERR, "create: can't open font file [%s] for reading\n", file_path);
             goto ErrorReadingFontFile;
         }
 
-        {
-            long size_to_read = file_size;
-            BStream stream(8192);
+        this->file_map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (this->file_map == MAP_FAILED) {
+            this->file_map = nullptr;
+            LOG(LOG_ERR, "create: can't map font file [%s] error: %s\n", file_path, strerror(errno));
+            goto ErrorReadingFontFile;
+        }
+        this->file_map_size = st.st_size;
 
-            // Read header
-            // -----------
-            while ((b = read(fd, stream.end, std::min<uint32_t>(size_to_read, 8192))) < 0){
-                if (b >= 0){
-                    break;
-                }
-                if ((errno == EAGAIN)||(errno == EINTR)){
-                    continue;
-                }
-                LOG(LOG_ERR,"create: error reading font file [%s] error: %s\n", file_path, strerror(errno));
-                goto ErrorReadingFontFile;
-            }
-            stream.end += b;
-            size_to_read -= b;
-            if (size_to_read == 0){
-                close(fd);
-                fd = -1;
-            }
+        {
+            StaticStream stream(static_cast<const uint8_t *>(this->file_map), this->file_map_size);
 
             // Extract font info from the buffer
             //----------------------------------
+            if (!stream.in_check_rem(48)){
+                LOG(LOG_ERR, "create: font file [%s] is too short\n", file_path);
+                goto ErrorReadingFontFile;
+            }
             stream.in_skip_bytes(4);                       // >>> 4 bytes for FNT1 (dropped)
             stream.in_copy_bytes(this->name, 32);          // >>> 32 bytes for Font Name
             this->size = stream.in_uint16_le();            // >>> 2 bytes for Font Size
@@ -240,41 +280,14 @@ struct Font
 
             // Extract each character glyph
             for (int index = 32; index < NUM_GLYPHS ; index++) {
-                unsigned remaining = stream.in_remain();
-                if (remaining < 1024){
-                    if (size_to_read > 0){
-                        TODO("Create a pack_left function in stream to do this");
-                        //-----------------------------------------------------
-                        memmove(stream.get_data(), stream.p, remaining);
-                        stream.p = stream.get_data();
-                        stream.end = stream.p + remaining;
-                        //-----------------------------------------------------
-                        while ((b = read(fd, stream.end, std::min<uint32_t>(size_to_read, 8192 - remaining))) < 0){
-                            if (b >= 0){
-                                break;
-                            }
-                            if ((errno == EAGAIN)||(errno == EINTR)){
-                                continue;
-                            }
-                            LOG(LOG_ERR,"create: error reading font file [%s] error: %s\n", file_path, strerror(errno));
-                            goto ErrorReadingFontFile;
-                        }
-                        stream.end += b;
-                        size_to_read -= b;
-                        if (size_to_read == 0){
-                            close(fd);
-                            fd = -1;
-                        }
-                    }
-                    // no more remaining glyphs in file
-                    if (!stream.in_check_rem(1)){
-                        LOG(LOG_INFO, "Font file %s defines glyphs up to %u", file_path, index);
-                        break;
-                    }
-                    if (!stream.in_check_rem(16)){
-                        LOG(LOG_WARNING, "Font file %s defines glyphs up to %u, file looks broken", file_path, index);
-                        break;
-                    }
+                // no more remaining glyphs in file
+                if (!stream.in_check_rem(1)){
+                    LOG(LOG_INFO, "Font file %s defines glyphs up to %u", file_path, index);
+                    break;
+                }
+                if (!stream.in_check_rem(16)){
+                    LOG(LOG_WARNING, "Font file %s defines glyphs up to %u, file looks broken", file_path, index);
+                    break;
                 }
 
 //                LOG(LOG_INFO, "Reading definition for glyph %u", index);
@@ -287,7 +300,7 @@ struct Font
                 int offset = stream.in_sint16_le(); // >>> 2 bytes for glyph offset
                 int incby = stream.in_sint16_le(); // >>> 2 bytes for glyph incby
                 stream.in_skip_bytes(6); // >>> 6 bytes for PAD (dropped)
-                this->font_items[index] = FontChar(offset, baseline, width, height, incby);
+                this->font_items[index] = FontChar(offset, baseline, width, height, incby, stream.p);
 
                 // Check if glyph data size make sense
                 unsigned datasize = this->font_items[index].datasize();
@@ -298,10 +311,11 @@ struct Font
                         this->font_items[index].width,
                         this->font_items[index].height);
                     // one glyph is broken but we continue with other glyphs
+                    this->font_items[index] = FontChar(offset, baseline, width, height, incby);
                     continue;
                 }
 
-                // Read the data only if there is enough space left in buffer
+                // the data must be in the file
                 if (!stream.in_check_rem(datasize)) {
                     LOG(LOG_ERR
                        , "Error loading font %s: not enough data for definition of glyph %d (expected %d, got %d)\n"
@@ -311,7 +325,7 @@ struct Font
                 }
 
                 // >>> <datasize> bytes for glyph data (bitmap)
-                stream.in_copy_bytes(this->font_items[index].data.get(), datasize);
+                stream.in_skip_bytes(datasize);
             }
         }
         return;
@@ -321,6 +335,16 @@ ErrorReadingFontFile:
         return;
     }
 
+    ~Font() {
+        if (this->file_map) {
+            munmap(this->file_map, this->file_map_size);
+        }
+    }
+
+    // glyphs are views on file_map
+    Font(const Font &) = delete;
+    Font & operator=(const Font &) = delete;
+
     bool glyph_defined(uint32_t charnum) const
     {
         if ((charnum < 32)||(charnum >= NUM_GLYPHS)){
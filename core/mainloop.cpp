@@ -37,6 +37,7 @@
 
 #include "config.hpp"
 #include "crypto_key_holder.hpp"
+#include "tls_context.hpp"
 
 /*****************************************************************************/
 void shutdown(int sig)
@@ -236,6 +237,15 @@ void redemption_main_loop(Inifile & ini, unsigned uid, unsigned gid, crypto_key_
 {
     init_signals();
 
+    // loaded once, inherited by session processes
+    if (!TLSServerContext::preload(ini.globals.certificate_password)) {
+        LOG(LOG_WARNING, "TLS server context will be loaded by each session");
+    }
+    // sessions opened with targets are resumed by next session process
+    if (!TLSClientContext::preload()) {
+        LOG(LOG_WARNING, "TLS client context will be loaded by each session");
+    }
+
     SessionServer ss(uid, gid, cryptoKeyHldr, ini.debug.config == Inifile::ENABLE_DEBUG_CONFIG);
     //    Inifile ini(CFG_PATH "/" RDPPROXY_INI);
     uint32_t s_addr = inet_addr(ini.globals.listen_address);
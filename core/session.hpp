@@ -43,6 +43,7 @@
 #include "ssl_calls.hpp"
 #include "rect.hpp"
 #include "netutils.hpp"
+#include "async_connect.hpp"
 
 #include "config.hpp"
 #include "wait_obj.hpp"
@@ -122,6 +123,8 @@ class Session {
 
     Client * client = nullptr;
 
+    AsyncConnect auth_connect;
+
           time_t   perf_last_info_collect_time;
     const pid_t    perf_pid;
           FILE   * perf_file;
@@ -183,6 +186,29 @@ public:
                 FD_ZERO(&wfds);
                 timeval timeout = time_mark;
 
+                // channel data held back during the last round, sent once its
+                // graphics and input are done
+                try {
+                    this->front->send_pending_channel_data(timeout);
+                }
+                catch (Error & e) {
+                    LOG(LOG_INFO, "Session::Session front channel data exception = %d!\n", e.id);
+                    run_session = false;
+                    continue;
+                }
+                catch (...) {
+                    LOG(LOG_INFO, "Session::Session front channel data other exception\n");
+                    run_session = false;
+                    continue;
+                }
+                try {
+                    mm.mod->send_pending_channel_data(timeout);
+                }
+                catch (Error & e) {
+                    LOG(LOG_INFO, "Session::Session exception = %d!\n", e.id);
+                    mm.invoke_close_box(e.errmsg(), signal, time(NULL));
+                }
+
                 add_to_fd_set(front_event, &front_trans, rfds, max, timeout);
                 if (this->front->capture) {
                     add_to_fd_set(this->front->capture->capture_event, nullptr, rfds, max, timeout);
@@ -191,6 +217,10 @@ public:
                     this->client->add_to_fd_set(rfds, max, timeout);
                 }
                 add_to_fd_set(mm.mod->get_event(), mm.mod_transport, rfds, max, timeout);
+                mm.add_to_fd_set(wfds, max, timeout);
+                if (!this->client) {
+                    this->auth_connect.add_to_fd_set(wfds, max, timeout, tvtime());
+                }
 
                 const bool has_pending_data = (front_trans.tls && SSL_pending(front_trans.allocated_ssl));
                 if (has_pending_data)
@@ -250,24 +280,17 @@ public:
                         if (this->front->capture && is_set(this->front->capture->capture_event, nullptr, rfds)) {
                             this->front->periodic_snapshot();
                         }
+                        mm.check_target_connect(wfds, now, signal);
                         // Incoming data from ACL, or opening acl
                         if (!this->client) {
                             if (!mm.last_module) {
                                 // acl never opened or closed by me (close box)
                                 try {
-                                    int client_sck = ip_connect(this->ini.globals.authip,
-                                                                this->ini.globals.authport,
-                                                                30,
-                                                                1000,
-                                                                this->ini.debug.auth);
-
-                                    if (client_sck == -1) {
-                                        LOG(LOG_ERR, "Failed to connect to authentifier");
-                                        throw Error(ERR_SOCKET_CONNECT_FAILED);
+                                    int client_sck = this->connect_authentifier(wfds);
+                                    if (client_sck != -1) {
+                                        this->client = new Client(client_sck, ini, *this->front, start_time, now);
+                                        signal = BACK_EVENT_NEXT;
                                     }
-
-                                    this->client = new Client(client_sck, ini, *this->front, start_time, now);
-                                    signal = BACK_EVENT_NEXT;
                                 }
                                 catch (...) {
                                     mm.invoke_close_box("No authentifier available",signal, now);
@@ -377,6 +400,42 @@ public:
     }
 
 private:
+    // Socket connected to the authentifier, throws when the connection
+    // failed. With async_connect, -1 while the connection is in progress.
+    int connect_authentifier(const fd_set & wfds) {
+        if (!this->ini.globals.async_connect) {
+            int client_sck = ip_connect(this->ini.globals.authip,
+                                        this->ini.globals.authport,
+                                        30,
+                                        1000,
+                                        this->ini.debug.auth);
+
+            if (client_sck == -1) {
+                LOG(LOG_ERR, "Failed to connect to authentifier");
+                throw Error(ERR_SOCKET_CONNECT_FAILED);
+            }
+            return client_sck;
+        }
+
+        if (this->auth_connect.get_state() == AsyncConnect::IDLE) {
+            this->auth_connect.start(this->ini.globals.authip, this->ini.globals.authport, 30000, tvtime());
+        }
+        else if (this->auth_connect.is_pending()) {
+            this->auth_connect.process(wfds, tvtime());
+        }
+
+        switch (this->auth_connect.get_state()) {
+        case AsyncConnect::CONNECTED:
+            return this->auth_connect.release();
+        case AsyncConnect::FAILED:
+            this->auth_connect.cancel();
+            LOG(LOG_ERR, "Failed to connect to authentifier");
+            throw Error(ERR_SOCKET_CONNECT_FAILED);
+        default:
+            return -1;
+        }
+    }
+
     void write_performance_log(time_t now) {
         if (!this->perf_last_info_collect_time) {
             REDASSERT(!this->perf_file);
@@ -30,6 +30,8 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <algorithm>
+#include <vector>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include "stream.hpp"
@@ -39,6 +41,7 @@
 #include "RDP/mcs.hpp"
 #include "RDP/lic.hpp"
 #include "channel_list.hpp"
+#include "channel_scheduler.hpp"
 #include "RDP/gcc.hpp"
 #include "RDP/sec.hpp"
 #include "colors.hpp"
@@ -52,11 +55,13 @@
 #include "capture.hpp"
 #include "font.hpp"
 #include "bitmap.hpp"
+#include "bitmap_tiles.hpp"
 #include "RDP/caches/bmpcache.hpp"
 #include "RDP/caches/bmpcachepersister.hpp"
 #include "RDP/caches/glyphcache.hpp"
 #include "RDP/caches/pointercache.hpp"
 #include "RDP/caches/brushcache.hpp"
+#include "RDP/caches/offscreencache.hpp"
 #include "client_info.hpp"
 #include "config.hpp"
 #include "error.hpp"
@@ -72,6 +77,8 @@
 #include "RDP/PersistentKeyListPDU.hpp"
 
 #include "RDP/compress_and_draw_bitmap_update.hpp"
+#include "RDP/nscodec.hpp"
+#include "RDP/rfx.hpp"
 
 #include "RDP/capabilities/cap_bmpcache.hpp"
 #include "RDP/capabilities/offscreencache.hpp"
@@ -86,6 +93,8 @@
 #include "RDP/capabilities/compdesk.hpp"
 #include "RDP/capabilities/cap_font.hpp"
 #include "RDP/capabilities/glyphcache.hpp"
+#include "RDP/capabilities/surfacecommands.hpp"
+#include "RDP/capabilities/bitmapcodecs.hpp"
 
 #include "front_api.hpp"
 #include "activity_checker.hpp"
@@ -194,6 +203,27 @@ private:
     GlyphCacheCaps     client_glyphcache_caps;
     bool               use_bitmapcache_rev2;
 
+    uint32_t           client_surface_commands;  // cmdFlags of the client Surface Commands caps
+    uint32_t           client_max_request_size;  // MaxRequestSize of the client Multifragment Update caps
+    bool               client_nscodec;
+    uint8_t            client_nscodec_id;
+    nscodec::Params    nscodec_params;
+    nscodec::Encoder   nscodec_encoder;
+
+    bool               client_remotefx;
+    uint8_t            client_remotefx_id;
+    rfx::Encoder       remotefx_encoder;
+    rfx::TileCache     remotefx_tiles;
+    size_t             remotefx_updates;  // drawing updates sent when remotefx_tiles was last right
+    uint32_t           remotefx_frame_idx;
+    std::vector<rfx::TileSource> remotefx_sources;
+    std::vector<uint64_t>        remotefx_hashes;
+
+    OffscreenCache     offscreen_cache;
+    bool               offscreen_cache_error;  // Offscreen Bitmap Cache Error PDU received
+
+    ChannelScheduler   channel_scheduler;
+
     std::string server_capabilities_filename;
 
     Transport * persistent_key_list_transport;
@@ -242,11 +272,24 @@ public:
     , mem3blt_support(mem3blt_support)
     , clientRequestedProtocols(X224::PROTOCOL_RDP)
     , use_bitmapcache_rev2(false)
+    , client_surface_commands(0)
+    , client_max_request_size(0)
+    , client_nscodec(false)
+    , client_nscodec_id(0)
+    , nscodec_params{1, false}
+    , client_remotefx(false)
+    , client_remotefx_id(0)
+    , remotefx_updates(0)
+    , remotefx_frame_idx(0)
+    , offscreen_cache_error(false)
+    , channel_scheduler(ini.globals.channel_scheduler)
     , server_capabilities_filename(server_capabilities_filename)
     , persistent_key_list_transport(persistent_key_list_transport)
     , mppc_enc(NULL)
     , authentifier(NULL)
     , auth_info_sent(false) {
+        this->channel_scheduler.set_rate_limits(this->ini.globals.channel_rate_limits.get_cstr());
+
         // init TLS
         // --------------------------------------------------------
 
@@ -312,6 +355,12 @@ public:
 
     ~Front() {
         ERR_free_strings();
+
+        // a shared serializer capture uses caches of front
+        if (this->capture && this->capture->is_shared_serializer()) {
+            this->stop_capture();
+        }
+
         delete this->mppc_enc;
 
         delete this->bmp_cache_persister;
@@ -323,6 +372,10 @@ public:
 
         delete this->orders;
         delete this->capture;
+
+        if (this->channel_scheduler.is_enabled() && (this->verbose & 16)) {
+            this->channel_scheduler.log_counters("Front");
+        }
     }
 
     uint64_t get_total_received() const
@@ -366,7 +419,11 @@ public:
                     this->stop_capture();
                     this->start_capture(width, height, this->ini, authentifier);
 
-                    this->capture_state = original_capture_state;
+                    // the new capture records until it is paused (its shared
+                    // serializer mirror is attached by its constructor)
+                    if (original_capture_state == CAPTURE_STATE_PAUSED) {
+                        this->pause_capture();
+                    }
                 }
 
                 this->client_info.width = width;
@@ -437,6 +494,8 @@ public:
             ini.video.capture_png   = false;
             ini.video.png_limit     = 0;
         }
+        // flv movies are generated offline from wrm by redrec
+        ini.video.capture_flv = false;
 
         LOG(LOG_INFO, "---<>  Front::start_capture  <>---");
         struct timeval now = tvtime();
@@ -465,6 +524,14 @@ public:
             throw Error(ERR_RECORDER_FAILED_TO_FOUND_PATH);
         }
         this->capture_bpp = ((ini.video.wrm_color_depth_selection_strategy == 1) ? 16 : 24);
+
+        // Recorder copies the orders sent to client instead of encoding them again,
+        // only possible when the client color depth is the capture color depth.
+        RDPSerializer * shared_serializer = nullptr;
+        if (ini.video.wrm_shared_serializer && this->orders && (this->client_info.bpp == this->capture_bpp)) {
+            shared_serializer = this->orders;
+        }
+
         this->capture = new Capture( now, width, height, this->capture_bpp, this->capture_bpp
                                    , ini.video.record_path
                                    , ini.video.record_tmp_path
@@ -473,6 +540,8 @@ public:
                                    , false
                                    , authentifier
                                    , ini
+                                   , false
+                                   , shared_serializer
                                    );
         if (this->nomouse) {
             this->capture->set_pointer_display();
@@ -510,6 +579,9 @@ public:
         if (this->capture) {
             LOG(LOG_INFO, "---<>   Front::stop_capture  <>---");
             this->authentifier = NULL;
+            if (this->orders) {
+                this->orders->set_mirror(nullptr);
+            }
             delete this->capture;
             this->capture = 0;
 
@@ -522,6 +594,7 @@ public:
            && (this->capture_state == CAPTURE_STATE_STARTED)) {
             this->capture->update_config(ini);
         }
+        this->channel_scheduler.set_rate_limits(ini.globals.channel_rate_limits.get_cstr());
     }
 
     void periodic_snapshot()
@@ -649,6 +722,14 @@ private:
             break;
         }
 
+        // a shared serializer capture must follow the new orders and caches
+        const bool restart_capture = this->capture && this->capture->is_shared_serializer();
+        CaptureState original_capture_state = this->capture_state;
+        auth_api * authentifier = this->authentifier;
+        if (restart_capture) {
+            this->stop_capture();
+        }
+
         // reset outgoing orders and reset caches
         delete this->bmp_cache_persister;
         this->bmp_cache_persister = NULL;
@@ -726,9 +807,36 @@ private:
             , this->verbose
             );
 
+        this->remotefx_tiles.reset(this->client_info.width, this->client_info.height);
+        this->remotefx_updates = 0;
+
+        // offscreen bitmaps of the client are lost on reactivation
+        this->offscreen_cache.reset( this->client_offscreencache_caps.offscreenCacheSize
+                                   , this->client_offscreencache_caps.offscreenCacheEntries);
+        this->offscreen_cache_error = false;
+
+        if (this->ini.client.multifragment_max_request_size) {
+            this->orders->set_max_request_size(std::min( this->client_max_request_size
+                                                       , this->ini.client.multifragment_max_request_size));
+        }
+
         this->pointer_cache.reset(this->client_info);
         this->brush_cache.reset(this->client_info);
         this->glyph_cache.reset(this->client_info.number_of_entries_in_glyph_cache);
+
+        if (this->ini.client.glyph_fragment_cache) {
+            // CacheEntries (2 bytes) then CacheMaximumCellSize (2 bytes)
+            this->orders->set_glyph_fragment_cache(
+                this->client_glyphcache_caps.FragCache & 0xFFFF,
+                this->client_glyphcache_caps.FragCache >> 16);
+        }
+
+        if (restart_capture) {
+            this->start_capture(this->client_info.width, this->client_info.height, this->ini, authentifier);
+            if (original_capture_state == CAPTURE_STATE_PAUSED) {
+                this->pause_capture();
+            }
+        }
     }
 
 public:
@@ -785,17 +893,39 @@ public:
                , chunk, length, chunk_size, flags);
         }
 
-        if (channel.flags & GCC::UserData::CSNet::CHANNEL_OPTION_SHOW_PROTOCOL) {
+        // sent after the graphics of this round when held back
+        if (this->channel_scheduler.queue(channel, chunk, chunk_size, length, flags, tvtime())) {
+            return;
+        }
+
+        this->send_channel_chunk(channel.chanid, channel.flags, chunk, chunk_size, length, flags);
+    }
+
+    // Channel data held back by the scheduler, timeout is lowered to the time
+    // the next pending chunk can be sent.
+    void send_pending_channel_data(timeval & timeout) {
+        this->channel_scheduler.send_pending(tvtime(), timeout, [this](const ChannelScheduler::Chunk & chunk) {
+            this->send_channel_chunk( chunk.chanid, chunk.channel_flags, chunk.data.data(), chunk.data.size()
+                                    , chunk.length, chunk.flags);
+        });
+    }
+
+private:
+    void send_channel_chunk( int chanid, uint32_t channel_flags, const uint8_t * chunk, size_t chunk_size
+                           , size_t length, int flags) {
+        if (channel_flags & GCC::UserData::CSNet::CHANNEL_OPTION_SHOW_PROTOCOL) {
             flags |= CHANNELS::CHANNEL_FLAG_SHOW_PROTOCOL;
         }
 
         CHANNELS::VirtualChannelPDU virtual_channel_pdu(this->verbose);
 
         virtual_channel_pdu.send_to_client( this->trans, this->encrypt
-                                          , this->encryptionLevel, userid, channel.chanid
+                                          , this->encryptionLevel, userid, chanid
                                           , length, flags, chunk, chunk_size);
     }
 
+public:
+
     // Global palette cf [MS-RDPCGR] 2.2.9.1.1.3.1.1.1 Palette Update Data
     // -------------------------------------------------------------------
 
@@ -2502,6 +2632,45 @@ public:
         input_caps.emit(stream);
         caps_count++;
 
+        if (this->ini.client.multifragment_max_request_size && this->fastpath_support) {
+            MultiFragmentUpdateCaps multifragment_update_caps;
+            multifragment_update_caps.MaxRequestSize = this->ini.client.multifragment_max_request_size;
+            if (this->verbose) {
+                multifragment_update_caps.log("Sending to client");
+            }
+            multifragment_update_caps.emit(stream);
+            caps_count++;
+        }
+
+        if ((this->ini.client.nscodec || this->ini.client.remotefx) && this->fastpath_support) {
+            SurfaceCommandsCaps surface_commands_caps;
+            surface_commands_caps.cmdFlags = SURFCMDS_SETSURFACEBITS;
+            if (this->verbose) {
+                surface_commands_caps.log("Sending to client");
+            }
+            surface_commands_caps.emit(stream);
+            caps_count++;
+
+            BitmapCodecCaps bitmap_codecs_caps;
+            BitmapCodecs & codecs = *bitmap_codecs_caps.supportedBitmapCodecs;
+            if (this->ini.client.nscodec) {
+                BitmapCodec & nscodec = codecs.bitmapCodecArray[codecs.bitmapCodecCount++];
+                nscodec.setCodecGUID(CODEC_GUID_NSCODEC);
+                nscodec.nscodecProperties.fAllowDynamicFidelity = 1;
+                nscodec.nscodecProperties.fAllowSubsampling = 1;
+                nscodec.nscodecProperties.colorLossLevel = 3;
+            }
+            if (this->ini.client.remotefx) {
+                BitmapCodec & remotefx = codecs.bitmapCodecArray[codecs.bitmapCodecCount++];
+                remotefx.setCodecGUID(CODEC_GUID_REMOTEFX);
+            }
+            if (this->verbose) {
+                bitmap_codecs_caps.log("Sending to client");
+            }
+            bitmap_codecs_caps.emit(stream);
+            caps_count++;
+        }
+
         size_t caps_size = stream.get_offset() - caps_count_offset;
         stream.set_out_uint16_le(caps_size, caps_size_offset);
         stream.set_out_uint32_le(caps_count, caps_count_offset);
@@ -2829,6 +2998,7 @@ public:
                     if (this->verbose) {
                         cap.log("Receiving from client");
                     }
+                    this->client_max_request_size = cap.MaxRequestSize;
                 }
                 break;
             case CAPSETTYPE_LARGE_POINTER: /* 27 */
@@ -2836,14 +3006,51 @@ public:
                     LOG(LOG_INFO, "Receiving from client CAPSETTYPE_LARGE_POINTER");
                 }
                 break;
-            case CAPSETTYPE_SURFACE_COMMANDS: /* 28 */
-                if (this->verbose) {
-                    LOG(LOG_INFO, "Receiving from client CAPSETTYPE_SURFACE_COMMANDS");
+            case CAPSETTYPE_SURFACE_COMMANDS: { /* 28 */
+                    SurfaceCommandsCaps cap;
+                    cap.recv(stream, capset_length);
+                    if (this->verbose) {
+                        cap.log("Receiving from client");
+                    }
+                    this->client_surface_commands = cap.cmdFlags;
                 }
                 break;
-            case CAPSETTYPE_BITMAP_CODECS: /* 29 */
-                if (this->verbose) {
-                    LOG(LOG_INFO, "Receiving from client CAPSETTYPE_BITMAP_CODECS");
+            case CAPSETTYPE_BITMAP_CODECS: { /* 29 */
+                    BitmapCodecCaps cap;
+                    cap.recv(stream, capset_length);
+                    if (this->verbose) {
+                        cap.log("Receiving from client");
+                    }
+                    const BitmapCodec * nscodec = cap.find(CODEC_GUID_NSCODEC);
+                    this->client_nscodec = nscodec;
+                    if (nscodec) {
+                        // color loss is only allowed with dynamic fidelity
+                        const NSCodecCaps & properties = nscodec->nscodecProperties;
+                        this->client_nscodec_id = nscodec->codecID;
+                        this->nscodec_params.color_loss_level = properties.fAllowDynamicFidelity
+                            ? std::max<uint8_t>(1, std::min<uint8_t>(3, properties.colorLossLevel))
+                            : 1;
+                        this->nscodec_params.subsampling = properties.fAllowSubsampling;
+                    }
+
+                    const BitmapCodec * remotefx = cap.find(CODEC_GUID_REMOTEFX);
+                    const RFXICap * icap = nullptr;
+                    if (remotefx) {
+                        // RLGR3 codes long runs of zeros better
+                        icap = remotefx->remotefxProperties.find(CLW_ENTROPY_RLGR3);
+                        if (!icap) {
+                            icap = remotefx->remotefxProperties.find(CLW_ENTROPY_RLGR1);
+                        }
+                    }
+                    this->client_remotefx = icap;
+                    if (icap) {
+                        this->client_remotefx_id = remotefx->codecID;
+                        this->remotefx_encoder.params.entropy = icap->entropyBits;
+                        this->remotefx_encoder.params.flags = icap->flags & CODEC_MODE;
+                        if (this->ini.client.remotefx) {
+                            this->remotefx_encoder.start_workers(this->ini.client.remotefx_encoder_threads);
+                        }
+                    }
                 }
                 break;
             case CAPSETTYPE_FRAME_ACKNOWLEDGE: /* 30 */
@@ -3576,6 +3783,11 @@ public:
             if (this->verbose & 8) {
                 LOG(LOG_INFO, "PDUTYPE2_OFFSCRCACHE_ERROR_PDU");
             }
+            // the client lost its offscreen bitmaps, content is sent again
+            //  from now on instead of being copied from them
+            LOG(LOG_WARNING, "Front::process_data: offscreen bitmap cache error, offscreen bitmaps disabled");
+            this->offscreen_cache_error = true;
+            this->offscreen_cache.clear();
             TODO("this quickfix prevents a tech crash, but consuming the data should be a better behaviour")
             sdata_in.payload.p = sdata_in.payload.end;
         break;
@@ -3833,16 +4045,214 @@ public:
                  src_tile.x, src_tile.y, src_tile.cx, src_tile.cy);
         }
 
-        const Bitmap tiled_bmp(bitmap, src_tile);
+        this->draw_tiled_bmp(dst_tile, cmd, Bitmap(bitmap, src_tile), clip);
+    }
+
+private:
+    void draw_tiled_bmp(const Rect & dst_tile, const RDPMemBlt & cmd, const Bitmap & tiled_bmp, const Rect & clip)
+    {
         const RDPMemBlt cmd2(0, dst_tile, cmd.rop, 0, 0, 0);
-        this->orders->draw(cmd2, clip, tiled_bmp);
+        const Rect visible = dst_tile.intersect(clip);
+        if (!(is_srccopy(cmd) && !visible.isempty()
+              && this->draw_surface_bits(visible, tiled_bmp, visible.x - dst_tile.x, visible.y - dst_tile.y))) {
+            this->orders->draw(cmd2, clip, tiled_bmp);
+        }
         if (  this->capture
             && (this->capture_state == CAPTURE_STATE_STARTED)) {
             this->capture->draw(cmd2, clip, Bitmap(this->capture_bpp, tiled_bmp));
         }
     }
 
-private:
+    enum {
+        NSCODEC_MIN_AREA = 32 * 32,
+        NSCODEC_MAX_SIDE = 64,
+        REMOTEFX_MIN_AREA = 32 * 32
+    };
+
+    // Bitmap pixels sent in Set Surface Bits commands rather than as
+    // orders, RemoteFX first. false when nothing was sent.
+    bool draw_surface_bits(const Rect & dest, const Bitmap & bmp, uint16_t src_x, uint16_t src_y)
+    {
+        return (this->use_remotefx() && this->draw_remotefx(dest, bmp, src_x, src_y))
+            || (this->use_nscodec() && this->draw_nscodec(dest, bmp, src_x, src_y));
+    }
+
+    bool use_remotefx() const
+    {
+        return this->ini.client.remotefx
+            && this->client_remotefx
+            && (this->client_surface_commands & SURFCMDS_SETSURFACEBITS)
+            && this->server_fastpath_update_support
+            && this->client_info.bpp >= 24
+            && !(this->capture && this->capture->is_shared_serializer());
+    }
+
+    // Sends the tiles of the screen covered by dest, with the pixels of bmp
+    // from (src_x, src_y), in RemoteFX messages that each fit in one update
+    // (fragmented when the client allows it). A tile whose pixels are the ones sent
+    // last time is skipped, as long as no other update was sent since.
+    bool draw_remotefx(const Rect & dest, const Bitmap & bmp, uint16_t src_x, uint16_t src_y)
+    {
+        const Rect visible = dest.intersect(Rect(0, 0, this->client_info.width, this->client_info.height));
+        if (size_t(visible.cx) * visible.cy < REMOTEFX_MIN_AREA) {
+            return false;
+        }
+        src_x += visible.x - dest.x;
+        src_y += visible.y - dest.y;
+
+        const Bitmap pixels((bmp.bpp() == 32) ? 32 : 24, bmp);
+        const uint8_t Bpp = ::nbbytes(pixels.bpp());
+        const ptrdiff_t line_size = pixels.line_size();
+        // bitmap rows are stored bottom-up
+        auto first_row = [&](uint16_t x, uint16_t y) {
+            return pixels.data() + line_size * (pixels.cy() - 1 - y) + x * Bpp;
+        };
+
+        this->orders->flush();
+        if (this->orders->drawing_updates() != this->remotefx_updates) {
+            this->remotefx_tiles.clear();
+        }
+
+        this->remotefx_sources.clear();
+        this->remotefx_hashes.clear();
+        for (uint16_t y_idx = visible.y / rfx::TILE_SIZE; y_idx * rfx::TILE_SIZE < visible.bottom(); ++y_idx) {
+            for (uint16_t x_idx = visible.x / rfx::TILE_SIZE; x_idx * rfx::TILE_SIZE < visible.right(); ++x_idx) {
+                const Rect tile(x_idx * rfx::TILE_SIZE, y_idx * rfx::TILE_SIZE, rfx::TILE_SIZE, rfx::TILE_SIZE);
+                const Rect part = tile.intersect(visible);
+                const uint8_t * part_row = first_row(src_x + part.x - visible.x, src_y + part.y - visible.y);
+                const uint64_t hash = rfx::tile_hash(part_row, -line_size, part.cx * Bpp, part.cy, part);
+                if (this->remotefx_tiles.contains(x_idx, y_idx, hash)) {
+                    continue;
+                }
+                this->remotefx_sources.push_back(rfx::TileSource{
+                    part_row, uint16_t(part.x - tile.x), uint16_t(part.y - tile.y), part.cx, part.cy, x_idx, y_idx
+                });
+                this->remotefx_hashes.push_back(hash);
+            }
+        }
+        if (this->remotefx_sources.empty()) {
+            return true;
+        }
+
+        const size_t count = this->remotefx_sources.size();
+        if (!this->remotefx_encoder.encode(&this->remotefx_sources[0], count, -line_size, Bpp)) {
+            return false;
+        }
+        // a Set Surface Bits command header comes before the message
+        const size_t max_message_size = this->orders->max_update_size() - 22;
+        const size_t message_base_size = rfx::HEADERS_SIZE + rfx::FRAME_SIZE + rfx::QUANT_SIZE;
+        for (size_t i = 0; i < count; ++i) {
+            const size_t size = rfx::TILE_HEADER_SIZE + rfx::RECT_SIZE + this->remotefx_encoder.tile(i).data.size();
+            if (message_base_size + size > max_message_size) {
+                return false;
+            }
+        }
+
+        const rfx::Params & params = this->remotefx_encoder.params;
+        std::vector<const rfx::Tile *> tiles;
+        std::vector<Rect> rects;
+        for (size_t first = 0; first < count; ) {
+            size_t message_size = message_base_size;
+            tiles.clear();
+            rects.clear();
+            for (; first < count; ++first) {
+                const rfx::Tile & tile = this->remotefx_encoder.tile(first);
+                const size_t size = rfx::TILE_HEADER_SIZE + rfx::RECT_SIZE + tile.data.size();
+                if (message_size + size > max_message_size) {
+                    break;
+                }
+                message_size += size;
+                const rfx::TileSource & source = this->remotefx_sources[first];
+                tiles.push_back(&tile);
+                rects.push_back(Rect( source.x_idx * rfx::TILE_SIZE + source.x, source.y_idx * rfx::TILE_SIZE + source.y
+                                    , source.cx, source.cy));
+            }
+
+            BStream stream(message_size);
+            rfx::emit_headers(stream, this->client_info.width, this->client_info.height, params);
+            rfx::emit_frame( stream, this->remotefx_frame_idx++, &rects[0], rects.size()
+                           , &tiles[0], tiles.size(), params);
+            stream.mark_end();
+
+            RDPSetSurfaceBits cmd;
+            cmd.dest_right = this->client_info.width;
+            cmd.dest_bottom = this->client_info.height;
+            cmd.bpp = 32;
+            cmd.codec_id = this->client_remotefx_id;
+            cmd.width = this->client_info.width;
+            cmd.height = this->client_info.height;
+            cmd.bitmap_data_length = stream.size();
+            this->orders->send_surface_bits(cmd, stream.get_data());
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            const rfx::TileSource & source = this->remotefx_sources[i];
+            this->remotefx_tiles.set(source.x_idx, source.y_idx, this->remotefx_hashes[i]);
+        }
+        this->remotefx_updates = this->orders->drawing_updates();
+        return true;
+    }
+
+    // Photographic bitmaps go to the client as NSCodec Set Surface Bits
+    // commands, a fast-path only update. Not while the recorder copies the
+    // orders sent to the client, it would miss them.
+    bool use_nscodec() const
+    {
+        return this->ini.client.nscodec
+            && this->client_nscodec
+            && (this->client_surface_commands & SURFCMDS_SETSURFACEBITS)
+            && this->server_fastpath_update_support
+            && this->client_info.bpp >= 24
+            && !(this->capture && this->capture->is_shared_serializer());
+    }
+
+    // Sends the pixels of bmp from (src_x, src_y) to dest, in blocks of at
+    // most NSCODEC_MAX_SIDE pixels to stay within one fast-path update.
+    // Nothing is sent if the bitmap is small or not photographic.
+    bool draw_nscodec(const Rect & dest, const Bitmap & bmp, uint16_t src_x, uint16_t src_y)
+    {
+        if (size_t(dest.cx) * dest.cy < NSCODEC_MIN_AREA) {
+            return false;
+        }
+
+        const Bitmap pixels((bmp.bpp() == 32) ? 32 : 24, bmp);
+        const uint8_t Bpp = ::nbbytes(pixels.bpp());
+        const ptrdiff_t line_size = pixels.line_size();
+        // bitmap rows are stored bottom-up
+        auto first_row = [&](uint16_t x, uint16_t y) {
+            return pixels.data() + line_size * (pixels.cy() - 1 - y) + x * Bpp;
+        };
+
+        if (!bitmap_tiles::is_photographic(first_row(src_x, src_y), -line_size, Bpp, dest.cx, dest.cy)) {
+            return false;
+        }
+
+        for (uint16_t y = 0; y < dest.cy; y += NSCODEC_MAX_SIDE) {
+            const uint16_t cy = std::min<uint16_t>(NSCODEC_MAX_SIDE, dest.cy - y);
+            for (uint16_t x = 0; x < dest.cx; x += NSCODEC_MAX_SIDE) {
+                const uint16_t cx = std::min<uint16_t>(NSCODEC_MAX_SIDE, dest.cx - x);
+
+                BStream stream(nscodec::max_encoded_size(cx, cy, this->nscodec_params.subsampling));
+                this->nscodec_encoder.encode( stream, first_row(src_x + x, src_y + y), -line_size, Bpp
+                                            , cx, cy, this->nscodec_params);
+                stream.mark_end();
+
+                RDPSetSurfaceBits cmd;
+                cmd.dest_left = dest.x + x;
+                cmd.dest_top = dest.y + y;
+                cmd.dest_right = cmd.dest_left + cx;
+                cmd.dest_bottom = cmd.dest_top + cy;
+                cmd.bpp = 32;
+                cmd.codec_id = this->client_nscodec_id;
+                cmd.width = cx;
+                cmd.height = cy;
+                cmd.bitmap_data_length = stream.size();
+                this->orders->send_surface_bits(cmd, stream.get_data());
+            }
+        }
+        return true;
+    }
+
     void priv_draw_tile(const Rect & dst_tile, const Rect & src_tile, const RDPMemBlt & cmd, const Bitmap & bitmap, const Rect & clip)
     {
         this->draw_tile(dst_tile, src_tile, cmd, bitmap, clip);
@@ -3853,6 +4263,197 @@ private:
         this->draw_tile3(dst_tile, src_tile, cmd, bitmap, clip);
     }
 
+    static bool is_srccopy(const RDPMemBlt & cmd)
+    {
+        return cmd.rop == 0xCC;
+    }
+
+    static bool is_srccopy(const RDPMem3Blt &)
+    {
+        return false;
+    }
+
+    enum {
+        OFFSCREEN_MIN_AREA = 128 * 128
+    };
+
+    // Offscreen bitmaps only live on the client: not while the recorder copies
+    // the orders sent to the client, nor once the client failed to keep them.
+    bool use_offscreen_cache() const
+    {
+        return this->ini.client.offscreen_bitmap_cache
+            && this->client_offscreencache_caps.offscreenSupportLevel
+            && this->offscreen_cache.enabled()
+            && !this->offscreen_cache_error
+            && this->client_info.bpp > 8
+            && !(this->capture && this->capture->is_shared_serializer());
+    }
+
+    void offscreen_signature( const Bitmap & bitmap, const Rect & src
+                            , OffscreenCache::Signature & sig) const
+    {
+        const uint8_t Bpp = ::nbbytes(bitmap.bpp());
+        const size_t line_size = bitmap.line_size();
+        // bitmap rows are stored bottom-up
+        const uint8_t * row = bitmap.data() + line_size * (bitmap.cy() - src.y - src.cy) + src.x * Bpp;
+
+        SslSha1 sha1;
+        const uint8_t bpp = bitmap.bpp();
+        sha1.update(&bpp, sizeof(bpp));
+        sha1.update(reinterpret_cast<const uint8_t *>(&src.cx), sizeof(src.cx));
+        sha1.update(reinterpret_cast<const uint8_t *>(&src.cy), sizeof(src.cy));
+        for (uint16_t y = 0; y < src.cy; ++y, row += line_size) {
+            sha1.update(row, src.cx * Bpp);
+        }
+        sha1.final(sig, sizeof(sig));
+    }
+
+    // A large MemBlt drawn a second time is kept in a client offscreen bitmap,
+    // then every drawing of the same pixels is a MemBlt from this bitmap.
+    // The capture is still drawn tile by tile. false when nothing was sent.
+    bool draw_offscreen( const RDPMemBlt & cmd, const Rect & clip, const Bitmap & bitmap
+                       , uint16_t dst_cx, uint16_t dst_cy)
+    {
+        if (size_t(dst_cx) * dst_cy < OFFSCREEN_MIN_AREA) {
+            return false;
+        }
+
+        const Rect src(cmd.srcx, cmd.srcy, dst_cx, dst_cy);
+        OffscreenCache::Signature sig;
+        this->offscreen_signature(bitmap, src, sig);
+
+        const uint16_t TILE_CX = ((::nbbytes(this->client_info.bpp) * 64 * 64 < RDPSerializer::MAX_ORDERS_SIZE) ? 64 : 32);
+        const uint16_t TILE_CY = TILE_CX;
+
+        int id = this->offscreen_cache.find(sig, dst_cx, dst_cy);
+        if (id < 0) {
+            if (!this->offscreen_cache.seen(sig)) {
+                return false;
+            }
+
+            RDP::CreateOffscrBitmap create(0, dst_cx, dst_cy);
+            id = this->offscreen_cache.allocate( sig, dst_cx, dst_cy
+                                               , ::nbbytes(this->client_info.bpp) * dst_cx * dst_cy
+                                               , create.delete_indices, create.delete_count);
+            if (id < 0) {
+                return false;
+            }
+            create.offscreen_bitmap_id = id;
+            if (this->verbose & 64) {
+                create.log(LOG_INFO);
+            }
+            this->orders->draw(create);
+
+            // tiles go through the bitmap cache, Set Surface Bits commands
+            //  always target the screen
+            const Rect surface(0, 0, dst_cx, dst_cy);
+            this->orders->draw(RDP::SwitchSurface(id));
+            for (int y = 0; y < dst_cy ; y += TILE_CY) {
+                int cy = std::min(TILE_CY, (uint16_t)(dst_cy - y));
+                for (int x = 0; x < dst_cx ; x += TILE_CX) {
+                    int cx = std::min(TILE_CX, (uint16_t)(dst_cx - x));
+                    const Rect src_tile(cmd.srcx + x, cmd.srcy + y, cx, cy);
+                    this->orders->draw(RDPMemBlt(0, Rect(x, y, cx, cy), 0xCC, 0, 0, 0), surface, Bitmap(bitmap, src_tile));
+                }
+            }
+            this->orders->draw(RDP::SwitchSurface());
+        }
+
+        this->orders->draw_offscreen(
+            RDPMemBlt(TS_BITMAPCACHE_SCREEN_ID, Rect(cmd.rect.x, cmd.rect.y, dst_cx, dst_cy), cmd.rop, 0, 0, id), clip);
+
+        if (  this->capture
+            && (this->capture_state == CAPTURE_STATE_STARTED)) {
+            for (int y = 0; y < dst_cy ; y += TILE_CY) {
+                int cy = std::min(TILE_CY, (uint16_t)(dst_cy - y));
+                for (int x = 0; x < dst_cx ; x += TILE_CX) {
+                    int cx = std::min(TILE_CX, (uint16_t)(dst_cx - x));
+                    const Rect dst_tile(cmd.rect.x + x, cmd.rect.y + y, cx, cy);
+                    const Rect src_tile(cmd.srcx + x, cmd.srcy + y, cx, cy);
+                    this->capture->draw( RDPMemBlt(0, dst_tile, cmd.rop, 0, 0, 0), clip
+                                       , Bitmap(this->capture_bpp, Bitmap(bitmap, src_tile)));
+                }
+            }
+        }
+        return true;
+    }
+
+    static bool draw_offscreen(const RDPMem3Blt &, const Rect &, const Bitmap &, uint16_t, uint16_t)
+    {
+        return false;
+    }
+
+    // Tile geometry comes from the client bitmap cache cell sizes. Uniform
+    // SRCCOPY tiles are sent as OpaqueRect, and a tile with the same pixels as
+    // an earlier tile of the same MemBlt reuses its Bitmap: the copy and the
+    // sha1 are done once, the next ones are bitmap cache hits.
+    template<class MemBlt>
+    void priv_draw_adaptive_tiles( const MemBlt & cmd, const Rect & clip, const Bitmap & bitmap
+                                 , uint16_t dst_x, uint16_t dst_y, uint16_t dst_cx, uint16_t dst_cy)
+    {
+        const uint32_t cell_size = std::max(std::max( this->client_info.cache1_size
+                                                    , this->client_info.cache2_size)
+                                                    , this->client_info.cache3_size);
+        const uint16_t max_side = bitmap_tiles::max_tile_side(
+            ::nbbytes(this->client_info.bpp), cell_size, RDPSerializer::MAX_ORDERS_SIZE);
+        const uint16_t TILE_CX = bitmap_tiles::balanced_tile_length(dst_cx, max_side, true);
+        const uint16_t TILE_CY = bitmap_tiles::balanced_tile_length(dst_cy, max_side, false);
+
+        // uniform tiles are sent in the module color depth, 8 bpp palette
+        // indexes are not decoded the same way for orders and bitmaps
+        const bool send_uniform_as_opaquerect = is_srccopy(cmd)
+                                             && bitmap.bpp() == this->mod_bpp
+                                             && this->mod_bpp > 8;
+
+        const uint8_t Bpp = ::nbbytes(bitmap.bpp());
+        const size_t line_size = bitmap.line_size();
+        // bitmap rows are stored bottom-up
+        auto tile_first_row = [&](const Rect & src_tile) {
+            return bitmap.data() + line_size * (bitmap.cy() - src_tile.y - src_tile.cy) + src_tile.x * Bpp;
+        };
+
+        struct SentTile {
+            Rect src_tile;
+            Bitmap tiled_bmp;
+        };
+        std::vector<SentTile> sent_tiles;
+
+        for (int y = 0; y < dst_cy ; y += TILE_CY) {
+            int cy = std::min(TILE_CY, (uint16_t)(dst_cy - y));
+
+            for (int x = 0; x < dst_cx ; x += TILE_CX) {
+                int cx = std::min(TILE_CX, (uint16_t)(dst_cx - x));
+
+                const Rect dst_tile(dst_x + x, dst_y + y, cx, cy);
+                const Rect src_tile(cmd.srcx + x, cmd.srcy + y, cx, cy);
+                const uint8_t * first_row = tile_first_row(src_tile);
+
+                uint32_t pixel;
+                if (send_uniform_as_opaquerect
+                 && bitmap_tiles::is_uniform(first_row, line_size, Bpp, cx, cy, pixel)) {
+                    // order colors have red and blue swapped compared to bitmap pixels
+                    const BGRColor color = color_encode(
+                        RGBtoBGR(color_decode(pixel, bitmap.bpp(), bitmap.palette())), bitmap.bpp());
+                    this->draw(RDPOpaqueRect(dst_tile, color), clip);
+                    continue;
+                }
+
+                auto same_tile = std::find_if(sent_tiles.begin(), sent_tiles.end(), [&](const SentTile & sent) {
+                    return sent.src_tile.cx == cx && sent.src_tile.cy == cy
+                        && bitmap_tiles::same_pixels( tile_first_row(sent.src_tile), first_row
+                                                    , line_size, cx * Bpp, cy);
+                });
+                if (same_tile != sent_tiles.end()) {
+                    this->draw_tiled_bmp(dst_tile, cmd, same_tile->tiled_bmp, clip);
+                    continue;
+                }
+
+                sent_tiles.push_back({src_tile, Bitmap(bitmap, src_tile)});
+                this->draw_tiled_bmp(dst_tile, cmd, sent_tiles.back().tiled_bmp, clip);
+            }
+        }
+    }
+
     template<class MemBlt>
     void priv_draw_memblt(const MemBlt & cmd, const Rect & clip, const Bitmap & bitmap)
     {
@@ -3877,6 +4478,10 @@ private:
         const uint16_t dst_cx = std::min<uint16_t>(bitmap.cx() - cmd.srcx, cmd.rect.cx);
         const uint16_t dst_cy = std::min<uint16_t>(bitmap.cy() - cmd.srcy, cmd.rect.cy);
 
+        if (this->use_offscreen_cache() && this->draw_offscreen(cmd, clip, bitmap, dst_cx, dst_cy)) {
+            return;
+        }
+
         // check if target bitmap can be fully stored inside one front cache entry
         // if so no need to tile it.
         uint32_t front_bitmap_size = ::nbbytes(this->client_info.bpp) * align4(dst_cx) * dst_cy;
@@ -3890,7 +4495,10 @@ private:
 //            this->client_info.cache2_size,
 //            this->client_info.cache3_size,
 //            front_bitmap_size);
-        if (front_bitmap_size <= this->client_info.cache3_size
+        if (this->ini.client.adaptive_bitmap_tiling) {
+            this->priv_draw_adaptive_tiles(cmd, clip, bitmap, dst_x, dst_y, dst_cx, dst_cy);
+        }
+        else if (front_bitmap_size <= this->client_info.cache3_size
             && align4(dst_cx) < 128 && dst_cy < 128) {
             // clip dst as it can be larger than source bitmap
             const Rect dst_tile(dst_x, dst_y, dst_cx, dst_cy);
@@ -3930,7 +4538,12 @@ public:
                  src_tile.x, src_tile.y, src_tile.cx, src_tile.cy);
         }
 
-        const Bitmap tiled_bmp(bitmap, src_tile);
+        this->draw_tiled_bmp(dst_tile, cmd, Bitmap(bitmap, src_tile), clip);
+    }
+
+private:
+    void draw_tiled_bmp(const Rect & dst_tile, const RDPMem3Blt & cmd, const Bitmap & tiled_bmp, const Rect & clip)
+    {
         RDPMem3Blt cmd2(0, dst_tile, cmd.rop, 0, 0, cmd.back_color, cmd.fore_color, cmd.brush, 0);
 
         if (this->client_info.bpp != this->mod_bpp) {
@@ -3961,6 +4574,7 @@ public:
         }
     }
 
+public:
     void draw(const RDPMem3Blt & cmd, const Rect & clip, const Bitmap & bitmap)
     {
         this->priv_draw_memblt(cmd, clip, bitmap);
@@ -4323,7 +4937,12 @@ public:
     virtual void draw(const RDPBitmapData & bitmap_data, const uint8_t * data
                      , size_t size, const Bitmap & bmp) {
         //LOG(LOG_INFO, "Front::draw(BitmapUpdate)");
-        this->orders->draw(bitmap_data, data, size, bmp);
+        const Rect dest( bitmap_data.dest_left, bitmap_data.dest_top
+                       , bitmap_data.dest_right - bitmap_data.dest_left + 1
+                       , bitmap_data.dest_bottom - bitmap_data.dest_top + 1);
+        if (!(dest.cx <= bmp.cx() && dest.cy <= bmp.cy() && this->draw_surface_bits(dest, bmp, 0, 0))) {
+            this->orders->draw(bitmap_data, data, size, bmp);
+        }
         //bitmap_data.log(LOG_INFO, "Front");
         //hexdump_d(data, size);
         if (  this->capture
@@ -0,0 +1,832 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2014
+    Author(s): Christophe Grosjean, Raphael Zhou
+
+    Graphics pipeline benchmark over a directory of WRM/TRM recordings
+*/
+
+#include <boost/program_options.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define LOGPRINT
+#include "log.hpp"
+
+#include "version.hpp"
+#include "difftimeval.hpp"
+#include "channel_list.hpp"
+#include "front_api.hpp"
+#include "in_file_transport.hpp"
+#include "FileToGraphic.hpp"
+#include "nativecapture.hpp"
+#include "image_capture.hpp"
+#include "transparentplayer.hpp"
+#include "RDP/mppc_40.hpp"
+#include "RDP/mppc_50.hpp"
+#include "RDP/mppc_60.hpp"
+#include "RDP/mppc_61.hpp"
+
+static inline uint64_t nstime() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return uint64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+struct BenchCounter {
+    uint64_t count;
+    uint64_t ns;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+
+    BenchCounter() : count(0), ns(0), bytes_in(0), bytes_out(0) {}
+
+    void add(uint64_t ns, uint64_t bytes_in = 0, uint64_t bytes_out = 0) {
+        this->count++;
+        this->ns        += ns;
+        this->bytes_in  += bytes_in;
+        this->bytes_out += bytes_out;
+    }
+
+    void merge(const BenchCounter & other) {
+        this->count     += other.count;
+        this->ns        += other.ns;
+        this->bytes_in  += other.bytes_in;
+        this->bytes_out += other.bytes_out;
+    }
+};
+
+enum BenchStage {
+    STAGE_PARSE,        // FileToGraphic, no consumer
+    STAGE_DRAW,         // RDPDrawable
+    STAGE_PNG,          // ImageCapture::flush()
+    STAGE_BMP_CACHE,    // BmpCache::cache_bitmap()
+    STAGE_COMPRESS,     // Bitmap::compress(), interleaved RLE
+    STAGE_COMPRESS60,   // Bitmap::compress(32), planar codec
+    STAGE_SERIALIZE,    // NativeCapture / GraphicToFile
+    STAGE_MPPC40,
+    STAGE_MPPC50,
+    STAGE_MPPC60,
+    STAGE_MPPC61,
+    STAGE_TRM_READ,     // TransparentPlayer, no decoding
+    STAGE_COUNT
+};
+
+static const char * stage_names[STAGE_COUNT] = {
+    "parse", "draw", "png", "bmp_cache", "compress", "compress60", "serialize"
+  , "mppc40", "mppc50", "mppc60", "mppc61", "trm_read"
+};
+
+enum BenchOrder {
+    ORDER_DSTBLT,
+    ORDER_MULTIDSTBLT,
+    ORDER_PATBLT,
+    ORDER_MULTIPATBLT,
+    ORDER_OPAQUERECT,
+    ORDER_MULTIOPAQUERECT,
+    ORDER_SCRBLT,
+    ORDER_MULTISCRBLT,
+    ORDER_MEMBLT,
+    ORDER_MEM3BLT,
+    ORDER_LINETO,
+    ORDER_GLYPHINDEX,
+    ORDER_POLYGONSC,
+    ORDER_POLYGONCB,
+    ORDER_POLYLINE,
+    ORDER_ELLIPSESC,
+    ORDER_ELLIPSECB,
+    ORDER_FRAMEMARKER,
+    ORDER_BITMAPDATA,
+    ORDER_POINTER,
+    ORDER_SNAPSHOT,     // capture device, timestamps and breakpoints
+    ORDER_COUNT
+};
+
+static const char * order_names[ORDER_COUNT] = {
+    "DstBlt", "MultiDstBlt", "PatBlt", "MultiPatBlt", "OpaqueRect", "MultiOpaqueRect"
+  , "ScrBlt", "MultiScrBlt", "MemBlt", "Mem3Blt", "LineTo", "GlyphIndex"
+  , "PolygonSC", "PolygonCB", "Polyline", "EllipseSC", "EllipseCB"
+  , "FrameMarker", "BitmapData", "Pointer", "Snapshot"
+};
+
+// Only accumulates the data sent, the recorded WRM is kept for MPPC.
+class BufferTransport : public Transport {
+public:
+    std::vector<uint8_t> data;
+
+private:
+    virtual void do_send(const char * const buffer, size_t len) {
+        this->data.insert(this->data.end(), buffer, buffer + len);
+    }
+};
+
+// Forwards the orders played by FileToGraphic to a consumer and accumulates
+// the time spent in the consumer by order type. Without consumer the orders
+// are only counted. Bitmaps drawn are kept (in drawing order) for the bitmap
+// cache and compression stages.
+class TimedConsumer : public RDPGraphicDevice, public RDPCaptureDevice {
+    RDPGraphicDevice * graphic_device;
+    RDPCaptureDevice * capture_device;
+
+public:
+    enum {
+        MAX_BITMAPS = 1000000
+    };
+
+    BenchCounter          orders[ORDER_COUNT];
+    std::vector<Bitmap> * bitmaps;
+
+    TimedConsumer(RDPGraphicDevice * graphic_device, RDPCaptureDevice * capture_device)
+    : graphic_device(graphic_device)
+    , capture_device(capture_device)
+    , bitmaps(nullptr) {}
+
+    uint64_t total_ns() const {
+        uint64_t ns = 0;
+        for (const BenchCounter & counter : this->orders) {
+            ns += counter.ns;
+        }
+        return ns;
+    }
+
+private:
+    template<class Draw>
+    void timed(BenchOrder type, Draw && draw) {
+        if (!this->graphic_device) {
+            this->orders[type].count++;
+            return;
+        }
+        const uint64_t start = nstime();
+        draw(*this->graphic_device);
+        this->orders[type].add(nstime() - start);
+    }
+
+    void keep(const Bitmap & bmp) {
+        if (this->bitmaps && this->bitmaps->size() < MAX_BITMAPS) {
+            this->bitmaps->push_back(bmp);
+        }
+    }
+
+public:
+    virtual void draw(const RDPDestBlt & cmd, const Rect & clip) {
+        this->timed(ORDER_DSTBLT, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDPMultiDstBlt & cmd, const Rect & clip) {
+        this->timed(ORDER_MULTIDSTBLT, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDPPatBlt & cmd, const Rect & clip) {
+        this->timed(ORDER_PATBLT, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDP::RDPMultiPatBlt & cmd, const Rect & clip) {
+        this->timed(ORDER_MULTIPATBLT, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDPOpaqueRect & cmd, const Rect & clip) {
+        this->timed(ORDER_OPAQUERECT, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDPMultiOpaqueRect & cmd, const Rect & clip) {
+        this->timed(ORDER_MULTIOPAQUERECT, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDPScrBlt & cmd, const Rect & clip) {
+        this->timed(ORDER_SCRBLT, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDP::RDPMultiScrBlt & cmd, const Rect & clip) {
+        this->timed(ORDER_MULTISCRBLT, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDPMemBlt & cmd, const Rect & clip, const Bitmap & bmp) {
+        this->keep(bmp);
+        this->timed(ORDER_MEMBLT, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip, bmp); });
+    }
+
+    virtual void draw(const RDPMem3Blt & cmd, const Rect & clip, const Bitmap & bmp) {
+        this->keep(bmp);
+        this->timed(ORDER_MEM3BLT, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip, bmp); });
+    }
+
+    virtual void draw(const RDPLineTo & cmd, const Rect & clip) {
+        this->timed(ORDER_LINETO, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDPGlyphIndex & cmd, const Rect & clip, const GlyphCache * gly_cache) {
+        this->timed(ORDER_GLYPHINDEX, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip, gly_cache); });
+    }
+
+    virtual void draw(const RDPPolygonSC & cmd, const Rect & clip) {
+        this->timed(ORDER_POLYGONSC, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDPPolygonCB & cmd, const Rect & clip) {
+        this->timed(ORDER_POLYGONCB, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDPPolyline & cmd, const Rect & clip) {
+        this->timed(ORDER_POLYLINE, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDPEllipseSC & cmd, const Rect & clip) {
+        this->timed(ORDER_ELLIPSESC, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDPEllipseCB & cmd, const Rect & clip) {
+        this->timed(ORDER_ELLIPSECB, [&](RDPGraphicDevice & gd) { gd.draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDPColCache & cmd) {
+        if (this->graphic_device) {
+            this->graphic_device->draw(cmd);
+        }
+    }
+
+    virtual void draw(const RDPBrushCache & cmd) {
+        if (this->graphic_device) {
+            this->graphic_device->draw(cmd);
+        }
+    }
+
+    virtual void draw(const RDP::FrameMarker & order) {
+        this->timed(ORDER_FRAMEMARKER, [&](RDPGraphicDevice & gd) { gd.draw(order); });
+    }
+
+    virtual void draw( const RDPBitmapData & bitmap_data, const uint8_t * data, std::size_t size
+                     , const Bitmap & bmp) {
+        this->keep(bmp);
+        this->timed(ORDER_BITMAPDATA, [&](RDPGraphicDevice & gd) { gd.draw(bitmap_data, data, size, bmp); });
+    }
+
+    virtual void server_set_pointer(const Pointer & cursor) {
+        this->timed(ORDER_POINTER, [&](RDPGraphicDevice & gd) { gd.server_set_pointer(cursor); });
+    }
+
+    virtual void set_mod_palette(const BGRPalette & palette) {
+        if (this->graphic_device) {
+            this->graphic_device->set_mod_palette(palette);
+        }
+    }
+
+    virtual void flush() {
+        if (this->graphic_device) {
+            this->graphic_device->flush();
+        }
+    }
+
+    // RDPCaptureDevice
+    virtual void set_row(size_t rownum, const uint8_t * data) {
+        if (this->capture_device) {
+            this->capture_device->set_row(rownum, data);
+        }
+    }
+
+    virtual void input(const timeval & now, Stream & input_data_32) {
+        if (this->capture_device) {
+            this->capture_device->input(now, input_data_32);
+        }
+    }
+
+    virtual void snapshot(const timeval & now, int mouse_x, int mouse_y, bool ignore_frame_in_timeval) {
+        if (!this->capture_device) {
+            return;
+        }
+        const uint64_t start = nstime();
+        this->capture_device->snapshot(now, mouse_x, mouse_y, ignore_frame_in_timeval);
+        this->orders[ORDER_SNAPSHOT].add(nstime() - start);
+    }
+
+    virtual void set_pointer_display() {
+        if (this->capture_device) {
+            this->capture_device->set_pointer_display();
+        }
+    }
+
+    virtual void external_breakpoint() {
+        if (this->capture_device) {
+            this->capture_device->external_breakpoint();
+        }
+    }
+
+    virtual void external_time(const timeval & now) {
+        if (this->capture_device) {
+            this->capture_device->external_time(now);
+        }
+    }
+};
+
+// Consumer of TransparentPlayer, chunks are read and dropped.
+class NullFront : public FrontAPI {
+    CHANNELS::ChannelDefArray channel_list;
+
+public:
+    uint64_t bytes;
+
+    NullFront() : FrontAPI(false, false), bytes(0) {}
+
+    // RDPGraphicDevice
+    virtual void draw(const RDPOpaqueRect      & cmd, const Rect & clip) {}
+    virtual void draw(const RDPScrBlt          & cmd, const Rect & clip) {}
+    virtual void draw(const RDPDestBlt         & cmd, const Rect & clip) {}
+    virtual void draw(const RDPMultiDstBlt     & cmd, const Rect & clip) {}
+    virtual void draw(const RDPMultiOpaqueRect & cmd, const Rect & clip) {}
+    virtual void draw(const RDP::RDPMultiPatBlt & cmd, const Rect & clip) {}
+    virtual void draw(const RDP::RDPMultiScrBlt & cmd, const Rect & clip) {}
+    virtual void draw(const RDPPatBlt          & cmd, const Rect & clip) {}
+    virtual void draw(const RDPMemBlt          & cmd, const Rect & clip, const Bitmap & bmp) {}
+    virtual void draw(const RDPMem3Blt         & cmd, const Rect & clip, const Bitmap & bmp) {}
+    virtual void draw(const RDPLineTo          & cmd, const Rect & clip) {}
+    virtual void draw(const RDPGlyphIndex      & cmd, const Rect & clip, const GlyphCache * gly_cache) {}
+    virtual void draw(const RDPPolygonSC       & cmd, const Rect & clip) {}
+    virtual void draw(const RDPPolygonCB       & cmd, const Rect & clip) {}
+    virtual void draw(const RDPPolyline        & cmd, const Rect & clip) {}
+    virtual void draw(const RDPEllipseSC       & cmd, const Rect & clip) {}
+    virtual void draw(const RDPEllipseCB       & cmd, const Rect & clip) {}
+    virtual void draw(const RDP::FrameMarker &) {}
+    virtual void draw(const RDPBitmapData &, const uint8_t *, size_t, const Bitmap &) {}
+    virtual void draw(const RDPBrushCache &) {}
+    virtual void draw(const RDPColCache &) {}
+
+    virtual void server_set_pointer(const Pointer & cursor) {}
+
+    virtual void flush() {}
+
+    // DrawApi
+    virtual void begin_update() {}
+    virtual void end_update() {}
+
+    virtual void text_metrics(Font const & font, const char * text, int & width, int & height) {}
+
+    virtual void server_draw_text( Font const & font, int16_t x, int16_t y, const char * text
+                                 , uint32_t fgcolor, uint32_t bgcolor, const Rect & clip) {}
+
+    // FrontAPI
+    virtual const CHANNELS::ChannelDefArray & get_channel_list(void) const {
+        return this->channel_list;
+    }
+
+    virtual void send_to_channel( const CHANNELS::ChannelDef & channel, uint8_t * data
+                                , size_t length, size_t chunk_size, int flags) {
+        this->bytes += length;
+    }
+
+    virtual void send_global_palette() throw(Error) {}
+    virtual void set_mod_palette(const BGRPalette & palette) {}
+
+    virtual int server_resize(int width, int height, int bpp) {
+        return 1;
+    }
+
+    virtual void send_data_indication_ex(uint16_t channelId, HStream & stream) {
+        this->bytes += stream.size();
+    }
+
+    virtual void send_fastpath_data(InStream & data) {
+        this->bytes += data.size();
+    }
+};
+
+struct FileResult {
+    std::string  name;
+    bool         wrm;
+    uint16_t     width;
+    uint16_t     height;
+    uint8_t      bpp;
+    BenchCounter stages[STAGE_COUNT];
+    BenchCounter draw[ORDER_COUNT];
+    BenchCounter serialize[ORDER_COUNT];
+
+    FileResult() : wrm(true), width(0), height(0), bpp(0) {}
+};
+
+static uint64_t file_size(const char * path) {
+    struct stat st;
+    return (stat(path, &st) == 0) ? st.st_size : 0;
+}
+
+// Input of the MPPC stages: the recorded WRM, cut in chunks the size of a
+// fastpath update (below the 8 KB history buffer of MPPC 4.0).
+static void bench_mppc(const std::vector<uint8_t> & data, FileResult & result) {
+    enum {
+        MPPC_CHUNK_SIZE = 4096
+    };
+
+    // same encoders as Front
+    std::unique_ptr<rdp_mppc_enc> mppc_40(new rdp_mppc_40_enc);
+    std::unique_ptr<rdp_mppc_enc> mppc_50(new rdp_mppc_50_enc);
+    std::unique_ptr<rdp_mppc_enc> mppc_60(new rdp_mppc_60_enc);
+    std::unique_ptr<rdp_mppc_enc> mppc_61(new rdp_mppc_61_enc_hash_based);
+
+    struct {
+        rdp_mppc_enc * enc;
+        BenchStage     stage;
+    } encoders[] = {
+        { mppc_40.get(), STAGE_MPPC40 },
+        { mppc_50.get(), STAGE_MPPC50 },
+        { mppc_60.get(), STAGE_MPPC60 },
+        { mppc_61.get(), STAGE_MPPC61 },
+    };
+
+    for (auto & encoder : encoders) {
+        for (size_t offset = 0; offset < data.size(); offset += MPPC_CHUNK_SIZE) {
+            const uint16_t size = std::min<size_t>(MPPC_CHUNK_SIZE, data.size() - offset);
+            uint8_t  compressed_type = 0;
+            uint16_t compressed_size = 0;
+
+            const uint64_t start = nstime();
+            encoder.enc->compress(&data[offset], size, compressed_type, compressed_size);
+            const uint64_t ns = nstime() - start;
+
+            result.stages[encoder.stage].add( ns, size
+                                            , (compressed_type & PACKET_COMPRESSED) ? compressed_size : size);
+        }
+    }
+}
+
+// Each distinct bitmap is compressed once from an uncompressed copy, the
+// compressed data kept by the bitmap would be returned as it is otherwise.
+static void bench_compress(const std::vector<Bitmap> & bitmaps, FileResult & result) {
+    std::vector<const Bitmap *> distinct;
+    for (const Bitmap & bmp : bitmaps) {
+        distinct.push_back(&bmp);
+    }
+    std::sort(distinct.begin(), distinct.end(), [](const Bitmap * a, const Bitmap * b) {
+        return a->data() < b->data();
+    });
+    distinct.erase(std::unique(distinct.begin(), distinct.end(), [](const Bitmap * a, const Bitmap * b) {
+        return a->data() == b->data();
+    }), distinct.end());
+
+    for (const Bitmap * bmp : distinct) {
+        const bool rle    = (bmp->bpp() != 32);
+        const bool planar = (bmp->bpp() == 24) || (bmp->bpp() == 32);
+        for (BenchStage stage : { STAGE_COMPRESS, STAGE_COMPRESS60 }) {
+            if ((stage == STAGE_COMPRESS && !rle) || (stage == STAGE_COMPRESS60 && !planar)) {
+                continue;
+            }
+            Bitmap copy( bmp->bpp(), bmp->bpp(), &bmp->palette(), bmp->cx(), bmp->cy()
+                       , bmp->data(), bmp->bmp_size());
+            BStream out(bmp->bmp_size() * 2 + 1024);
+
+            const uint64_t start = nstime();
+            copy.compress((stage == STAGE_COMPRESS60) ? 32 : bmp->bpp(), out);
+            const uint64_t ns = nstime() - start;
+
+            result.stages[stage].add(ns, bmp->bmp_size(), out.get_offset());
+        }
+    }
+}
+
+// Same caches as the recorder of the WRM.
+static BmpCache * new_recorder_bmp_cache(const FileToGraphic & player) {
+    const struct ToCacheOption {
+        ToCacheOption(){}
+        BmpCache::CacheOption operator()(const BmpCache::cache_ & cache) const {
+            return BmpCache::CacheOption(cache.entries(), cache.bmp_size(), cache.persistent());
+        }
+    } to_cache_option;
+
+    return new BmpCache(
+        BmpCache::Recorder,
+        player.bmp_cache->bpp,
+        player.bmp_cache->number_of_cache,
+        player.bmp_cache->use_waiting_list,
+        to_cache_option(player.bmp_cache->get_cache(0)),
+        to_cache_option(player.bmp_cache->get_cache(1)),
+        to_cache_option(player.bmp_cache->get_cache(2)),
+        to_cache_option(player.bmp_cache->get_cache(3)),
+        to_cache_option(player.bmp_cache->get_cache(4))
+    );
+}
+
+// InFileTransport owns the descriptor of the recording and closes it, also
+// when FileToGraphic throws on a broken file.
+static bool bench_wrm(const char * path, unsigned png_count, FileResult & result) {
+    const timeval no_time = { 0, 0 };
+    const uint64_t size = file_size(path);
+
+    // parse only
+    {
+        int fd = open(path, O_RDONLY);
+        if (fd == -1) {
+            LOG(LOG_ERR, "rdpbench: open %s failed: %s", path, strerror(errno));
+            return false;
+        }
+        InFileTransport trans(fd);
+        TimedConsumer counter(nullptr, nullptr);
+
+        const uint64_t start = nstime();
+        FileToGraphic player(&trans, no_time, no_time, false, 0);
+        player.add_consumer(&counter, &counter);
+        player.play();
+        result.stages[STAGE_PARSE].add(nstime() - start, size);
+
+        for (unsigned type = 0; type < ORDER_COUNT; ++type) {
+            result.draw[type].count = counter.orders[type].count;
+        }
+        result.width  = player.screen_rect.cx;
+        result.height = player.screen_rect.cy;
+        result.bpp    = player.bmp_cache->bpp;
+    }
+
+    std::vector<Bitmap> bitmaps;
+    std::unique_ptr<BmpCache> bmp_cache;
+
+    // rasterisation and PNG dump of the last screen
+    {
+        int fd = open(path, O_RDONLY);
+        if (fd == -1) {
+            return false;
+        }
+        InFileTransport trans(fd);
+        FileToGraphic player(&trans, no_time, no_time, false, 0);
+
+        RDPDrawable drawable(player.screen_rect.cx, player.screen_rect.cy, 24);
+        TimedConsumer timed(&drawable, &drawable);
+        timed.bitmaps = &bitmaps;
+        player.add_consumer(&timed, &timed);
+        player.play();
+        result.stages[STAGE_DRAW].add(timed.total_ns(), size);
+        std::copy(timed.orders, timed.orders + ORDER_COUNT, result.draw);
+
+        BufferTransport png_trans;
+        ImageCapture png_recorder(png_trans, player.screen_rect.cx, player.screen_rect.cy, drawable.impl());
+        for (unsigned i = 0; i < png_count; ++i) {
+            png_trans.data.clear();
+            const uint64_t start = nstime();
+            png_recorder.flush();
+            result.stages[STAGE_PNG].add( nstime() - start
+                                        , drawable.impl().pix_len(), png_trans.data.size());
+        }
+
+        bmp_cache.reset(new_recorder_bmp_cache(player));
+    }
+
+    // bitmaps in drawing order, as the recorder caches them
+    for (const Bitmap & bmp : bitmaps) {
+        const uint64_t start = nstime();
+        bmp_cache->cache_bitmap(bmp);
+        result.stages[STAGE_BMP_CACHE].add(nstime() - start, bmp.bmp_size());
+    }
+    bench_compress(bitmaps, result);
+    bitmaps.clear();
+
+    // serialisation to WRM
+    BufferTransport wrm_trans;
+    {
+        int fd = open(path, O_RDONLY);
+        if (fd == -1) {
+            return false;
+        }
+        InFileTransport trans(fd);
+        FileToGraphic player(&trans, no_time, no_time, false, 0);
+
+        bmp_cache.reset(new_recorder_bmp_cache(player));
+
+        Inifile ini;
+        GlyphCache gly_cache;
+        PointerCache ptr_cache;
+        RDPDrawable drawable(player.screen_rect.cx, player.screen_rect.cy, 24);
+        NativeCapture wrm_recorder( player.record_now, wrm_trans
+                                  , player.screen_rect.cx, player.screen_rect.cy, 24
+                                  , *bmp_cache, gly_cache, ptr_cache, drawable, ini);
+        wrm_recorder.update_config(ini);
+
+        TimedConsumer timed(&wrm_recorder, &wrm_recorder);
+        player.add_consumer(&timed, &timed);
+        player.play();
+
+        const uint64_t start = nstime();
+        wrm_recorder.flush();
+        result.stages[STAGE_SERIALIZE].add(timed.total_ns() + (nstime() - start), size, wrm_trans.data.size());
+        std::copy(timed.orders, timed.orders + ORDER_COUNT, result.serialize);
+    }
+
+    bench_mppc(wrm_trans.data, result);
+    return true;
+}
+
+static bool bench_trm(const char * path, FileResult & result) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        LOG(LOG_ERR, "rdpbench: open %s failed: %s", path, strerror(errno));
+        return false;
+    }
+    InFileTransport trans(fd);
+    NullFront front;
+
+    const uint64_t start = nstime();
+    TransparentPlayer player(&trans, &front);
+    while (player.interpret_chunk(/*real_time = */false));
+    result.stages[STAGE_TRM_READ].add(nstime() - start, file_size(path), front.bytes);
+    return true;
+}
+
+static void json_string(FILE * out, const char * s) {
+    fputc('"', out);
+    for (; *s; ++s) {
+        const unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        }
+        else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        }
+        else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void json_counter(FILE * out, const BenchCounter & counter) {
+    fprintf(out, "{\"count\": %llu, \"ns\": %llu, \"bytes_in\": %llu, \"bytes_out\": %llu}"
+           , static_cast<unsigned long long>(counter.count)
+           , static_cast<unsigned long long>(counter.ns)
+           , static_cast<unsigned long long>(counter.bytes_in)
+           , static_cast<unsigned long long>(counter.bytes_out));
+}
+
+static void json_stages(FILE * out, const BenchCounter * stages, const char * indent) {
+    fprintf(out, "{");
+    const char * sep = "\n";
+    for (unsigned stage = 0; stage < STAGE_COUNT; ++stage) {
+        if (!stages[stage].count) {
+            continue;
+        }
+        fprintf(out, "%s%s  \"%s\": ", sep, indent, stage_names[stage]);
+        json_counter(out, stages[stage]);
+        sep = ",\n";
+    }
+    fprintf(out, "\n%s}", indent);
+}
+
+static void json_result(FILE * out, const std::vector<FileResult> & results) {
+    BenchCounter totals[STAGE_COUNT];
+
+    fprintf(out, "{\n  \"version\": \"%s\",\n  \"files\": [", VERSION);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const FileResult & result = results[i];
+        fprintf(out, "%s\n    {\n      \"file\": ", i ? "," : "");
+        json_string(out, result.name.c_str());
+        fprintf(out, ",\n      \"type\": \"%s\",\n", result.wrm ? "wrm" : "trm");
+        if (result.wrm) {
+            fprintf(out, "      \"width\": %u,\n      \"height\": %u,\n      \"bpp\": %u,\n"
+                   , unsigned(result.width), unsigned(result.height), unsigned(result.bpp));
+        }
+        fprintf(out, "      \"stages\": ");
+        json_stages(out, result.stages, "      ");
+        if (result.wrm) {
+            fprintf(out, ",\n      \"orders\": {");
+            const char * sep = "\n";
+            for (unsigned type = 0; type < ORDER_COUNT; ++type) {
+                if (!result.draw[type].count && !result.serialize[type].count) {
+                    continue;
+                }
+                fprintf(out, "%s        \"%s\": {\"count\": %llu, \"draw_ns\": %llu, \"serialize_ns\": %llu}"
+                       , sep, order_names[type]
+                       , static_cast<unsigned long long>(std::max(result.draw[type].count, result.serialize[type].count))
+                       , static_cast<unsigned long long>(result.draw[type].ns)
+                       , static_cast<unsigned long long>(result.serialize[type].ns));
+                sep = ",\n";
+            }
+            fprintf(out, "\n      }");
+        }
+        fprintf(out, "\n    }");
+
+        for (unsigned stage = 0; stage < STAGE_COUNT; ++stage) {
+            totals[stage].merge(result.stages[stage]);
+        }
+    }
+    fprintf(out, "\n  ],\n  \"totals\": ");
+    json_stages(out, totals, "  ");
+    fprintf(out, "\n}\n");
+}
+
+static bool has_extension(const std::string & name, const char * extension) {
+    const size_t len = strlen(extension);
+    return name.size() > len && !name.compare(name.size() - len, len, extension);
+}
+
+int main(int argc, char * argv[]) {
+    openlog("rdpbench", LOG_CONS | LOG_PERROR, LOG_USER);
+
+    const char * copyright_notice =
+        "\n"
+        "ReDemPtion Graphics Benchmark " VERSION ".\n"
+        "Copyright (C) Wallix 2010-2014.\n"
+        "Christophe Grosjean, Raphael Zhou.\n"
+        "\n"
+        ;
+
+    std::string input;
+    std::string output_filename;
+    unsigned    png_count = 1;
+
+    boost::program_options::options_description desc("Options");
+    desc.add_options()
+    ("help,h",    "produce help message")
+    ("version,v", "show software version")
+
+    ("input,i",     boost::program_options::value(&input),           "directory of WRM/TRM recordings (or a single recording)")
+    ("output,o",    boost::program_options::value(&output_filename), "JSON output file name (default: standard output)")
+    ("png-count,p", boost::program_options::value(&png_count),       "PNG dumps of the last screen of each WRM")
+    ;
+
+    boost::program_options::variables_map options;
+    boost::program_options::store(
+        boost::program_options::command_line_parser(argc, argv).options(desc).run(),
+        options
+    );
+    boost::program_options::notify(options);
+
+    if (options.count("help") > 0) {
+        std::cout << copyright_notice;
+        std::cout << "Usage: rdpbench [options]\n\n";
+        std::cout << desc << std::endl;
+        exit(-1);
+    }
+
+    if (options.count("version") > 0) {
+        std::cout << copyright_notice;
+        exit(-1);
+    }
+
+    if (input.empty()) {
+        std::cout << "Use -i directory\n\n";
+        exit(-1);
+    }
+
+    std::vector<std::string> paths;
+    struct stat st;
+    if (stat(input.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+        paths.push_back(input);
+    }
+    else if (DIR * dir = opendir(input.c_str())) {
+        while (struct dirent * entry = readdir(dir)) {
+            const std::string name = entry->d_name;
+            if (has_extension(name, ".wrm") || has_extension(name, ".trm")) {
+                paths.push_back(input + "/" + name);
+            }
+        }
+        closedir(dir);
+        std::sort(paths.begin(), paths.end());
+    }
+    else {
+        std::cout << "Failed to open input directory: " << input << "\n\n";
+        exit(-1);
+    }
+
+    std::vector<FileResult> results;
+    for (const std::string & path : paths) {
+        FileResult result;
+        result.name = path;
+        result.wrm  = has_extension(path, ".wrm");
+        try {
+            if (result.wrm ? bench_wrm(path.c_str(), png_count, result) : bench_trm(path.c_str(), result)) {
+                results.push_back(result);
+            }
+        }
+        catch (const Error & e) {
+            LOG(LOG_ERR, "rdpbench: %s skipped, error %u", path.c_str(), e.id);
+        }
+    }
+
+    FILE * out = stdout;
+    if (!output_filename.empty()) {
+        out = fopen(output_filename.c_str(), "w");
+        if (!out) {
+            std::cout << "Failed to open output file: " << output_filename << "\n\n";
+            exit(-1);
+        }
+    }
+    json_result(out, results);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return 0;
+}
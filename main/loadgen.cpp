@@ -0,0 +1,535 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2014
+    Author(s): Christophe Grosjean, Raphael Zhou
+
+    rdp load generator main file
+
+    Opens concurrent RDP client sessions to a proxy and reports session
+    setup time, update interval percentiles, throughput and proxy CPU.
+    The proxy is meant to point to a stand-in target replaying a recorded
+    session, for instance:
+
+        rdptproxy -d session.trm -l 3390 -n 50 -s 0
+        rdpproxy (with target 127.0.0.1:3390)
+        rdploadgen -t 127.0.0.1:3389 -u user -p password -n 50 --proxy-pid <rdpproxy pid>
+*/
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/parsers.hpp>
+
+#include <dirent.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+//#define LOGNULL
+#define LOGPRINT
+
+#include "version.hpp"
+#include "async_connect.hpp"
+#include "channel_list.hpp"
+#include "client_info.hpp"
+#include "front_api.hpp"
+#include "genrandom.hpp"
+#include "latency_stats.hpp"
+#include "socket_transport.hpp"
+#include "socket_transport_utility.hpp"
+#include "rdp/rdp.hpp"
+
+// Client side of one session: counts what the proxy sends, draws nothing.
+class LoadSession : public FrontAPI {
+    CHANNELS::ChannelDefArray channel_list;
+
+public:
+    unsigned   index;
+    ClientInfo info;
+    LCGRandom  gen;
+    uint32_t   verbose;
+
+    std::string                      error_message;
+    AsyncConnect                     connect;
+    std::string                      host;
+    int                              port;
+    std::string                      username;
+    std::string                      password;
+    std::unique_ptr<SocketTransport> trans;
+    std::unique_ptr<mod_rdp>         mod;
+
+    bool     running;
+    bool     failed;
+    timeval  start_time;
+    timeval  last_update;
+    uint64_t updates;
+    uint64_t orders;
+    uint64_t setup_us;      // connection to first update
+    uint64_t bytes_received;
+
+    LatencyStats intervals;     // between two updates
+
+    LoadSession(unsigned index, uint16_t width, uint16_t height, int bpp, uint32_t verbose)
+    : FrontAPI(false, false)
+    , index(index)
+    , gen(index)
+    , verbose(verbose)
+    , connect(verbose)
+    , port(0)
+    , running(false)
+    , failed(false)
+    , updates(0)
+    , orders(0)
+    , setup_us(0)
+    , bytes_received(0) {
+        this->info.keylayout             = 0x040C;
+        this->info.console_session       = false;
+        this->info.brush_cache_code      = 0;
+        this->info.bpp                   = bpp;
+        this->info.width                 = width;
+        this->info.height                = height;
+        this->info.rdp5_performanceflags = PERF_DISABLE_WALLPAPER;
+        snprintf(this->info.hostname, sizeof(this->info.hostname), "loadgen%u", index);
+        this->start_time  = tvtime();
+        this->last_update = this->start_time;
+    }
+
+    // The connection goes on in the main loop, sessions started before are
+    // not held up while it is established.
+    void start(const char * host, int port, const char * username, const char * password) {
+        this->start_time = tvtime();
+        this->host       = host;
+        this->port       = port;
+        this->username   = username;
+        this->password   = password;
+        this->running    = true;
+
+        this->connect.start(host, port, 3000, this->start_time);
+        this->connection_progress();
+    }
+
+    void stop(bool failed) {
+        if (this->trans) {
+            this->bytes_received = this->trans->get_total_received();
+        }
+        this->mod.reset();
+        this->trans.reset();
+        this->connect.cancel();
+        this->running = false;
+        this->failed  = this->failed || failed;
+    }
+
+    void add_to_fd_set(fd_set & rfds, fd_set & wfds, unsigned & max, timeval & timeout, const timeval & now) {
+        if (!this->mod) {
+            this->connect.add_to_fd_set(wfds, max, timeout, now);
+            return;
+        }
+        ::add_to_fd_set(this->mod->get_event(), this->trans.get(), rfds, max, timeout);
+    }
+
+    void incoming(fd_set & rfds, fd_set & wfds, const timeval & now) {
+        if (!this->mod) {
+            this->connect.process(wfds, now);
+            this->connection_progress();
+            return;
+        }
+        if (!is_set(this->mod->get_event(), this->trans.get(), rfds)) {
+            return;
+        }
+        try {
+            this->mod->get_event().reset();
+            this->mod->draw_event(time(NULL));
+            if (this->mod->get_event().signal == BACK_EVENT_NEXT
+             || this->mod->get_event().signal == BACK_EVENT_STOP) {
+                this->stop(false);
+            }
+        }
+        catch (Error & e) {
+            // end of the replayed session closes the connection
+            if (this->verbose) {
+                LOG(LOG_INFO, "Session %u: closed (errid=%d)", this->index, e.id);
+            }
+            this->stop(!this->updates);
+        }
+    }
+
+private:
+    void connection_progress() {
+        switch (this->connect.get_state()) {
+        case AsyncConnect::CONNECTED:
+            this->connected(this->connect.release());
+        break;
+        case AsyncConnect::FAILED:
+            LOG(LOG_ERR, "Session %u: failed to connect to %s:%d", this->index, this->host.c_str(), this->port);
+            this->stop(true);
+        break;
+        default:
+        break;
+        }
+    }
+
+    void connected(int sck) {
+        this->trans.reset(new SocketTransport( "RDP Proxy", sck, this->host.c_str(), this->port
+                                             , this->verbose, &this->error_message));
+
+        ModRDPParams mod_rdp_params( this->username.c_str(), this->password.c_str(), this->host.c_str()
+                                   , "0.0.0.0", 0, this->verbose);
+        mod_rdp_params.enable_nla                = false;
+        mod_rdp_params.enable_bitmap_update      = true;
+        mod_rdp_params.certificate_change_action = 1;
+
+        try {
+            this->mod.reset(new mod_rdp(*this->trans, *this, this->info, this->gen, mod_rdp_params));
+        }
+        catch (Error & e) {
+            LOG(LOG_ERR, "Session %u: failed to start (errid=%d)", this->index, e.id);
+            this->stop(true);
+        }
+    }
+
+    void order() {
+        this->orders++;
+    }
+
+public:
+    virtual void begin_update() {
+        const timeval now = tvtime();
+        if (!this->updates) {
+            this->setup_us = difftimeval(now, this->start_time);
+        }
+        else {
+            this->intervals.add(difftimeval(now, this->last_update));
+        }
+        this->last_update = now;
+        this->updates++;
+    }
+
+    virtual void end_update() {}
+
+    virtual void draw(const RDPOpaqueRect       & cmd, const Rect & clip) { this->order(); }
+    virtual void draw(const RDPScrBlt           & cmd, const Rect & clip) { this->order(); }
+    virtual void draw(const RDPDestBlt          & cmd, const Rect & clip) { this->order(); }
+    virtual void draw(const RDPMultiDstBlt      & cmd, const Rect & clip) { this->order(); }
+    virtual void draw(const RDPMultiOpaqueRect  & cmd, const Rect & clip) { this->order(); }
+    virtual void draw(const RDP::RDPMultiPatBlt & cmd, const Rect & clip) { this->order(); }
+    virtual void draw(const RDP::RDPMultiScrBlt & cmd, const Rect & clip) { this->order(); }
+    virtual void draw(const RDPPatBlt           & cmd, const Rect & clip) { this->order(); }
+    virtual void draw(const RDPMemBlt           & cmd, const Rect & clip, const Bitmap & bmp) { this->order(); }
+    virtual void draw(const RDPMem3Blt          & cmd, const Rect & clip, const Bitmap & bmp) { this->order(); }
+    virtual void draw(const RDPLineTo           & cmd, const Rect & clip) { this->order(); }
+    virtual void draw(const RDPGlyphIndex       & cmd, const Rect & clip, const GlyphCache * gly_cache) { this->order(); }
+    virtual void draw(const RDPPolygonSC        & cmd, const Rect & clip) { this->order(); }
+    virtual void draw(const RDPPolygonCB        & cmd, const Rect & clip) { this->order(); }
+    virtual void draw(const RDPPolyline         & cmd, const Rect & clip) { this->order(); }
+    virtual void draw(const RDPEllipseSC        & cmd, const Rect & clip) { this->order(); }
+    virtual void draw(const RDPEllipseCB        & cmd, const Rect & clip) { this->order(); }
+    virtual void draw(const RDP::FrameMarker & order) {}
+    virtual void draw(const RDPBitmapData & bitmap_data, const uint8_t * data, size_t size, const Bitmap & bmp) {
+        this->order();
+    }
+
+    using FrontAPI::draw;
+
+    virtual void server_set_pointer(const Pointer & cursor) {}
+    virtual void flush() {}
+
+    virtual void text_metrics(Font const & font, const char * text, int & width, int & height) {
+        width  = 0;
+        height = 0;
+    }
+
+    virtual void server_draw_text( Font const & font, int16_t x, int16_t y, const char * text
+                                 , uint32_t fgcolor, uint32_t bgcolor, const Rect & clip) {}
+
+    virtual const CHANNELS::ChannelDefArray & get_channel_list(void) const {
+        return this->channel_list;
+    }
+
+    virtual void send_to_channel( const CHANNELS::ChannelDef & channel, uint8_t * data
+                                , size_t length, size_t chunk_size, int flags) {}
+
+    virtual void send_global_palette() throw(Error) {}
+
+    virtual int server_resize(int width, int height, int bpp) {
+        this->info.width  = width;
+        this->info.height = height;
+        this->info.bpp    = bpp;
+        return 1;
+    }
+};
+
+// CPU time (in clock ticks) of a process, of its children waited for and of
+// its living children (rdpproxy runs each session in a child process).
+static uint64_t process_tree_cpu_ticks(pid_t pid) {
+    auto read_stat = [](const char * path, pid_t & ppid, uint64_t & ticks, bool with_waited) -> bool {
+        FILE * f = fopen(path, "r");
+        if (!f) {
+            return false;
+        }
+        char line[1024];
+        const bool ok = fgets(line, sizeof(line), f);
+        fclose(f);
+        if (!ok) {
+            return false;
+        }
+        // fields after the command name, which may contain spaces
+        const char * p = strrchr(line, ')');
+        if (!p) {
+            return false;
+        }
+        char               state;
+        int                parent;
+        unsigned long      utime, stime;
+        long               cutime, cstime;
+        if (sscanf( p + 2, "%c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %ld %ld"
+                  , &state, &parent, &utime, &stime, &cutime, &cstime) != 6) {
+            return false;
+        }
+        ppid  = parent;
+        ticks = utime + stime + (with_waited ? cutime + cstime : 0);
+        return true;
+    };
+
+    char     path[64];
+    pid_t    ppid  = 0;
+    uint64_t total = 0;
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    if (!read_stat(path, ppid, total, true)) {
+        return 0;
+    }
+
+    if (DIR * dir = opendir("/proc")) {
+        while (struct dirent * entry = readdir(dir)) {
+            const pid_t child = atoi(entry->d_name);
+            uint64_t ticks = 0;
+            snprintf(path, sizeof(path), "/proc/%d/stat", child);
+            if (child > 0 && read_stat(path, ppid, ticks, true) && ppid == pid) {
+                total += ticks;
+            }
+        }
+        closedir(dir);
+    }
+    return total;
+}
+
+static void print_latency(const char * name, LatencyStats & stats) {
+    printf( "%-22s n=%-8zu mean=%8.2f p50=%8.2f p90=%8.2f p99=%8.2f max=%8.2f ms\n"
+          , name, stats.count(), stats.mean() / 1000.
+          , stats.percentile(50) / 1000., stats.percentile(90) / 1000.
+          , stats.percentile(99) / 1000., stats.max() / 1000.);
+}
+
+int main(int argc, char * argv[]) {
+    openlog("loadgen", LOG_CONS | LOG_PERROR, LOG_USER);
+
+    const char * copyright_notice =
+        "\n"
+        "ReDemPtion Load Generator " VERSION ".\n"
+        "Copyright (C) Wallix 2010-2014.\n"
+        "Christophe Grosjean, Raphael Zhou.\n"
+        "\n"
+        ;
+
+    std::string target_device;
+    uint32_t    target_port = 3389;
+    std::string username;
+    std::string password;
+    unsigned    sessions    = 1;
+    unsigned    ramp_up_ms  = 100;
+    unsigned    duration    = 0;
+    unsigned    width       = 1024;
+    unsigned    height      = 768;
+    unsigned    bpp         = 16;
+    int         proxy_pid   = 0;
+    uint32_t    verbose     = 0;
+
+    boost::program_options::options_description desc("Options");
+    desc.add_options()
+    ("help,h",    "produce help message")
+    ("version,v", "show software version")
+
+    ("target-device,t", boost::program_options::value(&target_device), "proxy address[:port]")
+    ("username,u",      boost::program_options::value(&username),      "username")
+    ("password,p",      boost::program_options::value(&password),      "password")
+    ("sessions,n",      boost::program_options::value(&sessions),      "number of concurrent sessions (default 1)")
+    ("ramp-up,r",       boost::program_options::value(&ramp_up_ms),    "milliseconds between two session starts (default 100)")
+    ("duration,d",      boost::program_options::value(&duration),      "seconds before closing the sessions, 0 to wait for their end (default)")
+    ("width,W",         boost::program_options::value(&width),         "client width (default 1024)")
+    ("height,H",        boost::program_options::value(&height),        "client height (default 768)")
+    ("bpp,b",           boost::program_options::value(&bpp),           "client color depth (default 16)")
+    ("proxy-pid",       boost::program_options::value(&proxy_pid),     "pid of the proxy main process, to report its CPU time")
+    ("verbose",         boost::program_options::value(&verbose),       "mod_rdp verbosity")
+    ;
+
+    boost::program_options::variables_map options;
+    boost::program_options::store(
+        boost::program_options::command_line_parser(argc, argv).options(desc).run(),
+        options
+    );
+    boost::program_options::notify(options);
+
+    if (options.count("help") > 0) {
+        std::cout << copyright_notice;
+        std::cout << "Usage: rdploadgen [options]\n\n";
+        std::cout << desc << std::endl;
+        exit(0);
+    }
+
+    if (options.count("version") > 0) {
+        std::cout << copyright_notice;
+        exit(0);
+    }
+
+    if (target_device.empty()) {
+        std::cerr << "Missing proxy address: use -t address\n\n";
+        exit(-1);
+    }
+
+    if (username.empty()) {
+        std::cerr << "Missing username : use -u username\n\n";
+        exit(-1);
+    }
+
+    if (!sessions) {
+        std::cerr << "At least one session is needed\n\n";
+        exit(-1);
+    }
+
+    size_t pos = target_device.find(':');
+    if (pos != std::string::npos) {
+        target_port = atoi(target_device.substr(pos + 1).c_str());
+        target_device.resize(pos);
+    }
+
+    std::vector<std::unique_ptr<LoadSession>> load_sessions;
+    for (unsigned index = 0; index < sessions; ++index) {
+        load_sessions.emplace_back(new LoadSession(index, width, height, bpp, verbose));
+    }
+
+    const long     clock_ticks     = sysconf(_SC_CLK_TCK);
+    const uint64_t proxy_ticks     = proxy_pid ? process_tree_cpu_ticks(proxy_pid) : 0;
+    const timeval  start_time      = tvtime();
+    unsigned       started         = 0;
+    timeval        next_start_time = start_time;
+
+    for (;;) {
+        const timeval now = tvtime();
+        if (duration && difftimeval(now, start_time) >= uint64_t(duration) * 1000000) {
+            break;
+        }
+
+        if (started < sessions && now >= next_start_time) {
+            load_sessions[started]->start( target_device.c_str(), target_port, username.c_str()
+                                         , password.c_str());
+            started++;
+            next_start_time = addusectimeval(uint64_t(ramp_up_ms) * 1000, now);
+        }
+
+        unsigned running = 0;
+        unsigned max     = 0;
+        fd_set   rfds;
+        fd_set   wfds;
+        FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
+        timeval timeout = { 1, 0 };
+        if (started < sessions) {
+            timeout = how_long_to_wait(next_start_time, now);
+        }
+
+        for (auto & session : load_sessions) {
+            if (session->running) {
+                session->add_to_fd_set(rfds, wfds, max, timeout, now);
+                running++;
+            }
+        }
+        if (!running && started == sessions) {
+            break;
+        }
+
+        const int num = select(max + 1, &rfds, &wfds, nullptr, &timeout);
+        if (num < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG(LOG_ERR, "select failed: %s", strerror(errno));
+            break;
+        }
+
+        for (auto & session : load_sessions) {
+            if (session->running) {
+                session->incoming(rfds, wfds, tvtime());
+            }
+        }
+    }
+
+    const double elapsed = difftimeval(tvtime(), start_time) / 1000000.;
+    const uint64_t proxy_ticks_used = proxy_pid ? process_tree_cpu_ticks(proxy_pid) - proxy_ticks : 0;
+
+    unsigned     established = 0;
+    unsigned     failed      = 0;
+    uint64_t     bytes       = 0;
+    uint64_t     updates     = 0;
+    uint64_t     orders      = 0;
+    LatencyStats setup;
+    LatencyStats intervals;
+    for (auto & session : load_sessions) {
+        if (session->running) {
+            session->stop(false);
+        }
+        if (session->updates) {
+            established++;
+            setup.add(session->setup_us);
+        }
+        if (session->failed) {
+            failed++;
+        }
+        bytes   += session->bytes_received;
+        updates += session->updates;
+        orders  += session->orders;
+        intervals.merge(session->intervals);
+
+        if (verbose) {
+            printf( "session %u: updates=%llu orders=%llu bytes=%llu setup=%.2f ms p50=%.2f p99=%.2f ms\n"
+                  , session->index
+                  , static_cast<unsigned long long>(session->updates)
+                  , static_cast<unsigned long long>(session->orders)
+                  , static_cast<unsigned long long>(session->bytes_received)
+                  , session->setup_us / 1000.
+                  , session->intervals.percentile(50) / 1000.
+                  , session->intervals.percentile(99) / 1000.);
+        }
+    }
+
+    printf("sessions               started=%u established=%u failed=%u\n", started, established, failed);
+    printf("duration               %.2f s\n", elapsed);
+    printf( "throughput             %.1f KB/s (%.1f KB/s per session), %.1f updates/s, %.1f orders/s\n"
+          , bytes / 1024. / elapsed, established ? bytes / 1024. / elapsed / established : 0.
+          , updates / elapsed, orders / elapsed);
+    print_latency("session setup", setup);
+    print_latency("update interval", intervals);
+    if (proxy_pid) {
+        const double cpu = double(proxy_ticks_used) / clock_ticks;
+        printf( "proxy cpu              %.2f s, %.3f s per session (%.1f%% of a core per session)\n"
+              , cpu, established ? cpu / established : 0.
+              , established ? 100. * cpu / established / elapsed : 0.);
+    }
+
+    return failed ? 1 : 0;
+}
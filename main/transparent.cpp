@@ -27,6 +27,8 @@
 #include <iostream>
 #include <string>
 
+#include <sys/wait.h>
+
 //#define LOGNULL
 #define LOGPRINT
 
@@ -59,9 +61,15 @@ int main(int argc, char * argv[]) {
     std::string record_filename;
     std::string play_filename;
     std::string persistent_key_list_filename;
+    uint32_t    listen_port;
+    unsigned    play_speed;
+    unsigned    play_sessions;
 
     persistent_key_list_filename = "./PersistentKeyList.bin";
     target_port                  = 3389;
+    listen_port                  = 3389;
+    play_speed                   = 1;
+    play_sessions                = 1;
 
     boost::program_options::options_description desc("Options");
     desc.add_options()
@@ -77,6 +85,9 @@ int main(int argc, char * argv[]) {
 
     ("record-file,r",   boost::program_options::value(&record_filename),              "record file name")
     ("play-file,d",     boost::program_options::value(&play_filename),                "play file name")
+    ("port,l",          boost::program_options::value(&listen_port),                  "listening port (default 3389)")
+    ("speed,s",         boost::program_options::value(&play_speed),                   "play speed: 1 real time (default), N times faster, 0 as fast as possible")
+    ("sessions,n",      boost::program_options::value(&play_sessions),                "number of client sessions served with the play file, one process each (default 1)")
     ;
 
     boost::program_options::variables_map options;
@@ -128,6 +139,12 @@ int main(int argc, char * argv[]) {
         exit(-1);
     }
 
+    if (   play_sessions != 1
+        && play_filename.empty()) {
+        std::cerr << "Use -n sessions with -d filename\n\n";
+        exit(-1);
+    }
+
     if (!target_device.empty()) {
         size_t pos = target_device.find(':');
         if (pos != string::npos) {
@@ -146,13 +163,18 @@ int main(int argc, char * argv[]) {
     }
 
 
-    // This server only support one incoming connection before closing listener
+    // This server only support one incoming connection before closing listener,
+    // or a given number of connections each served by a child process (load
+    // generation with a play file, see rdploadgen)
     class ServerOnce : public Server {
     public:
-        int  sck;
-        char ip_source[256];
+        int      sck;
+        char     ip_source[256];
+        unsigned sessions;
+        unsigned accepted;
+        bool     child;
 
-        ServerOnce() : sck(0) {
+        explicit ServerOnce(unsigned sessions) : sck(0), sessions(sessions), accepted(0), child(false) {
            this->ip_source[0] = 0;
         }
 
@@ -168,12 +190,37 @@ int main(int argc, char * argv[]) {
             this->sck = accept(incoming_sck, &u.s, &sin_size);
             strcpy(this->ip_source, inet_ntoa(u.s4.sin_addr));
             LOG(LOG_INFO, "Incoming socket to %d (ip=%s)\n", this->sck, this->ip_source);
-            return START_WANT_STOP;
+            this->accepted++;
+            if (this->sessions <= 1) {
+                return START_WANT_STOP;
+            }
+
+            const pid_t pid = fork();
+            switch (pid) {
+            case 0: /* child */
+                this->child = true;
+                return START_WANT_STOP;
+            case -1:
+                LOG(LOG_ERR, "Error creating process for new session : %s\n", strerror(errno));
+                break;
+            default: /* father */
+                break;
+            }
+            close(this->sck);
+            return (this->accepted < this->sessions) ? START_FAILED : START_WANT_STOP;
         }
-    } one_shot_server;
-    Listen listener(one_shot_server, 0, 3389, true, 5);  // 25 seconds to connect, or timeout
+    } one_shot_server(play_sessions);
+    Listen listener(one_shot_server, 0, listen_port, true, (play_sessions > 1) ? 60 : 5);  // seconds to connect, or timeout
     listener.run();
 
+    if (one_shot_server.sessions > 1 && !one_shot_server.child) {
+        // father, wait for the end of all sessions
+        while (wait(nullptr) > 0) {
+        }
+        LOG(LOG_INFO, "%u sessions played\n", one_shot_server.accepted);
+        return 0;
+    }
+
     Inifile             ini;
     ConfigurationLoader cfg_loader(ini, CFG_PATH "/" RDPPROXY_INI);
 
@@ -220,7 +267,7 @@ int main(int argc, char * argv[]) {
     try {
         if (target_device.empty()) {
             TransparentReplayMod mod(front, play_filename.c_str(),
-                front.client_info.width, front.client_info.height, NULL, ini.font);
+                front.client_info.width, front.client_info.height, NULL, ini.font, play_speed);
 
             run_mod(mod, front, front_event, nullptr, &front_trans);
         }
@@ -23,6 +23,7 @@
 
 #include "../mod/mod_api.hpp"
 #include "widget2/screen.hpp"
+#include "widget2/render_cache.hpp"
 #include "config.hpp"
 #include "front_api.hpp"
 #include "channel_list.hpp"
@@ -33,11 +34,14 @@ public:
 
     WidgetScreen screen;
 
+    WidgetRenderCache * render_cache;
+
     InternalMod(FrontAPI & front, uint16_t front_width, uint16_t front_height, Font const & font,
                 Inifile * ini = NULL)
         : mod_api(front_width, front_height)
         , front(front)
         , screen(*this, front_width, front_height, font, NULL, ini ? &(ini->theme): NULL)
+        , render_cache((ini && ini->internal_mod.widget_render_cache) ? &WidgetRenderCache::session_cache() : NULL)
     {
         this->front.server_resize(front_width, front_height, 24);
     }
@@ -62,6 +66,11 @@ public:
         }
     }
 
+    virtual WidgetRenderCache * get_render_cache()
+    {
+        return this->render_cache;
+    }
+
     virtual void begin_update()
     {
         this->front.begin_update();
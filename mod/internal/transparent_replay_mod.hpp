@@ -39,7 +39,8 @@ public:
                         , uint16_t width
                         , uint16_t height
                         , std::string * auth_error_message
-                        , Font const & font)
+                        , Font const & font
+                        , unsigned speed = 1)
     : InternalMod(front, width, height, font)
     , auth_error_message(auth_error_message)
     , fd([&]() {
@@ -50,7 +51,7 @@ public:
         return fd;
     }())
     , ift(this->fd)
-    , player(&this->ift, &this->front)
+    , player(&this->ift, &this->front, speed)
     {}
 
     virtual ~TransparentReplayMod() {
@@ -343,8 +343,7 @@ public:
         }
     }
     virtual void draw_inner_free(const Rect & clip, int bg_color) {
-        Region region;
-        region.rects.push_back(clip.intersect(this->rect));
+        Region region(clip.intersect(this->rect));
 
         CompositeContainer::iterator iter_w_current = this->impl->get_first();
         while (iter_w_current != reinterpret_cast<CompositeContainer::iterator>(CompositeContainer::invalid_iterator)) {
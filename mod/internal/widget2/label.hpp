@@ -23,7 +23,9 @@
 #define REDEMPTION_MOD_WIDGET2_LABEL_HPP
 
 #include "widget.hpp"
+#include "render_cache.hpp"
 #include "RDP/orders/RDPOrdersPrimaryOpaqueRect.hpp"
+#include "RDP/orders/RDPOrdersPrimaryMemBlt.hpp"
 
 class WidgetLabel : public Widget2
 {
@@ -93,6 +95,16 @@ public:
 
     virtual void draw(const Rect& clip)
     {
+        WidgetRenderCache * render_cache = this->drawable.get_render_cache();
+        if (render_cache && !this->rect.isempty()) {
+            const Bitmap & bmp = render_cache->label(this->font, this->get_text(),
+                                                     this->x_text, this->y_text,
+                                                     this->rect.cx, this->rect.cy,
+                                                     this->fg_color, this->bg_color);
+            this->drawable.draw(RDPMemBlt(0, this->rect, 0xCC, 0, 0, 0), clip, bmp);
+            return;
+        }
+
         this->drawable.draw(RDPOpaqueRect(this->rect, this->bg_color), clip);
         this->drawable.server_draw_text(this->font,
                                         this->x_text + this->dx(),
@@ -0,0 +1,172 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *   Product name: redemption, a FLOSS RDP proxy
+ *   Copyright (C) Wallix 2014
+ *   Author(s): Christophe Grosjean
+ *
+ *   Off-screen rendering of widgets. A widget is rendered once in a bitmap
+ *   keyed by what it looks like (font, colors, geometry and text), then
+ *   drawn as a MemBlt: the front bitmap cache sends the bitmap the first
+ *   time and only a cache index afterwards.
+ */
+
+#if !defined(REDEMPTION_MOD_WIDGET2_RENDER_CACHE_HPP)
+#define REDEMPTION_MOD_WIDGET2_RENDER_CACHE_HPP
+
+#include <map>
+#include <string>
+#include <memory>
+
+#include "mod_api.hpp"
+#include "bitmap.hpp"
+#include "RDP/RDPDrawable.hpp"
+#include "RDP/caches/glyphcache.hpp"
+
+class WidgetRenderCache
+{
+    struct Key
+    {
+        Font const * font;
+        uint32_t fg_color;
+        uint32_t bg_color;
+        uint16_t cx;
+        uint16_t cy;
+        int x_text;
+        int y_text;
+        std::string text;
+
+        bool operator<(const Key & other) const
+        {
+            if (this->font != other.font) {
+                return this->font < other.font;
+            }
+            if (this->fg_color != other.fg_color) {
+                return this->fg_color < other.fg_color;
+            }
+            if (this->bg_color != other.bg_color) {
+                return this->bg_color < other.bg_color;
+            }
+            if (this->cx != other.cx) {
+                return this->cx < other.cx;
+            }
+            if (this->cy != other.cy) {
+                return this->cy < other.cy;
+            }
+            if (this->x_text != other.x_text) {
+                return this->x_text < other.x_text;
+            }
+            if (this->y_text != other.y_text) {
+                return this->y_text < other.y_text;
+            }
+            return this->text < other.text;
+        }
+    };
+
+    struct Entry
+    {
+        Bitmap bmp;
+        unsigned stamp;
+    };
+
+    typedef std::map<Key, Entry> container_type;
+
+    container_type entries;
+    size_t max_bytes;
+    size_t used_bytes;
+    unsigned stamp;
+    GlyphCache glyph_cache;
+
+public:
+    // Bitmaps are bounded by their total size: a bitmap is a whole label and
+    // an edit widget renders a new one for each keystroke.
+    explicit WidgetRenderCache(size_t max_bytes = 4 * 1024 * 1024)
+    : max_bytes(max_bytes)
+    , used_bytes(0)
+    , stamp(0)
+    {}
+
+    // shared by the internal modules of a session
+    static WidgetRenderCache & session_cache()
+    {
+        static WidgetRenderCache cache;
+        return cache;
+    }
+
+    size_t size() const
+    {
+        return this->entries.size();
+    }
+
+    size_t bytes() const
+    {
+        return this->used_bytes;
+    }
+
+    // text drawn at (x_text, y_text) on a cx x cy rectangle of bg_color
+    const Bitmap & label( Font const & font, const char * text, int x_text, int y_text
+                        , uint16_t cx, uint16_t cy, uint32_t fg_color, uint32_t bg_color)
+    {
+        Key key{&font, fg_color, bg_color, cx, cy, x_text, y_text, text};
+        container_type::iterator it = this->entries.find(key);
+        if (it == this->entries.end()) {
+            Entry entry{this->render_label(font, text, x_text, y_text, cx, cy, fg_color, bg_color), 0};
+            const size_t entry_bytes = entry.bmp.bmp_size();
+            // a bitmap larger than the cache is kept alone
+            while (!this->entries.empty() && this->used_bytes + entry_bytes > this->max_bytes) {
+                this->evict_oldest();
+            }
+            it = this->entries.insert(container_type::value_type(std::move(key), std::move(entry))).first;
+            this->used_bytes += entry_bytes;
+        }
+        it->second.stamp = ++this->stamp;
+        return it->second.bmp;
+    }
+
+private:
+    void evict_oldest()
+    {
+        container_type::iterator oldest = this->entries.begin();
+        for (container_type::iterator it = this->entries.begin(); it != this->entries.end(); ++it) {
+            if (it->second.stamp < oldest->second.stamp) {
+                oldest = it;
+            }
+        }
+        this->used_bytes -= oldest->second.bmp.bmp_size();
+        this->entries.erase(oldest);
+    }
+
+    // same orders as WidgetLabel::draw, played on an off-screen drawable
+    Bitmap render_label( Font const & font, const char * text, int x_text, int y_text
+                       , uint16_t cx, uint16_t cy, uint32_t fg_color, uint32_t bg_color)
+    {
+        // bitmap lines are aligned on 4 pixels, the padding gets the background color
+        const Rect padded_rect(0, 0, align4(cx), cy);
+        const Rect rect(0, 0, cx, cy);
+        RDPDrawable gd(padded_rect.cx, cy, 24);
+        gd.draw(RDPOpaqueRect(padded_rect, bg_color), padded_rect);
+        mod_api::draw_text(gd, this->glyph_cache, font, x_text, y_text, text, fg_color, bg_color, rect);
+
+        // drawable rows are top-down, bitmap rows are bottom-up
+        const size_t row_size = gd.rowsize();
+        std::unique_ptr<uint8_t[]> rows(new uint8_t[row_size * cy]);
+        for (uint16_t y = 0; y < cy; ++y) {
+            memcpy(rows.get() + row_size * (cy - 1 - y), gd.data() + row_size * y, row_size);
+        }
+        return Bitmap(24, 24, nullptr, padded_rect.cx, cy, rows.get(), row_size * cy);
+    }
+};
+
+#endif
@@ -146,8 +146,7 @@ public:
                 this->drawable.draw(RDPScrBlt(dest, 0xCC, src_x, src_y),
                                     clip);
                 if (this->diff_x && this->diff_y) {
-                    Region region;
-                    region.rects.push_back(refreshx);
+                    Region region(refreshx);
                     region.subtract_rect(refresh);
                     // if (region.rects.size() > 0) {
                     //     this->wid->draw(clip.intersect(region.rects[0]));
@@ -117,12 +117,20 @@ public:
         );
     }
 
-    TODO("implementation of the server_draw_text function below is a small subset of possibilities text can be packed (detecting duplicated strings). See MS-RDPEGDI 2.2.2.2.1.1.2.13 GlyphIndex (GLYPHINDEX_ORDER)")
     virtual void server_draw_text(Font const & font, int16_t x, int16_t y, const char * text,
                                   uint32_t fgcolor, uint32_t bgcolor, const Rect & clip)
     {
         static GlyphCache mod_glyph_cache;
 
+        draw_text(*this->gd, mod_glyph_cache, font, x, y, text, fgcolor, bgcolor, clip);
+    }
+
+    TODO("implementation of the draw_text function below is a small subset of possibilities text can be packed (detecting duplicated strings). See MS-RDPEGDI 2.2.2.2.1.1.2.13 GlyphIndex (GLYPHINDEX_ORDER)")
+    // draws text as GlyphIndex orders on gd, glyphs are added to mod_glyph_cache
+    static void draw_text(RDPGraphicDevice & gd, GlyphCache & mod_glyph_cache,
+                          Font const & font, int16_t x, int16_t y, const char * text,
+                          uint32_t fgcolor, uint32_t bgcolor, const Rect & clip)
+    {
         UTF8toUnicodeIterator unicode_iter(text);
         while (*unicode_iter) {
             int total_width = 0;
@@ -183,7 +191,7 @@ public:
 
             x += total_width;
 
-            this->gd->draw(glyphindex, clip, &mod_glyph_cache);
+            gd.draw(glyphindex, clip, &mod_glyph_cache);
         }
     }
 
@@ -215,6 +223,10 @@ public:
 
     virtual bool is_up_and_running() { return false; }
 
+    // sends the channel data held back by the module channel scheduler,
+    // timeout is lowered to the time the next pending chunk can be sent
+    virtual void send_pending_channel_data(timeval & timeout) {}
+
     virtual void send_fastpath_data(Stream & data) {}
     virtual void send_data_indication_ex(uint16_t channelId, HStream & stream) {}
     virtual void disconnect() {}
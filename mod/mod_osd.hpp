@@ -434,6 +434,11 @@ public:
         this->mod.send_to_mod_channel(front_channel_name, chunk, length, flags);
     }
 
+    virtual void send_pending_channel_data(timeval & timeout)
+    {
+        this->mod.send_pending_channel_data(timeout);
+    }
+
     // Interface for session to send back to mod_rdp for tse virtual channel target data (asked previously)
     virtual void send_auth_channel_data(const char * data)
     {
@@ -73,8 +73,10 @@
 #include "client_info.hpp"
 #include "genrandom.hpp"
 #include "authorization_channels.hpp"
+#include "rdp/rdp_channel_routes.hpp"
 #include "parser.hpp"
 #include "channel_names.hpp"
+#include "channel_scheduler.hpp"
 #include "finally.hpp"
 
 class mod_rdp : public mod_api {
@@ -84,12 +86,16 @@ class mod_rdp : public mod_api {
 
     const AuthorizationChannels authorization_channels;
 
+    RDPChannelRoutes channel_routes;
+
     typedef int_fast32_t data_size_type;
     data_size_type max_clipboard_data = 0;
     data_size_type total_clipboard_data = 0;
     data_size_type max_rdpdr_data = 0;
     data_size_type total_rdpdr_data = 0;
 
+    ChannelScheduler channel_scheduler;
+
     int  use_rdp5;
 
     int  keylayout;
@@ -225,6 +231,7 @@ public:
             mod_rdp_params.allow_channels ? *mod_rdp_params.allow_channels : unsafe_to_cref(std::string{}),
             mod_rdp_params.deny_channels ? *mod_rdp_params.deny_channels : unsafe_to_cref(std::string{})
           )
+        , channel_scheduler(mod_rdp_params.channel_scheduler)
         , use_rdp5(1)
         , keylayout(info.keylayout)
         , orders( mod_rdp_params.target_host, mod_rdp_params.enable_persistent_disk_bitmap_cache
@@ -308,6 +315,8 @@ public:
 
         this->configure_extra_orders(mod_rdp_params.extra_orders);
 
+        this->channel_scheduler.set_rate_limits(mod_rdp_params.channel_rate_limits);
+
         this->event.object_and_time = (this->open_session_timeout > 0);
 
         memset(this->auth_channel, 0, sizeof(this->auth_channel));
@@ -487,6 +496,10 @@ public:
             free(this->lic_layer_license_data);
         }
 
+        if (this->channel_scheduler.is_enabled() && (this->verbose & 16)) {
+            this->channel_scheduler.log_counters("mod_rdp");
+        }
+
         if (this->verbose & 1) {
             LOG(LOG_INFO, "~mod_rdp(): Recv bmp cache count  = %llu",
                 this->orders.recv_bmp_cache_count);
@@ -620,6 +633,19 @@ public:
     }
 
 private:
+    void send_to_front_channel( const RDPChannelRoute & route, uint8_t * data
+                              , size_t length, size_t chunk_size, int flags) {
+        if (this->transparent_recorder) {
+            this->transparent_recorder->send_to_front_channel( this->mod_channel_list[route.mod_index].name
+                                                             , data, length, chunk_size, flags);
+        }
+
+        if (route.front_index >= 0) {
+            this->front.send_to_channel( this->front.get_channel_list()[route.front_index]
+                                       , data, length, chunk_size, flags);
+        }
+    }
+
     template<class PDU, class... Args>
     void send_clipboard_pdu_to_front_channel(bool response_ok, Args&&... args) {
         PDU             format_data_response_pdu(response_ok);
@@ -680,13 +706,27 @@ public:
             }
         });
 
+        const RDPChannelRoute * route = this->channel_routes.get_by_name(front_channel_name);
+        // if no matching channel is found just forget it
+        if (!route) {
+            return;
+        }
+
+        // channels needing no inspection are forwarded as they are
+        if (route->passthrough_to_mod) {
+            if (route->mod_channel) {
+                this->send_to_channel(this->mod_channel_list[route->mod_index], chunk, length, flags);
+            }
+            return;
+        }
+
         // filtering device redirection (printer, smartcard, etc)
-        if (!strcmp(front_channel_name, channel_names::rdpdr)) {
+        if (route->handler == RDPChannelRoute::RDPDR) {
             auto p = chunk.p;
 
             const rdpdr::PacketId packet_id = rdpdr::SharedHeader::read_packet_id(chunk);
 
-            if (packet_id == rdpdr::PacketId::PAKID_CORE_CLIENT_CAPABILITY) {
+            if (packet_id == rdpdr::PacketId::PAKID_CORE_CLIENT_CAPABILITY && route->rdpdr_filter) {
                 const auto p_num = chunk.p;
 
                 const uint16_t num_capabilities = rdpdr::read_num_capability(chunk);
@@ -725,11 +765,11 @@ public:
             chunk.p = p;
         }
         // Clipboard is a Clipboard PDU
-        else if (!strcmp(front_channel_name, channel_names::cliprdr)) {
+        else if (route->handler == RDPChannelRoute::CLIPRDR) {
             const uint16_t msgType = chunk.in_uint16_le();
 
             // Clipboard is unavailable
-            if (!this->authorization_channels.cliprdr_up_is_authorized()) {
+            if (!route->cliprdr_up) {
                 if (this->verbose & 1) {
                     LOG(LOG_INFO, "mod_rdp clipboard PDU");
                 }
@@ -740,7 +780,7 @@ public:
                     throw Error(ERR_RDP_DATA_TRUNCATED);
                 }
 
-                if (this->authorization_channels.cliprdr_down_is_authorized()) {
+                if (route->cliprdr_down) {
                     if (msgType == RDPECLIP::CB_FORMAT_DATA_REQUEST) {
                         this->send_clipboard_pdu_to_front_channel<RDPECLIP::FormatDataResponsePDU>(false, "\0");
                         return;
@@ -758,7 +798,7 @@ public:
                 }
             }
             //  Clipboard is available and Copy a file is unavailable
-            else if (!this->authorization_channels.cliprdr_file_is_authorized()) {
+            else if (!route->cliprdr_file) {
                 if (msgType == RDPECLIP::CB_FILECONTENTS_REQUEST) {
                     this->send_clipboard_pdu_to_front_channel<RDPECLIP::FileContentsResponse>(false);
                     return ;
@@ -771,13 +811,13 @@ public:
             chunk.p -= 2;
         }
 
-        const CHANNELS::ChannelDef * mod_channel = this->mod_channel_list.get_by_name(front_channel_name);
-        // send it if module has a matching channel, if no matching channel is found just forget it
-        if (mod_channel) {
+        // send it if module has a matching channel
+        if (route->mod_channel) {
+            const CHANNELS::ChannelDef & mod_channel = this->mod_channel_list[route->mod_index];
             if (this->verbose & 16) {
-                mod_channel->log(unsigned(mod_channel - &this->mod_channel_list[0]));
+                mod_channel.log(unsigned(route->mod_index));
             }
-            this->send_to_channel(*mod_channel, chunk, length, flags);
+            this->send_to_channel(mod_channel, chunk, length, flags);
         }
     }
 
@@ -810,20 +850,38 @@ public:
             channel.log(-1u);
         }
 
-        if (channel.flags & GCC::UserData::CSNet::CHANNEL_OPTION_SHOW_PROTOCOL) {
+        // sent after the graphics of this round when held back
+        if (!this->channel_scheduler.queue(channel, chunk.get_data(), chunk.size(), length, flags, tvtime())) {
+            this->send_channel_chunk(channel.chanid, channel.flags, chunk.get_data(), chunk.size(), length, flags);
+        }
+
+        if (this->verbose & 16) {
+            LOG(LOG_INFO, "mod_rdp::send_to_channel done");
+        }
+    }
+
+    virtual void send_pending_channel_data(timeval & timeout) {
+        this->channel_scheduler.send_pending(tvtime(), timeout, [this](const ChannelScheduler::Chunk & chunk) {
+            this->send_channel_chunk( chunk.chanid, chunk.channel_flags, chunk.data.data(), chunk.data.size()
+                                    , chunk.length, chunk.flags);
+        });
+    }
+
+private:
+    void send_channel_chunk( int chanid, uint32_t channel_flags, const uint8_t * chunk, size_t chunk_size
+                           , size_t length, uint32_t flags) {
+        if (channel_flags & GCC::UserData::CSNet::CHANNEL_OPTION_SHOW_PROTOCOL) {
             flags |= CHANNELS::CHANNEL_FLAG_SHOW_PROTOCOL;
         }
 
         CHANNELS::VirtualChannelPDU virtual_channel_pdu;
 
         virtual_channel_pdu.send_to_server( this->nego.trans, this->encrypt, this->encryptionLevel
-                                            , this->userid, channel.chanid, length, flags, chunk.get_data(), chunk.size());
-
-        if (this->verbose & 16) {
-            LOG(LOG_INFO, "mod_rdp::send_to_channel done");
-        }
+                                          , this->userid, chanid, length, flags, chunk, chunk_size);
     }
 
+public:
+
     void send_data_request(uint16_t channelId, HStream & stream)
     {
         if (this->verbose & 16) {
@@ -1334,6 +1392,13 @@ public:
                                     LOG(LOG_INFO, "cjcf[%u] = %u", index, mcs.channelId);
                                 }
                             }
+
+                            this->channel_routes.build( this->mod_channel_list, this->front.get_channel_list()
+                                                      , this->authorization_channels, this->auth_channel
+                                                      , this->max_clipboard_data != 0, this->max_rdpdr_data != 0);
+                            if (this->verbose & 16){
+                                this->channel_routes.log();
+                            }
                         }
 
                         // RDP Security Commencement
@@ -1868,14 +1933,18 @@ public:
                                 mod_channel.log(num_channel_src);
                             }
 
+                            const RDPChannelRoute * route = this->channel_routes.get_by_mod_index(num_channel_src);
+                            if (!route) {
+                                LOG(LOG_WARNING, "mod::rdp::MOD_RDP_CONNECTED::Channel id=%d not joined", mcs.channelId);
+                                throw Error(ERR_CHANNEL_UNKNOWN_CHANNEL);
+                            }
+
                             uint32_t length = sec.payload.in_uint32_le();
                             int flags = sec.payload.in_uint32_le();
                             size_t chunk_size = sec.payload.in_remain();
 
                             // If channel name is our virtual channel, then don't send data to front
-                            if ( this->auth_channel[0] /*&& this->acl */
-                             && !strcmp(mod_channel.name, this->auth_channel)
-                            ) {
+                            if (route->handler == RDPChannelRoute::AUTH) {
                                 std::string auth_channel_message((const char *)sec.payload.p, sec.payload.in_remain());
                                 LOG(LOG_INFO, "Auth channel data=\"%s\"", auth_channel_message.c_str());
                                 //if (this->auth_channel_state == 0) {
@@ -1898,12 +1967,16 @@ public:
                                 //    this->auth_channel_state = 0;
                                 //}
                             }
+                            // channels needing no inspection are forwarded as they are
+                            if (route->passthrough_to_front) {
+                                this->send_to_front_channel(*route, sec.payload.p, length, chunk_size, flags);
+                            }
                             // Clipboard is a Clipboard PDU
-                            if (!strcmp(mod_channel.name, channel_names::cliprdr)) {
+                            else if (route->handler == RDPChannelRoute::CLIPRDR) {
                                 const uint16_t msgType = sec.payload.in_uint16_le();
 
                                 // Clipboard is unavailable and is a Clipboard PDU
-                                if (!this->authorization_channels.cliprdr_down_is_authorized()) {
+                                if (!route->cliprdr_down) {
                                     TODO("RZ: Don't reject clipboard update, this can block rdesktop."
                                         " (until 1.7.1 ?)");
 
@@ -1911,7 +1984,7 @@ public:
                                         LOG(LOG_INFO, "mod_rdp clipboard PDU");
                                     }
 
-                                    if (this->authorization_channels.cliprdr_up_is_authorized()) {
+                                    if (route->cliprdr_up) {
                                         if (msgType == RDPECLIP::CB_FORMAT_DATA_REQUEST) {
                                             BStream out_s(256);
                                             RDPECLIP::FormatDataResponsePDU(false).emit(out_s, "\0");
@@ -1923,8 +1996,7 @@ public:
                                         }
                                         else {
                                             sec.payload.p -= 2;
-                                            this->send_to_front_channel(
-                                                mod_channel.name, sec.payload.p, length, chunk_size, flags);
+                                            this->send_to_front_channel(*route, sec.payload.p, length, chunk_size, flags);
                                         }
                                     }
                                     else if (msgType == RDPECLIP::CB_FORMAT_LIST) {
@@ -1944,7 +2016,7 @@ public:
                                         );
                                     }
                                 }
-                                else if (!this->authorization_channels.cliprdr_file_is_authorized()) {
+                                else if (!route->cliprdr_file) {
                                     if (msgType == RDPECLIP::CB_FILECONTENTS_REQUEST) {
                                         BStream out_s(256);
                                         const bool response_ok = false;
@@ -1957,28 +2029,22 @@ public:
                                     }
                                     else {
                                         sec.payload.p -= 2;
-                                        this->send_to_front_channel(
-                                            mod_channel.name, sec.payload.p, length, chunk_size, flags
-                                        );
+                                        this->send_to_front_channel(*route, sec.payload.p, length, chunk_size, flags);
                                     }
                                 }
                                 else {
                                     this->update_total_clipboard_data(msgType, length);
                                     sec.payload.p -= 2;
-                                    this->send_to_front_channel(
-                                        mod_channel.name, sec.payload.p, length, chunk_size, flags
-                                    );
+                                    this->send_to_front_channel(*route, sec.payload.p, length, chunk_size, flags);
                                 }
                             }
                             else {
-                                if (!strcmp(mod_channel.name, channel_names::rdpdr)) {
+                                if (route->handler == RDPChannelRoute::RDPDR) {
                                     auto const packet_id = rdpdr::SharedHeader::read_packet_id(sec.payload);
                                     this->update_total_rdpdr_data(packet_id, length);
                                     sec.payload.p -= sizeof(rdpdr::SharedHeader);
                                 }
-                                this->send_to_front_channel(
-                                    mod_channel.name, sec.payload.p, length, chunk_size, flags
-                                );
+                                this->send_to_front_channel(*route, sec.payload.p, length, chunk_size, flags);
                             }
                             sec.payload.p = sec.payload.end;
                         }
@@ -4422,15 +4488,16 @@ public:
         }
         if ((UP_AND_RUNNING == this->connection_finalization_state)
             && (vr.size() > 0)) {
+            // the server refreshes overlapping areas once
+            Region region;
+            for (size_t i = 0; i < vr.size() ; i++){
+                region.add_rect(vr[i]);
+            }
             RDP::RefreshRectPDU rrpdu(this->share_id,
                                       this->userid,
                                       this->encryptionLevel,
                                       this->encrypt);
-            for (size_t i = 0; i < vr.size() ; i++){
-                if (!vr[i].isempty()){
-                    rrpdu.addInclusiveRect(vr[i].x, vr[i].y, vr[i].x + vr[i].cx - 1, vr[i].y + vr[i].cy - 1);
-                }
-            }
+            rrpdu.addInclusiveRects(region);
             rrpdu.emit(this->nego.trans);
         }
         if (this->verbose & 4){
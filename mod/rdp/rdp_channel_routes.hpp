@@ -0,0 +1,169 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2014
+    Author(s): Christophe Grosjean, Raphael Zhou
+*/
+
+#ifndef _REDEMPTION_MOD_RDP_RDP_CHANNEL_ROUTES_HPP_
+#define _REDEMPTION_MOD_RDP_RDP_CHANNEL_ROUTES_HPP_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "log.hpp"
+#include "channel_names.hpp"
+#include "authorization_channels.hpp"
+
+// Handling of the virtual channel PDUs relayed by mod_rdp, resolved once per
+// channel when the channels are joined instead of comparing names and asking
+// AuthorizationChannels for each PDU.
+struct RDPChannelRoute {
+    enum Handler {
+        PASSTHROUGH,
+        CLIPRDR,
+        RDPDR,
+        AUTH        // proxy auth channel (wablauncher)
+    };
+
+    uint64_t name_id;       // channel_name_id() of the channel name
+    Handler  handler;
+    size_t   mod_index;     // in the mod channel list
+    bool     mod_channel;   // the channel is authorized, the target has it
+    int      front_index;   // in the front channel list, -1 when not relayed to the client
+
+    bool cliprdr_up;        // AuthorizationChannels::cliprdr_up_is_authorized()
+    bool cliprdr_down;      // AuthorizationChannels::cliprdr_down_is_authorized()
+    bool cliprdr_file;      // AuthorizationChannels::cliprdr_file_is_authorized()
+    bool rdpdr_filter;      // some device types are not authorized
+
+    // PDUs are forwarded as they are, headers are not read
+    bool passthrough_to_mod;
+    bool passthrough_to_front;
+};
+
+class RDPChannelRoutes {
+public:
+    enum {
+        MAX_ROUTES = 32     // MAX_STATIC_VIRTUAL_CHANNELS + global channel + wab channel
+    };
+
+private:
+    RDPChannelRoute routes[MAX_ROUTES];
+    size_t          count;
+
+public:
+    RDPChannelRoutes() : count(0) {}
+
+    // mod_channels and front_channels are CHANNELS::ChannelDefArray, the
+    // first mod channels are the front channels in the same order, with an
+    // empty name when not authorized. Data of a channel is inspected when its
+    // authorizations filter some PDUs or when it is counted against a limit
+    // (count_clipboard, count_rdpdr).
+    template<class ChannelDefArray>
+    void build( const ChannelDefArray & mod_channels, const ChannelDefArray & front_channels
+              , const AuthorizationChannels & authorization_channels, const char * auth_channel
+              , bool count_clipboard, bool count_rdpdr) {
+        const uint64_t auth_channel_id = channel_name_id(auth_channel);
+
+        this->count = 0;
+        for (size_t index = 0; index < mod_channels.size() && index < MAX_ROUTES; ++index) {
+            const char * name = (index < front_channels.size())
+                              ? front_channels[index].name : mod_channels[index].name;
+
+            RDPChannelRoute & route = this->routes[this->count++];
+            route.name_id      = channel_name_id(name);
+            route.mod_index    = index;
+            route.mod_channel  = (mod_channels[index].name[0] != 0);
+            route.front_index  = route.mod_channel ? front_channels.get_index_by_name(name) : -1;
+            route.cliprdr_up   = authorization_channels.cliprdr_up_is_authorized();
+            route.cliprdr_down = authorization_channels.cliprdr_down_is_authorized();
+            route.cliprdr_file = authorization_channels.cliprdr_file_is_authorized();
+            route.rdpdr_filter = false;
+            for (unsigned type = 1; type <= AuthorizationChannels::rdpdr_list.size(); ++type) {
+                if (!authorization_channels.rdpdr_type_is_authorized(type)) {
+                    route.rdpdr_filter = true;
+                }
+            }
+
+            if (auth_channel_id && route.name_id == auth_channel_id) {
+                route.handler              = RDPChannelRoute::AUTH;
+                route.passthrough_to_mod   = true;
+                route.passthrough_to_front = false;
+            }
+            else if (route.name_id == channel_name_id(channel_names::cliprdr)) {
+                route.handler              = RDPChannelRoute::CLIPRDR;
+                route.passthrough_to_mod   = route.cliprdr_up && route.cliprdr_file && !count_clipboard;
+                route.passthrough_to_front = route.cliprdr_down && route.cliprdr_file && !count_clipboard;
+            }
+            else if (route.name_id == channel_name_id(channel_names::rdpdr)) {
+                route.handler              = RDPChannelRoute::RDPDR;
+                route.passthrough_to_mod   = !route.rdpdr_filter && !count_rdpdr;
+                route.passthrough_to_front = !count_rdpdr;
+            }
+            else {
+                route.handler              = RDPChannelRoute::PASSTHROUGH;
+                route.passthrough_to_mod   = true;
+                route.passthrough_to_front = true;
+            }
+
+            // nothing to filter, the data is dropped
+            if (!route.mod_channel && route.handler != RDPChannelRoute::CLIPRDR) {
+                route.passthrough_to_mod = true;
+            }
+            if (!route.mod_channel) {
+                route.passthrough_to_front = true;
+            }
+        }
+    }
+
+    void clear() {
+        this->count = 0;
+    }
+
+    size_t size() const {
+        return this->count;
+    }
+
+    const RDPChannelRoute & operator[](size_t index) const {
+        return this->routes[index];
+    }
+
+    const RDPChannelRoute * get_by_name(const char * name) const {
+        const uint64_t name_id = channel_name_id(name);
+        for (size_t index = 0; index < this->count; ++index) {
+            if (this->routes[index].name_id == name_id) {
+                return &this->routes[index];
+            }
+        }
+        return nullptr;
+    }
+
+    const RDPChannelRoute * get_by_mod_index(size_t mod_index) const {
+        return (mod_index < this->count) ? &this->routes[mod_index] : nullptr;
+    }
+
+    void log() const {
+        for (size_t index = 0; index < this->count; ++index) {
+            const RDPChannelRoute & route = this->routes[index];
+            LOG(LOG_INFO, "RDPChannelRoutes[%u]: handler=%d front_index=%d passthrough_to_mod=%s passthrough_to_front=%s"
+               , unsigned(index), route.handler, route.front_index
+               , route.passthrough_to_mod ? "yes" : "no", route.passthrough_to_front ? "yes" : "no");
+        }
+    }
+};
+
+#endif
@@ -298,7 +298,7 @@ private:
                         , uint16_t width, uint16_t height, const uint8_t * data)
     {
         FontChar fi(offset, baseline, width, height, 0);
-        memcpy(fi.data.get(), data, fi.datasize());
+        memcpy(fi.writable_data(), data, fi.datasize());
 
         this->gly_cache.set_glyph(std::move(fi), cacheId, cacheIndex);
     }
@@ -77,6 +77,9 @@ struct ModRDPParams {
     const std::string * allow_channels;
     const std::string * deny_channels;
 
+    bool         channel_scheduler;
+    const char * channel_rate_limits;
+
     uint32_t verbose;
     uint32_t cache_verbose;
 
@@ -135,6 +138,9 @@ struct ModRDPParams {
         , allow_channels(nullptr)
         , deny_channels(nullptr)
 
+        , channel_scheduler(false)
+        , channel_rate_limits("")
+
         , verbose(verbose)
         , cache_verbose(0)
     {}
@@ -223,6 +229,11 @@ struct ModRDPParams {
         LOG(LOG_INFO,
             "ModRDPParams deny_channels=<%p>",                     this->deny_channels);
 
+        LOG(LOG_INFO,
+            "ModRDPParams channel_scheduler=%s",                   (this->channel_scheduler ? "yes" : "no"));
+        LOG(LOG_INFO,
+            "ModRDPParams channel_rate_limits=\"%s\"",             (this->channel_rate_limits ? this->channel_rate_limits : "<null>"));
+
         LOG(LOG_INFO,
             "ModRDPParams verbose=0x%08X",                         this->verbose);
         LOG(LOG_INFO,
@@ -214,3 +214,104 @@ BOOST_AUTO_TEST_CASE(TestAclSerializerInItems)
     acl.in_items(stream);
     BOOST_CHECK(ini.context_is_asked(AUTHID_PASSWORD));
 }
+
+inline void out_binary_item(Stream & stream, authid_t authid, uint8_t flags, const char * value)
+{
+    stream.out_uint16_be(authid);
+    stream.out_uint8(flags);
+    stream.out_uint16_be(strlen(value));
+    stream.out_copy_bytes(value, strlen(value));
+    stream.out_uint8(0);
+}
+
+BOOST_AUTO_TEST_CASE(TestAclSerializeBinaryIncoming)
+{
+    Inifile ini;
+    BStream stream(1024);
+    stream.out_uint32_be(0);
+    out_binary_item(stream, AUTHID_AUTH_USER, 1, "");
+    out_binary_item(stream, AUTHID_TARGET_USER, 0, "administrateur");
+    out_binary_item(stream, AUTHID_TARGET_PASSWORD, 0, "SecureLinux");
+    // unknown authid are skipped
+    out_binary_item(stream, MAX_AUTHID, 0, "whatever");
+    stream.set_out_uint32_be((stream.get_offset() - 4) | 0x80000000, 0);
+
+    GeneratorTransport trans((char *)stream.get_data(), stream.get_offset());
+    AclSerializer acl(&ini, trans, 0);
+    ini.context_set_value(AUTHID_AUTH_USER, "testuser");
+    BOOST_CHECK(!acl.is_binary());
+
+    try {
+        acl.incoming();
+    } catch (const Error & e){
+        BOOST_CHECK(false);
+    }
+    BOOST_CHECK(acl.is_binary());
+    BOOST_CHECK(ini.context_is_asked(AUTHID_AUTH_USER));
+    BOOST_CHECK_EQUAL("administrateur", ini.context_get_value(AUTHID_TARGET_USER));
+    BOOST_CHECK_EQUAL("SecureLinux", ini.context_get_value(AUTHID_TARGET_PASSWORD));
+
+    // missing terminal zero
+    stream.reset();
+    stream.out_uint32_be(0);
+    stream.out_uint16_be(AUTHID_TARGET_USER);
+    stream.out_uint8(0);
+    stream.out_uint16_be(4);
+    stream.out_copy_bytes("user", 4);
+    stream.set_out_uint32_be((stream.get_offset() - 4) | 0x80000000, 0);
+
+    GeneratorTransport transexcpt((char *)stream.get_data(), stream.get_offset());
+    AclSerializer aclexcpt(&ini, transexcpt, 0);
+    try {
+        aclexcpt.incoming();
+        BOOST_CHECK(false);
+    } catch (const Error & e){
+        BOOST_CHECK_EQUAL((uint32_t)ERR_ACL_UNEXPECTED_IN_ITEM_OUT, (uint32_t)e.id);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestAclSerializeBinarySend)
+{
+    Inifile ini;
+    MemoryTransport trans;
+
+    // authentifier opts in with an empty binary message
+    trans.out_stream.out_uint32_be(0x80000000);
+    AclSerializer acl(&ini, trans, 0);
+    acl.incoming();
+    BOOST_CHECK(acl.is_binary());
+    ini.reset();
+
+    ini.context_set_value(AUTHID_TARGET_USER, "user");
+    ini.context_set_value(AUTHID_TARGET_PASSWORD, "");
+    ini.context_ask(AUTHID_TARGET_PASSWORD);
+    acl.send_acl_data();
+
+    BStream stream(256);
+    trans.out_stream.mark_end();
+    size_t size = trans.out_stream.get_offset() - trans.in_stream.get_offset();
+    trans.in_stream.in_copy_bytes(stream.get_data(), size);
+    stream.end = stream.get_data() + size;
+
+    BOOST_CHECK_EQUAL(0x80000000u | (size - 4), stream.in_uint32_be());
+    // changed set is ordered by field address, so do not rely on item order
+    unsigned found = 0;
+    while (stream.in_remain()) {
+        const unsigned authid = stream.in_uint16_be();
+        const uint8_t flags = stream.in_uint8();
+        const unsigned length = stream.in_uint16_be();
+        const char * value = reinterpret_cast<const char *>(stream.p);
+        stream.in_skip_bytes(length + 1);
+        if (authid == AUTHID_TARGET_USER) {
+            BOOST_CHECK_EQUAL(0, flags);
+            BOOST_CHECK_EQUAL(std::string("user"), std::string(value, length));
+            ++found;
+        }
+        else if (authid == AUTHID_TARGET_PASSWORD) {
+            BOOST_CHECK_EQUAL(1, flags);
+            BOOST_CHECK_EQUAL(0u, length);
+            ++found;
+        }
+    }
+    BOOST_CHECK_EQUAL(2u, found);
+}
@@ -0,0 +1,117 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Unit test for Acl Serializer, text and binary protocol round-trip cost
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestAclSerializerPerf
+#include <boost/test/auto_unit_test.hpp>
+
+#undef SHARE_PATH
+#define SHARE_PATH FIXTURES_PATH
+
+#define LOGNULL
+
+#include "acl_serializer.hpp"
+#include "test_transport.hpp"
+#include "difftimeval.hpp"
+
+// every authid twice, as a session start (or reselection) message does
+inline size_t make_message(Stream & stream, bool binary)
+{
+    stream.out_uint32_be(0);
+    for (int pass = 0; pass < 2; pass++) {
+        for (unsigned i = AUTHID_UNKNOWN + 1; i < MAX_AUTHID; i++) {
+            if (binary) {
+                stream.out_uint16_be(i);
+                stream.out_uint8(0);
+                stream.out_uint16_be(1);
+                stream.out_uint8('1');
+                stream.out_uint8(0);
+            }
+            else {
+                stream.out_concat(string_from_authid(static_cast<authid_t>(i)));
+                stream.out_concat("\n!1\n");
+            }
+        }
+    }
+    stream.set_out_uint32_be((stream.get_offset() - 4) | (binary ? 0x80000000 : 0), 0);
+    return stream.get_offset();
+}
+
+inline uint64_t bench_incoming(bool binary, unsigned iterations)
+{
+    BStream stream(65536);
+    const size_t len = make_message(stream, binary);
+
+    Inifile ini;
+    uint64_t usec = ustime();
+    for (unsigned n = 0; n < iterations; n++) {
+        GeneratorTransport trans(reinterpret_cast<char *>(stream.get_data()), len);
+        AclSerializer acl(&ini, trans, 0);
+        acl.incoming();
+    }
+    return ustime() - usec;
+}
+
+inline uint64_t bench_send(bool binary, unsigned iterations)
+{
+    Inifile ini;
+    for (auto & x : ini.get_field_list()) {
+        ini.to_send_set.insert(x.first);
+    }
+
+    uint64_t usec = ustime();
+    for (unsigned n = 0; n < iterations; n++) {
+        MemoryTransport trans;
+        if (binary) {
+            trans.out_stream.out_uint32_be(0x80000000);
+        }
+        AclSerializer acl(&ini, trans, 0);
+        if (binary) {
+            acl.incoming();
+        }
+        for (auto & x : ini.get_field_list()) {
+            x.second->ask();
+            x.second->set_from_cstr("1");
+        }
+        acl.send_acl_data();
+    }
+    return ustime() - usec;
+}
+
+BOOST_AUTO_TEST_CASE(TestAclSerializerRoundTripPerformance)
+{
+    const unsigned iterations = 2000;
+
+    uint64_t text_in    = bench_incoming(false, iterations);
+    uint64_t binary_in  = bench_incoming(true, iterations);
+    uint64_t text_out   = bench_send(false, iterations);
+    uint64_t binary_out = bench_send(true, iterations);
+
+    printf("%u fields per message, %u messages\n", 2 * (MAX_AUTHID - 1), iterations);
+    printf("incoming: text = %lu us, binary = %lu us\n",
+        static_cast<long unsigned>(text_in), static_cast<long unsigned>(binary_in));
+    printf("send:     text = %lu us, binary = %lu us\n",
+        static_cast<long unsigned>(text_out), static_cast<long unsigned>(binary_out));
+
+    BOOST_CHECK(true);
+}
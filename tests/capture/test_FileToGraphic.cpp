@@ -136,6 +136,43 @@ BOOST_AUTO_TEST_CASE(TestSample0WRM)
     ::unlink(filename);
 }
 
+BOOST_AUTO_TEST_CASE(TestSample0WRMBatched)
+{
+    timeval begin_capture;
+    begin_capture.tv_sec = 0; begin_capture.tv_usec = 0;
+    timeval end_capture;
+    end_capture.tv_sec = 0; end_capture.tv_usec = 0;
+
+    int fd1 = ::open("./tests/fixtures/sample0.wrm", O_RDONLY);
+    int fd2 = ::open("./tests/fixtures/sample0.wrm", O_RDONLY);
+    BOOST_REQUIRE(fd1 != -1 && fd2 != -1);
+
+    InFileTransport in_wrm_trans1(fd1);
+    FileToGraphic player1(&in_wrm_trans1, begin_capture, end_capture, false, 0);
+    RDPDrawable drawable1(player1.screen_rect.cx, player1.screen_rect.cy, 24);
+    player1.add_consumer(&drawable1, nullptr);
+
+    InFileTransport in_wrm_trans2(fd2);
+    FileToGraphic player2(&in_wrm_trans2, begin_capture, end_capture, false, 0);
+    RDPDrawable drawable2(player2.screen_rect.cx, player2.screen_rect.cy, 24);
+    RDPDrawable drawable3(player2.screen_rect.cx, player2.screen_rect.cy, 24);
+    player2.add_consumer(&drawable2, nullptr);
+    player2.add_consumer(&drawable3, nullptr);
+    player2.batch_orders = true;
+
+    player1.play();
+    player2.play();
+
+    BOOST_CHECK_EQUAL(player1.total_orders_count, player2.total_orders_count);
+    BOOST_CHECK_EQUAL(player1.statistics.MemBlt, player2.statistics.MemBlt);
+    BOOST_CHECK_EQUAL(player1.statistics.CacheBitmap, player2.statistics.CacheBitmap);
+
+    const Drawable & d1 = drawable1.impl();
+    const size_t size = d1.rowsize() * d1.height();
+    BOOST_CHECK_EQUAL(0, memcmp(d1.data(), drawable2.impl().data(), size));
+    BOOST_CHECK_EQUAL(0, memcmp(d1.data(), drawable3.impl().data(), size));
+}
+
 //BOOST_AUTO_TEST_CASE(TestSecondPart)
 //{
 //    const char * input_filename = "./tests/fixtures/sample1.wrm";
@@ -32,6 +32,7 @@
 //#define LOGPRINT
 
 #include "test_transport.hpp"
+#include "count_transport.hpp"
 #include "out_file_transport.hpp"
 #include "in_file_transport.hpp"
 #include "out_filename_sequence_transport.hpp"
@@ -39,6 +40,7 @@
 #include "FileToGraphic.hpp"
 #include "GraphicToFile.hpp"
 #include "image_capture.hpp"
+#include "RDP/GraphicUpdatePDU.hpp"
 
 const char expected_stripped_wrm[] =
 /* 0000 */ "\xEE\x03\x1C\x00\x00\x00\x01\x00" // 03EE: META 0010: chunk_len=28 0001: 1 order
@@ -507,3 +509,200 @@ BOOST_AUTO_TEST_CASE(TestCaptureToWrmReplayToPng)
    ::unlink("./testcap.wrm");
 }
 
+
+BOOST_AUTO_TEST_CASE(TestSharedSerializerRev2Replay)
+{
+    // mstsc uses bitmap cache v2, bitmaps are recorded as they are sent to
+    // client: cache content at start of file and cache orders of the client
+    // stream are TS_CACHE_BITMAP_*_REV2
+    timeval now;
+    now.tv_usec = 0;
+    now.tv_sec = 1000;
+
+    Rect scr(0, 0, 100, 100);
+    Inifile ini;
+    BmpCache bmp_cache(BmpCache::Front, 24, 3, false,
+                       BmpCache::CacheOption(120, nbbytes(24) * 16 * 16, false),
+                       BmpCache::CacheOption(120, nbbytes(24) * 32 * 32, false),
+                       BmpCache::CacheOption(2553, nbbytes(24) * 64 * 64, false));
+    GlyphCache gly_cache;
+    PointerCache ptr_cache;
+
+    CountTransport client_trans;
+    uint16_t userid = 0;
+    int shareid = 0;
+    int encryptionLevel = 0;
+    CryptContext encrypt;
+    GraphicsUpdatePDU orders( &client_trans, userid, shareid, encryptionLevel, encrypt, ini, 24
+                            , bmp_cache, gly_cache, ptr_cache
+                            , 2     // bitmap_cache_version
+                            , 1     // use_bitmap_comp
+                            , 1     // op2
+                            , true, nullptr, false, 0);
+
+    uint8_t pixels1[16 * 16 * 3];
+    uint8_t pixels2[16 * 16 * 3];
+    for (size_t i = 0; i < sizeof(pixels1); i++) {
+        pixels1[i] = uint8_t(i);
+        pixels2[i] = uint8_t(i * 7 + 3);
+    }
+    Bitmap bmp1(24, 24, nullptr, 16, 16, pixels1, sizeof(pixels1), false);
+    Bitmap bmp2(24, 24, nullptr, 16, 16, pixels2, sizeof(pixels2), false);
+
+    // what the client shows, recorder starts from it
+    RDPDrawable drawable(scr.cx, scr.cy, 24);
+
+    orders.draw(RDPOpaqueRect(scr, BLUE), scr);
+    drawable.draw(RDPOpaqueRect(scr, BLUE), scr);
+    orders.draw(RDPMemBlt(0, Rect(0, 0, 16, 16), 0xCC, 0, 0, 0), scr, bmp1);
+    drawable.draw(RDPMemBlt(0, Rect(0, 0, 16, 16), 0xCC, 0, 0, 0), scr, bmp1);
+
+    const char * filename = "./testshared.wrm";
+    int fd = ::creat(filename, 0777);
+    BOOST_CHECK(fd != -1);
+    OutFileTransport trans(fd);
+    {
+        GraphicToFile recorder(now, &trans, scr.cx, scr.cy, orders, drawable, ini);
+        orders.set_mirror(&recorder);
+
+        // bmp1 only comes from the cache content dumped at start
+        orders.draw(RDPMemBlt(0, Rect(20, 20, 16, 16), 0xCC, 0, 0, 0), scr, bmp1);
+        drawable.draw(RDPMemBlt(0, Rect(20, 20, 16, 16), 0xCC, 0, 0, 0), scr, bmp1);
+        orders.draw(RDPMemBlt(0, Rect(40, 40, 16, 16), 0xCC, 0, 0, 0), scr, bmp2);
+        drawable.draw(RDPMemBlt(0, Rect(40, 40, 16, 16), 0xCC, 0, 0, 0), scr, bmp2);
+        orders.draw(RDPMemBlt(0, Rect(60, 20, 16, 16), 0xCC, 0, 0, 0), scr, bmp2);
+        drawable.draw(RDPMemBlt(0, Rect(60, 20, 16, 16), 0xCC, 0, 0, 0), scr, bmp2);
+        now.tv_sec++;
+        recorder.timestamp(now);
+        orders.flush();
+        recorder.flush();
+
+        orders.set_mirror(nullptr);
+    }
+    trans.disconnect();
+
+    fd = ::open(filename, O_RDONLY);
+    BOOST_CHECK(fd != -1);
+    InFileTransport in_wrm_trans(fd);
+
+    timeval begin_capture;
+    begin_capture.tv_sec = 0; begin_capture.tv_usec = 0;
+    timeval end_capture;
+    end_capture.tv_sec = 0; end_capture.tv_usec = 0;
+    FileToGraphic player(&in_wrm_trans, begin_capture, end_capture, false, 0);
+    RDPDrawable replayed(player.screen_rect.cx, player.screen_rect.cy, 24);
+    player.add_consumer((RDPGraphicDevice *)&replayed, (RDPCaptureDevice *)&replayed);
+    while (player.next_order()) {
+        player.interpret_order();
+    }
+    in_wrm_trans.disconnect();
+
+    // bmp1 from the cache dump, bmp2 from the client stream
+    BOOST_CHECK_EQUAL(2u, player.statistics.CacheBitmap);
+    BOOST_CHECK_EQUAL(3u, player.statistics.MemBlt);
+    BOOST_CHECK_EQUAL(drawable.impl().pix_len(), replayed.impl().pix_len());
+    BOOST_CHECK_EQUAL(0, memcmp(drawable.impl().data(), replayed.impl().data(), drawable.impl().pix_len()));
+
+    ::unlink(filename);
+}
+
+BOOST_AUTO_TEST_CASE(TestSharedSerializerPauseResume)
+{
+    // orders sent to client while capture is paused are not recorded, on
+    // resume the recorder starts again from the state of the shared caches
+    timeval now;
+    now.tv_usec = 0;
+    now.tv_sec = 1000;
+
+    Rect scr(0, 0, 100, 100);
+    Inifile ini;
+    BmpCache bmp_cache(BmpCache::Front, 24, 3, false,
+                       BmpCache::CacheOption(120, nbbytes(24) * 16 * 16, false),
+                       BmpCache::CacheOption(120, nbbytes(24) * 32 * 32, false),
+                       BmpCache::CacheOption(2553, nbbytes(24) * 64 * 64, false));
+    GlyphCache gly_cache;
+    PointerCache ptr_cache;
+
+    CountTransport client_trans;
+    uint16_t userid = 0;
+    int shareid = 0;
+    int encryptionLevel = 0;
+    CryptContext encrypt;
+    GraphicsUpdatePDU orders( &client_trans, userid, shareid, encryptionLevel, encrypt, ini, 24
+                            , bmp_cache, gly_cache, ptr_cache
+                            , 2     // bitmap_cache_version
+                            , 1     // use_bitmap_comp
+                            , 1     // op2
+                            , true, nullptr, false, 0);
+
+    uint8_t pixels1[16 * 16 * 3];
+    uint8_t pixels2[16 * 16 * 3];
+    for (size_t i = 0; i < sizeof(pixels1); i++) {
+        pixels1[i] = uint8_t(i);
+        pixels2[i] = uint8_t(i * 7 + 3);
+    }
+    Bitmap bmp1(24, 24, nullptr, 16, 16, pixels1, sizeof(pixels1), false);
+    Bitmap bmp2(24, 24, nullptr, 16, 16, pixels2, sizeof(pixels2), false);
+
+    RDPDrawable drawable(scr.cx, scr.cy, 24);
+
+    orders.draw(RDPOpaqueRect(scr, BLUE), scr);
+    drawable.draw(RDPOpaqueRect(scr, BLUE), scr);
+
+    const char * filename = "./testsharedpause.wrm";
+    int fd = ::creat(filename, 0777);
+    BOOST_CHECK(fd != -1);
+    OutFileTransport trans(fd);
+    {
+        GraphicToFile recorder(now, &trans, scr.cx, scr.cy, orders, drawable, ini);
+        orders.set_mirror(&recorder);
+
+        orders.draw(RDPMemBlt(0, Rect(20, 20, 16, 16), 0xCC, 0, 0, 0), scr, bmp1);
+        drawable.draw(RDPMemBlt(0, Rect(20, 20, 16, 16), 0xCC, 0, 0, 0), scr, bmp1);
+
+        recorder.detach_source();
+
+        // bmp2 enters the cache while paused, only the image shows it
+        orders.draw(RDPMemBlt(0, Rect(40, 40, 16, 16), 0xCC, 0, 0, 0), scr, bmp2);
+        drawable.draw(RDPMemBlt(0, Rect(40, 40, 16, 16), 0xCC, 0, 0, 0), scr, bmp2);
+
+        now.tv_sec++;
+        recorder.timestamp(now);
+        recorder.attach_source();
+
+        // cache hit on an entry the recording only knows from the resume dump
+        orders.draw(RDPMemBlt(0, Rect(60, 20, 16, 16), 0xCC, 0, 0, 0), scr, bmp2);
+        drawable.draw(RDPMemBlt(0, Rect(60, 20, 16, 16), 0xCC, 0, 0, 0), scr, bmp2);
+        now.tv_sec++;
+        recorder.timestamp(now);
+        orders.flush();
+        recorder.flush();
+
+        orders.set_mirror(nullptr);
+    }
+    trans.disconnect();
+
+    fd = ::open(filename, O_RDONLY);
+    BOOST_CHECK(fd != -1);
+    InFileTransport in_wrm_trans(fd);
+
+    timeval begin_capture;
+    begin_capture.tv_sec = 0; begin_capture.tv_usec = 0;
+    timeval end_capture;
+    end_capture.tv_sec = 0; end_capture.tv_usec = 0;
+    FileToGraphic player(&in_wrm_trans, begin_capture, end_capture, false, 0);
+    RDPDrawable replayed(player.screen_rect.cx, player.screen_rect.cy, 24);
+    player.add_consumer((RDPGraphicDevice *)&replayed, (RDPCaptureDevice *)&replayed);
+    while (player.next_order()) {
+        player.interpret_order();
+    }
+    in_wrm_trans.disconnect();
+
+    // bmp1 recorded as sent to client, bmp1 and bmp2 from the cache dump on resume
+    BOOST_CHECK_EQUAL(3u, player.statistics.CacheBitmap);
+    BOOST_CHECK_EQUAL(2u, player.statistics.MemBlt);
+    BOOST_CHECK_EQUAL(drawable.impl().pix_len(), replayed.impl().pix_len());
+    BOOST_CHECK_EQUAL(0, memcmp(drawable.impl().data(), replayed.impl().data(), drawable.impl().pix_len()));
+
+    ::unlink(filename);
+}
@@ -0,0 +1,152 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Unit test for FLV capture
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestFlvCapture
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include "flvcapture.hpp"
+#include "test_transport.hpp"
+#include "RDP/orders/RDPOrdersPrimaryOpaqueRect.hpp"
+#include "RDP/RDPDrawable.hpp"
+
+namespace {
+
+struct FlvSummary {
+    unsigned nb_headers      = 0;
+    unsigned nb_frames       = 0;
+    unsigned nb_key_frames   = 0;
+    uint32_t last_timestamp  = 0;
+};
+
+FlvSummary summarize_flv(const uint8_t * flv, size_t size)
+{
+    FlvSummary summary;
+    size_t pos = 0;
+    while (pos < size) {
+        if (!memcmp(flv + pos, "FLV", 3)) {
+            ++summary.nb_headers;
+            pos += 13;
+            continue;
+        }
+        const uint32_t data_size = (flv[pos + 1] << 16) | (flv[pos + 2] << 8) | flv[pos + 3];
+        if (flv[pos] == 9) {
+            ++summary.nb_frames;
+            summary.nb_key_frames += ((flv[pos + 11] >> 4) == 1);
+            summary.last_timestamp = (flv[pos + 4] << 16) | (flv[pos + 5] << 8) | flv[pos + 6];
+        }
+        pos += 11 + data_size + 4;
+    }
+    return summary;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(TestFlvCapture)
+{
+    timeval now;
+    now.tv_sec  = 1350998222;
+    now.tv_usec = 0;
+
+    Inifile ini;
+    ini.globals.video_quality.set_from_cstr("high");
+    ini.video.h_framerate        = 4;
+    ini.video.flv_break_interval = 0;
+
+    RDPDrawable drawable(320, 200, 24);
+    drawable.impl().dont_show_mouse_cursor = true;
+    const Rect screen(0, 0, 320, 200);
+
+    MemoryTransport trans;
+    {
+        FlvCapture consumer(now, trans, 320, 200, ini, drawable.impl());
+
+        consumer.snapshot(now, 0, 0, false);
+        BOOST_CHECK_EQUAL(250000, consumer.time_to_wait);
+
+        // same second, timestamp not changed, frames are skipped
+        for (unsigned i = 0; i < 3; ++i) {
+            now.tv_usec += 250000;
+            consumer.snapshot(now, 0, 0, false);
+        }
+        BOOST_CHECK_EQUAL(1, summarize_flv(trans.out_stream.get_data(), trans.out_stream.get_offset()).nb_frames);
+
+        // frame is encoded on next snapshot after frame time
+        now.tv_sec  += 1;
+        now.tv_usec  = 100000;
+        drawable.draw(RDPOpaqueRect(Rect(100, 100, 50, 50), 0x0000FF), screen);
+        consumer.snapshot(now, 0, 0, false);
+        BOOST_CHECK_EQUAL(150000, consumer.time_to_wait);
+        BOOST_CHECK_EQUAL(2, summarize_flv(trans.out_stream.get_data(), trans.out_stream.get_offset()).nb_frames);
+
+        consumer.snapshot(now, 0, 0, false);
+        BOOST_CHECK_EQUAL(150000, consumer.time_to_wait);
+
+        // late frames are not duplicated
+        now.tv_sec += 5;
+        drawable.draw(RDPOpaqueRect(Rect(10, 100, 50, 50), 0x00FF00), screen);
+        consumer.snapshot(now, 0, 0, false);
+        BOOST_CHECK_EQUAL(150000, consumer.time_to_wait);
+        BOOST_CHECK_EQUAL(3, summarize_flv(trans.out_stream.get_data(), trans.out_stream.get_offset()).nb_frames);
+    }
+
+    // a last frame is written at destruction
+    FlvSummary summary = summarize_flv(trans.out_stream.get_data(), trans.out_stream.get_offset());
+    BOOST_CHECK_EQUAL(1,    summary.nb_headers);
+    BOOST_CHECK_EQUAL(4,    summary.nb_frames);
+    BOOST_CHECK_EQUAL(1,    summary.nb_key_frames);
+    BOOST_CHECK_EQUAL(6100, summary.last_timestamp);
+}
+
+BOOST_AUTO_TEST_CASE(TestFlvCaptureBreakInterval)
+{
+    timeval now;
+    now.tv_sec  = 1350998222;
+    now.tv_usec = 0;
+
+    Inifile ini;
+    ini.globals.video_quality.set_from_cstr("medium");
+    ini.video.m_framerate        = 1;
+    ini.video.flv_break_interval = 8;
+
+    RDPDrawable drawable(320, 200, 24);
+    drawable.impl().dont_show_mouse_cursor = true;
+
+    MemoryTransport trans;
+    {
+        FlvCapture consumer(now, trans, 320, 200, ini, drawable.impl());
+        for (unsigned i = 0; i < 24; ++i) {
+            consumer.snapshot(now, 0, 0, false);
+            now.tv_sec += 1;
+        }
+    }
+
+    // one file every 8 seconds, each starting by a key frame
+    FlvSummary summary = summarize_flv(trans.out_stream.get_data(), trans.out_stream.get_offset());
+    BOOST_CHECK_EQUAL(2, trans.get_seqno());
+    BOOST_CHECK_EQUAL(3, summary.nb_headers);
+    BOOST_CHECK_EQUAL(3, summary.nb_key_frames);
+    BOOST_CHECK_EQUAL(7000, summary.last_timestamp);
+}
@@ -0,0 +1,144 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Raster benchmark: replays recorded order streams into RDPDrawable and
+   reports Mpixel/s for each order type and rop
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestRasterPerf
+#include <boost/test/auto_unit_test.hpp>
+
+#undef SHARE_PATH
+#define SHARE_PATH FIXTURES_PATH
+
+#define LOGNULL
+
+#include <chrono>
+
+#include "in_file_transport.hpp"
+#include "FileToGraphic.hpp"
+#include "RDP/RDPDrawable.hpp"
+
+class TimedDrawable : public RDPDrawable
+{
+public:
+    enum { DESTBLT, PATBLT, OPAQUERECT, SCRBLT, MEMBLT, MEM3BLT, NB_ORDER_TYPES };
+
+    struct Counter {
+        uint64_t nsec;
+        uint64_t pixels;
+        unsigned count;
+    };
+
+    Counter counters[NB_ORDER_TYPES][256];
+
+    TimedDrawable(uint16_t width, uint16_t height)
+    : RDPDrawable(width, height, 24)
+    , counters()
+    {}
+
+private:
+    template<class F>
+    void timed(int order, uint8_t rop, const Rect & rect, F f)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const auto end = std::chrono::steady_clock::now();
+        Counter & counter = this->counters[order][rop];
+        counter.nsec += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        counter.pixels += rect.cx * rect.cy;
+        counter.count++;
+    }
+
+public:
+    using RDPDrawable::draw;
+
+    virtual void draw(const RDPDestBlt & cmd, const Rect & clip) {
+        this->timed(DESTBLT, cmd.rop, clip.intersect(cmd.rect), [&]{ this->RDPDrawable::draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDPPatBlt & cmd, const Rect & clip) {
+        this->timed(PATBLT, cmd.rop, clip.intersect(cmd.rect), [&]{ this->RDPDrawable::draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDPOpaqueRect & cmd, const Rect & clip) {
+        this->timed(OPAQUERECT, 0xF0, clip.intersect(cmd.rect), [&]{ this->RDPDrawable::draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDPScrBlt & cmd, const Rect & clip) {
+        this->timed(SCRBLT, cmd.rop, clip.intersect(cmd.rect), [&]{ this->RDPDrawable::draw(cmd, clip); });
+    }
+
+    virtual void draw(const RDPMemBlt & cmd, const Rect & clip, const Bitmap & bmp) {
+        this->timed(MEMBLT, cmd.rop, clip.intersect(cmd.rect), [&]{ this->RDPDrawable::draw(cmd, clip, bmp); });
+    }
+
+    virtual void draw(const RDPMem3Blt & cmd, const Rect & clip, const Bitmap & bmp) {
+        this->timed(MEM3BLT, cmd.rop, clip.intersect(cmd.rect), [&]{ this->RDPDrawable::draw(cmd, clip, bmp); });
+    }
+
+    void report(const char * name) const
+    {
+        static const char * order_names[] = {
+            "DestBlt", "PatBlt", "OpaqueRect", "ScrBlt", "MemBlt", "Mem3Blt"
+        };
+        printf("%s: avx2=%s\n", name, rop_kernels::has_avx2() ? "yes" : "no");
+        for (int order = 0; order < NB_ORDER_TYPES; ++order) {
+            for (int rop = 0; rop < 256; ++rop) {
+                const Counter & counter = this->counters[order][rop];
+                if (counter.count) {
+                    printf("  %-10s rop=0x%02X %7u orders %10lu pixels %8.1f Mpixel/s\n",
+                        order_names[order], rop, counter.count,
+                        static_cast<unsigned long>(counter.pixels),
+                        counter.nsec ? double(counter.pixels) * 1000. / double(counter.nsec) : 0.);
+                }
+            }
+        }
+    }
+};
+
+BOOST_AUTO_TEST_CASE(TestRasterPerfReplay)
+{
+    const char * wrm_files[] = {
+        "./tests/fixtures/sample0.wrm",
+        "./tests/fixtures/replay.wrm",
+        "./tests/fixtures/perfmon.wrm",
+    };
+
+    for (const char * filename : wrm_files) {
+        int fd = ::open(filename, O_RDONLY);
+        BOOST_REQUIRE(fd != -1);
+
+        InFileTransport in_wrm_trans(fd);
+        timeval begin_capture = {0, 0};
+        timeval end_capture = {0, 0};
+        FileToGraphic player(&in_wrm_trans, begin_capture, end_capture, false, 0);
+
+        TimedDrawable drawable(player.screen_rect.cx, player.screen_rect.cy);
+        player.add_consumer(&drawable, &drawable);
+        player.play();
+
+        drawable.report(filename);
+        ::close(fd);
+    }
+
+    BOOST_CHECK(true);
+}
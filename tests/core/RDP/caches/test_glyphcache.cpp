@@ -21,12 +21,112 @@
 
 #define BOOST_AUTO_TEST_MAIN
 #define BOOST_TEST_DYN_LINK
-#define BOOST_TEST_MODULE TestXXX
+#define BOOST_TEST_MODULE TestGlyphCache
 #include <boost/test/auto_unit_test.hpp>
 
 #define LOGNULL
 
+#include "RDP/caches/glyphcache.hpp"
 
-BOOST_AUTO_TEST_CASE(TestXXX)
+namespace {
+
+FontChar make_glyph(int width, int height, uint8_t seed)
+{
+    FontChar fc(0, -height, width, height, width + 1);
+    for (int i = 0; i < fc.datasize(); ++i) {
+        fc.writable_data()[i] = uint8_t(seed + i * 7);
+    }
+    return fc;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(TestGlyphCacheAddAndReset)
+{
+    GlyphCache cache;
+    GlyphCache::number_of_entries_t entries = { { 254, 254, 254, 254, 254, 254, 254, 254, 254, 64 } };
+    cache.reset(entries);
+
+    FontChar a = make_glyph(8, 12, 1);
+    FontChar b = make_glyph(9, 12, 2);
+
+    int index_a = -1;
+    int index_b = -1;
+    BOOST_CHECK_EQUAL(GlyphCache::GLYPH_ADDED_TO_CACHE, cache.add_glyph(a, 7, index_a));
+    BOOST_CHECK_EQUAL(GlyphCache::GLYPH_ADDED_TO_CACHE, cache.add_glyph(b, 7, index_b));
+    BOOST_CHECK(index_a != index_b);
+    BOOST_CHECK(cache.is_cached(7, index_a));
+
+    int index = -1;
+    BOOST_CHECK_EQUAL(GlyphCache::GLYPH_FOUND_IN_CACHE, cache.add_glyph(b, 7, index));
+    BOOST_CHECK_EQUAL(index_b, index);
+
+    // the cache keeps its own copy of the glyph
+    FontChar const & cached = cache.glyph(7, index_a);
+    BOOST_CHECK(cached);
+    BOOST_CHECK(cached.data != a.data);
+    BOOST_CHECK(cached.item_compare(a));
+
+    cache.reset(entries);
+    BOOST_CHECK(!cache.glyph(7, index_a));
+    BOOST_CHECK(!cache.is_cached(7, index_a));
+    BOOST_CHECK_EQUAL(GlyphCache::GLYPH_ADDED_TO_CACHE, cache.add_glyph(b, 7, index));
+    BOOST_CHECK_EQUAL(0, index);
+}
+
+BOOST_AUTO_TEST_CASE(TestGlyphCacheEviction)
 {
+    GlyphCache cache;
+    GlyphCache::number_of_entries_t entries = { { 4, 4, 4, 4, 4, 4, 4, 4, 4, 4 } };
+    cache.reset(entries);
+
+    // glyphs replace the least recently used ones, the glyph data buffer
+    // of the cache is moved when full: cached glyphs must stay the same
+    FontChar glyphs[64];
+    for (int i = 0; i < 64; ++i) {
+        glyphs[i] = make_glyph(16 + i % 8, 24, uint8_t(i));
+    }
+    int last_index[64];
+    for (int round = 0; round < 20; ++round) {
+        for (int i = 0; i < 64; ++i) {
+            cache.add_glyph(glyphs[i], 3, last_index[i]);
+            BOOST_CHECK(last_index[i] < 4);
+            if (i >= 3) {
+                for (int k = i - 3; k <= i; ++k) {
+                    BOOST_CHECK(cache.glyph(3, last_index[k]).item_compare(glyphs[k]));
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestGlyphCacheFragments)
+{
+    GlyphCache cache;
+
+    const uint8_t hello[] = { 1, 0, 2, 9, 3, 9, 3, 4, 4, 6 };
+    const uint8_t world[] = { 5, 0, 4, 9, 6, 9, 3, 4, 7, 6 };
+
+    int index_hello = -1;
+    int index_world = -1;
+    int index = -1;
+    BOOST_CHECK_EQUAL(GlyphCache::GLYPH_ADDED_TO_CACHE,
+                      cache.add_fragment(7, hello, sizeof(hello), 2, index_hello));
+    BOOST_CHECK_EQUAL(GlyphCache::GLYPH_ADDED_TO_CACHE,
+                      cache.add_fragment(7, world, sizeof(world), 2, index_world));
+    BOOST_CHECK(index_hello != index_world);
+    BOOST_CHECK_EQUAL(GlyphCache::GLYPH_FOUND_IN_CACHE,
+                      cache.add_fragment(7, hello, sizeof(hello), 2, index));
+    BOOST_CHECK_EQUAL(index_hello, index);
+
+    // same glyph indexes in another glyph cache are other glyphs
+    BOOST_CHECK_EQUAL(GlyphCache::GLYPH_ADDED_TO_CACHE,
+                      cache.add_fragment(6, hello, sizeof(hello), 2, index));
+    // "world" was the least recently used
+    BOOST_CHECK_EQUAL(index_world, index);
+
+    GlyphCache::number_of_entries_t entries = { { 254, 254, 254, 254, 254, 254, 254, 254, 254, 64 } };
+    cache.reset(entries);
+    BOOST_CHECK_EQUAL(GlyphCache::GLYPH_ADDED_TO_CACHE,
+                      cache.add_fragment(7, hello, sizeof(hello), 2, index));
 }
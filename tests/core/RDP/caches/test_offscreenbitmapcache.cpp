@@ -0,0 +1,110 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestOffscreenCache
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include "RDP/caches/offscreencache.hpp"
+
+namespace {
+    void make_sig(OffscreenCache::Signature & sig, uint8_t n) {
+        memset(sig, n, sizeof(sig));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestOffscreenCacheSeen)
+{
+    OffscreenCache cache;
+    BOOST_CHECK(!cache.enabled());
+
+    cache.reset(1, 10);
+    BOOST_CHECK(cache.enabled());
+
+    OffscreenCache::Signature sig;
+    make_sig(sig, 1);
+    BOOST_CHECK(!cache.seen(sig));
+    BOOST_CHECK(cache.seen(sig));
+
+    // the oldest signatures are forgotten
+    for (unsigned i = 0; i < OffscreenCache::RECENT_COUNT; ++i) {
+        OffscreenCache::Signature other;
+        make_sig(other, 2 + i);
+        cache.seen(other);
+    }
+    BOOST_CHECK(!cache.seen(sig));
+
+    cache.clear();
+    BOOST_CHECK(!cache.seen(sig) && cache.seen(sig));
+}
+
+BOOST_AUTO_TEST_CASE(TestOffscreenCacheAllocate)
+{
+    OffscreenCache cache;
+    // 1 KB, 3 entries
+    cache.reset(1, 3);
+
+    OffscreenCache::Signature sig1, sig2, sig3, sig4;
+    make_sig(sig1, 1);
+    make_sig(sig2, 2);
+    make_sig(sig3, 3);
+    make_sig(sig4, 4);
+
+    uint16_t deleted[OffscreenCache::MAX_ENTRIES];
+    uint16_t delete_count = 0;
+
+    BOOST_CHECK_EQUAL(-1, cache.find(sig1, 8, 8));
+    BOOST_CHECK_EQUAL(0, cache.allocate(sig1, 8, 8, 256, deleted, delete_count));
+    BOOST_CHECK_EQUAL(1, cache.allocate(sig2, 8, 8, 256, deleted, delete_count));
+    BOOST_CHECK_EQUAL(2, cache.allocate(sig3, 8, 8, 256, deleted, delete_count));
+    BOOST_CHECK_EQUAL(0, delete_count);
+    BOOST_CHECK_EQUAL(768, cache.size());
+
+    BOOST_CHECK_EQUAL(0, cache.find(sig1, 8, 8));
+    BOOST_CHECK_EQUAL(-1, cache.find(sig1, 8, 16));
+
+    // no entry left: the least recently used one (sig2) is deleted
+    BOOST_CHECK_EQUAL(1, cache.allocate(sig4, 8, 8, 256, deleted, delete_count));
+    BOOST_CHECK_EQUAL(1, delete_count);
+    BOOST_CHECK_EQUAL(1, deleted[0]);
+    BOOST_CHECK_EQUAL(-1, cache.find(sig2, 8, 8));
+    BOOST_CHECK_EQUAL(1, cache.find(sig4, 8, 8));
+
+    // no room left: sig3 then sig1 are deleted
+    delete_count = 0;
+    BOOST_CHECK_EQUAL(2, cache.allocate(sig2, 16, 16, 768, deleted, delete_count));
+    BOOST_CHECK_EQUAL(2, delete_count);
+    BOOST_CHECK_EQUAL(2, deleted[0]);
+    BOOST_CHECK_EQUAL(0, deleted[1]);
+    BOOST_CHECK_EQUAL(1024, cache.size());
+
+    // larger than the whole cache
+    delete_count = 0;
+    BOOST_CHECK_EQUAL(-1, cache.allocate(sig1, 32, 32, 1025, deleted, delete_count));
+    BOOST_CHECK_EQUAL(0, delete_count);
+
+    cache.clear();
+    BOOST_CHECK_EQUAL(0, cache.size());
+    BOOST_CHECK_EQUAL(-1, cache.find(sig4, 8, 8));
+}
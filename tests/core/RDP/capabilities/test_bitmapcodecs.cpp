@@ -36,6 +36,108 @@ BOOST_AUTO_TEST_CASE(TestBitmapCodecCaps)
     stream.mark_end();
     stream.p = stream.get_data();
 
+    BOOST_CHECK_EQUAL((uint16_t)CAPSETTYPE_BITMAP_CODECS, stream.in_uint16_le());
+    BOOST_CHECK_EQUAL((uint16_t)CAPLEN_BITMAP_CODECS, stream.in_uint16_le());
+
     BitmapCodecCaps cap2;
     cap2.recv(stream, CAPLEN_BITMAP_CODECS);
+    BOOST_CHECK_EQUAL(0, cap2.supportedBitmapCodecs->bitmapCodecCount);
+    BOOST_CHECK(!cap2.find(CODEC_GUID_NSCODEC));
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapCodecCapsNSCodec)
+{
+    BitmapCodecCaps cap;
+    cap.supportedBitmapCodecs->bitmapCodecCount = 2;
+    cap.supportedBitmapCodecs->bitmapCodecArray[0].setCodecGUID(CODEC_GUID_REMOTEFX);
+    cap.supportedBitmapCodecs->bitmapCodecArray[0].codecID = 3;
+    cap.supportedBitmapCodecs->bitmapCodecArray[0].codecPropertiesLength = 4;
+    BitmapCodec & nscodec = cap.supportedBitmapCodecs->bitmapCodecArray[1];
+    nscodec.setCodecGUID(CODEC_GUID_NSCODEC);
+    nscodec.nscodecProperties.fAllowDynamicFidelity = 1;
+    nscodec.nscodecProperties.fAllowSubsampling = 1;
+    nscodec.nscodecProperties.colorLossLevel = 3;
+
+    BStream stream(1024);
+    cap.emit(stream);
+    stream.mark_end();
+    stream.p = stream.get_data();
+
+    BOOST_CHECK_EQUAL(5 + 19 + 4 + 19 + 3, stream.size());
+    BOOST_CHECK_EQUAL((uint16_t)CAPSETTYPE_BITMAP_CODECS, stream.in_uint16_le());
+    BOOST_CHECK_EQUAL(stream.size(), stream.in_uint16_le());
+
+    BitmapCodecCaps cap2;
+    cap2.recv(stream, stream.size());
+    BOOST_CHECK_EQUAL(2, cap2.supportedBitmapCodecs->bitmapCodecCount);
+    BOOST_CHECK_EQUAL(0u, stream.in_remain());
+
+    const BitmapCodec * codec = cap2.find(CODEC_GUID_NSCODEC);
+    BOOST_REQUIRE(codec);
+    BOOST_CHECK_EQUAL(1, codec->codecID);
+    BOOST_CHECK_EQUAL(1, codec->nscodecProperties.fAllowDynamicFidelity);
+    BOOST_CHECK_EQUAL(1, codec->nscodecProperties.fAllowSubsampling);
+    BOOST_CHECK_EQUAL(3, codec->nscodecProperties.colorLossLevel);
+
+    codec = cap2.find(CODEC_GUID_REMOTEFX);
+    BOOST_REQUIRE(codec);
+    BOOST_CHECK_EQUAL(3, codec->codecID);
+
+    // truncated: the complete codecs are kept
+    stream.p = stream.get_data() + 4;
+    stream.end = stream.get_data() + stream.size() - 1;
+    BitmapCodecCaps cap3;
+    cap3.recv(stream, stream.size());
+    BOOST_CHECK_EQUAL(1, cap3.supportedBitmapCodecs->bitmapCodecCount);
+    BOOST_CHECK(!cap3.find(CODEC_GUID_NSCODEC));
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapCodecCapsRemoteFX)
+{
+    // client container with RLGR1 and RLGR3 icaps
+    const uint8_t properties[] =
+        "\x31\x00\x00\x00" "\x01\x00\x00\x00" "\x25\x00\x00\x00"    // length, captureFlags, capsLength
+        "\xC0\xCB" "\x08\x00\x00\x00" "\x01\x00"                    // TS_RFX_CAPS
+        "\xC1\xCB" "\x1D\x00\x00\x00" "\x01" "\xC0\xCF"             // TS_RFX_CAPSET
+        "\x02\x00" "\x08\x00"                                       // numIcaps, icapLen
+        "\x00\x01" "\x40\x00" "\x00" "\x01" "\x01" "\x01"           // RLGR1
+        "\x00\x01" "\x40\x00" "\x02" "\x01" "\x01" "\x04"           // RLGR3, image mode
+        ;
+
+    BStream stream(1024);
+    stream.out_uint16_le(CAPSETTYPE_BITMAP_CODECS);
+    stream.out_uint16_le(5 + 19 + sizeof(properties) - 1);
+    stream.out_uint8(1);
+    BitmapCodec remotefx;
+    remotefx.setCodecGUID(CODEC_GUID_REMOTEFX);
+    stream.out_copy_bytes(remotefx.codecGUID, 16);
+    stream.out_uint8(3);
+    stream.out_uint16_le(sizeof(properties) - 1);
+    stream.out_copy_bytes(properties, sizeof(properties) - 1);
+    stream.mark_end();
+    stream.p = stream.get_data() + 4;
+
+    BitmapCodecCaps cap;
+    cap.recv(stream, stream.size());
+    BOOST_CHECK_EQUAL(0u, stream.in_remain());
+    const BitmapCodec * codec = cap.find(CODEC_GUID_REMOTEFX);
+    BOOST_REQUIRE(codec);
+    BOOST_CHECK_EQUAL(3, codec->codecID);
+    BOOST_CHECK_EQUAL(1u, codec->remotefxProperties.captureFlags);
+    BOOST_CHECK_EQUAL(2, codec->remotefxProperties.numIcaps);
+    const RFXICap * icap = codec->remotefxProperties.find(CLW_ENTROPY_RLGR3);
+    BOOST_REQUIRE(icap);
+    BOOST_CHECK_EQUAL(CODEC_MODE, icap->flags);
+    icap = codec->remotefxProperties.find(CLW_ENTROPY_RLGR1);
+    BOOST_REQUIRE(icap);
+    BOOST_CHECK_EQUAL(0, icap->flags);
+
+    // server container
+    BitmapCodecCaps server_cap;
+    server_cap.supportedBitmapCodecs->bitmapCodecCount = 1;
+    server_cap.supportedBitmapCodecs->bitmapCodecArray[0].setCodecGUID(CODEC_GUID_REMOTEFX);
+    BStream server_stream(1024);
+    server_cap.emit(server_stream);
+    server_stream.mark_end();
+    BOOST_CHECK_EQUAL(5 + 19 + 4, server_stream.size());
 }
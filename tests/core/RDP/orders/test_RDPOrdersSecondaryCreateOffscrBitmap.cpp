@@ -0,0 +1,105 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Unit test to RDP Orders coder/decoder
+   Using lib boost functions for testing
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestOrderCreateOffscrBitmap
+#include <boost/test/auto_unit_test.hpp>
+
+#include "RDP/orders/RDPOrdersSecondaryCreateOffscrBitmap.hpp"
+
+#include "test_orders.hpp"
+
+BOOST_AUTO_TEST_CASE(TestCreateOffscrBitmap)
+{
+    using namespace RDP;
+
+    {
+        BStream stream(1000);
+
+        CreateOffscrBitmap newcmd(5, 640, 480);
+        BOOST_CHECK_EQUAL(7, newcmd.size());
+        newcmd.emit(stream);
+
+        uint8_t datas[] = {
+            SECONDARY | (AltsecDrawingOrderHeader::CreateOffscrBitmap << 2),
+            0x05, 0x00,     // flags (offscreenBitmapId, no deleteList)
+            0x80, 0x02,     // cx
+            0xE0, 0x01,     // cy
+        };
+        check_datas(stream.p-stream.get_data(), stream.get_data(), sizeof(datas), datas, "CreateOffscrBitmap");
+        stream.mark_end(); stream.p = stream.get_data();
+
+        AltsecDrawingOrderHeader header(stream);
+        BOOST_CHECK_EQUAL(AltsecDrawingOrderHeader::CreateOffscrBitmap, header.orderType);
+
+        CreateOffscrBitmap cmd;
+        cmd.receive(stream, header);
+        check<CreateOffscrBitmap>(cmd, newcmd, "CreateOffscrBitmap");
+    }
+
+    {
+        BStream stream(1000);
+
+        CreateOffscrBitmap newcmd(2, 256, 128);
+        newcmd.delete_indices[newcmd.delete_count++] = 2;
+        newcmd.delete_indices[newcmd.delete_count++] = 7;
+        BOOST_CHECK_EQUAL(13, newcmd.size());
+        newcmd.emit(stream);
+
+        uint8_t datas[] = {
+            SECONDARY | (AltsecDrawingOrderHeader::CreateOffscrBitmap << 2),
+            0x02, 0x80,     // flags (offscreenBitmapId, deleteList present)
+            0x00, 0x01,     // cx
+            0x80, 0x00,     // cy
+            0x02, 0x00,     // cIndices
+            0x02, 0x00,     // indices
+            0x07, 0x00,
+        };
+        check_datas(stream.p-stream.get_data(), stream.get_data(), sizeof(datas), datas, "CreateOffscrBitmap deleteList");
+        stream.mark_end(); stream.p = stream.get_data();
+
+        AltsecDrawingOrderHeader header(stream);
+        CreateOffscrBitmap cmd;
+        cmd.receive(stream, header);
+        check<CreateOffscrBitmap>(cmd, newcmd, "CreateOffscrBitmap deleteList");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestCreateOffscrBitmapTooManyIndices)
+{
+    using namespace RDP;
+
+    uint8_t datas[] = {
+        SECONDARY | (AltsecDrawingOrderHeader::CreateOffscrBitmap << 2),
+        0x00, 0x80,     // flags (offscreenBitmapId, deleteList present)
+        0x10, 0x00,     // cx
+        0x10, 0x00,     // cy
+        0xF5, 0x01,     // cIndices (501)
+    };
+    FixedSizeStream stream(datas, sizeof(datas));
+
+    AltsecDrawingOrderHeader header(stream);
+    CreateOffscrBitmap cmd;
+    BOOST_CHECK_THROW(cmd.receive(stream, header), Error);
+}
@@ -0,0 +1,76 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Unit test to RDP Orders coder/decoder
+   Using lib boost functions for testing
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestOrderSwitchSurface
+#include <boost/test/auto_unit_test.hpp>
+
+#include "RDP/orders/RDPOrdersSecondarySwitchSurface.hpp"
+
+#include "test_orders.hpp"
+
+BOOST_AUTO_TEST_CASE(TestSwitchSurface)
+{
+    using namespace RDP;
+
+    {
+        BStream stream(1000);
+
+        SwitchSurface newcmd(12);
+        newcmd.emit(stream);
+
+        uint8_t datas[] = {
+            SECONDARY | (AltsecDrawingOrderHeader::SwitchSurface << 2),
+            0x0C, 0x00,     // bitmapId
+        };
+        check_datas(stream.p-stream.get_data(), stream.get_data(), sizeof(datas), datas, "SwitchSurface");
+        stream.mark_end(); stream.p = stream.get_data();
+
+        AltsecDrawingOrderHeader header(stream);
+        BOOST_CHECK_EQUAL(AltsecDrawingOrderHeader::SwitchSurface, header.orderType);
+
+        SwitchSurface cmd;
+        cmd.receive(stream, header);
+        check<SwitchSurface>(cmd, newcmd, "SwitchSurface");
+    }
+
+    {
+        BStream stream(1000);
+
+        SwitchSurface newcmd;
+        newcmd.emit(stream);
+
+        uint8_t datas[] = {
+            SECONDARY | (AltsecDrawingOrderHeader::SwitchSurface << 2),
+            0xFF, 0xFF,     // bitmapId (SCREEN_BITMAP_SURFACE)
+        };
+        check_datas(stream.p-stream.get_data(), stream.get_data(), sizeof(datas), datas, "SwitchSurface screen");
+        stream.mark_end(); stream.p = stream.get_data();
+
+        AltsecDrawingOrderHeader header(stream);
+        SwitchSurface cmd(3);
+        cmd.receive(stream, header);
+        check<SwitchSurface>(cmd, newcmd, "SwitchSurface screen");
+    }
+}
@@ -26,7 +26,81 @@
 
 #define LOGNULL
 
+#include "test_transport.hpp"
+#include "RDP/GraphicUpdatePDU.hpp"
 
 BOOST_AUTO_TEST_CASE(TestXXX)
 {
 }
+
+namespace {
+    // fragmentation of each Server Fast-Path Update PDU of trans, and the
+    // reassembled update data
+    size_t read_fastpath_updates(MemoryTransport & trans, uint8_t * fragmentations, BStream & data)
+    {
+        CryptContext decrypt;
+        const uint8_t * p = trans.stream.get_data();
+        const uint8_t * end = p + trans.out_stream.get_offset();
+        size_t count = 0;
+        while (p < end) {
+            // one PDU at a time, the payload of a PDU is the rest of the stream
+            const uint16_t length = (p[1] & 0x80) ? (((p[1] & 0x7F) << 8) | p[2]) : p[1];
+            BOOST_CHECK(length <= 0x7FFF);
+
+            Array array(length);
+            memcpy(array.get_data(), p, length);
+            InStream stream(array, 0, 0, length);
+            FastPath::ServerUpdatePDU_Recv su(stream, decrypt);
+            FastPath::Update_Recv upd(su.payload, nullptr);
+            BOOST_CHECK_EQUAL(FastPath::FASTPATH_UPDATETYPE_BITMAP, upd.updateCode);
+            BOOST_CHECK_EQUAL(0u, su.payload.in_remain());
+            fragmentations[count++] = upd.fragmentation;
+            data.out_copy_bytes(upd.payload.get_data(), upd.payload.size());
+            p += length;
+        }
+        data.mark_end();
+        return count;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestSendServerUpdateMultiFragment)
+{
+    CryptContext encrypt;
+    uint8_t fragmentations[8];
+
+    HStream update(1024, 65536);
+    for (size_t i = 0; i < 40000; ++i) {
+        update.out_uint8(uint8_t(i * 7));
+    }
+    update.mark_end();
+
+    {
+        MemoryTransport trans;
+        ::send_server_update( trans, true, false, nullptr, 0, 0, encrypt, 0
+                            , SERVER_UPDATE_GRAPHICS_BITMAP, 0, update, 0, true);
+
+        BStream data(65536);
+        BOOST_CHECK_EQUAL(3u, read_fastpath_updates(trans, fragmentations, data));
+        BOOST_CHECK_EQUAL(FastPath::FASTPATH_FRAGMENT_FIRST, fragmentations[0]);
+        BOOST_CHECK_EQUAL(FastPath::FASTPATH_FRAGMENT_NEXT, fragmentations[1]);
+        BOOST_CHECK_EQUAL(FastPath::FASTPATH_FRAGMENT_LAST, fragmentations[2]);
+        BOOST_CHECK_EQUAL(update.size(), data.size());
+        BOOST_CHECK_EQUAL(0, memcmp(update.get_data(), data.get_data(), data.size()));
+    }
+
+    // an update no larger than a fragment is not fragmented
+    {
+        HStream small(1024, 65536);
+        small.out_copy_bytes(update.get_data(), FASTPATH_FRAGMENT_SIZE);
+        small.mark_end();
+
+        MemoryTransport trans;
+        ::send_server_update( trans, true, false, nullptr, 0, 0, encrypt, 0
+                            , SERVER_UPDATE_GRAPHICS_BITMAP, 0, small, 0, true);
+
+        BStream data(65536);
+        BOOST_CHECK_EQUAL(1u, read_fastpath_updates(trans, fragmentations, data));
+        BOOST_CHECK_EQUAL(FastPath::FASTPATH_FRAGMENT_SINGLE, fragmentations[0]);
+        BOOST_CHECK_EQUAL(size_t(FASTPATH_FRAGMENT_SIZE), data.size());
+    }
+}
@@ -47,3 +47,52 @@ BOOST_AUTO_TEST_CASE(TestRefreshRectPDU)
 
     rrpdu.emit(out_t);
 }
+
+BOOST_AUTO_TEST_CASE(TestRefreshRectPDURegion)
+{
+    CryptContext encrypt;
+
+    Region region;
+    region.add_rect(Rect(10, 20, 30, 40));
+    region.add_rect(Rect(100, 20, 10, 40));
+
+    RDP::RefreshRectPDU rrpdu(132074, 7, 0, encrypt);
+    rrpdu.addInclusiveRects(region);
+
+    BOOST_CHECK_EQUAL(2, rrpdu.area_count);
+
+    Stream & stream = rrpdu.buffer_stream;
+    stream.p = stream.get_data() + rrpdu.offset_area_count + 4;
+    BOOST_CHECK_EQUAL(10,  stream.in_uint16_le());
+    BOOST_CHECK_EQUAL(20,  stream.in_uint16_le());
+    BOOST_CHECK_EQUAL(39,  stream.in_uint16_le());
+    BOOST_CHECK_EQUAL(59,  stream.in_uint16_le());
+    BOOST_CHECK_EQUAL(100, stream.in_uint16_le());
+    BOOST_CHECK_EQUAL(20,  stream.in_uint16_le());
+    BOOST_CHECK_EQUAL(109, stream.in_uint16_le());
+    BOOST_CHECK_EQUAL(59,  stream.in_uint16_le());
+}
+
+BOOST_AUTO_TEST_CASE(TestRefreshRectPDURegionTooManyRects)
+{
+    CryptContext encrypt;
+
+    // numberOfAreas is 8 bits wide
+    Region region;
+    for (int i = 0; i < 300; i++) {
+        region.add_rect(Rect(i * 2, 5, 1, 1));
+    }
+    BOOST_CHECK_EQUAL(300u, region.rects.size());
+
+    RDP::RefreshRectPDU rrpdu(132074, 7, 0, encrypt);
+    rrpdu.addInclusiveRects(region);
+
+    BOOST_CHECK_EQUAL(1, rrpdu.area_count);
+
+    Stream & stream = rrpdu.buffer_stream;
+    stream.p = stream.get_data() + rrpdu.offset_area_count + 4;
+    BOOST_CHECK_EQUAL(0,   stream.in_uint16_le());
+    BOOST_CHECK_EQUAL(5,   stream.in_uint16_le());
+    BOOST_CHECK_EQUAL(598, stream.in_uint16_le());
+    BOOST_CHECK_EQUAL(5,   stream.in_uint16_le());
+}
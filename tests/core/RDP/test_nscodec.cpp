@@ -0,0 +1,186 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Unit test of NSCodec encoder
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestNSCodec
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include "RDP/nscodec.hpp"
+
+#include <stdlib.h>
+#include <algorithm>
+
+BOOST_AUTO_TEST_CASE(TestNSCodecRle)
+{
+    uint8_t plane[600];
+    memset(plane, 7, 300);
+    for (size_t i = 300; i < sizeof(plane); ++i) {
+        plane[i] = uint8_t(i / 3);
+    }
+    // the byte before the last 4 bytes is the same as them
+    memset(plane + sizeof(plane) - 5, 9, 5);
+
+    uint8_t encoded[sizeof(plane)];
+    const size_t size = nscodec::rle_encode(plane, sizeof(plane), encoded);
+    BOOST_CHECK(size < sizeof(plane));
+    // long run
+    BOOST_CHECK_EQUAL(0, memcmp(encoded, "\x07\x07\xFF\x2C\x01\x00\x00", 7));
+    BOOST_CHECK_EQUAL(0, memcmp(encoded + size - 4, "\x09\x09\x09\x09", 4));
+
+    uint8_t decoded[sizeof(plane)];
+    BOOST_CHECK(nscodec::rle_decode(encoded, size, decoded, sizeof(decoded)));
+    BOOST_CHECK_EQUAL(0, memcmp(plane, decoded, sizeof(plane)));
+
+    // short run then raw bytes
+    const uint8_t small[] = { 1, 1, 1, 1, 1, 2, 3, 4, 5, 6 };
+    BOOST_CHECK_EQUAL(8u, nscodec::rle_encode(small, sizeof(small), encoded));
+    BOOST_CHECK_EQUAL(0, memcmp(encoded, "\x01\x01\x03\x02\x03\x04\x05\x06", 8));
+    BOOST_CHECK(nscodec::rle_decode(encoded, 8, decoded, sizeof(small)));
+    BOOST_CHECK_EQUAL(0, memcmp(small, decoded, sizeof(small)));
+
+    // no gain: stored raw
+    uint8_t noise[64];
+    for (size_t i = 0; i < sizeof(noise); ++i) {
+        noise[i] = uint8_t(i * 37);
+    }
+    BOOST_CHECK_EQUAL(sizeof(noise), nscodec::rle_encode(noise, sizeof(noise), encoded));
+}
+
+namespace {
+    // 24 bpp rows, bottom-up like Bitmap
+    void make_pixels(uint8_t * pixels, uint16_t cx, uint16_t cy, size_t line_size)
+    {
+        for (uint16_t y = 0; y < cy; ++y) {
+            for (uint16_t x = 0; x < cx; ++x) {
+                uint8_t * p = pixels + (cy - 1 - y) * line_size + x * 3;
+                p[0] = uint8_t(x * 4);
+                p[1] = uint8_t(y * 4 + x);
+                p[2] = uint8_t(200 - y * 2);
+            }
+        }
+    }
+
+    int max_difference(const uint8_t * bottom_up, const uint8_t * top_down, uint16_t cx, uint16_t cy
+                      , size_t line_size)
+    {
+        int diff = 0;
+        for (uint16_t y = 0; y < cy; ++y) {
+            for (size_t i = 0; i < cx * 3u; ++i) {
+                diff = std::max(diff, abs(bottom_up[(cy - 1 - y) * line_size + i] - top_down[y * cx * 3 + i]));
+            }
+        }
+        return diff;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestNSCodecRoundTrip)
+{
+    const uint16_t cx = 37;
+    const uint16_t cy = 21;
+    const size_t line_size = 40 * 3;
+    uint8_t pixels[line_size * cy];
+    make_pixels(pixels, cx, cy, line_size);
+    const uint8_t * first_row = pixels + (cy - 1) * line_size;
+
+    nscodec::Encoder encoder;
+    uint8_t decoded[cx * cy * 3];
+
+    // lossless but for the rounding of chroma
+    {
+        BStream stream(nscodec::max_encoded_size(cx, cy, false));
+        encoder.encode(stream, first_row, -ptrdiff_t(line_size), 3, cx, cy, nscodec::Params{1, false});
+        stream.mark_end();
+        BOOST_CHECK(stream.size() <= nscodec::max_encoded_size(cx, cy, false));
+        BOOST_CHECK_EQUAL(1, stream.get_data()[16]);
+        BOOST_CHECK_EQUAL(0, stream.get_data()[17]);
+        // alpha plane
+        BOOST_CHECK_EQUAL(0, memcmp(stream.get_data() + 12, "\0\0\0\0", 4));
+
+        BOOST_CHECK(nscodec::decode(stream.get_data(), stream.size(), cx, cy, decoded, cx * 3));
+        BOOST_CHECK(max_difference(pixels, decoded, cx, cy, line_size) <= 2);
+    }
+
+    // subsampled and color loss
+    {
+        BStream stream(nscodec::max_encoded_size(cx, cy, true));
+        encoder.encode(stream, first_row, -ptrdiff_t(line_size), 3, cx, cy, nscodec::Params{3, true});
+        stream.mark_end();
+        BOOST_CHECK(stream.size() <= nscodec::max_encoded_size(cx, cy, true));
+        // luma rows padded to 40 pixels, chroma 20 x 11
+        const nscodec::PlaneGeometry geometry(cx, cy, true);
+        BOOST_CHECK_EQUAL(40, geometry.luma_width);
+        BOOST_CHECK_EQUAL(20, geometry.chroma_width);
+        BOOST_CHECK_EQUAL(11, geometry.chroma_height);
+
+        BOOST_CHECK(nscodec::decode(stream.get_data(), stream.size(), cx, cy, decoded, cx * 3));
+        BOOST_CHECK(max_difference(pixels, decoded, cx, cy, line_size) <= 16);
+    }
+
+    // 32 bpp source gives the same stream
+    {
+        uint8_t pixels32[cx * cy * 4];
+        for (size_t i = 0; i < size_t(cx) * cy; ++i) {
+            memcpy(pixels32 + i * 4, decoded + i * 3, 3);
+            pixels32[i * 4 + 3] = 0x55;
+        }
+        BStream stream24(nscodec::max_encoded_size(cx, cy, true));
+        BStream stream32(nscodec::max_encoded_size(cx, cy, true));
+        encoder.encode(stream24, decoded, cx * 3, 3, cx, cy, nscodec::Params{2, true});
+        encoder.encode(stream32, pixels32, cx * 4, 4, cx, cy, nscodec::Params{2, true});
+        stream24.mark_end();
+        stream32.mark_end();
+        BOOST_CHECK_EQUAL(stream24.size(), stream32.size());
+        BOOST_CHECK_EQUAL(0, memcmp(stream24.get_data(), stream32.get_data(), stream24.size()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestNSCodecUniform)
+{
+    const uint16_t cx = 64;
+    const uint16_t cy = 64;
+    uint8_t pixels[cx * cy * 3];
+    for (size_t i = 0; i < sizeof(pixels); i += 3) {
+        pixels[i] = 0x10;
+        pixels[i + 1] = 0x80;
+        pixels[i + 2] = 0xF0;
+    }
+
+    nscodec::Encoder encoder;
+    BStream stream(nscodec::max_encoded_size(cx, cy, true));
+    encoder.encode(stream, pixels, cx * 3, 3, cx, cy, nscodec::Params{1, true});
+    stream.mark_end();
+    // 3 planes of one run each
+    BOOST_CHECK_EQUAL(size_t(nscodec::HEADER_SIZE + 3 * 11), stream.size());
+
+    uint8_t decoded[cx * cy * 3];
+    BOOST_CHECK(nscodec::decode(stream.get_data(), stream.size(), cx, cy, decoded, cx * 3));
+    BOOST_CHECK_EQUAL(0x10, decoded[0]);
+    BOOST_CHECK_EQUAL(0x80, decoded[1]);
+    BOOST_CHECK_EQUAL(0xF0, decoded[2]);
+    BOOST_CHECK_EQUAL(0, memcmp(decoded, decoded + 3, sizeof(decoded) - 3));
+
+    // truncated stream
+    BOOST_CHECK(!nscodec::decode(stream.get_data(), stream.size() - 1, cx, cy, decoded, cx * 3));
+}
@@ -0,0 +1,312 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Unit test of RemoteFX encoder
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestRfx
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include "RDP/rfx.hpp"
+
+#include <stdlib.h>
+#include <algorithm>
+
+namespace {
+    // sparse coefficients, as after quantization
+    void make_coefficients(int16_t * data, size_t n, unsigned seed)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            seed = seed * 1103515245 + 12345;
+            const unsigned r = (seed >> 16) & 0x7FFF;
+            data[i] = (r % 5) ? 0 : int16_t(int(r % 41) - 20);
+        }
+    }
+
+    // 24 bpp pixels of a tile, top-down
+    void make_pixels(uint8_t * pixels, uint16_t cx, uint16_t cy, size_t line_size)
+    {
+        for (uint16_t y = 0; y < cy; ++y) {
+            for (uint16_t x = 0; x < cx; ++x) {
+                uint8_t * p = pixels + y * line_size + x * 3;
+                p[0] = uint8_t(x * 3 + y);
+                p[1] = uint8_t(128 + y * 2 - x);
+                p[2] = uint8_t(200 - y * 3);
+            }
+        }
+    }
+
+    int max_difference(const uint8_t * pixels, size_t line_size, const uint8_t * tile
+                      , uint16_t x0, uint16_t y0, uint16_t cx, uint16_t cy)
+    {
+        int diff = 0;
+        for (uint16_t y = 0; y < cy; ++y) {
+            for (size_t i = 0; i < cx * 3u; ++i) {
+                diff = std::max(diff, abs( pixels[y * line_size + i]
+                                         - tile[((y0 + y) * rfx::TILE_SIZE + x0) * 3 + i]));
+            }
+        }
+        return diff;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestRfxRlgr)
+{
+    int16_t data[rfx::TILE_PIXELS];
+    int16_t decoded[rfx::TILE_PIXELS];
+    std::vector<uint8_t> out;
+
+    for (uint8_t entropy : { uint8_t(CLW_ENTROPY_RLGR1), uint8_t(CLW_ENTROPY_RLGR3) }) {
+        make_coefficients(data, rfx::TILE_PIXELS, entropy);
+        // large values and a run of zeros up to the end
+        data[10] = 3000;
+        data[11] = -2500;
+        std::fill(data + 4000, data + rfx::TILE_PIXELS, 0);
+
+        out.clear();
+        rfx::rlgr_encode(entropy, data, rfx::TILE_PIXELS, out);
+        BOOST_CHECK(out.size() < rfx::TILE_PIXELS);
+        BOOST_CHECK(rfx::rlgr_decode(entropy, out.data(), out.size(), decoded, rfx::TILE_PIXELS));
+        BOOST_CHECK_EQUAL(0, memcmp(data, decoded, sizeof(data)));
+
+        // truncated
+        BOOST_CHECK(!rfx::rlgr_decode(entropy, out.data(), out.size() / 2, decoded, rfx::TILE_PIXELS));
+
+        // only zeros
+        std::fill(data, data + rfx::TILE_PIXELS, 0);
+        out.clear();
+        rfx::rlgr_encode(entropy, data, rfx::TILE_PIXELS, out);
+        BOOST_CHECK(out.size() < 16);
+        BOOST_CHECK(rfx::rlgr_decode(entropy, out.data(), out.size(), decoded, rfx::TILE_PIXELS));
+        BOOST_CHECK_EQUAL(0, memcmp(data, decoded, sizeof(data)));
+    }
+
+    // RLGR3 with an odd number of values
+    const int16_t odd[] = { 5, -3, 0, 7, 1 };
+    out.clear();
+    rfx::rlgr_encode(CLW_ENTROPY_RLGR3, odd, 5, out);
+    BOOST_CHECK(rfx::rlgr_decode(CLW_ENTROPY_RLGR3, out.data(), out.size(), decoded, 5));
+    BOOST_CHECK_EQUAL(0, memcmp(odd, decoded, sizeof(odd)));
+}
+
+BOOST_AUTO_TEST_CASE(TestRfxDwt)
+{
+    int16_t buffer[rfx::TILE_PIXELS];
+    int16_t original[rfx::TILE_PIXELS];
+    int16_t generic[rfx::TILE_PIXELS];
+    int16_t tmp[rfx::TILE_PIXELS];
+    for (size_t i = 0; i < rfx::TILE_PIXELS; ++i) {
+        original[i] = int16_t((i % 64) * 100 - (i / 64) * 37 - 2000);
+    }
+    original[100] = 4095;
+    original[101] = -4096;
+
+    memcpy(buffer, original, sizeof(buffer));
+    rfx::dwt_2d_encode(buffer, tmp);
+    // vector kernels give the result of the 8 lanes ones
+    memcpy(generic, original, sizeof(generic));
+    rfx::dwt_2d<rfx::vec8i16>(generic, tmp);
+    BOOST_CHECK_EQUAL(0, memcmp(buffer, generic, sizeof(buffer)));
+
+    // LL3 is an average of the block
+    BOOST_CHECK(abs(buffer[4032] - original[0]) < 400);
+
+    rfx::dwt_2d_decode(buffer, tmp);
+    int diff = 0;
+    for (size_t i = 0; i < rfx::TILE_PIXELS; ++i) {
+        diff = std::max(diff, abs(buffer[i] - original[i]));
+    }
+    BOOST_CHECK(diff <= 4);
+}
+
+BOOST_AUTO_TEST_CASE(TestRfxColorConversion)
+{
+    uint8_t pixels[37 * 4];
+    for (size_t i = 0; i < sizeof(pixels); ++i) {
+        pixels[i] = uint8_t(i * 29);
+    }
+    int16_t y[2][37];
+    int16_t cb[2][37];
+    int16_t cr[2][37];
+    rfx::ycbcr<4>(pixels, 37, y[0], cb[0], cr[0]);
+    rfx::ycbcr_row<rfx::vec4i32, 4>(pixels, 37, y[1], cb[1], cr[1]);
+    BOOST_CHECK_EQUAL(0, memcmp(y[0], y[1], sizeof(y[0])));
+    BOOST_CHECK_EQUAL(0, memcmp(cb[0], cb[1], sizeof(cb[0])));
+    BOOST_CHECK_EQUAL(0, memcmp(cr[0], cr[1], sizeof(cr[0])));
+
+    const uint8_t white[3] = { 255, 255, 255 };
+    const uint8_t black[3] = { 0, 0, 0 };
+    rfx::ycbcr<3>(white, 1, y[0], cb[0], cr[0]);
+    BOOST_CHECK_EQUAL(255 * 32 - 4096, y[0][0]);
+    BOOST_CHECK(abs(cb[0][0]) <= 1);
+    BOOST_CHECK(abs(cr[0][0]) <= 1);
+    rfx::ycbcr<3>(black, 1, y[0], cb[0], cr[0]);
+    BOOST_CHECK_EQUAL(-4096, y[0][0]);
+    BOOST_CHECK_EQUAL(0, cb[0][0]);
+    BOOST_CHECK_EQUAL(0, cr[0][0]);
+}
+
+BOOST_AUTO_TEST_CASE(TestRfxTile)
+{
+    const size_t line_size = 64 * 3;
+    uint8_t pixels[line_size * 64];
+    make_pixels(pixels, 64, 64, line_size);
+    uint8_t decoded[rfx::TILE_PIXELS * 3];
+
+    rfx::Params params{CLW_ENTROPY_RLGR3, 0, rfx::default_quant()};
+    rfx::TileSource source{pixels, 0, 0, 64, 64, 2, 3};
+    rfx::Tile tile;
+
+    // without quantization only the roundings remain
+    rfx::Quant lossless;
+    std::fill(lossless.values, lossless.values + 10, 1);
+    for (uint8_t entropy : { uint8_t(CLW_ENTROPY_RLGR1), uint8_t(CLW_ENTROPY_RLGR3) }) {
+        params.entropy = entropy;
+        params.quant = lossless;
+        BOOST_CHECK(rfx::encode_tile(source, line_size, 3, params, tile));
+        BOOST_CHECK_EQUAL(2, tile.x_idx);
+        BOOST_CHECK_EQUAL(3, tile.y_idx);
+        BOOST_CHECK_EQUAL( tile.data.size()
+                         , size_t(tile.component_lengths[0] + tile.component_lengths[1]
+                                 + tile.component_lengths[2]));
+        BOOST_CHECK(rfx::decode_tile(tile.data.data(), tile.component_lengths, entropy, lossless, decoded));
+        BOOST_CHECK(max_difference(pixels, line_size, decoded, 0, 0, 64, 64) <= 2);
+    }
+
+    // default quantization
+    params.quant = rfx::default_quant();
+    BOOST_CHECK(rfx::encode_tile(source, line_size, 3, params, tile));
+    const size_t lossy_size = tile.data.size();
+    BOOST_CHECK(lossy_size < 64 * 64 * 3 / 4);
+    BOOST_CHECK(rfx::decode_tile(tile.data.data(), tile.component_lengths, params.entropy, params.quant, decoded));
+    BOOST_CHECK(max_difference(pixels, line_size, decoded, 0, 0, 64, 64) <= 12);
+
+    // part of a tile, bottom-up rows of 32 bpp
+    const uint16_t cx = 20;
+    const uint16_t cy = 9;
+    uint8_t part[cx * cy * 3];
+    make_pixels(part, cx, cy, cx * 3);
+    uint8_t part32[cx * cy * 4];
+    for (uint16_t y = 0; y < cy; ++y) {
+        for (uint16_t x = 0; x < cx; ++x) {
+            memcpy(part32 + ((cy - 1 - y) * cx + x) * 4, part + (y * cx + x) * 3, 3);
+            part32[((cy - 1 - y) * cx + x) * 4 + 3] = 0xFF;
+        }
+    }
+    rfx::TileSource part_source{part32 + (cy - 1) * cx * 4, 40, 50, cx, cy, 0, 0};
+    BOOST_CHECK(rfx::encode_tile(part_source, -cx * 4, 4, params, tile));
+    BOOST_CHECK(rfx::decode_tile(tile.data.data(), tile.component_lengths, params.entropy, params.quant, decoded));
+    BOOST_CHECK(max_difference(part, cx * 3, decoded, 40, 50, cx, cy) <= 12);
+}
+
+BOOST_AUTO_TEST_CASE(TestRfxEncoder)
+{
+    const uint16_t cx = 200;
+    const uint16_t cy = 130;
+    const size_t line_size = cx * 3;
+    std::vector<uint8_t> pixels(line_size * cy);
+    make_pixels(pixels.data(), cx, cy, line_size);
+
+    std::vector<rfx::TileSource> sources;
+    for (uint16_t y = 0; y < cy; y += 64) {
+        for (uint16_t x = 0; x < cx; x += 64) {
+            sources.push_back(rfx::TileSource{
+                &pixels[y * line_size + x * 3], 0, 0
+              , uint16_t(std::min(64, cx - x)), uint16_t(std::min(64, cy - y)), uint16_t(x / 64), uint16_t(y / 64)
+            });
+        }
+    }
+
+    rfx::Encoder encoder;
+    BOOST_CHECK(encoder.encode(sources.data(), sources.size(), line_size, 3));
+    std::vector<std::vector<uint8_t>> tiles;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        tiles.push_back(encoder.tile(i).data);
+    }
+
+    // same tiles with worker threads
+    rfx::Encoder parallel_encoder;
+    parallel_encoder.start_workers(4);
+    for (int n = 0; n < 3; ++n) {
+        BOOST_CHECK(parallel_encoder.encode(sources.data(), sources.size(), line_size, 3));
+        for (size_t i = 0; i < sources.size(); ++i) {
+            BOOST_CHECK(tiles[i] == parallel_encoder.tile(i).data);
+            BOOST_CHECK_EQUAL(sources[i].x_idx, parallel_encoder.tile(i).x_idx);
+            BOOST_CHECK_EQUAL(sources[i].y_idx, parallel_encoder.tile(i).y_idx);
+        }
+    }
+
+    // message
+    const rfx::Tile * message_tiles[] = { &encoder.tile(0), &encoder.tile(1) };
+    const Rect rects[] = { Rect(0, 0, 64, 64), Rect(64, 0, 64, 64) };
+    BStream stream(65536);
+    rfx::emit_headers(stream, 1024, 768, encoder.params);
+    rfx::emit_frame(stream, 7, rects, 2, message_tiles, 2, encoder.params);
+    stream.mark_end();
+    BOOST_CHECK_EQUAL( size_t(rfx::HEADERS_SIZE + rfx::FRAME_SIZE + rfx::QUANT_SIZE + 2 * rfx::RECT_SIZE
+                             + 2 * rfx::TILE_HEADER_SIZE + tiles[0].size() + tiles[1].size())
+                     , stream.size());
+
+    // blocks follow each other up to the end
+    stream.p = stream.get_data();
+    const uint16_t types[] = {
+        rfx::WBT_SYNC, rfx::WBT_CODEC_VERSIONS, rfx::WBT_CHANNELS, rfx::WBT_CONTEXT
+      , rfx::WBT_FRAME_BEGIN, rfx::WBT_REGION, rfx::WBT_EXTENSION, rfx::WBT_FRAME_END
+    };
+    for (uint16_t type : types) {
+        uint8_t * block = stream.p;
+        BOOST_CHECK_EQUAL(type, stream.in_uint16_le());
+        const uint32_t len = stream.in_uint32_le();
+        if (type == rfx::WBT_SYNC) {
+            BOOST_CHECK_EQUAL(uint32_t(rfx::WF_MAGIC), stream.in_uint32_le());
+        }
+        if (type == rfx::WBT_FRAME_BEGIN) {
+            stream.in_skip_bytes(2);
+            BOOST_CHECK_EQUAL(7u, stream.in_uint32_le());
+        }
+        stream.p = block + len;
+    }
+    BOOST_CHECK_EQUAL(0u, stream.in_remain());
+}
+
+BOOST_AUTO_TEST_CASE(TestRfxTileCache)
+{
+    uint8_t pixels[64 * 3 * 2];
+    make_pixels(pixels, 64, 2, 64 * 3);
+    const uint64_t hash = rfx::tile_hash(pixels, 64 * 3, 64 * 3, 2, Rect(0, 0, 64, 2));
+    BOOST_CHECK(hash != rfx::tile_hash(pixels, 64 * 3, 64 * 3, 2, Rect(0, 1, 64, 2)));
+    pixels[200] ^= 1;
+    BOOST_CHECK(hash != rfx::tile_hash(pixels, 64 * 3, 64 * 3, 2, Rect(0, 0, 64, 2)));
+
+    rfx::TileCache cache;
+    cache.reset(800, 600);
+    BOOST_CHECK(!cache.contains(12, 9, hash));
+    cache.set(12, 9, hash);
+    BOOST_CHECK(cache.contains(12, 9, hash));
+    BOOST_CHECK(!cache.contains(12, 9, hash + 1));
+    // out of screen
+    cache.set(13, 9, hash);
+    BOOST_CHECK(!cache.contains(13, 9, hash));
+    cache.clear();
+    BOOST_CHECK(!cache.contains(12, 9, hash));
+}
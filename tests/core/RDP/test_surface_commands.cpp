@@ -0,0 +1,75 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Unit test of surface commands
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestSurfaceCommands
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include "RDP/surface_commands.hpp"
+
+BOOST_AUTO_TEST_CASE(TestSetSurfaceBits)
+{
+    RDPSetSurfaceBits cmd;
+    cmd.dest_left = 10;
+    cmd.dest_top = 20;
+    cmd.dest_right = 74;
+    cmd.dest_bottom = 52;
+    cmd.bpp = 32;
+    cmd.codec_id = 1;
+    cmd.width = 64;
+    cmd.height = 32;
+    cmd.bitmap_data_length = 3;
+
+    BStream stream(256);
+    cmd.emit(stream);
+    stream.out_copy_bytes("abc", 3);
+    stream.mark_end();
+
+    BOOST_CHECK_EQUAL(25, stream.size());
+    BOOST_CHECK_EQUAL(0, memcmp(stream.get_data(),
+        "\x01\x00"                                  // cmdType
+        "\x0A\x00\x14\x00\x4A\x00\x34\x00"          // dest
+        "\x20\x00\x00\x01"                          // bpp, flags, reserved, codecID
+        "\x40\x00\x20\x00"                          // width, height
+        "\x03\x00\x00\x00"                          // bitmapDataLength
+        "abc", 25));
+
+    stream.p = stream.get_data();
+    BOOST_CHECK_EQUAL(CMDTYPE_SET_SURFACE_BITS, stream.in_uint16_le());
+    RDPSetSurfaceBits cmd2;
+    cmd2.receive(stream);
+    BOOST_CHECK_EQUAL(74, cmd2.dest_right);
+    BOOST_CHECK_EQUAL(52, cmd2.dest_bottom);
+    BOOST_CHECK_EQUAL(1, cmd2.codec_id);
+    BOOST_CHECK_EQUAL(64, cmd2.width);
+    BOOST_CHECK_EQUAL(32, cmd2.height);
+    BOOST_CHECK_EQUAL(3u, cmd2.bitmap_data_length);
+    BOOST_CHECK_EQUAL(0, memcmp(stream.p, "abc", 3));
+
+    // bitmap data longer than the stream
+    stream.p = stream.get_data() + 2;
+    stream.end = stream.get_data() + 24;
+    BOOST_CHECK_THROW(cmd2.receive(stream), Error);
+}
@@ -0,0 +1,176 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestChannelScheduler
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include <string>
+
+#include "channel_scheduler.hpp"
+
+namespace {
+    struct ChannelDef {
+        char     name[8];
+        uint32_t flags;
+        int      chanid;
+    };
+
+    ChannelDef make_channel(const char * name, int chanid) {
+        ChannelDef channel;
+        strcpy(channel.name, name);
+        channel.flags = 0;
+        channel.chanid = chanid;
+        return channel;
+    }
+
+    timeval at_usec(uint64_t usec) {
+        timeval tv;
+        tv.tv_sec  = 1000 + usec / 1000000;
+        tv.tv_usec = usec % 1000000;
+        return tv;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestChannelSchedulerDisabled)
+{
+    ChannelScheduler scheduler;
+    const ChannelDef rdpdr = make_channel("rdpdr", 1004);
+    uint8_t data[1600] = {};
+
+    for (int i = 0; i < 100; ++i) {
+        BOOST_CHECK(!scheduler.queue(rdpdr, data, sizeof(data), sizeof(data), 3, at_usec(0)));
+    }
+    BOOST_CHECK(!scheduler.has_pending());
+    BOOST_CHECK(!scheduler.counters("rdpdr"));
+}
+
+BOOST_AUTO_TEST_CASE(TestChannelSchedulerQuantum)
+{
+    ChannelScheduler scheduler(true);
+    const ChannelDef rdpdr = make_channel("rdpdr", 1004);
+    uint8_t data[1600] = {};
+
+    // 16384 bytes go right away (11 chunks), the following ones are queued
+    unsigned sent_now = 0;
+    for (uint8_t i = 0; i < 20; ++i) {
+        data[0] = i;
+        if (!scheduler.queue(rdpdr, data, sizeof(data), 32000, 0, at_usec(0))) {
+            ++sent_now;
+        }
+    }
+    BOOST_CHECK_EQUAL(11, sent_now);
+    BOOST_CHECK(scheduler.has_pending());
+
+    std::string order;
+    timeval timeout = {3, 0};
+    scheduler.send_pending(at_usec(100), timeout, [&](const ChannelScheduler::Chunk & chunk) {
+        BOOST_CHECK_EQUAL(1004, chunk.chanid);
+        BOOST_CHECK_EQUAL(32000, chunk.length);
+        order += char('a' + chunk.data[0]);
+    });
+    // queued in order, none left
+    BOOST_CHECK_EQUAL("lmnopqrst", order);
+    BOOST_CHECK(!scheduler.has_pending());
+    BOOST_CHECK_EQUAL(3, timeout.tv_sec);
+
+    const ChannelScheduler::Counters * counters = scheduler.counters("rdpdr");
+    BOOST_REQUIRE(counters);
+    BOOST_CHECK_EQUAL(20 * 1600, counters->bytes_sent);
+    BOOST_CHECK_EQUAL(20, counters->chunks_sent);
+    BOOST_CHECK_EQUAL(9, counters->chunks_delayed);
+    BOOST_CHECK_EQUAL(9 * 1600, counters->max_queued_bytes);
+}
+
+BOOST_AUTO_TEST_CASE(TestChannelSchedulerWeights)
+{
+    ChannelScheduler scheduler(true);
+    const ChannelDef rdpdr  = make_channel("rdpdr", 1004);
+    const ChannelDef rdpsnd = make_channel("rdpsnd", 1005);
+    uint8_t data[1600] = {};
+
+    // use the quantum of the round
+    for (int i = 0; i < 11; ++i) {
+        scheduler.queue(rdpdr, data, sizeof(data), sizeof(data), 0, at_usec(0));
+    }
+    for (int i = 0; i < 20; ++i) {
+        BOOST_CHECK(scheduler.queue(rdpdr, data, sizeof(data), sizeof(data), 0, at_usec(0)));
+        BOOST_CHECK(scheduler.queue(rdpsnd, data, sizeof(data), sizeof(data), 0, at_usec(0)));
+    }
+
+    unsigned rdpdr_count = 0;
+    unsigned rdpsnd_count = 0;
+    timeval timeout = {3, 0};
+    scheduler.send_pending(at_usec(0), timeout, [&](const ChannelScheduler::Chunk & chunk) {
+        ++(chunk.chanid == 1004 ? rdpdr_count : rdpsnd_count);
+    });
+    // bulk channel gets a lower share of the quantum
+    BOOST_CHECK_EQUAL(11, rdpdr_count + rdpsnd_count);
+    BOOST_CHECK(rdpsnd_count > 3 * rdpdr_count / 2);
+    // more to send next round, as soon as possible
+    BOOST_CHECK_EQUAL(0, timeout.tv_sec);
+    BOOST_CHECK_EQUAL(0, timeout.tv_usec);
+}
+
+BOOST_AUTO_TEST_CASE(TestChannelSchedulerRateLimit)
+{
+    ChannelScheduler scheduler(true);
+    scheduler.set_rate_limits("cliprdr:16000,rdpdr:abc,toolongname:5,rdpsnd");
+    BOOST_CHECK_EQUAL(16000, scheduler.rate_limit("cliprdr"));
+    BOOST_CHECK_EQUAL(0, scheduler.rate_limit("rdpdr"));
+    BOOST_CHECK_EQUAL(0, scheduler.rate_limit("rdpsnd"));
+
+    const ChannelDef cliprdr = make_channel("cliprdr", 1003);
+    uint8_t data[1000] = {};
+
+    // first chunk goes, 1 token left then negative
+    BOOST_CHECK(!scheduler.queue(cliprdr, data, sizeof(data), sizeof(data), 0, at_usec(0)));
+    BOOST_CHECK(scheduler.queue(cliprdr, data, sizeof(data), sizeof(data), 0, at_usec(0)));
+    BOOST_CHECK(scheduler.queue(cliprdr, data, sizeof(data), sizeof(data), 0, at_usec(0)));
+
+    unsigned sent = 0;
+    auto count = [&](const ChannelScheduler::Chunk &) { ++sent; };
+
+    // 999 bytes owed at 16000 bytes/s: 62438 usec
+    timeval timeout = {3, 0};
+    scheduler.send_pending(at_usec(1000), timeout, count);
+    BOOST_CHECK_EQUAL(0, sent);
+    BOOST_CHECK_EQUAL(0, timeout.tv_sec);
+    BOOST_CHECK(timeout.tv_usec > 55000 && timeout.tv_usec <= 62438);
+
+    timeout = {3, 0};
+    scheduler.send_pending(at_usec(63000), timeout, count);
+    BOOST_CHECK_EQUAL(1, sent);
+    BOOST_CHECK(scheduler.has_pending());
+
+    timeout = {3, 0};
+    scheduler.send_pending(at_usec(130000), timeout, count);
+    BOOST_CHECK_EQUAL(2, sent);
+    BOOST_CHECK(!scheduler.has_pending());
+    BOOST_CHECK_EQUAL(3, timeout.tv_sec);
+
+    // limits apply to known channels
+    scheduler.set_rate_limits("");
+    BOOST_CHECK(!scheduler.queue(cliprdr, data, sizeof(data), sizeof(data), 0, at_usec(130000)));
+}
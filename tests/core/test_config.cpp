@@ -109,6 +109,11 @@ BOOST_AUTO_TEST_CASE(TestConfigFromFile)
 
     BOOST_CHECK_EQUAL(0,                                ini.video.wrm_color_depth_selection_strategy);
     BOOST_CHECK_EQUAL(0,                                ini.video.wrm_compression_algorithm);
+    BOOST_CHECK_EQUAL(false,                            ini.video.wrm_shared_serializer);
+    BOOST_CHECK_EQUAL(false,                            ini.video.wrm_meta_index);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_encoder_threads);
+    BOOST_CHECK_EQUAL(-1,                               ini.video.png_zlib_level);
+    BOOST_CHECK_EQUAL(1,                                ini.video.png_filter);
 
     BOOST_CHECK_EQUAL(900,                              ini.globals.session_timeout);
     BOOST_CHECK_EQUAL(30,                               ini.globals.keepalive_grace_delay);
@@ -130,6 +135,10 @@ BOOST_AUTO_TEST_CASE(TestConfigFromFile)
     BOOST_CHECK_EQUAL(true,                             ini.globals.enable_close_box);
     BOOST_CHECK_EQUAL(true,                             ini.globals.enable_osd);
     BOOST_CHECK_EQUAL(true,                             ini.globals.enable_osd_display_remote_target);
+    BOOST_CHECK_EQUAL(false,                            ini.globals.channel_scheduler);
+    BOOST_CHECK_EQUAL("",                               ini.globals.channel_rate_limits.get_cstr());
+    BOOST_CHECK_EQUAL(false,                            ini.globals.async_connect);
+    BOOST_CHECK_EQUAL(0,                                ini.globals.preconnect_timeout);
 
     BOOST_CHECK_EQUAL(0,                                memcmp(ini.crypto.key0,
                                                                "\x00\x01\x02\x03\x04\x05\x06\x07"
@@ -177,6 +186,13 @@ BOOST_AUTO_TEST_CASE(TestConfigFromFile)
     BOOST_CHECK_EQUAL(true,                             ini.client.cache_waiting_list);
     BOOST_CHECK_EQUAL(false,                            ini.client.persist_bitmap_cache_on_disk);
     BOOST_CHECK_EQUAL(true,                             ini.client.bitmap_compression);
+    BOOST_CHECK_EQUAL(false,                            ini.client.adaptive_bitmap_tiling);
+    BOOST_CHECK_EQUAL(false,                            ini.client.glyph_fragment_cache);
+    BOOST_CHECK_EQUAL(false,                            ini.client.nscodec);
+    BOOST_CHECK_EQUAL(false,                            ini.client.remotefx);
+    BOOST_CHECK_EQUAL(1,                                ini.client.remotefx_encoder_threads);
+    BOOST_CHECK_EQUAL(0,                                ini.client.multifragment_max_request_size);
+    BOOST_CHECK_EQUAL(false,                            ini.client.offscreen_bitmap_cache);
 
     BOOST_CHECK_EQUAL(4,                                ini.mod_rdp.rdp_compression);
     BOOST_CHECK_EQUAL(false,                            ini.mod_rdp.disconnect_on_logon_user_change);
@@ -207,6 +223,7 @@ BOOST_AUTO_TEST_CASE(TestConfigFromFile)
     BOOST_CHECK_EQUAL("Diagnostic",                     ini.translation.diagnostic.get_cstr());
     BOOST_CHECK_EQUAL("Connection closed",              ini.translation.connection_closed.get_cstr());
     BOOST_CHECK_EQUAL(0,                                ini.mod_replay.on_end_of_data);
+    BOOST_CHECK_EQUAL(false,                            ini.internal_mod.widget_render_cache);
 
     BOOST_CHECK_EQUAL("",                               ini.context.movie.c_str());
 
@@ -769,6 +786,10 @@ BOOST_AUTO_TEST_CASE(TestConfig1)
                           "enable_close_box=false\n"
                           "enable_osd=false\n"
                           "enable_osd_display_remote_target=false\n"
+                          "channel_scheduler=yes\n"
+                          "channel_rate_limits=rdpdr:131072,cliprdr:65536\n"
+                          "async_connect=yes\n"
+                          "preconnect_timeout=20\n"
                           "\n"
                           "[client]\n"
                           "ignore_logon_password=yes\n"
@@ -784,6 +805,13 @@ BOOST_AUTO_TEST_CASE(TestConfig1)
                           "cache_waiting_list=no\n"
                           "persist_bitmap_cache_on_disk=yes\n"
                           "bitmap_compression=true\n"
+                          "adaptive_bitmap_tiling=yes\n"
+                          "glyph_fragment_cache=yes\n"
+                          "nscodec=yes\n"
+                          "remotefx=yes\n"
+                          "remotefx_encoder_threads=4\n"
+                          "multifragment_max_request_size=65536\n"
+                          "offscreen_bitmap_cache=yes\n"
                           "\n"
                           "[mod_rdp]\n"
                           "disconnect_on_logon_user_change=yes\n"
@@ -914,6 +942,10 @@ BOOST_AUTO_TEST_CASE(TestConfig1)
     BOOST_CHECK_EQUAL(false,                            ini.globals.enable_close_box);
     BOOST_CHECK_EQUAL(false,                            ini.globals.enable_osd);
     BOOST_CHECK_EQUAL(false,                            ini.globals.enable_osd_display_remote_target);
+    BOOST_CHECK_EQUAL(true,                             ini.globals.channel_scheduler);
+    BOOST_CHECK_EQUAL("rdpdr:131072,cliprdr:65536",     ini.globals.channel_rate_limits.get_cstr());
+    BOOST_CHECK_EQUAL(true,                             ini.globals.async_connect);
+    BOOST_CHECK_EQUAL(20,                               ini.globals.preconnect_timeout);
 
     BOOST_CHECK_EQUAL(0,                                memcmp(ini.crypto.key0,
                                                                "\x00\x11\x22\x33\x44\x55\x66\x77"
@@ -961,6 +993,13 @@ BOOST_AUTO_TEST_CASE(TestConfig1)
     BOOST_CHECK_EQUAL(false,                            ini.client.cache_waiting_list);
     BOOST_CHECK_EQUAL(true,                             ini.client.persist_bitmap_cache_on_disk);
     BOOST_CHECK_EQUAL(true,                             ini.client.bitmap_compression);
+    BOOST_CHECK_EQUAL(true,                             ini.client.adaptive_bitmap_tiling);
+    BOOST_CHECK_EQUAL(true,                             ini.client.glyph_fragment_cache);
+    BOOST_CHECK_EQUAL(true,                             ini.client.nscodec);
+    BOOST_CHECK_EQUAL(true,                             ini.client.remotefx);
+    BOOST_CHECK_EQUAL(4,                                ini.client.remotefx_encoder_threads);
+    BOOST_CHECK_EQUAL(65536,                            ini.client.multifragment_max_request_size);
+    BOOST_CHECK_EQUAL(true,                             ini.client.offscreen_bitmap_cache);
 
     BOOST_CHECK_EQUAL(4,                                ini.mod_rdp.rdp_compression);
     BOOST_CHECK_EQUAL(true,                             ini.mod_rdp.disconnect_on_logon_user_change);
@@ -1041,6 +1080,8 @@ BOOST_AUTO_TEST_CASE(TestConfig1bis)
                           "persist_bitmap_cache_on_disk=no\n"
                           "[mod_replay]\n"
                           "on_end_of_data=1\n"
+                          "[internal_mod]\n"
+                          "widget_render_cache=yes\n"
                           "[video]\n"
                           "hash_path=/mnt/wab/hash/\n"
                           "record_path=/mnt/wab/recorded/rdp/\n"
@@ -1217,6 +1258,7 @@ BOOST_AUTO_TEST_CASE(TestConfig1bis)
     BOOST_CHECK_EQUAL("Connexion fermée",               ini.translation.connection_closed.get_cstr());
 
     BOOST_CHECK_EQUAL(1,                                ini.mod_replay.on_end_of_data);
+    BOOST_CHECK_EQUAL(true,                             ini.internal_mod.widget_render_cache);
 
     BOOST_CHECK_EQUAL(40000,                            ini.context.opt_bitrate.get());
     BOOST_CHECK_EQUAL(5,                                ini.context.opt_framerate.get());
@@ -1260,6 +1302,12 @@ BOOST_AUTO_TEST_CASE(TestConfig2)
                           "disable_keyboard_log=4\n"
                           "wrm_color_depth_selection_strategy=1\n"
                           "wrm_compression_algorithm=1\n"
+                          "wrm_shared_serializer=yes\n"
+                          "wrm_meta_index=yes\n"
+                          "png_encoder_threads=4\n"
+                          "png_zlib_level=1\n"
+                          "png_filter=4\n"
+                          "flv_break_interval=3600\n"
                           "\n"
                           );
 
@@ -1298,7 +1346,7 @@ BOOST_AUTO_TEST_CASE(TestConfig2)
     BOOST_CHECK_EQUAL(3000,                             ini.video.png_interval);
     BOOST_CHECK_EQUAL(40,                               ini.video.frame_interval);
     BOOST_CHECK_EQUAL(600,                              ini.video.break_interval);
-    BOOST_CHECK_EQUAL(0,                                ini.video.flv_break_interval);
+    BOOST_CHECK_EQUAL(3600,                             ini.video.flv_break_interval);
     BOOST_CHECK_EQUAL(100,                              ini.video.ocr_interval);
     BOOST_CHECK_EQUAL(false,                            ini.video.ocr_on_title_bar_only);
     BOOST_CHECK_EQUAL(40,                               ini.video.ocr_max_unrecog_char_rate);
@@ -1337,6 +1385,11 @@ BOOST_AUTO_TEST_CASE(TestConfig2)
 
     BOOST_CHECK_EQUAL(1,                                ini.video.wrm_color_depth_selection_strategy);
     BOOST_CHECK_EQUAL(1,                                ini.video.wrm_compression_algorithm);
+    BOOST_CHECK_EQUAL(true,                             ini.video.wrm_shared_serializer);
+    BOOST_CHECK_EQUAL(true,                             ini.video.wrm_meta_index);
+    BOOST_CHECK_EQUAL(4,                                ini.video.png_encoder_threads);
+    BOOST_CHECK_EQUAL(1,                                ini.video.png_zlib_level);
+    BOOST_CHECK_EQUAL(4,                                ini.video.png_filter);
 
     BOOST_CHECK_EQUAL(900,                              ini.globals.session_timeout);
     BOOST_CHECK_EQUAL(30,                               ini.globals.keepalive_grace_delay);
@@ -2769,6 +2822,21 @@ BOOST_AUTO_TEST_CASE(TestContextSetValue)
 }
 
 
+BOOST_AUTO_TEST_CASE(TestAuthidIndex)
+{
+    for (unsigned i = AUTHID_UNKNOWN + 1; i < MAX_AUTHID; i++) {
+        const authid_t authid = static_cast<authid_t>(i);
+        BOOST_CHECK_EQUAL(authid, authid_from_string(string_from_authid(authid)));
+    }
+    BOOST_CHECK_EQUAL(AUTHID_UNKNOWN, authid_from_string("unknown"));
+    BOOST_CHECK_EQUAL(AUTHID_UNKNOWN, authid_from_string(""));
+    BOOST_CHECK_EQUAL(AUTHID_UNKNOWN, authid_from_string("target_passwor"));
+    BOOST_CHECK_EQUAL(AUTHID_UNKNOWN, authid_from_string("target_passwordd"));
+
+    static_assert(authid_hash(STRAUTHID_TARGET_USER) != authid_hash(STRAUTHID_TARGET_PASSWORD),
+                  "authid_hash is a constant expression");
+}
+
 //BOOST_AUTO_TEST_CASE(TestAuthentificationKeywordRecognition)
 //{
 //    BOOST_CHECK_EQUAL(AUTHID_UNKNOWN, authid_from_string("unknown"));
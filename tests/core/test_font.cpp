@@ -52,3 +52,22 @@ BOOST_AUTO_TEST_CASE(TestCreateFont)
     BOOST_CHECK(f.font_items[32]);
     BOOST_CHECK(f.font_items[0x4dff]);
 }
+
+BOOST_AUTO_TEST_CASE(TestFontCharCopy)
+{
+    Font f(FIXTURES_PATH "/dejavu-sans-10.fv1");
+    const FontChar & glyph = f.font_items['A'];
+    BOOST_CHECK(glyph);
+    // glyphs of a font have no data of their own
+    BOOST_CHECK(!const_cast<FontChar &>(glyph).writable_data());
+
+    // a copy (as in glyph caches) owns its data
+    FontChar copy(glyph);
+    BOOST_CHECK(copy.writable_data());
+    BOOST_CHECK(copy.data != glyph.data);
+    BOOST_CHECK(copy.item_compare(glyph));
+
+    FontChar moved(std::move(copy));
+    BOOST_CHECK(!copy);
+    BOOST_CHECK(moved.item_compare(glyph));
+}
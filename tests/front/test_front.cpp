@@ -21,12 +21,253 @@
 
 #define BOOST_AUTO_TEST_MAIN
 #define BOOST_TEST_DYN_LINK
-#define BOOST_TEST_MODULE TestXXX
+#define BOOST_TEST_MODULE TestFront
 #include <boost/test/auto_unit_test.hpp>
 
 #define LOGNULL
 
+#undef SHARE_PATH
+#define SHARE_PATH FIXTURES_PATH
+
+#undef DEFAULT_FONT_NAME
+#define DEFAULT_FONT_NAME "sans-10.fv1"
+
+#include "test_transport.hpp"
+#include "config.hpp"
+#include "front.hpp"
+#include "null/null.hpp"
+#include "RDP/mppc_unified_dec.hpp"
+#include "rdp/rdp_orders.hpp"
+#include "RDP/RDPDrawable.hpp"
 
 BOOST_AUTO_TEST_CASE(TestXXX)
 {
 }
+
+// Connection of a client replayed from a trace, what Front sends to the
+// client once up and running is kept one PDU by send.
+class ConnectedClientTransport : public Transport
+{
+    TestTransport & trace;
+
+public:
+    bool connected;
+    std::vector<std::string> sent;
+
+    explicit ConnectedClientTransport(TestTransport & trace)
+    : trace(trace)
+    , connected(false)
+    {}
+
+    virtual const uint8_t * get_public_key() const {
+        return this->trace.get_public_key();
+    }
+
+    virtual size_t get_public_key_length() const {
+        return this->trace.get_public_key_length();
+    }
+
+private:
+    virtual void do_recv(char ** pbuffer, size_t len) {
+        this->trace.recv(pbuffer, len);
+    }
+
+    virtual void do_send(const char * const buffer, size_t len) {
+        if (this->connected) {
+            this->sent.emplace_back(buffer, len);
+        }
+        else {
+            this->trace.send(buffer, len);
+        }
+    }
+};
+
+// Same decoding as mod_rdp on the client side
+void draw_sent_orders( const std::vector<std::string> & pdus, uint8_t bpp, RDPGraphicDevice & gd
+                     , uint16_t width, uint16_t height)
+{
+    rdp_orders orders("", false, false, 0);
+    CryptContext decrypt;
+    rdp_mppc_unified_dec mppc_dec;
+
+    for (const std::string & pdu : pdus) {
+        GeneratorTransport trans(pdu.data(), pdu.size());
+        Array array(65536);
+        uint8_t * end = array.get_data();
+        X224::RecvFactory fx224(trans, &end, array.size(), true);
+        InStream stream(array, 0, 0, end - array.get_data());
+
+        if (fx224.fast_path) {
+            FastPath::ServerUpdatePDU_Recv su(stream, decrypt);
+            while (su.payload.in_remain()) {
+                FastPath::Update_Recv upd(su.payload, &mppc_dec);
+                if (upd.updateCode == FastPath::FASTPATH_UPDATETYPE_ORDERS) {
+                    orders.process_orders(bpp, upd.payload, true, gd, width, height);
+                }
+            }
+            continue;
+        }
+
+        X224::DT_TPDU_Recv x224(stream);
+        MCS::SendDataIndication_Recv mcs(x224.payload, MCS::PER_ENCODING);
+        SEC::Sec_Recv sec(mcs.payload, decrypt, 0);
+        while (sec.payload.in_remain()) {
+            ShareControl_Recv sctrl(sec.payload);
+            if (sctrl.pduType == PDUTYPE_DATAPDU) {
+                ShareData_Recv sdata(sctrl.payload, &mppc_dec);
+                if (sdata.pdutype2 == PDUTYPE2_UPDATE) {
+                    SlowPath::GraphicsUpdate_Recv gur(sdata.payload);
+                    if (gur.update_type == RDP_UPDATE_ORDERS) {
+                        orders.process_orders(bpp, sdata.payload, false, gd, width, height);
+                    }
+                }
+                sdata.payload.p = sdata.payload.end;
+            }
+            sctrl.payload.p = sctrl.payload.end;
+        }
+    }
+}
+
+// A uniform tile of a SRCCOPY MemBlt is sent as an OpaqueRect, the client
+// must show the same colors as for the bitmap.
+void check_adaptive_tiling_uniform_memblt(uint8_t mod_bpp, const uint8_t * pixel)
+{
+    Inifile ini;
+    ini.client.tls_support             = true;
+    ini.client.tls_fallback_legacy     = false;
+    ini.client.rdp_compression         = 0;
+    ini.client.adaptive_bitmap_tiling  = true;
+
+    LCGRandom gen(0);
+
+    #include "fixtures/trace_mstsc_client.hpp"
+
+    TestTransport trace("Test Front Transport", indata, sizeof(indata), outdata, sizeof(outdata));
+    ConnectedClientTransport front_trans(trace);
+
+    const bool fastpath_support = true;
+    const bool mem3blt_support  = false;
+    Front front( front_trans, SHARE_PATH "/" DEFAULT_FONT_NAME, gen, ini
+               , fastpath_support, mem3blt_support);
+    null_mod no_mod(front);
+
+    while (front.up_and_running == 0) {
+        front.incoming(no_mod);
+    }
+    front_trans.connected = true;
+
+    // mstsc trace is a 16 bpp client, the module depth only changes
+    const uint16_t width  = front.client_info.width;
+    const uint16_t height = front.client_info.height;
+    const uint8_t client_bpp = front.client_info.bpp;
+    front.server_resize(width, height, mod_bpp);
+
+    // uniform bitmap, red and blue components differ
+    const uint16_t cx = 152;
+    const uint16_t cy = 72;
+    const uint8_t Bpp = nbbytes(mod_bpp);
+    std::vector<uint8_t> raw(cx * cy * Bpp);
+    for (size_t i = 0; i < raw.size(); i += Bpp) {
+        memcpy(&raw[i], pixel, Bpp);
+    }
+    Bitmap bmp(mod_bpp, mod_bpp, nullptr, cx, cy, raw.data(), raw.size());
+
+    const Rect screen(0, 0, width, height);
+    const RDPMemBlt cmd(0, Rect(20, 10, cx, cy), 0xCC, 0, 0, 0);
+
+    front.begin_update();
+    front.draw(cmd, screen, bmp);
+    front.end_update();
+
+    // what the client would show without adaptive tiling
+    RDPDrawable expected(width, height, client_bpp);
+    expected.draw(cmd, screen, Bitmap(client_bpp, bmp));
+
+    RDPDrawable drawn(width, height, client_bpp);
+    draw_sent_orders(front_trans.sent, client_bpp, drawn, width, height);
+
+    BOOST_CHECK(!front_trans.sent.empty());
+    BOOST_CHECK_EQUAL(0, memcmp(expected.impl().data(), drawn.impl().data(), expected.impl().pix_len()));
+}
+
+BOOST_AUTO_TEST_CASE(TestAdaptiveTilingUniformMemBlt16)
+{
+    // RGB565: r=0x1F, g=0x05, b=0x03
+    const uint8_t pixel[] = { 0xA3, 0xF8 };
+    check_adaptive_tiling_uniform_memblt(16, pixel);
+}
+
+BOOST_AUTO_TEST_CASE(TestAdaptiveTilingUniformMemBlt24)
+{
+    const uint8_t pixel[] = { 0x10, 0x80, 0xF0 };
+    check_adaptive_tiling_uniform_memblt(24, pixel);
+}
+
+// A capture restarted by a resize while paused must stay paused: orders sent
+// to the client are not mirrored to the recorder.
+BOOST_AUTO_TEST_CASE(TestResizeKeepsSharedSerializerCapturePaused)
+{
+    char record_path[] = "/tmp/test_front_XXXXXX";
+    BOOST_REQUIRE(mkdtemp(record_path));
+    const std::string path = std::string(record_path) + "/";
+
+    Inifile ini;
+    ini.client.tls_support                   = true;
+    ini.client.tls_fallback_legacy           = false;
+    ini.client.rdp_compression               = 0;
+    ini.globals.movie.set(true);
+    ini.globals.movie_path.set_from_cstr("capture");
+    ini.video.record_path                    = path.c_str();
+    ini.video.record_tmp_path                = path.c_str();
+    ini.video.hash_path                      = path.c_str();
+    ini.video.png_limit                      = 0;
+    ini.video.wrm_shared_serializer          = true;
+    // same depth as the mstsc trace, the client orders are shared
+    ini.video.wrm_color_depth_selection_strategy = 1;
+
+    LCGRandom gen(0);
+
+    #include "fixtures/trace_mstsc_client.hpp"
+
+    TestTransport trace("Test Front Transport", indata, sizeof(indata), outdata, sizeof(outdata));
+    ConnectedClientTransport front_trans(trace);
+
+    const bool fastpath_support = true;
+    const bool mem3blt_support  = false;
+    Front front( front_trans, SHARE_PATH "/" DEFAULT_FONT_NAME, gen, ini
+               , fastpath_support, mem3blt_support);
+    null_mod no_mod(front);
+
+    while (front.up_and_running == 0) {
+        front.incoming(no_mod);
+    }
+    front_trans.connected = true;
+
+    const uint16_t width  = front.client_info.width - 16;
+    const uint16_t height = front.client_info.height;
+    front.start_capture(front.client_info.width, height, ini, nullptr);
+    BOOST_REQUIRE(front.capture);
+    BOOST_REQUIRE(front.capture->is_shared_serializer());
+
+    front.pause_capture();
+    front.server_resize(width, height, front.client_info.bpp);
+    BOOST_REQUIRE(front.capture);
+
+    const uint64_t recorded = front.capture->wrm_trans->get_total_sent();
+
+    // as once the client has confirmed the new size
+    front.up_and_running = 1;
+
+    const Rect screen(0, 0, width, height);
+    front.begin_update();
+    for (uint16_t i = 0; i < 100; ++i) {
+        front.draw(RDPOpaqueRect(Rect(i, i, 64, 32), i * 0x010203), screen);
+    }
+    front.end_update();
+
+    BOOST_CHECK(!front_trans.sent.empty());
+    BOOST_CHECK_EQUAL(recorded, front.capture->wrm_trans->get_total_sent());
+
+    front.stop_capture();
+    BOOST_CHECK_EQUAL(0, system(("rm -rf " + path).c_str()));
+}
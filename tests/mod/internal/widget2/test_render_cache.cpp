@@ -0,0 +1,132 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *   Product name: redemption, a FLOSS RDP proxy
+ *   Copyright (C) Wallix 2014
+ *   Author(s): Christophe Grosjean
+ */
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestWidgetRenderCache
+#include <boost/test/auto_unit_test.hpp>
+
+#undef SHARE_PATH
+#define SHARE_PATH FIXTURES_PATH
+
+#define LOGNULL
+
+#include "config.hpp"
+#include "internal/widget2/label.hpp"
+#include "internal/widget2/screen.hpp"
+#include "internal/widget2/render_cache.hpp"
+
+#include "fake_draw.hpp"
+
+// text goes out as GlyphIndex orders, as a mod sends it to the front
+struct TestOrdersDraw : TestDraw
+{
+    GlyphCache glyph_cache;
+
+    TestOrdersDraw(uint16_t w, uint16_t h) : TestDraw(w, h) {}
+
+    virtual void server_draw_text(Font const & font, int16_t x, int16_t y, const char * text,
+                                  uint32_t fgcolor, uint32_t bgcolor, const Rect & clip)
+    {
+        mod_api::draw_text(this->gd, this->glyph_cache, font, x, y, text, fgcolor, bgcolor, clip);
+    }
+};
+
+struct TestCachedDraw : TestDraw
+{
+    WidgetRenderCache cache;
+
+    TestCachedDraw(uint16_t w, uint16_t h) : TestDraw(w, h) {}
+
+    virtual WidgetRenderCache * get_render_cache() {
+        return &this->cache;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(TestWidgetRenderCacheSameAsOrders)
+{
+    Inifile ini(FIXTURES_PATH "/dejavu-sans-10.fv1");
+
+    TestOrdersDraw drawable(200, 100);
+    TestCachedDraw cached_drawable(200, 100);
+
+    WidgetScreen parent(drawable, 200, 100, ini.font);
+    WidgetScreen cached_parent(cached_drawable, 200, 100, ini.font);
+
+    // odd width, so that the cached bitmap has a padding column
+    WidgetLabel wlabel(drawable, 10, 20, parent, NULL, "cached label", false, 0,
+                       RED, YELLOW, ini.font, 4, 1);
+    WidgetLabel cached_wlabel(cached_drawable, 10, 20, cached_parent, NULL, "cached label", false, 0,
+                              RED, YELLOW, ini.font, 4, 1);
+    wlabel.rect.cx = cached_wlabel.rect.cx = 97;
+    wlabel.rect.cy = cached_wlabel.rect.cy = 21;
+
+    const Rect clips[] = { Rect(0, 0, 200, 100), Rect(30, 25, 40, 9) };
+    for (const Rect & clip : clips) {
+        wlabel.rdp_input_invalidate(clip);
+        cached_wlabel.rdp_input_invalidate(clip);
+
+        BOOST_CHECK_EQUAL(drawable.gd.rowsize() * drawable.gd.height(),
+                          cached_drawable.gd.rowsize() * cached_drawable.gd.height());
+        BOOST_CHECK_EQUAL(0, memcmp(drawable.gd.data(), cached_drawable.gd.data(),
+                                    drawable.gd.rowsize() * drawable.gd.height()));
+    }
+
+    // the label is rendered once
+    BOOST_CHECK_EQUAL(1, cached_drawable.cache.size());
+}
+
+BOOST_AUTO_TEST_CASE(TestWidgetRenderCacheEviction)
+{
+    Inifile ini(FIXTURES_PATH "/dejavu-sans-10.fv1");
+
+    // room for two 40x16 labels
+    WidgetRenderCache cache(2 * 40 * 16 * 3);
+
+    const Bitmap & bmp1 = cache.label(ini.font, "one", 0, 0, 40, 16, RED, YELLOW);
+    BOOST_CHECK_EQUAL(&bmp1, &cache.label(ini.font, "one", 0, 0, 40, 16, RED, YELLOW));
+    BOOST_CHECK_EQUAL(40, bmp1.cx());
+    BOOST_CHECK_EQUAL(16, bmp1.cy());
+
+    cache.label(ini.font, "two", 0, 0, 40, 16, RED, YELLOW);
+    BOOST_CHECK_EQUAL(2, cache.size());
+    BOOST_CHECK_EQUAL(2 * 40 * 16 * 3, cache.bytes());
+
+    // "one" is the most recently used, "two" gets evicted
+    cache.label(ini.font, "one", 0, 0, 40, 16, RED, YELLOW);
+    const Bitmap & bmp3 = cache.label(ini.font, "three", 0, 0, 40, 16, RED, YELLOW);
+    BOOST_CHECK_EQUAL(2, cache.size());
+    BOOST_CHECK_EQUAL(&bmp1, &cache.label(ini.font, "one", 0, 0, 40, 16, RED, YELLOW));
+    BOOST_CHECK_EQUAL(&bmp3, &cache.label(ini.font, "three", 0, 0, 40, 16, RED, YELLOW));
+
+    // same text in other colors is another bitmap
+    cache.label(ini.font, "one", 0, 0, 40, 16, BLUE, YELLOW);
+    BOOST_CHECK_EQUAL(2, cache.size());
+
+    // a larger label takes the room of the two others
+    cache.label(ini.font, "wide", 0, 0, 80, 16, RED, YELLOW);
+    BOOST_CHECK_EQUAL(1, cache.size());
+    BOOST_CHECK_EQUAL(80 * 16 * 3, cache.bytes());
+
+    // a label larger than the cache is kept alone
+    cache.label(ini.font, "too wide", 0, 0, 160, 16, RED, YELLOW);
+    BOOST_CHECK_EQUAL(1, cache.size());
+    BOOST_CHECK_EQUAL(160 * 16 * 3, cache.bytes());
+}
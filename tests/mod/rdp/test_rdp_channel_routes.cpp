@@ -0,0 +1,173 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestRDPChannelRoutes
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include <string.h>
+#include <algorithm>
+
+#include "rdp/rdp_channel_routes.hpp"
+
+// same interface as CHANNELS::ChannelDefArray, which pulls the whole RDP stack
+struct ChannelDef {
+    char name[8];
+};
+
+struct ChannelDefArray {
+    ChannelDef items[8];
+    size_t     count;
+
+    ChannelDefArray() : count(0) {}
+
+    void push_back(const char * name) {
+        memset(this->items[this->count].name, 0, 8);
+        memcpy(this->items[this->count].name, name, std::min<size_t>(strlen(name), 7));
+        this->count++;
+    }
+
+    size_t size() const { return this->count; }
+
+    const ChannelDef & operator[](size_t index) const { return this->items[index]; }
+
+    int get_index_by_name(const char * name) const {
+        for (size_t index = 0; index < this->count; index++) {
+            if (!strcmp(name, this->items[index].name)) {
+                return index;
+            }
+        }
+        return -1;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(TestChannelNameId)
+{
+    BOOST_CHECK(channel_name_id("cliprdr") != channel_name_id("rdpdr"));
+    BOOST_CHECK_EQUAL(channel_name_id("rdpdr"), channel_name_id(channel_names::rdpdr));
+    BOOST_CHECK_EQUAL(channel_name_id(""), 0);
+
+    char name[8] = "rdpsnd";
+    switch (channel_name_id(name)) {
+    case channel_name_id("rdpsnd"):
+        break;
+    default:
+        BOOST_CHECK(false);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestRoutesPassthrough)
+{
+    ChannelDefArray front;
+    front.push_back("cliprdr");
+    front.push_back("rdpdr");
+    front.push_back("rdpsnd");
+
+    ChannelDefArray mod = front;
+    mod.push_back("wablnch");
+
+    RDPChannelRoutes routes;
+    routes.build(mod, front, AuthorizationChannels("*", ""), "wablnch", false, false);
+    BOOST_CHECK_EQUAL(routes.size(), 4);
+
+    const RDPChannelRoute * cliprdr = routes.get_by_name("cliprdr");
+    BOOST_REQUIRE(cliprdr);
+    BOOST_CHECK_EQUAL(cliprdr->handler, RDPChannelRoute::CLIPRDR);
+    BOOST_CHECK_EQUAL(cliprdr->mod_index, 0);
+    BOOST_CHECK_EQUAL(cliprdr->front_index, 0);
+    BOOST_CHECK(cliprdr->passthrough_to_mod);
+    BOOST_CHECK(cliprdr->passthrough_to_front);
+
+    const RDPChannelRoute * rdpdr = routes.get_by_name("rdpdr");
+    BOOST_REQUIRE(rdpdr);
+    BOOST_CHECK_EQUAL(rdpdr->handler, RDPChannelRoute::RDPDR);
+    BOOST_CHECK(rdpdr->passthrough_to_mod);
+    BOOST_CHECK(rdpdr->passthrough_to_front);
+
+    BOOST_CHECK_EQUAL(routes.get_by_name("rdpsnd")->handler, RDPChannelRoute::PASSTHROUGH);
+
+    const RDPChannelRoute * auth = routes.get_by_mod_index(3);
+    BOOST_REQUIRE(auth);
+    BOOST_CHECK_EQUAL(auth->handler, RDPChannelRoute::AUTH);
+    BOOST_CHECK_EQUAL(auth->front_index, -1);
+    BOOST_CHECK(!auth->passthrough_to_front);
+
+    BOOST_CHECK(!routes.get_by_name("drdynvc"));
+    BOOST_CHECK(!routes.get_by_mod_index(4));
+
+    // data counted against a limit is inspected
+    routes.build(mod, front, AuthorizationChannels("*", ""), "", true, true);
+    BOOST_CHECK(!routes.get_by_name("cliprdr")->passthrough_to_mod);
+    BOOST_CHECK(!routes.get_by_name("cliprdr")->passthrough_to_front);
+    BOOST_CHECK(!routes.get_by_name("rdpdr")->passthrough_to_mod);
+    BOOST_CHECK(!routes.get_by_name("rdpdr")->passthrough_to_front);
+    BOOST_CHECK_EQUAL(routes.get_by_mod_index(3)->handler, RDPChannelRoute::PASSTHROUGH);
+}
+
+BOOST_AUTO_TEST_CASE(TestRoutesAuthorizations)
+{
+    ChannelDefArray front;
+    front.push_back("cliprdr");
+    front.push_back("rdpdr");
+    front.push_back("rdpsnd");
+
+    // denied channels keep their place with an empty name
+    ChannelDefArray mod;
+    mod.push_back("cliprdr");
+    mod.push_back("rdpdr");
+    mod.push_back("");
+
+    RDPChannelRoutes routes;
+    routes.build(mod, front, AuthorizationChannels("*", "cliprdr_up,rdpdr_printer,rdpsnd"), "", false, false);
+
+    const RDPChannelRoute * cliprdr = routes.get_by_name("cliprdr");
+    BOOST_CHECK(!cliprdr->cliprdr_up);
+    BOOST_CHECK(cliprdr->cliprdr_down);
+    BOOST_CHECK(cliprdr->cliprdr_file);
+    BOOST_CHECK(!cliprdr->passthrough_to_mod);
+    BOOST_CHECK(cliprdr->passthrough_to_front);
+
+    const RDPChannelRoute * rdpdr = routes.get_by_name("rdpdr");
+    BOOST_CHECK(rdpdr->rdpdr_filter);
+    BOOST_CHECK(!rdpdr->passthrough_to_mod);
+    BOOST_CHECK(rdpdr->passthrough_to_front);
+
+    const RDPChannelRoute * rdpsnd = routes.get_by_name("rdpsnd");
+    BOOST_REQUIRE(rdpsnd);
+    BOOST_CHECK(!rdpsnd->mod_channel);
+    BOOST_CHECK_EQUAL(rdpsnd->front_index, -1);
+
+    // clipboard PDUs of the client are still answered when the target has no clipboard
+    mod = ChannelDefArray();
+    mod.push_back("");
+    mod.push_back("rdpdr");
+    mod.push_back("rdpsnd");
+    routes.build(mod, front, AuthorizationChannels("rdpdr,rdpsnd", "cliprdr"), "", false, false);
+    cliprdr = routes.get_by_name("cliprdr");
+    BOOST_REQUIRE(cliprdr);
+    BOOST_CHECK(!cliprdr->mod_channel);
+    BOOST_CHECK(!cliprdr->passthrough_to_mod);
+    BOOST_CHECK(cliprdr->passthrough_to_front);
+    BOOST_CHECK(routes.get_by_name("rdpdr")->passthrough_to_mod);
+}
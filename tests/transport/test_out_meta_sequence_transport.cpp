@@ -26,6 +26,7 @@
 
 #define LOGNULL
 #include "out_meta_sequence_transport.hpp"
+#include "in_meta_sequence_transport.hpp"
 #include "fileutils.hpp"
 
 
@@ -59,3 +60,79 @@ BOOST_AUTO_TEST_CASE(TestOutmetaTransport)
     BOOST_CHECK_EQUAL(0, ::unlink(file2));
 }
 
+
+BOOST_AUTO_TEST_CASE(TestOutmetaTransportWithIndex)
+{
+    timeval now;
+    now.tv_sec = 1352304810;
+    now.tv_usec = 0;
+    {
+        const int groupid = 0;
+        OutMetaSequenceTransport wrm_trans("./", "yyy", now, 800, 600, groupid);
+        BOOST_CHECK(wrm_trans.open_index(800, 600));
+        for (unsigned i = 0; i < 10; ++i) {
+            wrm_trans.send("AAAAXAAAAXAAAAX", 5 + i);
+            now.tv_sec += 10;
+            wrm_trans.timestamp(now);
+            wrm_trans.next();
+        }
+    } // brackets necessary to force closing sequence
+
+    char meta_path[1024];
+    snprintf(meta_path, 1024, "./yyy-%06u.mwrm", getpid());
+    char index_path[1024];
+    snprintf(index_path, 1024, "./yyy-%06u.mwrm.idx", getpid());
+    BOOST_CHECK_EQUAL(16 + 10 * 32, filesize(index_path));
+
+    {
+        detail::MetaIndex index(meta_path);
+        BOOST_CHECK(index.is_valid());
+        BOOST_CHECK_EQUAL(10, index.size());
+
+        detail::MetaIndexRecord record = index.record(3);
+        BOOST_CHECK_EQUAL(1352304810 + 30, record.start_sec);
+        BOOST_CHECK_EQUAL(1352304810 + 41, record.stop_sec);
+        BOOST_CHECK_EQUAL(8, record.file_size);
+
+        BOOST_CHECK_EQUAL(0, index.find(0));
+        BOOST_CHECK_EQUAL(3, index.find(1352304810 + 40));
+        BOOST_CHECK_EQUAL(4, index.find(1352304810 + 41));
+        BOOST_CHECK_EQUAL(10, index.find(1352304810 + 200));
+
+        // the index gives the same files as a walk through the .mwrm
+        InMetaSequenceTransport in_trans(meta_path);
+        BOOST_CHECK(in_trans.seek_to_time(1352304810 + 41));
+        in_trans.next();
+        BOOST_CHECK_EQUAL(5, in_trans.get_seqno());
+        BOOST_CHECK_EQUAL(1352304810 + 40, in_trans.begin_chunk_time());
+        BOOST_CHECK_EQUAL(1352304810 + 51, in_trans.end_chunk_time());
+        char buf[16];
+        char * p = buf;
+        in_trans.recv(&p, 9);
+        BOOST_CHECK_EQUAL(0, memcmp(buf, "AAAAX", 5));
+
+        BOOST_CHECK(in_trans.seek_to_time(1352304810));
+        in_trans.next();
+        BOOST_CHECK_EQUAL(1, in_trans.get_seqno());
+        BOOST_CHECK_EQUAL(1352304810, in_trans.begin_chunk_time());
+    }
+
+    // the index does not describe a .mwrm with more lines
+    {
+        int fd = ::open(meta_path, O_WRONLY | O_APPEND);
+        BOOST_CHECK(fd >= 0);
+        BOOST_CHECK_EQUAL(10, ::write(fd, "./x 1 2\n\n\n", 10));
+        ::close(fd);
+        detail::MetaIndex index(meta_path);
+        BOOST_CHECK(!index.is_valid());
+    }
+
+    BOOST_CHECK_EQUAL(0, ::unlink(meta_path));
+    BOOST_CHECK_EQUAL(0, ::unlink(index_path));
+    for (unsigned i = 0; i < 10; ++i) {
+        char file[1024];
+        snprintf(file, 1024, "./yyy-%06u-%06u.wrm", getpid(), i);
+        BOOST_CHECK_EQUAL(5 + i, filesize(file));
+        BOOST_CHECK_EQUAL(0, ::unlink(file));
+    }
+}
@@ -0,0 +1,128 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Unit test for shared TLS session caches
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestTLSContext
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "tls_context.hpp"
+
+BOOST_AUTO_TEST_CASE(TestTLSSessionCache)
+{
+    TLSSessionCache cache(16);
+    BOOST_REQUIRE(cache.is_valid());
+
+    const uint8_t id1[32] = { 1, 2, 3 };
+    const uint8_t id2[32] = { 4, 5, 6 };
+    const uint8_t der1[] = "first session";
+    uint8_t der[TLSSessionCache::MAX_SESSION_DER_LENGTH];
+
+    BOOST_CHECK(cache.add(id1, sizeof(id1), der1, sizeof(der1), 1000));
+    BOOST_CHECK_EQUAL(sizeof(der1), cache.get(id1, sizeof(id1), der, 999));
+    BOOST_CHECK_EQUAL(0, memcmp(der, der1, sizeof(der1)));
+
+    BOOST_CHECK_EQUAL(0, cache.get(id2, sizeof(id2), der, 999));
+    // shorter id is another session
+    BOOST_CHECK_EQUAL(0, cache.get(id1, 16, der, 999));
+
+    // expired
+    BOOST_CHECK_EQUAL(0, cache.get(id1, sizeof(id1), der, 1000));
+    BOOST_CHECK_EQUAL(0, cache.get(id1, sizeof(id1), der, 0));
+
+    BOOST_CHECK(cache.add(id1, sizeof(id1), der1, sizeof(der1), 1000));
+    cache.remove(id2, sizeof(id2));
+    BOOST_CHECK_EQUAL(sizeof(der1), cache.get(id1, sizeof(id1), der, 0));
+    cache.remove(id1, sizeof(id1));
+    BOOST_CHECK_EQUAL(0, cache.get(id1, sizeof(id1), der, 0));
+
+    // too large
+    BOOST_CHECK(!cache.add(id1, sizeof(id1), der, TLSSessionCache::MAX_SESSION_DER_LENGTH + 1, 1000));
+    BOOST_CHECK(!cache.add(id1, 0, der1, sizeof(der1), 1000));
+}
+
+BOOST_AUTO_TEST_CASE(TestTLSSessionCacheSharedByChildren)
+{
+    TLSSessionCache cache(16);
+    BOOST_REQUIRE(cache.is_valid());
+
+    const uint8_t id[32] = { 42 };
+    const uint8_t der1[] = "session from child";
+
+    const pid_t pid = fork();
+    BOOST_REQUIRE(pid != -1);
+    if (pid == 0) {
+        cache.add(id, sizeof(id), der1, sizeof(der1), 1000);
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    uint8_t der[TLSSessionCache::MAX_SESSION_DER_LENGTH];
+    BOOST_CHECK_EQUAL(sizeof(der1), cache.get(id, sizeof(id), der, 0));
+    BOOST_CHECK_EQUAL(0, memcmp(der, der1, sizeof(der1)));
+}
+
+BOOST_AUTO_TEST_CASE(TestTLSClientSessionByTarget)
+{
+    SSL_CTX * ctx = TLSClientContext::get();
+    BOOST_REQUIRE(ctx);
+    BOOST_CHECK(!TLSClientContext::find_session("10.10.47.36", 3389));
+
+    // TLS_RSA_WITH_AES_128_CBC_SHA
+    SSL * ssl = SSL_new(ctx);
+    const SSL_CIPHER * cipher = SSL_CIPHER_find(ssl, reinterpret_cast<const uint8_t*>("\x00\x2F"));
+    BOOST_REQUIRE(cipher);
+
+    SSL_SESSION * session = SSL_SESSION_new();
+    SSL_SESSION_set_cipher(session, cipher);
+    const uint8_t id[32] = { 1, 2, 3, 4 };
+    const uint8_t master_key[48] = { 5, 6, 7, 8 };
+    SSL_SESSION_set1_id(session, id, sizeof(id));
+    SSL_SESSION_set1_master_key(session, master_key, sizeof(master_key));
+    SSL_SESSION_set_protocol_version(session, TLS1_VERSION);
+    SSL_SESSION_set_time(session, time(nullptr));
+    SSL_SESSION_set_timeout(session, 300);
+
+    BOOST_CHECK(TLSClientContext::store_session("10.10.47.36", 3389, session));
+    SSL_SESSION_free(session);
+    SSL_free(ssl);
+
+    // other port is another target
+    BOOST_CHECK(!TLSClientContext::find_session("10.10.47.36", 3390));
+
+    session = TLSClientContext::find_session("10.10.47.36", 3389);
+    BOOST_REQUIRE(session);
+    unsigned id_length = 0;
+    const uint8_t * found_id = SSL_SESSION_get_id(session, &id_length);
+    BOOST_CHECK_EQUAL(sizeof(id), id_length);
+    BOOST_CHECK_EQUAL(0, memcmp(found_id, id, sizeof(id)));
+    SSL_SESSION_free(session);
+
+    TLSClientContext::remove_session("10.10.47.36", 3389);
+    BOOST_CHECK(!TLSClientContext::find_session("10.10.47.36", 3389));
+}
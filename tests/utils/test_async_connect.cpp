@@ -0,0 +1,166 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestAsyncConnect
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include "async_connect.hpp"
+
+// listening socket on 127.0.0.1, port chosen by the system
+static int listen_local(int & port) {
+    int sck = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = 0;
+    bind(sck, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    listen(sck, 4);
+    socklen_t len = sizeof(addr);
+    getsockname(sck, reinterpret_cast<sockaddr *>(&addr), &len);
+    port = ntohs(addr.sin_port);
+    return sck;
+}
+
+// the session loop: select() then process() until the connection is done
+static AsyncConnect::State run(AsyncConnect & connect, unsigned max_rounds = 1000) {
+    for (unsigned round = 0; round < max_rounds && connect.is_pending(); ++round) {
+        fd_set wfds;
+        FD_ZERO(&wfds);
+        unsigned max = 0;
+        timeval timeout = { 3, 0 };
+        connect.add_to_fd_set(wfds, max, timeout, tvtime());
+        BOOST_CHECK(timeout.tv_sec < 3 || (timeout.tv_sec == 3 && timeout.tv_usec == 0));
+        select(max + 1, nullptr, &wfds, nullptr, &timeout);
+        connect.process(wfds, tvtime());
+    }
+    return connect.get_state();
+}
+
+BOOST_AUTO_TEST_CASE(TestAsyncConnectNumeric)
+{
+    int port;
+    int server = listen_local(port);
+
+    AsyncConnect connect;
+    connect.start("127.0.0.1", port, 2000, tvtime());
+    BOOST_CHECK(connect.get_state() == AsyncConnect::CONNECTING
+             || connect.get_state() == AsyncConnect::CONNECTED);
+
+    BOOST_CHECK(connect.targets("127.0.0.1", port));
+    BOOST_CHECK(!connect.targets("127.0.0.1", port + 1));
+    BOOST_CHECK(!connect.targets("localhost", port));
+
+    BOOST_CHECK_EQUAL(AsyncConnect::CONNECTED, run(connect));
+    BOOST_CHECK(connect.targets("127.0.0.1", port));
+    int sck = connect.release();
+    BOOST_CHECK(sck != -1);
+    BOOST_CHECK_EQUAL(AsyncConnect::IDLE, connect.get_state());
+    BOOST_CHECK(!connect.targets("127.0.0.1", port));
+    BOOST_CHECK(fcntl(sck, F_GETFL) & O_NONBLOCK);
+
+    int accepted = accept(server, nullptr, nullptr);
+    BOOST_CHECK(accepted != -1);
+    BOOST_CHECK_EQUAL(4, send(sck, "ping", 4, 0));
+
+    close(accepted);
+    close(sck);
+    close(server);
+}
+
+BOOST_AUTO_TEST_CASE(TestAsyncConnectRefused)
+{
+    int port;
+    close(listen_local(port));
+
+    AsyncConnect connect;
+    connect.start("127.0.0.1", port, 2000, tvtime());
+    BOOST_CHECK_EQUAL(AsyncConnect::FAILED, run(connect));
+    BOOST_CHECK_EQUAL(-1, connect.release());
+}
+
+BOOST_AUTO_TEST_CASE(TestAsyncConnectResolve)
+{
+    // localhost may resolve to ::1 first, refused, then to 127.0.0.1
+    int port;
+    int server = listen_local(port);
+
+    AsyncConnect connect;
+    connect.start("localhost", port, 5000, tvtime());
+    BOOST_CHECK(connect.get_state() != AsyncConnect::FAILED);
+
+    BOOST_CHECK_EQUAL(AsyncConnect::CONNECTED, run(connect));
+    int sck = connect.release();
+    BOOST_CHECK(sck != -1);
+
+    close(sck);
+    close(server);
+}
+
+BOOST_AUTO_TEST_CASE(TestAsyncConnectUnknownHost)
+{
+    AsyncConnect connect;
+    connect.start("host.invalid", 3389, 5000, tvtime());
+    BOOST_CHECK_EQUAL(AsyncConnect::FAILED, run(connect));
+}
+
+BOOST_AUTO_TEST_CASE(TestAsyncConnectTimeout)
+{
+    // nothing answers to the syn of a full backlog, the deadline is reached
+    int port;
+    int server = listen_local(port);
+    listen(server, 0);
+    int fill[8];
+    for (int & sck : fill) {
+        sck = ip_connect("127.0.0.1", port, 1, 10);
+    }
+
+    AsyncConnect connect;
+    timeval now = tvtime();
+    connect.start("127.0.0.1", port, 200, now);
+    AsyncConnect::State state = run(connect);
+    BOOST_CHECK(state == AsyncConnect::FAILED || state == AsyncConnect::CONNECTED);
+    BOOST_CHECK(difftimeval(tvtime(), now) < 2000000);
+
+    for (int sck : fill) {
+        if (sck != -1) {
+            close(sck);
+        }
+    }
+    close(server);
+}
+
+BOOST_AUTO_TEST_CASE(TestAsyncConnectCancel)
+{
+    int port;
+    int server = listen_local(port);
+
+    AsyncConnect connect;
+    connect.start("localhost", port, 5000, tvtime());
+    connect.cancel();
+    BOOST_CHECK_EQUAL(AsyncConnect::IDLE, connect.get_state());
+    BOOST_CHECK(!connect.is_pending());
+
+    close(server);
+}
@@ -0,0 +1,108 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Unit test of MemBlt tiling helpers
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestBitmapTiles
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include "bitmap_tiles.hpp"
+
+BOOST_AUTO_TEST_CASE(TestMaxTileSide)
+{
+    // bitmap cache rev2 cells (4096 pixels)
+    BOOST_CHECK_EQUAL(64, bitmap_tiles::max_tile_side(2, 4096 * 2, 16384));
+    BOOST_CHECK_EQUAL(64, bitmap_tiles::max_tile_side(3, 4096 * 3, 16384));
+    // does not fit in one order
+    BOOST_CHECK_EQUAL(32, bitmap_tiles::max_tile_side(4, 4096 * 4, 16384));
+    // bitmap cache rev1 cells given in bytes
+    BOOST_CHECK_EQUAL(16, bitmap_tiles::max_tile_side(3, 2048, 16384));
+    BOOST_CHECK_EQUAL(32, bitmap_tiles::max_tile_side(2, 2048, 16384));
+    BOOST_CHECK_EQUAL(8, bitmap_tiles::max_tile_side(3, 0, 16384));
+}
+
+BOOST_AUTO_TEST_CASE(TestBalancedTileLength)
+{
+    BOOST_CHECK_EQUAL(36, bitmap_tiles::balanced_tile_length(70, 64, true));
+    BOOST_CHECK_EQUAL(35, bitmap_tiles::balanced_tile_length(70, 64, false));
+    BOOST_CHECK_EQUAL(64, bitmap_tiles::balanced_tile_length(128, 64, true));
+    BOOST_CHECK_EQUAL(44, bitmap_tiles::balanced_tile_length(130, 64, true));
+    BOOST_CHECK_EQUAL(20, bitmap_tiles::balanced_tile_length(17, 64, true));
+    BOOST_CHECK_EQUAL(17, bitmap_tiles::balanced_tile_length(17, 64, false));
+    BOOST_CHECK_EQUAL(64, bitmap_tiles::balanced_tile_length(63, 64, true));
+    BOOST_CHECK_EQUAL(64, bitmap_tiles::balanced_tile_length(64, 64, true));
+}
+
+BOOST_AUTO_TEST_CASE(TestUniformAndSameTiles)
+{
+    // 8x4 pixels of 3 bytes, lines are 24 bytes
+    uint8_t data[8 * 4 * 3];
+    for (size_t i = 0; i < sizeof(data); i += 3) {
+        data[i] = 0x10;
+        data[i + 1] = 0x20;
+        data[i + 2] = 0x30;
+    }
+
+    uint32_t pixel = 0;
+    BOOST_CHECK(bitmap_tiles::is_uniform(data, 24, 3, 8, 4, pixel));
+    BOOST_CHECK_EQUAL(0x302010u, pixel);
+
+    // left and right halves have the same pixels
+    BOOST_CHECK(bitmap_tiles::same_pixels(data, data + 12, 24, 12, 4));
+
+    data[3 * 24 + 7 * 3] = 0x11;
+    BOOST_CHECK(!bitmap_tiles::is_uniform(data, 24, 3, 8, 4, pixel));
+    BOOST_CHECK(bitmap_tiles::is_uniform(data, 24, 3, 7, 4, pixel));
+    BOOST_CHECK(bitmap_tiles::is_uniform(data, 24, 3, 8, 3, pixel));
+    BOOST_CHECK(!bitmap_tiles::same_pixels(data, data + 12, 24, 12, 4));
+    BOOST_CHECK(bitmap_tiles::same_pixels(data, data + 12, 24, 12, 3));
+
+    data[1] = 0;
+    BOOST_CHECK(!bitmap_tiles::is_uniform(data, 24, 3, 8, 3, pixel));
+    BOOST_CHECK(bitmap_tiles::is_uniform(data + 3, 24, 3, 7, 3, pixel));
+    BOOST_CHECK(!bitmap_tiles::is_uniform(data, 24, 3, 0, 3, pixel));
+}
+
+BOOST_AUTO_TEST_CASE(TestPhotographicTiles)
+{
+    // 16x8 pixels of 3 bytes, lines are 48 bytes
+    uint8_t data[16 * 8 * 3];
+    for (size_t i = 0; i < sizeof(data); ++i) {
+        data[i] = uint8_t(i * 7 + i / 48);
+    }
+    BOOST_CHECK(bitmap_tiles::is_photographic(data, 48, 3, 16, 8));
+    // bottom-up rows
+    BOOST_CHECK(bitmap_tiles::is_photographic(data + 7 * 48, -48, 3, 16, 8));
+
+    // a quarter of the pixels repeat their left neighbour
+    for (size_t y = 0; y < 8; ++y) {
+        for (size_t x = 1; x < 16; x += 4) {
+            memcpy(data + y * 48 + x * 3, data + y * 48 + (x - 1) * 3, 3);
+        }
+    }
+    BOOST_CHECK(!bitmap_tiles::is_photographic(data, 48, 3, 16, 8));
+    BOOST_CHECK(bitmap_tiles::is_photographic(data + 3 * 2, 48, 3, 2, 8));
+
+    BOOST_CHECK(!bitmap_tiles::is_photographic(data, 48, 3, 1, 8));
+}
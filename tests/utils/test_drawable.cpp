@@ -1112,3 +1112,19 @@ BOOST_AUTO_TEST_CASE(TestMemblt3)
     // uncomment to see result in png file
     //dump_png("./test_memblt3_", gd.impl());
 }
+
+BOOST_AUTO_TEST_CASE(TestMemblt32)
+{
+    // 32 bpp bitmaps are blitted without going through a 24 bpp bitmap
+    DrawableImpl<DepthColor::color24> d24(8, 8);
+
+    uint8_t raw32[4 * 4 * 4];
+    for (size_t i = 0; i < sizeof(raw32); ++i) {
+        raw32[i] = uint8_t(i * 5);
+    }
+    Bitmap bmp32(32, 32, nullptr, 4, 4, raw32, sizeof(raw32));
+    d24.mem_blt(Rect(0, 0, 4, 4), bmp32, 0, 0, Ops::CopySrc());
+    BOOST_CHECK_EQUAL(0, memcmp(d24.data(0, 0), bmp32.data() + 3 * 4 * 4, 3));
+    BOOST_CHECK_EQUAL(0, memcmp(d24.data(1, 0), bmp32.data() + 3 * 4 * 4 + 4, 3));
+    BOOST_CHECK_EQUAL(0, memcmp(d24.data(3, 3), bmp32.data() + 3 * 4, 3));
+}
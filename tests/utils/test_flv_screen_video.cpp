@@ -0,0 +1,202 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Unit test for FLV Screen Video writer
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestFlvScreenVideo
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include "flv_screen_video.hpp"
+#include "test_transport.hpp"
+
+namespace {
+
+uint32_t get_be(const uint8_t * p, unsigned nb_bytes) {
+    uint32_t res = 0;
+    while (nb_bytes--) {
+        res = (res << 8) | *p++;
+    }
+    return res;
+}
+
+struct FlvFrame {
+    bool     key_frame;
+    uint32_t timestamp;
+    unsigned nb_changed_blocks;
+};
+
+// minimal FLV Screen Video reader: applies each frame to image (packed bgr, top to bottom)
+bool decode_flv(const uint8_t * flv, size_t size, unsigned width, unsigned height,
+                std::vector<uint8_t> & image, std::vector<FlvFrame> & frames)
+{
+    if (size < 13 || memcmp(flv, "FLV\x01\x01\x00\x00\x00\x09\x00\x00\x00\x00", 13)) {
+        return false;
+    }
+    image.assign(width * height * 3, 0);
+    frames.clear();
+
+    size_t pos = 13;
+    while (pos < size) {
+        const uint8_t  type      = flv[pos];
+        const uint32_t data_size = get_be(flv + pos + 1, 3);
+        const uint32_t timestamp = get_be(flv + pos + 4, 3) | (flv[pos + 7] << 24);
+        const uint8_t * data     = flv + pos + 11;
+        if (get_be(data + data_size, 4) != data_size + 11) {
+            return false;
+        }
+        pos += 11 + data_size + 4;
+
+        if (type == 18) {
+            if (memcmp(data, "\x02\x00\x0AonMetaData", 13)) {
+                return false;
+            }
+            continue;
+        }
+        if (type != 9 || (data[0] & 0x0F) != 3) {
+            return false;
+        }
+
+        FlvFrame frame;
+        frame.key_frame = (data[0] >> 4) == 1;
+        frame.timestamp = timestamp;
+        frame.nb_changed_blocks = 0;
+
+        const unsigned bw = ((data[1] >> 4) + 1) * 16;
+        const unsigned bh = ((data[3] >> 4) + 1) * 16;
+        if (get_be(data + 1, 2) % 4096 != width || get_be(data + 3, 2) % 4096 != height) {
+            return false;
+        }
+
+        const uint8_t * p = data + 5;
+        for (unsigned y = 0; y < height; y += bh) {
+            const unsigned cur_bh = std::min(bh, height - y);
+            for (unsigned x = 0; x < width; x += bw) {
+                const unsigned cur_bw = std::min(bw, width - x);
+                const unsigned block_size = get_be(p, 2);
+                p += 2;
+                if (!block_size) {
+                    if (frame.key_frame) {
+                        return false;
+                    }
+                    continue;
+                }
+                std::vector<uint8_t> raw(cur_bw * cur_bh * 3);
+                uLongf raw_size = raw.size();
+                if (uncompress(raw.data(), &raw_size, p, block_size) != Z_OK || raw_size != raw.size()) {
+                    return false;
+                }
+                p += block_size;
+                ++frame.nb_changed_blocks;
+                // rows are stored from bottom of image
+                for (unsigned k = 0; k < cur_bh; ++k) {
+                    memcpy(&image[((height - y - 1 - k) * width + x) * 3], &raw[k * cur_bw * 3], cur_bw * 3);
+                }
+            }
+        }
+        if (p != data + data_size) {
+            return false;
+        }
+        frames.push_back(frame);
+    }
+    return pos == size;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(TestFlvScreenVideo)
+{
+    const unsigned width   = 150;
+    const unsigned height  = 70;
+    const size_t   rowsize = width * 3 + 6;  // padded rows
+
+    std::vector<uint8_t> screen(rowsize * height);
+    for (unsigned y = 0; y < height; ++y) {
+        for (unsigned x = 0; x < width * 3; ++x) {
+            screen[y * rowsize + x] = x ^ (y * 5);
+        }
+    }
+
+    FlvParams params;
+    params.block_width        = 64;
+    params.block_height       = 32;
+    params.key_frame_interval = 3;
+
+    MemoryTransport trans;
+    FlvScreenVideoEncoder encoder(trans, width, height, params);
+    encoder.write_header();
+
+    // 3 x 3 blocks
+    BOOST_CHECK(encoder.write_frame(screen.data(), rowsize, 0));
+    BOOST_CHECK_EQUAL(9, encoder.changed_blocks);
+
+    // nothing changed, frame is skipped unless forced
+    BOOST_CHECK(!encoder.write_frame(screen.data(), rowsize, 200));
+    BOOST_CHECK_EQUAL(0, encoder.changed_blocks);
+
+    // top left pixel is in the partial top row of blocks
+    screen[0] = ~screen[0];
+    // bottom right pixel is in the bottom right block
+    screen[(height - 1) * rowsize + (width - 1) * 3 + 2] ^= 0x80;
+    BOOST_CHECK(encoder.write_frame(screen.data(), rowsize, 400));
+    BOOST_CHECK_EQUAL(2, encoder.changed_blocks);
+
+    BOOST_CHECK(encoder.write_frame(screen.data(), rowsize, 600, true));
+    BOOST_CHECK_EQUAL(0, encoder.changed_blocks);
+
+    // fourth frame written, key frame
+    BOOST_CHECK(encoder.write_frame(screen.data(), rowsize, 70000, true));
+    BOOST_CHECK_EQUAL(9, encoder.changed_blocks);
+
+    std::vector<uint8_t> image;
+    std::vector<FlvFrame> frames;
+    BOOST_REQUIRE(decode_flv( trans.out_stream.get_data(), trans.out_stream.get_offset()
+                            , width, height, image, frames));
+
+    BOOST_REQUIRE_EQUAL(4, frames.size());
+    BOOST_CHECK(frames[0].key_frame);
+    BOOST_CHECK(!frames[1].key_frame);
+    BOOST_CHECK(!frames[2].key_frame);
+    BOOST_CHECK(frames[3].key_frame);
+    BOOST_CHECK_EQUAL(0,     frames[0].timestamp);
+    BOOST_CHECK_EQUAL(400,   frames[1].timestamp);
+    BOOST_CHECK_EQUAL(600,   frames[2].timestamp);
+    BOOST_CHECK_EQUAL(70000, frames[3].timestamp);
+    BOOST_CHECK_EQUAL(2,     frames[1].nb_changed_blocks);
+    BOOST_CHECK_EQUAL(0,     frames[2].nb_changed_blocks);
+
+    bool same = true;
+    for (unsigned y = 0; y < height; ++y) {
+        same = same && !memcmp(&image[y * width * 3], &screen[y * rowsize], width * 3);
+    }
+    BOOST_CHECK(same);
+}
+
+BOOST_AUTO_TEST_CASE(TestFlvScreenVideoInvalidGeometry)
+{
+    MemoryTransport trans;
+    FlvParams params;
+    BOOST_CHECK_THROW(FlvScreenVideoEncoder(trans, 4096, 100, params), Error);
+    params.block_width = 40;
+    BOOST_CHECK_THROW(FlvScreenVideoEncoder(trans, 100, 100, params), Error);
+}
@@ -0,0 +1,77 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestLatencyStats
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include "latency_stats.hpp"
+
+BOOST_AUTO_TEST_CASE(TestLatencyStatsEmpty)
+{
+    LatencyStats stats;
+    BOOST_CHECK_EQUAL(stats.count(), 0);
+    BOOST_CHECK_EQUAL(stats.mean(), 0);
+    BOOST_CHECK_EQUAL(stats.percentile(50), 0);
+    BOOST_CHECK_EQUAL(stats.max(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestLatencyStatsPercentiles)
+{
+    LatencyStats stats;
+    for (uint64_t us = 100; us > 0; --us) {
+        stats.add(us * 10);
+    }
+    BOOST_CHECK_EQUAL(stats.count(), 100);
+    BOOST_CHECK_EQUAL(stats.mean(), 505);
+    BOOST_CHECK_EQUAL(stats.percentile(0), 10);
+    BOOST_CHECK_EQUAL(stats.percentile(50), 500);
+    BOOST_CHECK_EQUAL(stats.percentile(90), 900);
+    BOOST_CHECK_EQUAL(stats.percentile(99), 990);
+    BOOST_CHECK_EQUAL(stats.max(), 1000);
+
+    stats.add(5);
+    BOOST_CHECK_EQUAL(stats.percentile(0), 5);
+    BOOST_CHECK_EQUAL(stats.max(), 1000);
+}
+
+BOOST_AUTO_TEST_CASE(TestLatencyStatsMerge)
+{
+    LatencyStats a;
+    a.add(1);
+    a.add(3);
+
+    LatencyStats b;
+    b.add(2);
+    b.add(4);
+
+    a.merge(b);
+    BOOST_CHECK_EQUAL(a.count(), 4);
+    BOOST_CHECK_EQUAL(a.percentile(50), 2);
+    BOOST_CHECK_EQUAL(a.percentile(75), 3);
+    BOOST_CHECK_EQUAL(a.max(), 4);
+
+    LatencyStats c;
+    c.merge(b);
+    BOOST_CHECK_EQUAL(c.percentile(50), 2);
+}
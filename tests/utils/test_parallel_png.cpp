@@ -0,0 +1,217 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Unit test for strip based multi-threaded PNG writer
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestParallelPng
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include "parallel_png.hpp"
+#include "test_transport.hpp"
+
+namespace {
+
+uint32_t get_uint32_be(const uint8_t * p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+// minimal PNG reader: check chunks crc, inflate IDAT and revert filters
+bool decode_png24(const uint8_t * png, size_t size, size_t & width, size_t & height,
+                  std::vector<uint8_t> & rgb, size_t & nb_idat)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    if (size < 8 || memcmp(png, signature, 8)) {
+        return false;
+    }
+
+    std::vector<uint8_t> zdata;
+    nb_idat = 0;
+    bool iend = false;
+    for (size_t pos = 8; pos < size && !iend; ) {
+        const uint32_t len = get_uint32_be(png + pos);
+        const uint8_t * type = png + pos + 4;
+        const uint8_t * data = png + pos + 8;
+        if (crc32(crc32(0, type, 4), data, len) != get_uint32_be(data + len)) {
+            return false;
+        }
+        if (!memcmp(type, "IHDR", 4)) {
+            width  = get_uint32_be(data);
+            height = get_uint32_be(data + 4);
+            if (data[8] != 8 || data[9] != 2) {
+                return false;
+            }
+        }
+        else if (!memcmp(type, "IDAT", 4)) {
+            zdata.insert(zdata.end(), data, data + len);
+            ++nb_idat;
+        }
+        else if (!memcmp(type, "IEND", 4)) {
+            iend = true;
+        }
+        pos += 12 + len;
+    }
+    if (!iend) {
+        return false;
+    }
+
+    const size_t stride = width * 3 + 1;
+    std::vector<uint8_t> raw(stride * height);
+    uLongf raw_size = raw.size();
+    // uncompress checks zlib header and adler32
+    if (uncompress(raw.data(), &raw_size, zdata.data(), zdata.size()) != Z_OK
+    || raw_size != raw.size()) {
+        return false;
+    }
+
+    rgb.assign(width * 3 * height, 0);
+    for (size_t y = 0; y < height; ++y) {
+        const uint8_t filter = raw[y * stride];
+        const uint8_t * src = &raw[y * stride + 1];
+        uint8_t * cur = &rgb[y * width * 3];
+        const uint8_t * prev = y ? cur - width * 3 : nullptr;
+        for (size_t i = 0; i < width * 3; ++i) {
+            const uint8_t a = (i >= 3) ? cur[i - 3] : 0;
+            const uint8_t b = prev ? prev[i] : 0;
+            const uint8_t c = (prev && i >= 3) ? prev[i - 3] : 0;
+            switch (filter) {
+            case 0: cur[i] = src[i]; break;
+            case 1: cur[i] = src[i] + a; break;
+            case 2: cur[i] = src[i] + b; break;
+            case 3: cur[i] = src[i] + ((a + b) >> 1); break;
+            case 4: cur[i] = src[i] + png_parallel_paeth(a, b, c); break;
+            default: return false;
+            }
+        }
+    }
+    return true;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(TestParallelPngRoundTrip)
+{
+    const size_t width   = 101;
+    const size_t height  = 77;
+    const size_t rowsize = width * 3 + 5;  // padded rows
+
+    std::vector<uint8_t> image(rowsize * height);
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            uint8_t * p = &image[y * rowsize + x * 3];
+            p[0] = x * 2;
+            p[1] = y * 3;
+            p[2] = (x * y) ^ 0x5A;
+        }
+    }
+
+    for (uint8_t filter = 0; filter <= PngParallelParams::FILTER_PAETH; ++filter) {
+        for (unsigned nb_threads : { 1, 3 }) {
+            for (bool bgr : { false, true }) {
+                PngParallelParams params;
+                params.filter       = filter;
+                params.nb_threads   = nb_threads;
+                params.strip_height = 16;
+                params.zlib_level   = 1;
+
+                MemoryTransport trans;
+                transport_dump_png24_parallel(trans, image.data(), width, height, rowsize, bgr, params);
+
+                size_t w = 0, h = 0, nb_idat = 0;
+                std::vector<uint8_t> rgb;
+                BOOST_REQUIRE(decode_png24( trans.out_stream.get_data(), trans.out_stream.get_offset()
+                                          , w, h, rgb, nb_idat));
+                BOOST_CHECK_EQUAL(width, w);
+                BOOST_CHECK_EQUAL(height, h);
+                BOOST_CHECK_EQUAL(5, nb_idat);
+
+                bool same = true;
+                for (size_t y = 0; y < height; ++y) {
+                    for (size_t x = 0; x < width; ++x) {
+                        const uint8_t * s = &image[y * rowsize + x * 3];
+                        const uint8_t * d = &rgb[(y * width + x) * 3];
+                        same = same && (d[0] == s[bgr ? 2 : 0]) && (d[1] == s[1]) && (d[2] == s[bgr ? 0 : 2]);
+                    }
+                }
+                BOOST_CHECK(same);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestParallelPngSameOutputWhateverThreads)
+{
+    const size_t width  = 64;
+    const size_t height = 50;
+    std::vector<uint8_t> image(width * 3 * height);
+    for (size_t i = 0; i < image.size(); ++i) {
+        image[i] = (i * 7) ^ (i >> 5);
+    }
+
+    PngParallelParams params;
+    params.strip_height = 8;
+    params.filter       = PngParallelParams::FILTER_PAETH;
+
+    params.nb_threads = 1;
+    MemoryTransport trans1;
+    transport_dump_png24_parallel(trans1, image.data(), width, height, width * 3, true, params);
+
+    params.nb_threads = 4;
+    MemoryTransport trans4;
+    transport_dump_png24_parallel(trans4, image.data(), width, height, width * 3, true, params);
+
+    BOOST_CHECK_EQUAL(trans1.out_stream.get_offset(), trans4.out_stream.get_offset());
+    BOOST_CHECK_EQUAL(0, memcmp( trans1.out_stream.get_data(), trans4.out_stream.get_data()
+                               , trans1.out_stream.get_offset()));
+
+    // a single strip is a plain zlib stream
+    params.strip_height = 0;
+    MemoryTransport trans;
+    transport_dump_png24_parallel(trans, image.data(), width, height, width * 3, false, params);
+    size_t w = 0, h = 0, nb_idat = 0;
+    std::vector<uint8_t> rgb;
+    BOOST_CHECK(decode_png24(trans.out_stream.get_data(), trans.out_stream.get_offset(), w, h, rgb, nb_idat));
+    BOOST_CHECK_EQUAL(1, nb_idat);
+    BOOST_CHECK_EQUAL(0, memcmp(rgb.data(), image.data(), image.size()));
+}
+
+BOOST_AUTO_TEST_CASE(TestParallelPngEncoderFailure)
+{
+    // rows too large to be allocated: strips encoders fail on their threads
+    const size_t width  = size_t(1) << 60;
+    const size_t height = 4;
+    const uint8_t image[3] = {};
+
+    PngParallelParams params;
+    params.strip_height = 2;
+    params.nb_threads   = 2;
+
+    MemoryTransport trans;
+    try {
+        transport_dump_png24_parallel(trans, image, width, height, width * 3, false, params);
+        BOOST_CHECK(false);
+    }
+    catch (Error const & e) {
+        BOOST_CHECK_EQUAL(ERR_BITMAP_PNG_SAVE_FAILED, e.id);
+    }
+}
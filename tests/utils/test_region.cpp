@@ -112,3 +112,118 @@ BOOST_AUTO_TEST_CASE(TestRegion)
     BOOST_CHECK(region3.rects[1].equal(Rect(50, 10, 50, 90))); // B
 
 }
+
+BOOST_AUTO_TEST_CASE(TestRegionBands)
+{
+    // two overlapping rects give 3 bands
+    //   x-----x
+    //   x  A  x
+    //   x   x-x------x
+    //   x B x    C   x
+    //   x---x-x------x
+    //       x   D    x
+    //       x--------x
+    Region region;
+    region.add_rect(Rect(10, 10, 20, 20));
+    region.add_rect(Rect(20, 20, 30, 20));
+    BOOST_CHECK_EQUAL(3, region.rects.size());
+    BOOST_CHECK(region.rects[0].equal(Rect(10, 10, 20, 10))); // A
+    BOOST_CHECK(region.rects[1].equal(Rect(10, 20, 40, 10))); // B + C
+    BOOST_CHECK(region.rects[2].equal(Rect(20, 30, 30, 10))); // D
+    BOOST_CHECK(region.bounds().equal(Rect(10, 10, 40, 30)));
+
+    // adding the same rect again does not add fragments
+    region.add_rect(Rect(20, 20, 30, 20));
+    BOOST_CHECK_EQUAL(3, region.rects.size());
+
+    // touching bands with the same spans are coalesced
+    Region region2;
+    region2.add_rect(Rect(0, 0, 100, 10));
+    region2.add_rect(Rect(0, 10, 100, 10));
+    region2.add_rect(Rect(0, 30, 50, 10));
+    region2.add_rect(Rect(50, 30, 50, 10));
+    BOOST_CHECK_EQUAL(2, region2.rects.size());
+    BOOST_CHECK(region2.rects[0].equal(Rect(0, 0, 100, 20)));
+    BOOST_CHECK(region2.rects[1].equal(Rect(0, 30, 100, 10)));
+
+    region2.add_rect(Rect(0, 20, 100, 10));
+    BOOST_CHECK_EQUAL(1, region2.rects.size());
+    BOOST_CHECK(region2.rects[0].equal(Rect(0, 0, 100, 40)));
+
+    // subtracting then adding back the same rect gives the original rect
+    region2.subtract_rect(Rect(30, 5, 10, 10));
+    BOOST_CHECK_EQUAL(4, region2.rects.size());
+    region2.add_rect(Rect(30, 5, 10, 10));
+    BOOST_CHECK_EQUAL(1, region2.rects.size());
+    BOOST_CHECK(region2.rects[0].equal(Rect(0, 0, 100, 40)));
+
+    region2.intersect_region(region);
+    BOOST_CHECK_EQUAL(3, region2.rects.size());
+    BOOST_CHECK(region2.rects[0].equal(Rect(10, 10, 20, 10)));
+    BOOST_CHECK(region2.rects[1].equal(Rect(10, 20, 40, 10)));
+    BOOST_CHECK(region2.rects[2].equal(Rect(20, 30, 30, 10)));
+
+    region2.intersect_rect(Rect(200, 200, 10, 10));
+    BOOST_CHECK(region2.isempty());
+
+    region.subtract_region(region);
+    BOOST_CHECK(region.isempty());
+}
+
+BOOST_AUTO_TEST_CASE(TestRegionSameAsPixels)
+{
+    // checks region operations against a 64x64 pixels mask
+    const int size = 64;
+    bool mask[size][size] = {};
+    Region region;
+
+    unsigned seed = 42;
+    auto random = [&seed](int n) {
+        seed = seed * 1103515245u + 12345u;
+        return int((seed >> 16) % n);
+    };
+
+    for (int n = 0; n < 300; ++n) {
+        const Rect rect(random(size), random(size), random(size / 2) + 1, random(size / 2) + 1);
+        const int op = random(3);
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                const bool in = rect.contains_pt(x, y);
+                mask[y][x] = (op == 0) ? (mask[y][x] || in)
+                           : (op == 1) ? (mask[y][x] && !in)
+                           : (mask[y][x] && (in || n % 7));
+            }
+        }
+        if (op == 0) {
+            region.add_rect(rect);
+        }
+        else if (op == 1) {
+            region.subtract_rect(rect);
+        }
+        else if (!(n % 7)) {
+            region.intersect_rect(rect);
+        }
+
+        bool same = true;
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                int count = 0;
+                for (const Rect & r : region.rects) {
+                    count += r.contains_pt(x, y);
+                }
+                same = same && (count == (mask[y][x] ? 1 : 0));
+            }
+        }
+        BOOST_CHECK(same);
+
+        // banded and coalesced
+        bool banded = true;
+        for (size_t i = 1; i < region.rects.size(); ++i) {
+            const Rect & prev = region.rects[i - 1];
+            const Rect & r = region.rects[i];
+            banded = banded && ((prev.y == r.y && prev.cy == r.cy && prev.right() < r.x)
+                             || prev.bottom() <= r.y);
+        }
+        BOOST_CHECK(banded);
+    }
+}
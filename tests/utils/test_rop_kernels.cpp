@@ -0,0 +1,161 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Unit test of vectorised raster operation kernels
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestRopKernels
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include "drawable.hpp"
+#include "difftimeval.hpp"
+
+namespace {
+
+const size_t max_len = 200;
+
+struct Buffers
+{
+    uint8_t dest[max_len];
+    uint8_t ref[max_len];
+    uint8_t src[max_len];
+
+    Buffers()
+    {
+        for (size_t i = 0; i < max_len; ++i) {
+            this->dest[i] = this->ref[i] = uint8_t(i * 37 + 11);
+            this->src[i] = uint8_t(i * 101 + (i >> 3));
+        }
+    }
+};
+
+template<class Op>
+bool check_binary(Op op)
+{
+    bool ok = true;
+    for (size_t n = 0; n < max_len; ++n) {
+        Buffers b16;
+        Buffers b32;
+        for (size_t i = 0; i < n; ++i) {
+            b16.ref[i] = op(b16.ref[i], b16.src[i]);
+        }
+        rop_kernels::binary_rows<rop_kernels::vec16>(b16.dest, 0, b16.src, 0, n, 1, op);
+        rop_kernels::binary(b32.dest, 0, b32.src, 0, n, 1, op);
+        ok = ok && !memcmp(b16.dest, b16.ref, max_len) && !memcmp(b32.dest, b16.ref, max_len);
+    }
+    return ok;
+}
+
+template<size_t Bpp, class Op>
+bool check_pattern(Op op)
+{
+    uint8_t pixel[Bpp];
+    for (size_t i = 0; i < Bpp; ++i) {
+        pixel[i] = uint8_t(0x5A + i * 0x33);
+    }
+    bool ok = true;
+    for (size_t n = 0; n < max_len; ++n) {
+        Buffers b16;
+        Buffers b32;
+        Buffers t16;
+        Buffers t32;
+        for (size_t i = 0; i < n; ++i) {
+            b16.ref[i] = op(b16.ref[i], pixel[i % Bpp]);
+            t16.ref[i] = Ops::Op_0xB8()(t16.ref[i], t16.src[i], pixel[i % Bpp]);
+        }
+        rop_kernels::pattern_rows<rop_kernels::vec16>(b16.dest, 0, pixel, n, 1, op);
+        rop_kernels::pattern(b32.dest, 0, pixel, n, 1, op);
+        rop_kernels::ternary_rows<rop_kernels::vec16>(t16.dest, 0, t16.src, 0, pixel, n, 1, Ops::Op_0xB8());
+        rop_kernels::ternary(t32.dest, 0, t32.src, 0, pixel, n, 1, Ops::Op_0xB8());
+        ok = ok && !memcmp(b16.dest, b16.ref, max_len) && !memcmp(b32.dest, b16.ref, max_len)
+                && !memcmp(t16.dest, t16.ref, max_len) && !memcmp(t32.dest, t16.ref, max_len);
+    }
+    return ok;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(TestRopKernelsSameAsBytes)
+{
+    BOOST_CHECK(check_binary(Ops::InvertSrc()));  // 0x33
+    BOOST_CHECK(check_binary(Ops::Op_0x66()));    // SRCINVERT
+    BOOST_CHECK(check_binary(Ops::Op_0x88()));    // SRCAND
+    BOOST_CHECK(check_binary(Ops::Op_0x11()));
+    BOOST_CHECK(check_binary(Ops::Op_0xDD()));
+    BOOST_CHECK(check_binary(Ops::Op2_0x01()));
+    BOOST_CHECK(check_binary(Ops::Op2_0x10()));
+
+    BOOST_CHECK(check_pattern<1>(Ops::Op_0x5A()));  // PATINVERT
+    BOOST_CHECK(check_pattern<2>(Ops::Op_0x5A()));
+    BOOST_CHECK(check_pattern<3>(Ops::Op_0x5A()));
+    BOOST_CHECK(check_pattern<4>(Ops::Op_0x5A()));
+    BOOST_CHECK(check_pattern<3>(Ops::Op_0xA0()));
+    BOOST_CHECK(check_pattern<3>(Ops::Op_0xF5()));
+}
+
+BOOST_AUTO_TEST_CASE(TestRopKernelsThroughput)
+{
+    const uint16_t width = 1024;
+    const uint16_t height = 768;
+    const Rect screen(0, 0, width, height);
+    const unsigned iterations = 20;
+    const double mpixels = double(width) * height * iterations / 1000000.;
+
+    DrawableImpl<DepthColor::color24> drawable(width, height);
+    const auto color = DrawableImpl<DepthColor::color24>::traits::u32_to_color(0x3366CC);
+
+    std::unique_ptr<uint8_t[]> raw(new uint8_t[width * height * 3]);
+    for (size_t i = 0; i < size_t(width) * height * 3; ++i) {
+        raw[i] = uint8_t(i * 7);
+    }
+    Bitmap bmp(24, 24, nullptr, width, height, raw.get(), width * height * 3);
+
+    struct Bench {
+        const char * name;
+        uint64_t usec;
+    } results[7];
+    Bench * result = results;
+
+    auto bench = [&](const char * name, std::function<void()> f) {
+        const uint64_t start = ustime();
+        for (unsigned n = 0; n < iterations; ++n) {
+            f();
+        }
+        *result++ = {name, ustime() - start};
+    };
+
+    bench("0xCC SRCCOPY",   [&]{ drawable.mem_blt(screen, bmp, 0, 0, Ops::Op_0xCC()); });
+    bench("0x55 DSTINVERT", [&]{ drawable.invert_color(screen); });
+    bench("0xF0 PATCOPY",   [&]{ drawable.patblt_op(screen, color, Ops::Op_0xF0()); });
+    bench("0x5A PATINVERT", [&]{ drawable.patblt_op(screen, color, Ops::Op_0x5A()); });
+    bench("0x66 SRCINVERT", [&]{ drawable.mem_blt(screen, bmp, 0, 0, Ops::Op_0x66()); });
+    bench("0xB8 PSDPxax",   [&]{ drawable.mem_blt(screen, bmp, 0, 0, Ops::Op_0xB8(), color); });
+    bench("0x88 SRCAND",    [&]{ drawable.mem_blt(screen, bmp, 0, 0, Ops::Op_0x88()); });
+
+    printf("avx2: %s\n", rop_kernels::has_avx2() ? "yes" : "no");
+    for (Bench & b : results) {
+        printf("%-16s %8.1f Mpixel/s\n", b.name, mpixels * 1000000. / double(b.usec ? b.usec : 1));
+    }
+
+    BOOST_CHECK(true);
+}
@@ -0,0 +1,282 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *   Product name: redemption, a FLOSS RDP proxy
+ *   Copyright (C) Wallix 2014
+ *   Author(s): Christophe Grosjean, Raphael Zhou, Jonathan Poelen, Meng Tan
+ */
+
+#ifndef REDEMPTION_TRANSPORT_DETAIL_META_INDEX_HPP
+#define REDEMPTION_TRANSPORT_DETAIL_META_INDEX_HPP
+
+#include "fdbuf.hpp"
+#include "fileutils.hpp"
+
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Binary index of a .mwrm file ("<mwrm>.idx"), written along the .mwrm
+// lines: a header then one fixed-size record per wrm file, ordered by time.
+// All integers are little endian.
+//
+// header (16 bytes)
+//   "MWRI"       4 bytes
+//   version      2 bytes
+//   record size  2 bytes
+//   width        2 bytes
+//   height       2 bytes
+//   pad          4 bytes
+//
+// record (32 bytes)
+//   start_sec    4 bytes
+//   stop_sec     4 bytes
+//   line_offset  8 bytes  offset of the line of the wrm file in the .mwrm
+//   file_size    8 bytes  size of the wrm file
+//   line_size    4 bytes  size of the line, with its '\n'
+//   pad          4 bytes
+//
+// Hashes of the wrm files are only in the .mwrm lines.
+
+namespace detail
+{
+    struct MetaIndexRecord
+    {
+        uint32_t start_sec = 0;
+        uint32_t stop_sec = 0;
+        uint64_t line_offset = 0;
+        uint64_t file_size = 0;
+        uint32_t line_size = 0;
+    };
+
+    struct MetaIndexFormat
+    {
+        enum {
+            VERSION = 1,
+            HEADER_SIZE = 16,
+            RECORD_SIZE = 32
+        };
+
+        static void put_le(uint8_t * p, uint64_t value, unsigned nbytes)
+        {
+            for (unsigned i = 0; i < nbytes; ++i, value >>= 8) {
+                p[i] = uint8_t(value);
+            }
+        }
+
+        static uint64_t get_le(const uint8_t * p, unsigned nbytes)
+        {
+            uint64_t value = 0;
+            for (unsigned i = nbytes; i > 0; --i) {
+                value = (value << 8) | p[i - 1];
+            }
+            return value;
+        }
+
+        static void write_header(uint8_t (&buf)[HEADER_SIZE], uint16_t width, uint16_t height)
+        {
+            memset(buf, 0, sizeof(buf));
+            memcpy(buf, "MWRI", 4);
+            put_le(buf + 4, VERSION, 2);
+            put_le(buf + 6, RECORD_SIZE, 2);
+            put_le(buf + 8, width, 2);
+            put_le(buf + 10, height, 2);
+        }
+
+        static void write_record(uint8_t (&buf)[RECORD_SIZE], MetaIndexRecord const & record)
+        {
+            put_le(buf, record.start_sec, 4);
+            put_le(buf + 4, record.stop_sec, 4);
+            put_le(buf + 8, record.line_offset, 8);
+            put_le(buf + 16, record.file_size, 8);
+            put_le(buf + 24, record.line_size, 4);
+            put_le(buf + 28, 0, 4);
+        }
+
+        static MetaIndexRecord read_record(const uint8_t * buf)
+        {
+            MetaIndexRecord record;
+            record.start_sec = get_le(buf, 4);
+            record.stop_sec = get_le(buf + 4, 4);
+            record.line_offset = get_le(buf + 8, 8);
+            record.file_size = get_le(buf + 16, 8);
+            record.line_size = get_le(buf + 24, 4);
+            return record;
+        }
+    };
+
+    struct MetaIndexFilename
+    {
+        char filename[2048];
+
+        explicit MetaIndexFilename(const char * meta_filename)
+        {
+            const int res = snprintf(this->filename, sizeof(this->filename), "%s.idx", meta_filename);
+            if (res < 0 || res >= int(sizeof(this->filename))) {
+                this->filename[0] = 0;
+            }
+        }
+    };
+
+    class MetaIndexWriter
+    {
+        io::posix::fdbuf file;
+
+    public:
+        /// \return -1 on error
+        int open(const char * meta_filename, mode_t mode, uint16_t width, uint16_t height)
+        {
+            MetaIndexFilename index_filename(meta_filename);
+            if (!index_filename.filename[0]
+             || this->file.open(index_filename.filename, O_WRONLY | O_CREAT | O_TRUNC, mode) < 0) {
+                return -1;
+            }
+            uint8_t header[MetaIndexFormat::HEADER_SIZE];
+            MetaIndexFormat::write_header(header, width, height);
+            if (this->file.write(header, sizeof(header)) != ssize_t(sizeof(header))) {
+                this->file.close();
+                return -1;
+            }
+            return 0;
+        }
+
+        bool is_open() const
+        { return this->file.is_open(); }
+
+        ssize_t write(MetaIndexRecord const & record)
+        {
+            uint8_t buf[MetaIndexFormat::RECORD_SIZE];
+            MetaIndexFormat::write_record(buf, record);
+            return this->file.write(buf, sizeof(buf));
+        }
+
+        int close()
+        { return this->file.close(); }
+    };
+
+    // Read-only mapping of the index of a .mwrm. The index is ignored
+    // (is_valid() is false) when it does not describe the whole .mwrm.
+    class MetaIndex
+    {
+        void * map = nullptr;
+        size_t map_size = 0;
+        size_t count = 0;
+
+        const uint8_t * record_data(size_t i) const
+        {
+            return static_cast<const uint8_t *>(this->map)
+                 + MetaIndexFormat::HEADER_SIZE + i * MetaIndexFormat::RECORD_SIZE;
+        }
+
+        void unmap()
+        {
+            if (this->map) {
+                munmap(this->map, this->map_size);
+                this->map = nullptr;
+            }
+            this->count = 0;
+        }
+
+    public:
+        MetaIndex() = default;
+
+        explicit MetaIndex(const char * meta_filename)
+        {
+            this->open(meta_filename);
+        }
+
+        MetaIndex(MetaIndex const &) = delete;
+        MetaIndex & operator=(MetaIndex const &) = delete;
+
+        ~MetaIndex()
+        {
+            this->unmap();
+        }
+
+        bool open(const char * meta_filename)
+        {
+            this->unmap();
+
+            MetaIndexFilename index_filename(meta_filename);
+            if (!index_filename.filename[0]) {
+                return false;
+            }
+            const int fd = ::open(index_filename.filename, O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat st;
+            if (fstat(fd, &st) || size_t(st.st_size) < size_t(MetaIndexFormat::HEADER_SIZE)
+             || (st.st_size - MetaIndexFormat::HEADER_SIZE) % MetaIndexFormat::RECORD_SIZE) {
+                ::close(fd);
+                return false;
+            }
+            void * map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (map == MAP_FAILED) {
+                return false;
+            }
+            this->map = map;
+            this->map_size = st.st_size;
+            this->count = (st.st_size - MetaIndexFormat::HEADER_SIZE) / MetaIndexFormat::RECORD_SIZE;
+
+            const uint8_t * header = static_cast<const uint8_t *>(this->map);
+            const int meta_size = filesize(meta_filename);
+            const bool ok = !memcmp(header, "MWRI", 4)
+                && MetaIndexFormat::get_le(header + 4, 2) == MetaIndexFormat::VERSION
+                && MetaIndexFormat::get_le(header + 6, 2) == MetaIndexFormat::RECORD_SIZE
+                && this->count
+                && meta_size >= 0
+                && [&]{
+                    const MetaIndexRecord last = this->record(this->count - 1);
+                    return last.line_offset + last.line_size == uint64_t(meta_size);
+                }();
+            if (!ok) {
+                this->unmap();
+            }
+            return ok;
+        }
+
+        bool is_valid() const
+        { return this->count; }
+
+        size_t size() const
+        { return this->count; }
+
+        MetaIndexRecord record(size_t i) const
+        { return MetaIndexFormat::read_record(this->record_data(i)); }
+
+        /// \return index of the first record ending after sec, size() if none
+        size_t find(uint32_t sec) const
+        {
+            size_t first = 0;
+            size_t last = this->count;
+            while (first < last) {
+                const size_t middle = first + (last - first) / 2;
+                if (MetaIndexFormat::get_le(this->record_data(middle) + 4, 4) <= sec) {
+                    first = middle + 1;
+                }
+                else {
+                    last = middle;
+                }
+            }
+            return first;
+        }
+    };
+}
+
+#endif
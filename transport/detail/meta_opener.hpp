@@ -86,6 +86,13 @@ namespace detail
             return total_read;
         }
 
+        /// forgets the buffered data, after a seek of the reader
+        void reset() /*noexcept*/
+        {
+            this->eof = this->buf;
+            this->cur = this->buf;
+        }
+
         int next_line() /*noexcept*/
         {
             char * pos;
@@ -227,6 +234,20 @@ namespace detail
             return this->next_line();
         }
 
+        /// The next line read is at offset in the .mwrm.
+        /// \return 0 if success
+        int seek_line(uint64_t offset)
+        {
+            if (this->is_open()) {
+                this->Buf::close();
+            }
+            if (this->buf_meta.seek(offset, SEEK_SET) < 0) {
+                return -1;
+            }
+            this->reader.reset();
+            return 0;
+        }
+
     private:
         int open_next() {
             if (const int e = this->next_line()) {
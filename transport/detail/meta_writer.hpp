@@ -23,11 +23,13 @@
 
 #include "sequence_generator.hpp"
 #include "no_param.hpp"
+#include "meta_index.hpp"
 #include "error.hpp"
 #include "log.hpp"
 #include "auth_api.hpp"
 
 #include <limits>
+#include <algorithm>
 #include <cerrno>
 #include <ctime>
 #include <stdint.h>
@@ -265,6 +267,10 @@ namespace detail
 
         BufMeta meta_buf_;
 
+        MetaIndexWriter index_;
+        // size of the .mwrm, only maintained when index_ is open
+        uint64_t meta_size_;
+
     protected:
         detail::MetaFilename mf_;
         time_t start_sec_;
@@ -275,6 +281,7 @@ namespace detail
         out_meta_sequence_filename_buf(out_meta_sequence_filename_buf_param<T> const & params)
         : sequence_base_type(params.sq_params)
         , meta_buf_(params.meta_buf_params)
+        , meta_size_(0)
         , mf_(params.sq_params.prefix, params.sq_params.filename, params.sq_params.format)
         , start_sec_(params.sec)
         , stop_sec_(params.sec)
@@ -293,9 +300,24 @@ namespace detail
         {
             const int res1 = this->next();
             const int res2 = (this->meta_buf().is_open() ? this->meta_buf_.close() : 0);
+            this->index_.close();
             return res1 ? res1 : res2;
         }
 
+        /// Writes the binary index of the .mwrm (see meta_index.hpp) from now on,
+        /// the .mwrm headers must be written.
+        /// \return 0 if success
+        int open_index(uint16_t width, uint16_t height)
+        {
+            const off_t meta_size = this->meta_buf_.seek(0, SEEK_CUR);
+            if (meta_size < 0 || this->index_.open(this->mf_.filename, S_IRUSR, width, height) < 0) {
+                LOG(LOG_WARNING, "Can't create index of %s : %s", this->mf_.filename, strerror(errno));
+                return -1;
+            }
+            this->meta_size_ = meta_size;
+            return 0;
+        }
+
         /// \return 0 if success
         int next() /*noexcept*/
         {
@@ -306,7 +328,8 @@ namespace detail
                 if (!filename) {
                     return 1;
                 }
-                ssize_t len = strlen(filename);
+                const ssize_t filename_len = strlen(filename);
+                ssize_t len = filename_len;
                 ssize_t res = this->meta_buf_.write(filename, len);
                 if (res == len) {
                     char mes[(std::numeric_limits<unsigned>::digits10 + 1) * 2 + 4];
@@ -316,6 +339,20 @@ namespace detail
                 if (res < len) {
                     return res < 0 ? res : 1;
                 }
+                if (this->index_.is_open()) {
+                    MetaIndexRecord record;
+                    record.start_sec = this->start_sec_;
+                    record.stop_sec = this->stop_sec_ + 1;
+                    record.line_offset = this->meta_size_;
+                    record.line_size = filename_len + len;
+                    record.file_size = std::max(filesize(filename), 0);
+                    if (this->index_.write(record) != MetaIndexFormat::RECORD_SIZE) {
+                        // an incomplete index is ignored by readers
+                        LOG(LOG_WARNING, "Write to index of %s failed, index disabled", this->mf_.filename);
+                        this->index_.close();
+                    }
+                    this->meta_size_ += record.line_size;
+                }
                 this->start_sec_ = this->stop_sec_;
                 return 0;
             }
@@ -326,6 +363,10 @@ namespace detail
         {
             this->sequence_base_type::request_full_cleaning();
             ::unlink(this->mf_.filename);
+            if (this->index_.is_open()) {
+                this->index_.close();
+                ::unlink(MetaIndexFilename(this->mf_.filename).filename);
+            }
         }
 
         int flush() /*noexcept*/
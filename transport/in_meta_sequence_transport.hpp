@@ -22,6 +22,7 @@
 #define REDEMPTION_TRANSPORT_IN_META_SEQUENCE_TRANSPORT_HPP
 
 #include "detail/meta_opener.hpp"
+#include "detail/meta_index.hpp"
 #include "mixin_transport.hpp"
 // #include "buffer/buffering_buf.hpp"
 #include "buffer/file_buf.hpp"
@@ -36,16 +37,43 @@ struct InMetaSequenceTransport
     InMetaSequenceTransport(const char * filename, const char * extension, uint32_t verbose = 0)
     : InMetaSequenceTransport::TransportType(
         detail::in_meta_sequence_buf_param<>(detail::temporary_concat(filename, extension).str, verbose))
+    , index_(detail::temporary_concat(filename, extension).str)
     {
         this->verbose = verbose;
     }
 
     InMetaSequenceTransport(const char * filename, uint32_t verbose = 0) /*noexcept*/
     : InMetaSequenceTransport::TransportType(detail::in_meta_sequence_buf_param<>(filename, verbose))
+    , index_(filename)
     {
         this->verbose = verbose;
     }
 
+    /// Binary index of the .mwrm, not valid when there is none.
+    const detail::MetaIndex & index() const /*noexcept*/
+    { return this->index_; }
+
+    /// With the index, the next call to next() opens the first wrm file
+    /// ending after sec, seqno is the one of a linear walk.
+    /// \return false when there is no index
+    bool seek_to_time(unsigned sec)
+    {
+        if (!this->index_.is_valid()) {
+            return false;
+        }
+        const size_t i = this->index_.find(sec);
+        const detail::MetaIndexRecord record = this->index_.record(std::min(i, this->index_.size() - 1));
+        const uint64_t offset = (i < this->index_.size())
+            ? record.line_offset
+            : record.line_offset + record.line_size;
+        if (this->buffer().seek_line(offset)) {
+            throw Error(ERR_TRANSPORT_READ_FAILED, errno);
+        }
+        this->seqno = i;
+        this->status = true;
+        return true;
+    }
+
     unsigned begin_chunk_time() const /*noexcept*/
     { return this->buffer().get_begin_chunk_time(); }
 
@@ -54,6 +82,9 @@ struct InMetaSequenceTransport
 
     const char * path() const /*noexcept*/
     { return this->buffer().current_path(); }
+
+private:
+    detail::MetaIndex index_;
 };
 
 #endif
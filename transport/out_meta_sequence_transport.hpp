@@ -61,6 +61,13 @@ RequestCleaningTransport<
         detail::write_meta_headers(this->buffer().meta_buf(), path, width, height, this->authentifier);
     }
 
+    /// Also writes a binary index of the .mwrm (see detail/meta_index.hpp),
+    /// to call before the first next().
+    bool open_index(uint16_t width, uint16_t height)
+    {
+        return !this->buffer().open_index(width, height);
+    }
+
     virtual void timestamp(timeval now) /*noexcept*/
     {
         this->buffer().update_sec(now.tv_sec);
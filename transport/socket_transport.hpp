@@ -29,9 +29,11 @@
 #include "fileutils.hpp"
 #include "openssl_crypto.hpp"
 #include "openssl_tls.hpp"
+#include "tls_context.hpp"
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 
 #include <memory>
 #include <string>
@@ -140,7 +142,7 @@ public:
             this->disconnect();
         }
         if (this->allocated_ssl) {
-            //SSL_shutdown(this->allocated_ssl);
+            this->quiet_shutdown();
             SSL_free(this->allocated_ssl);
         }
 
@@ -171,243 +173,17 @@ public:
         }
         LOG(LOG_INFO, "SocketTransport::enable_server_tls() start");
 
-        // SSL_CTX_new - create a new SSL_CTX object as framework for TLS/SSL enabled functions
-        // ------------------------------------------------------------------------------------
-
-        // SSL_CTX_new() creates a new SSL_CTX object as framework to establish TLS/SSL enabled
-        // connections.
-
-        // The SSL_CTX data structure is the global context structure which is created by a server
-        // or client *once* per program life-time and which holds mainly default values for the SSL
-        // structures which are later created for the connections.
-
-        // Various options regarding certificates, algorithms, etc. can be set in this object.
-
-        // SSL_CTX_new() receive a data structure of type SSL_METHOD (SSL Method), which is
-        // a dispatch structure describing the internal ssl library methods/functions which
-        // implement the various protocol versions (SSLv1, SSLv2 and TLSv1). An SSL_METHOD
-        // is necessary to create an SSL_CTX.
-
-        // The SSL_CTX object uses method as connection method. The methods exist in a generic
-        // type (for client and server use), a server only type, and a client only type. method
-        // can be of several types (server, client, generic, support SSLv2, TLSv1, TLSv1.1, etc.)
-
-        // TLSv1_client_method(void): A TLS/SSL connection established with this methods will
-        // only understand the TLSv1 protocol. A client will send out TLSv1 client hello messages
-        // and will indicate that it only understands TLSv1.
-
-        BIO * bio_err = BIO_new_fp(stderr, BIO_NOCLOSE);
-
-        SSL_CTX* ctx = SSL_CTX_new(SSLv23_server_method());
-        this->allocated_ctx = ctx;
-
-        /*
-         * This is necessary, because the Microsoft TLS implementation is not perfect.
-         * SSL_OP_ALL enables a couple of workarounds for buggy TLS implementations,
-         * but the most important workaround being SSL_OP_TLS_BLOCK_PADDING_BUG.
-         * As the size of the encrypted payload may give hints about its contents,
-         * block padding is normally used, but the Microsoft TLS implementation
-         * won't recognize it and will disconnect you after sending a TLS alert.
-         */
-
-        // SSL_CTX_set_options() adds the options set via bitmask in options to ctx.
-        // Options already set before are not cleared!
-
-         // During a handshake, the option settings of the SSL object are used. When
-         // a new SSL object is created from a context using SSL_new(), the current
-         // option setting is copied. Changes to ctx do not affect already created
-         // SSL objects. SSL_clear() does not affect the settings.
-
-         // The following bug workaround options are available:
-
-         // SSL_OP_MICROSOFT_SESS_ID_BUG
-
-         // www.microsoft.com - when talking SSLv2, if session-id reuse is performed,
-         // the session-id passed back in the server-finished message is different
-         // from the one decided upon.
-
-         // SSL_OP_NETSCAPE_CHALLENGE_BUG
-
-         // Netscape-Commerce/1.12, when talking SSLv2, accepts a 32 byte challenge
-         // but then appears to only use 16 bytes when generating the encryption keys.
-         // Using 16 bytes is ok but it should be ok to use 32. According to the SSLv3
-         // spec, one should use 32 bytes for the challenge when operating in SSLv2/v3
-         // compatibility mode, but as mentioned above, this breaks this server so
-         // 16 bytes is the way to go.
-
-         // SSL_OP_NETSCAPE_REUSE_CIPHER_CHANGE_BUG
-
-         // As of OpenSSL 0.9.8q and 1.0.0c, this option has no effect.
-
-        // SSL_OP_SSLREF2_REUSE_CERT_TYPE_BUG
-
-        //  ...
-
-        // SSL_OP_MICROSOFT_BIG_SSLV3_BUFFER
-
-        // ...
-
-        // SSL_OP_MSIE_SSLV2_RSA_PADDING
-
-        // As of OpenSSL 0.9.7h and 0.9.8a, this option has no effect.
-
-        // SSL_OP_SSLEAY_080_CLIENT_DH_BUG
-        // ...
-
-        // SSL_OP_TLS_D5_BUG
-        //    ...
-
-        // SSL_OP_TLS_BLOCK_PADDING_BUG
-        //   ...
-
-        // SSL_OP_DONT_INSERT_EMPTY_FRAGMENTS
-
-        // Disables a countermeasure against a SSL 3.0/TLS 1.0 protocol vulnerability
-        // affecting CBC ciphers, which cannot be handled by some broken SSL implementations.
-        // This option has no effect for connections using other ciphers.
-
-        // SSL_OP_ALL
-        // All of the above bug workarounds.
-
-        // It is usually safe to use SSL_OP_ALL to enable the bug workaround options if
-        // compatibility with somewhat broken implementations is desired.
-
-        // The following modifying options are available:
-
-        // SSL_OP_TLS_ROLLBACK_BUG
-
-        // Disable version rollback attack detection.
-
-        // During the client key exchange, the client must send the same information about
-        // acceptable SSL/TLS protocol levels as during the first hello. Some clients violate
-        // this rule by adapting to the server's answer. (Example: the client sends a SSLv2
-        // hello and accepts up to SSLv3.1=TLSv1, the server only understands up to SSLv3.
-        // In this case the client must still use the same SSLv3.1=TLSv1 announcement. Some
-        // clients step down to SSLv3 with respect to the server's answer and violate the
-        // version rollback protection.)
-
-        // SSL_OP_SINGLE_DH_USE
-
-        // Always create a new key when using temporary/ephemeral DH parameters (see
-        // SSL_CTX_set_tmp_dh_callback(3)). This option must be used to prevent small subgroup
-        // attacks, when the DH parameters were not generated using ``strong'' primes (e.g.
-        // when using DSA-parameters, see dhparam(1)). If ``strong'' primes were used, it is
-        // not strictly necessary to generate a new DH key during each handshake but it is
-        // also recommended. SSL_OP_SINGLE_DH_USE should therefore be enabled whenever
-        // temporary/ephemeral DH parameters are used.
-
-        // SSL_OP_EPHEMERAL_RSA
-
-        // Always use ephemeral (temporary) RSA key when doing RSA operations (see
-        // SSL_CTX_set_tmp_rsa_callback(3)). According to the specifications this is only done,
-        // when a RSA key can only be used for signature operations (namely under export ciphers
-        // with restricted RSA keylength). By setting this option, ephemeral RSA keys are always
-        // used. This option breaks compatibility with the SSL/TLS specifications and may lead
-        // to interoperability problems with clients and should therefore never be used. Ciphers
-        // with EDH (ephemeral Diffie-Hellman) key exchange should be used instead.
-
-        // SSL_OP_CIPHER_SERVER_PREFERENCE
-
-        // When choosing a cipher, use the server's preferences instead of the client preferences.
-        // When not set, the SSL server will always follow the clients preferences. When set, the
-        // SSLv3/TLSv1 server will choose following its own preferences. Because of the different
-        // protocol, for SSLv2 the server will send its list of preferences to the client and the
-        // client chooses.
-
-        // SSL_OP_PKCS1_CHECK_1
-        //  ...
-
-        // SSL_OP_PKCS1_CHECK_2
-        //  ...
-
-        // SSL_OP_NETSCAPE_CA_DN_BUG
-        // If we accept a netscape connection, demand a client cert, have a non-this-signed CA
-        // which does not have its CA in netscape, and the browser has a cert, it will crash/hang.
-        // Works for 3.x and 4.xbeta
-
-        // SSL_OP_NETSCAPE_DEMO_CIPHER_CHANGE_BUG
-        //    ...
-
-        // SSL_OP_NO_SSLv2
-        // Do not use the SSLv2 protocol.
-
-        // SSL_OP_NO_SSLv3
-        // Do not use the SSLv3 protocol.
-
-        // SSL_OP_NO_TLSv1
-
-        // Do not use the TLSv1 protocol.
-        // SSL_OP_NO_SESSION_RESUMPTION_ON_RENEGOTIATION
-
-        // When performing renegotiation as a server, always start a new session (i.e., session
-        // resumption requests are only accepted in the initial handshake). This option is not
-        // needed for clients.
-
-        // SSL_OP_NO_TICKET
-        // Normally clients and servers will, where possible, transparently make use of RFC4507bis
-        // tickets for stateless session resumption.
-
-        // If this option is set this functionality is disabled and tickets will not be used by
-        // clients or servers.
-
-        // SSL_OP_ALLOW_UNSAFE_LEGACY_RENEGOTIATION
-
-        // Allow legacy insecure renegotiation between OpenSSL and unpatched clients or servers.
-        // See the SECURE RENEGOTIATION section for more details.
-
-        // SSL_OP_LEGACY_SERVER_CONNECT
-        // Allow legacy insecure renegotiation between OpenSSL and unpatched servers only: this option
-        // is currently set by default. See the SECURE RENEGOTIATION section for more details.
-
-        LOG(LOG_INFO, "SocketTransport::SSL_CTX_set_options()");
-        SSL_CTX_set_options(ctx, SSL_OP_ALL);
-        SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2);
-        SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv3);
-
-//        LOG(LOG_INFO, "SocketTransport::SSL_CTX_set_ciphers(HIGH:!ADH:!3DES)");
-//        SSL_CTX_set_cipher_list(ctx, "ALL:!aNULL:!eNULL:!ADH:!EXP");
-// Not compatible with MSTSC 6.1 on XP and W2K3
-//        SSL_CTX_set_cipher_list(ctx, "HIGH:!ADH:!3DES");
-
-        // -------- End of system wide SSL_Ctx option ----------------------------------
-
-        // --------Start of session specific init code ---------------------------------
-
-        /* Load our keys and certificates*/
-        if(!(SSL_CTX_use_certificate_chain_file(ctx, CFG_PATH "/rdpproxy.crt")))
-        {
-            BIO_printf(bio_err, "Can't read certificate file\n");
-            ERR_print_errors(bio_err);
-            exit(0);
-        }
-
-        SSL_CTX_set_default_passwd_cb(ctx, password_cb0);
-        SSL_CTX_set_default_passwd_cb_userdata(ctx, const_cast<void*>(static_cast<const void*>(certificate_password)));
-        if(!(SSL_CTX_use_PrivateKey_file(ctx, CFG_PATH "/rdpproxy.key", SSL_FILETYPE_PEM)))
-        {
-            BIO_printf(bio_err,"Can't read key file\n");
-            ERR_print_errors(bio_err);
-            exit(0);
-        }
-
-        DH *ret=0;
-        BIO *bio;
-
-        if ((bio=BIO_new_file(CFG_PATH "/" DH_PEM,"r")) == NULL){
-            BIO_printf(bio_err,"Couldn't open DH file\n");
-            ERR_print_errors(bio_err);
-            exit(0);
+        // context is normally preloaded by listener (see TLSServerContext),
+        // it is built here only for processes that did not preload it
+        SSL_CTX * ctx = TLSServerContext::get();
+        if (!ctx) {
+            ctx = TLSServerContext::create(certificate_password);
+            if (!ctx) {
+                throw Error(ERR_TRANSPORT_TLS_SERVER);
+            }
+            this->allocated_ctx = ctx;
         }
 
-        ret = PEM_read_bio_DHparams(bio, NULL, NULL, NULL);
-        BIO_free(bio);
-        if(SSL_CTX_set_tmp_dh(ctx, ret)<0)
-        {
-            BIO_printf(bio_err,"Couldn't set DH parameters\n");
-            ERR_print_errors(bio_err);
-            exit(0);
-        }
-        DH_free(ret);
         // SSL_new() creates a new SSL structure which is needed to hold the data for a TLS/SSL
         // connection. The new structure inherits the settings of the underlying context ctx:
         // - connection method (SSLv2/v3/TLSv1),
@@ -422,27 +198,79 @@ public:
         SSL * ssl = SSL_new(ctx);
         this->allocated_ssl = ssl;
 
-        TODO("I should probably not be doing that here ? Is it really necessary");
-        int flags = fcntl(this->sck, F_GETFL);
-        fcntl(this->sck, F_SETFL, flags & ~(O_NONBLOCK));
-
         SSL_set_bio(ssl, sbio, sbio);
 
-        int r = SSL_accept(ssl);
-        if(r <= 0)
-        {
-            BIO_printf(bio_err, "SSL accept error\n");
-            ERR_print_errors(bio_err);
-            exit(0);
+        // handshake is run on non blocking socket to bound its duration
+        int flags = fcntl(this->sck, F_GETFL);
+        fcntl(this->sck, F_SETFL, flags | O_NONBLOCK);
+        const bool accepted = this->nonblocking_handshake(ssl, SSL_accept, HANDSHAKE_TIMEOUT);
+        TODO("I should probably not be doing that here ? Is it really necessary");
+        fcntl(this->sck, F_SETFL, flags & ~(O_NONBLOCK));
+        if (!accepted) {
+            LOG(LOG_ERR, "SocketTransport::enable_server_tls() SSL accept error");
+            throw Error(ERR_TRANSPORT_TLS_SERVER);
+        }
+        if (SSL_session_reused(ssl)) {
+            LOG(LOG_INFO, "SocketTransport::enable_server_tls() session resumed");
         }
 
         this->io = ssl;
         this->tls = true;
 
-        BIO_free(bio_err);
         LOG(LOG_INFO, "SocketTransport::enable_server_tls() done");
     }
 
+    // in seconds
+    enum { HANDSHAKE_TIMEOUT = 30 };
+
+private:
+    // marks connection as closed without sending close_notify, otherwise
+    // SSL_free() considers the session as bad and removes it from cache
+    void quiet_shutdown()
+    {
+        SSL_set_quiet_shutdown(this->allocated_ssl, 1);
+        SSL_shutdown(this->allocated_ssl);
+    }
+
+    // handshake: SSL_accept or SSL_connect
+    bool nonblocking_handshake(SSL * ssl, int (*handshake)(SSL *), int timeout) const
+    {
+        const time_t deadline = time(nullptr) + timeout;
+        for (;;) {
+            const int r = handshake(ssl);
+            if (r > 0) {
+                return true;
+            }
+            pollfd pfd;
+            pfd.fd = this->sck;
+            switch (SSL_get_error(ssl, r)) {
+            case SSL_ERROR_WANT_READ:
+                pfd.events = POLLIN;
+                break;
+            case SSL_ERROR_WANT_WRITE:
+                pfd.events = POLLOUT;
+                break;
+            default:
+                {
+                    unsigned long error;
+                    while ((error = ERR_get_error()) != 0) {
+                        LOG(LOG_INFO, "%s", ERR_error_string(error, NULL));
+                    }
+                }
+                return false;
+            }
+            const time_t now = time(nullptr);
+            if (now >= deadline) {
+                LOG(LOG_WARNING, "SocketTransport: TLS handshake timeout");
+                return false;
+            }
+            if (poll(&pfd, 1, (deadline - now) * 1000) < 0 && errno != EINTR) {
+                return false;
+            }
+        }
+    }
+
+public:
     virtual void enable_client_tls(bool ignore_certificate_change) throw (Error)
     {
         if (this->tls) {
@@ -477,17 +305,12 @@ public:
         // only understand the TLSv1 protocol. A client will send out TLSv1 client hello messages
         // and will indicate that it only understands TLSv1.
 
-        SSL_CTX* ctx = SSL_CTX_new(TLSv1_client_method());
-        this->allocated_ctx = ctx;
-
-        /*
-         * This is necessary, because the Microsoft TLS implementation is not perfect.
-         * SSL_OP_ALL enables a couple of workarounds for buggy TLS implementations,
-         * but the most important workaround being SSL_OP_TLS_BLOCK_PADDING_BUG.
-         * As the size of the encrypted payload may give hints about its contents,
-         * block padding is normally used, but the Microsoft TLS implementation
-         * won't recognize it and will disconnect you after sending a TLS alert.
-         */
+        // Context is created once per process (see TLSClientContext, options
+        // described below are set there), it is not owned by transport.
+        SSL_CTX * ctx = TLSClientContext::get();
+        if (!ctx) {
+            throw Error(ERR_TRANSPORT_TLS_CLIENT);
+        }
 
         // SSL_CTX_set_options() adds the options set via bitmask in options to ctx.
         // Options already set before are not cleared!
@@ -638,8 +461,6 @@ public:
         // Allow legacy insecure renegotiation between OpenSSL and unpatched servers only: this option
         // is currently set by default. See the SECURE RENEGOTIATION section for more details.
 
-//        LOG(LOG_INFO, "SocketTransport::SSL_CTX_set_options()");
-        SSL_CTX_set_options(ctx, SSL_OP_ALL);
 
         // -------- End of system wide SSL_Ctx option ----------------------------------
 
@@ -658,10 +479,6 @@ public:
         SSL * ssl = SSL_new(ctx);
         this->allocated_ssl = ssl;
 
-        TODO("I should probably not be doing that here ? Is it really necessary");
-        int flags = fcntl(this->sck, F_GETFL);
-        fcntl(this->sck, F_SETFL, flags & ~(O_NONBLOCK));
-
         // SSL_set_fd - connect the SSL object with a file descriptor
         // ==========================================================
 
@@ -685,8 +502,14 @@ public:
         TODO("add error management");
         SSL_set_fd(ssl, this->sck);
 
+        // last session opened with this target is offered for an abbreviated handshake
+        SSL_SESSION * cached_session = TLSClientContext::find_session(this->ip_address, this->port);
+        if (cached_session) {
+            SSL_set_session(ssl, cached_session);
+            SSL_SESSION_free(cached_session);
+        }
+
         LOG(LOG_INFO, "SSL_connect()");
-    again:
         // SSL_connect - initiate the TLS/SSL handshake with an TLS/SSL server
         // -------------------------------------------------------------------
 
@@ -723,44 +546,23 @@ public:
         // for non-blocking BIOs. Call SSL_get_error() with the return value ret to find
         // out the reason
 
-        int connection_status = SSL_connect(ssl);
-
-        if (connection_status <= 0)
-        {
-            unsigned long error;
-
-            switch (SSL_get_error(ssl, connection_status))
-            {
-                case SSL_ERROR_ZERO_RETURN:
-                    LOG(LOG_INFO, "Server closed TLS connection\n");
-                    return;
-
-                case SSL_ERROR_WANT_READ:
-                    goto again;
-
-                case SSL_ERROR_WANT_WRITE:
-                    goto again;
-
-                case SSL_ERROR_SYSCALL:
-                    LOG(LOG_INFO, "I/O error\n");
-                    while ((error = ERR_get_error()) != 0)
-                        LOG(LOG_INFO, "%s\n", ERR_error_string(error, NULL));
-                    return;
-
-                case SSL_ERROR_SSL:
-                    LOG(LOG_INFO, "Failure in SSL library (protocol error?)\n");
-                    while ((error = ERR_get_error()) != 0)
-                        LOG(LOG_INFO, "%s\n", ERR_error_string(error, NULL));
-                    return;
-
-                default:
-                    LOG(LOG_INFO, "Unknown error\n");
-                    while ((error = ERR_get_error()) != 0){
-                        LOG(LOG_INFO, "%s\n", ERR_error_string(error, NULL));
-                    }
-                    LOG(LOG_INFO, "tls::tls_print_error %s [%u]", strerror(errno), errno);
-                    return;
+        // handshake is run on non blocking socket to bound its duration
+        int flags = fcntl(this->sck, F_GETFL);
+        fcntl(this->sck, F_SETFL, flags | O_NONBLOCK);
+        const bool connected = this->nonblocking_handshake(ssl, SSL_connect, HANDSHAKE_TIMEOUT);
+        TODO("I should probably not be doing that here ? Is it really necessary");
+        fcntl(this->sck, F_SETFL, flags & ~(O_NONBLOCK));
+        if (!connected) {
+            LOG(LOG_ERR, "SocketTransport::enable_client_tls() SSL connect error");
+            if (cached_session) {
+                TLSClientContext::remove_session(this->ip_address, this->port);
             }
+            throw Error(ERR_TRANSPORT_TLS_CLIENT);
+        }
+
+        const bool session_resumed = SSL_session_reused(ssl);
+        if (session_resumed) {
+            LOG(LOG_INFO, "SocketTransport::enable_client_tls() session resumed");
         }
 
         LOG(LOG_INFO, "SSL_get_peer_certificate()");
@@ -923,6 +725,9 @@ public:
                     issuer_existing, subject_existing, fingerprint_existing, issuer, subject, fingerprint);
 
                 if (!ignore_certificate_change) {
+                    if (cached_session) {
+                        TLSClientContext::remove_session(this->ip_address, this->port);
+                    }
                     throw Error(ERR_TRANSPORT_TLS_CERTIFICATE_CHANGED, 0);
                 }
 
@@ -945,6 +750,11 @@ public:
             X509_free(px509Existing);
         }
 
+        // only a target whose certificate was accepted is offered its session again
+        if (!session_resumed) {
+            TLSClientContext::store_session(this->ip_address, this->port, SSL_get_session(ssl));
+        }
+
 
 //        SSL_get_verify_result();
 
@@ -1089,6 +899,7 @@ public:
         // Disconnect tls if needed
         if (this->tls) {
             if (this->allocated_ssl) {
+                this->quiet_shutdown();
                 SSL_free(this->allocated_ssl);
                 this->allocated_ssl = NULL;
             }
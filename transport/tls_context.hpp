@@ -0,0 +1,471 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Server and client TLS contexts shared by all sessions.
+
+   The server context (certificate, private key, DH parameters, ECDHE curve)
+   is built once by the listener before sessions are forked, so children do
+   not parse PEM files again. Sessions are resumed across processes:
+   - with session tickets, as ticket keys are generated with the context,
+     before fork, they are the same in every session process;
+   - with session ids, stored in a cache in anonymous shared memory.
+
+   The client context is used toward targets. The last session opened with
+   each target (host:port) is kept in another shared cache, next connection
+   to the same target from any session process does an abbreviated handshake.
+*/
+
+#ifndef REDEMPTION_TRANSPORT_TLS_CONTEXT_HPP
+#define REDEMPTION_TRANSPORT_TLS_CONTEXT_HPP
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include <openssl/ec.h>
+#include <openssl/pem.h>
+#include <openssl/sha.h>
+
+#include "defines.hpp"
+#include "log.hpp"
+#include "openssl_tls.hpp"
+
+static inline int tls_context_password_cb(char * buf, int num, int /*rwflag*/, void * userdata)
+{
+    const char * pass = static_cast<const char*>(userdata);
+    if (num < static_cast<int>(strlen(pass)) + 1) {
+        return 0;
+    }
+    strcpy(buf, pass);
+    return strlen(pass);
+}
+
+
+// Fixed size session cache in shared memory. Slots are indexed by session id
+// (random bytes), a new session replaces the one using the same slot.
+class TLSSessionCache
+{
+public:
+    enum {
+        MAX_SESSION_ID_LENGTH  = 32,
+        // client sessions include the certificate of target
+        MAX_SESSION_DER_LENGTH = 4096,
+        DEFAULT_NB_ENTRIES     = 4096
+    };
+
+private:
+    struct Entry {
+        time_t   expire;
+        uint16_t der_length;
+        uint8_t  id_length;
+        uint8_t  id[MAX_SESSION_ID_LENGTH];
+        uint8_t  der[MAX_SESSION_DER_LENGTH];
+    };
+
+    struct Shared {
+        pthread_mutex_t mutex;
+        uint32_t        nb_entries;
+        Entry           entries[1];
+    };
+
+    Shared * shared;
+    size_t   shared_size;
+
+    class Lock {
+        pthread_mutex_t & mutex;
+
+    public:
+        explicit Lock(pthread_mutex_t & mutex)
+        : mutex(mutex)
+        {
+            // a session process may die while holding the lock
+            if (pthread_mutex_lock(&this->mutex) == EOWNERDEAD) {
+                pthread_mutex_consistent(&this->mutex);
+            }
+        }
+
+        ~Lock() {
+            pthread_mutex_unlock(&this->mutex);
+        }
+    };
+
+    Entry & entry(const uint8_t * id, unsigned id_length) const {
+        uint32_t h = 2166136261u;
+        for (unsigned i = 0; i < id_length; ++i) {
+            h = (h ^ id[i]) * 16777619u;
+        }
+        return this->shared->entries[h % this->shared->nb_entries];
+    }
+
+public:
+    // must be created before fork to be shared by session processes
+    explicit TLSSessionCache(uint32_t nb_entries = DEFAULT_NB_ENTRIES)
+    : shared(nullptr)
+    , shared_size(sizeof(Shared) + (nb_entries - 1) * sizeof(Entry))
+    {
+        void * p = mmap(nullptr, this->shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            LOG(LOG_WARNING, "TLSSessionCache: shared memory allocation failed (%s)", strerror(errno));
+            return;
+        }
+        // memory is zero filled: every entry is empty
+        this->shared = static_cast<Shared*>(p);
+        this->shared->nb_entries = nb_entries;
+
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&this->shared->mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+
+    ~TLSSessionCache() {
+        if (this->shared) {
+            munmap(this->shared, this->shared_size);
+        }
+    }
+
+    bool is_valid() const {
+        return this->shared;
+    }
+
+    bool add(const uint8_t * id, unsigned id_length, const uint8_t * der, unsigned der_length, time_t expire) {
+        if (!this->shared || !id_length || id_length > MAX_SESSION_ID_LENGTH || der_length > MAX_SESSION_DER_LENGTH) {
+            return false;
+        }
+        Lock lock(this->shared->mutex);
+        Entry & e = this->entry(id, id_length);
+        e.expire     = expire;
+        e.id_length  = id_length;
+        e.der_length = der_length;
+        memcpy(e.id, id, id_length);
+        memcpy(e.der, der, der_length);
+        return true;
+    }
+
+    // returns der length, 0 if not found or expired
+    unsigned get(const uint8_t * id, unsigned id_length, uint8_t * der, time_t now) {
+        if (!this->shared || !id_length || id_length > MAX_SESSION_ID_LENGTH) {
+            return 0;
+        }
+        Lock lock(this->shared->mutex);
+        Entry & e = this->entry(id, id_length);
+        if (e.id_length != id_length || memcmp(e.id, id, id_length)) {
+            return 0;
+        }
+        if (e.expire <= now) {
+            e.id_length = 0;
+            return 0;
+        }
+        memcpy(der, e.der, e.der_length);
+        return e.der_length;
+    }
+
+    void remove(const uint8_t * id, unsigned id_length) {
+        if (!this->shared || !id_length || id_length > MAX_SESSION_ID_LENGTH) {
+            return;
+        }
+        Lock lock(this->shared->mutex);
+        Entry & e = this->entry(id, id_length);
+        if (e.id_length == id_length && !memcmp(e.id, id, id_length)) {
+            e.id_length = 0;
+        }
+    }
+};
+
+
+class TLSServerContext
+{
+    static SSL_CTX *& preloaded_ctx() {
+        static SSL_CTX * ctx = nullptr;
+        return ctx;
+    }
+
+    static TLSSessionCache *& session_cache() {
+        static TLSSessionCache * cache = nullptr;
+        return cache;
+    }
+
+    static int new_session_cb(SSL * /*ssl*/, SSL_SESSION * session) {
+        unsigned id_length = 0;
+        const uint8_t * id = SSL_SESSION_get_id(session, &id_length);
+        const int der_length = i2d_SSL_SESSION(session, nullptr);
+        if (der_length <= 0 || der_length > TLSSessionCache::MAX_SESSION_DER_LENGTH) {
+            return 0;
+        }
+        uint8_t der[TLSSessionCache::MAX_SESSION_DER_LENGTH];
+        uint8_t * p = der;
+        i2d_SSL_SESSION(session, &p);
+        session_cache()->add( id, id_length, der, der_length
+                            , SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session));
+        // session was not referenced
+        return 0;
+    }
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    static SSL_SESSION * get_session_cb(SSL * /*ssl*/, const unsigned char * id, int id_length, int * copy) {
+#else
+    static SSL_SESSION * get_session_cb(SSL * /*ssl*/, unsigned char * id, int id_length, int * copy) {
+#endif
+        *copy = 0;
+        uint8_t der[TLSSessionCache::MAX_SESSION_DER_LENGTH];
+        const unsigned der_length = session_cache()->get(id, id_length, der, time(nullptr));
+        if (!der_length) {
+            return nullptr;
+        }
+        const unsigned char * p = der;
+        return d2i_SSL_SESSION(nullptr, &p, der_length);
+    }
+
+    static void remove_session_cb(SSL_CTX * /*ctx*/, SSL_SESSION * session) {
+        unsigned id_length = 0;
+        const uint8_t * id = SSL_SESSION_get_id(session, &id_length);
+        session_cache()->remove(id, id_length);
+    }
+
+public:
+    // lifetime of resumable sessions, in seconds
+    enum { SESSION_TIMEOUT = 3600 };
+
+    // returns nullptr on failure, errors are logged
+    static SSL_CTX * create(const char * certificate_password) {
+        SSL_CTX * ctx = SSL_CTX_new(SSLv23_server_method());
+        if (!ctx) {
+            LOG(LOG_ERR, "TLSServerContext: SSL_CTX_new failed");
+            return nullptr;
+        }
+
+        // SSL_OP_ALL enables workarounds for the Microsoft TLS implementation
+        // (SSL_OP_TLS_BLOCK_PADDING_BUG)
+        SSL_CTX_set_options(ctx, SSL_OP_ALL);
+        SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2);
+        SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv3);
+        // Not compatible with MSTSC 6.1 on XP and W2K3
+        // SSL_CTX_set_cipher_list(ctx, "HIGH:!ADH:!3DES");
+
+        if (!SSL_CTX_use_certificate_chain_file(ctx, CFG_PATH "/rdpproxy.crt")) {
+            LOG(LOG_ERR, "TLSServerContext: can't read certificate file " CFG_PATH "/rdpproxy.crt");
+            SSL_CTX_free(ctx);
+            return nullptr;
+        }
+
+        SSL_CTX_set_default_passwd_cb(ctx, tls_context_password_cb);
+        SSL_CTX_set_default_passwd_cb_userdata(ctx, const_cast<char*>(certificate_password));
+        const int key_loaded = SSL_CTX_use_PrivateKey_file(ctx, CFG_PATH "/rdpproxy.key", SSL_FILETYPE_PEM);
+        // password is not kept after key is loaded
+        SSL_CTX_set_default_passwd_cb_userdata(ctx, nullptr);
+        if (!key_loaded) {
+            LOG(LOG_ERR, "TLSServerContext: can't read key file " CFG_PATH "/rdpproxy.key");
+            SSL_CTX_free(ctx);
+            return nullptr;
+        }
+
+        // finite field DH is kept for old clients
+        BIO * bio = BIO_new_file(CFG_PATH "/" DH_PEM, "r");
+        if (!bio) {
+            LOG(LOG_ERR, "TLSServerContext: couldn't open DH file " CFG_PATH "/" DH_PEM);
+            SSL_CTX_free(ctx);
+            return nullptr;
+        }
+        DH * dh = PEM_read_bio_DHparams(bio, nullptr, nullptr, nullptr);
+        BIO_free(bio);
+        if (!dh || SSL_CTX_set_tmp_dh(ctx, dh) <= 0) {
+            LOG(LOG_ERR, "TLSServerContext: couldn't set DH parameters");
+            DH_free(dh);
+            SSL_CTX_free(ctx);
+            return nullptr;
+        }
+        DH_free(dh);
+        SSL_CTX_set_options(ctx, SSL_OP_SINGLE_DH_USE);
+
+        // ECDHE is much cheaper than DHE for the same security
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+        SSL_CTX_set_ecdh_auto(ctx, 1);
+#else
+        EC_KEY * ecdh = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+        if (ecdh) {
+            SSL_CTX_set_tmp_ecdh(ctx, ecdh);
+            EC_KEY_free(ecdh);
+        }
+        else {
+            LOG(LOG_WARNING, "TLSServerContext: ECDHE not available");
+        }
+#endif
+        SSL_CTX_set_options(ctx, SSL_OP_SINGLE_ECDH_USE);
+
+        static const unsigned char sid_ctx[] = "rdpproxy";
+        SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+        SSL_CTX_set_timeout(ctx, SESSION_TIMEOUT);
+        if (session_cache() && session_cache()->is_valid()) {
+            // each session is a new process, internal cache is useless
+            SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+            SSL_CTX_sess_set_new_cb(ctx, new_session_cb);
+            SSL_CTX_sess_set_get_cb(ctx, get_session_cb);
+            SSL_CTX_sess_set_remove_cb(ctx, remove_session_cb);
+        }
+
+        return ctx;
+    }
+
+    // called by listener before forking sessions
+    static bool preload(const char * certificate_password) {
+        if (!session_cache()) {
+            session_cache() = new TLSSessionCache;
+        }
+        SSL_CTX * ctx = create(certificate_password);
+        if (!ctx) {
+            return false;
+        }
+        if (preloaded_ctx()) {
+            SSL_CTX_free(preloaded_ctx());
+        }
+        preloaded_ctx() = ctx;
+        LOG(LOG_INFO, "TLSServerContext: server context preloaded");
+        return true;
+    }
+
+    // nullptr if preload was not called (or failed)
+    static SSL_CTX * get() {
+        return preloaded_ctx();
+    }
+};
+
+
+class TLSClientContext
+{
+    // one entry per target
+    enum { NB_TARGETS = 256 };
+
+    static SSL_CTX *& process_ctx() {
+        static SSL_CTX * ctx = nullptr;
+        return ctx;
+    }
+
+    static TLSSessionCache *& session_cache() {
+        static TLSSessionCache * cache = nullptr;
+        return cache;
+    }
+
+    // hostnames may be longer than a session id
+    static void target_key(const char * host, int port, uint8_t (&key)[SHA256_DIGEST_LENGTH]) {
+        char target[256];
+        const int len = snprintf(target, sizeof(target), "%s:%d", host, port);
+        SHA256(reinterpret_cast<const uint8_t*>(target), std::min<size_t>(len, sizeof(target) - 1), key);
+    }
+
+public:
+    // returns nullptr on failure, errors are logged
+    static SSL_CTX * create() {
+        SSL_CTX * ctx = SSL_CTX_new(TLSv1_client_method());
+        if (!ctx) {
+            LOG(LOG_ERR, "TLSClientContext: SSL_CTX_new failed");
+            return nullptr;
+        }
+        /*
+         * This is necessary, because the Microsoft TLS implementation is not perfect.
+         * SSL_OP_ALL enables a couple of workarounds for buggy TLS implementations,
+         * but the most important workaround being SSL_OP_TLS_BLOCK_PADDING_BUG.
+         * As the size of the encrypted payload may give hints about its contents,
+         * block padding is normally used, but the Microsoft TLS implementation
+         * won't recognize it and will disconnect you after sending a TLS alert.
+         */
+        SSL_CTX_set_options(ctx, SSL_OP_ALL);
+        // sessions are stored by target, see store_session()
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+        return ctx;
+    }
+
+    // called by listener before forking sessions
+    static bool preload() {
+        if (!session_cache()) {
+            session_cache() = new TLSSessionCache(NB_TARGETS);
+        }
+        SSL_CTX * ctx = create();
+        if (!ctx) {
+            return false;
+        }
+        if (process_ctx()) {
+            SSL_CTX_free(process_ctx());
+        }
+        process_ctx() = ctx;
+        return true;
+    }
+
+    // context is never freed, it is created on first use if not preloaded
+    // (sessions are then only resumed inside this process)
+    static SSL_CTX * get() {
+        if (!session_cache()) {
+            session_cache() = new TLSSessionCache(NB_TARGETS);
+        }
+        if (!process_ctx()) {
+            process_ctx() = create();
+        }
+        return process_ctx();
+    }
+
+    static bool store_session(const char * host, int port, SSL_SESSION * session) {
+        if (!session_cache() || !session) {
+            return false;
+        }
+        const int der_length = i2d_SSL_SESSION(session, nullptr);
+        if (der_length <= 0 || der_length > TLSSessionCache::MAX_SESSION_DER_LENGTH) {
+            return false;
+        }
+        uint8_t der[TLSSessionCache::MAX_SESSION_DER_LENGTH];
+        uint8_t * p = der;
+        i2d_SSL_SESSION(session, &p);
+        uint8_t key[SHA256_DIGEST_LENGTH];
+        target_key(host, port, key);
+        return session_cache()->add( key, sizeof(key), der, der_length
+                                   , SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session));
+    }
+
+    // returned session must be released with SSL_SESSION_free(), nullptr if none
+    static SSL_SESSION * find_session(const char * host, int port) {
+        if (!session_cache()) {
+            return nullptr;
+        }
+        uint8_t key[SHA256_DIGEST_LENGTH];
+        target_key(host, port, key);
+        uint8_t der[TLSSessionCache::MAX_SESSION_DER_LENGTH];
+        const unsigned der_length = session_cache()->get(key, sizeof(key), der, time(nullptr));
+        if (!der_length) {
+            return nullptr;
+        }
+        const unsigned char * p = der;
+        return d2i_SSL_SESSION(nullptr, &p, der_length);
+    }
+
+    // target refused or failed with stored session
+    static void remove_session(const char * host, int port) {
+        if (session_cache()) {
+            uint8_t key[SHA256_DIGEST_LENGTH];
+            target_key(host, port, key);
+            session_cache()->remove(key, sizeof(key));
+        }
+    }
+};
+
+#endif
@@ -108,6 +108,7 @@ int app_recorder( int argc, char ** argv, const char * copyright_notice
     std::string wrm_compression_algorithm;  // output compression algorithm.
     std::string wrm_color_depth;
     std::string wrm_encryption;
+    std::string video_quality;
 
     boost::program_options::options_description desc("Options");
     desc.add_options()
@@ -129,6 +130,8 @@ int app_recorder( int argc, char ** argv, const char * copyright_notice
 
     ("png,p", "enable png capture")
     ("wrm,w", "enable wrm capture")
+    ("flv,f", "enable flv capture")
+    ("video-quality,q", boost::program_options::value(&video_quality), "flv frame rate (default=medium, low, high), as set by [video] *_framerate")
     ;
 
     add_prog_option(desc.add_options());
@@ -239,6 +242,17 @@ int app_recorder( int argc, char ** argv, const char * copyright_notice
     ini.video.break_interval = wrm_break_interval;
     ini.video.capture_wrm    = (options.count("wrm") > 0);
     ini.video.capture_png    = (options.count("png") > 0);
+    ini.video.capture_flv    = (options.count("flv") > 0);
+
+    if (options.count("video-quality") > 0) {
+        if (   strcmp(video_quality.c_str(), "low")
+            && strcmp(video_quality.c_str(), "medium")
+            && strcmp(video_quality.c_str(), "high")) {
+            std::cerr << "Unknown video quality\n\n";
+            return -1;
+        }
+        ini.globals.video_quality.set_from_cstr(video_quality.c_str());
+    }
 
     if (int status = parse_format(ini, options, output_filename)) {
         return status;
@@ -394,6 +408,7 @@ int recompress_or_record( std::string & output_filename, std::string & input_fil
             result = (
                 force_record
              || ini.video.capture_png
+             || ini.video.capture_flv
              || ini.video.wrm_color_depth_selection_strategy != USE_ORIGINAL_COLOR_DEPTH
              || show_file_metadata
              || show_statistics
@@ -442,6 +457,25 @@ int recompress_or_record( std::string & output_filename, std::string & input_fil
              , std::forward<ExtraArguments>(extra_argument)...);
 }
 
+// only plain .mwrm files have a binary index
+template<typename InWrmTrans>
+const detail::MetaIndex * get_meta_index(InWrmTrans & in_wrm_trans) {
+    return nullptr;
+}
+
+inline const detail::MetaIndex * get_meta_index(InMetaSequenceTransport & in_wrm_trans) {
+    return in_wrm_trans.index().is_valid() ? &in_wrm_trans.index() : nullptr;
+}
+
+template<typename InWrmTrans>
+bool seek_to_time(InWrmTrans & in_wrm_trans, uint32_t sec) {
+    return false;
+}
+
+inline bool seek_to_time(InMetaSequenceTransport & in_wrm_trans, uint32_t sec) {
+    return in_wrm_trans.seek_to_time(sec);
+}
+
 template<typename InWrmTrans>
 unsigned get_file_count( InWrmTrans & in_wrm_trans, uint32_t & begin_cap, uint32_t & end_cap, timeval & begin_record
                        , timeval & end_record) {
@@ -457,10 +491,17 @@ unsigned get_file_count( InWrmTrans & in_wrm_trans, uint32_t & begin_cap, uint32
         // begin_capture.tv_usec is 0
         end_cap += in_wrm_trans.begin_chunk_time();
     }
+    if (begin_cap >= in_wrm_trans.end_chunk_time() && seek_to_time(in_wrm_trans, begin_cap)) {
+        in_wrm_trans.next();
+    }
     while (begin_cap >= in_wrm_trans.end_chunk_time()) {
         in_wrm_trans.next();
     }
     unsigned result = in_wrm_trans.get_seqno();
+    if (const detail::MetaIndex * index = get_meta_index(in_wrm_trans)) {
+        end_record.tv_sec = index->record(index->size() - 1).stop_sec;
+        return result;
+    }
     try {
         do {
             end_record.tv_sec = in_wrm_trans.end_chunk_time();
@@ -706,6 +747,8 @@ static int do_record( Transport & in_wrm_trans, const timeval begin_record, cons
     }
 
     player.max_order_count = order_count;
+    // offline transcoding, orders are sent to capture chunk by chunk
+    player.batch_orders = true;
 
     int return_code = 0;
 
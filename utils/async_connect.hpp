@@ -0,0 +1,419 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Non blocking TCP connection driven by the session loop
+*/
+
+#ifndef _REDEMPTION_UTILS_ASYNC_CONNECT_HPP_
+#define _REDEMPTION_UTILS_ASYNC_CONNECT_HPP_
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+#include <algorithm>
+
+#include "netutils.hpp"
+#include "difftimeval.hpp"
+#include "noncopyable.hpp"
+
+// Same result as ip_connect() without blocking the caller: the host name is
+// resolved in the background (getaddrinfo_a), then the resolved addresses are
+// tried in parallel, the next one being started when the previous one did not
+// answer after ATTEMPT_DELAY_MS or failed (Happy Eyeballs, RFC 8305). The
+// first socket connected wins, the others are closed.
+//
+// The owner adds the pending sockets to the write set of its select() with
+// add_to_fd_set() and calls process() after select() until the state is
+// CONNECTED or FAILED.
+class AsyncConnect : noncopyable {
+public:
+    enum State {
+        IDLE,
+        RESOLVING,
+        CONNECTING,
+        CONNECTED,
+        FAILED
+    };
+
+    enum {
+        MAX_ADDRESSES    = 8,
+        ATTEMPT_DELAY_MS = 250,
+        RESOLVE_POLL_MS  = 10   // getaddrinfo_a() gives no file descriptor to wait on
+    };
+
+private:
+    // glibc may still write to a lookup that could not be cancelled, it is
+    // then left to it.
+    struct Resolution {
+        gaicb    request;
+        gaicb  * requests[1];
+        addrinfo hints;
+        char     host[256];
+        char     service[8];
+    };
+
+    struct Attempt {
+        sockaddr_storage addr;
+        socklen_t        addrlen;
+        int              sck;
+        bool             started;
+    };
+
+    State        state;
+    char         host[256];
+    int          port;
+    uint32_t     verbose;
+    uint64_t     deadline;      // us
+    uint64_t     next_attempt;  // us
+    Resolution * resolution;
+    Attempt      attempts[MAX_ADDRESSES];
+    size_t       attempt_count;
+    int          sck;
+
+public:
+    explicit AsyncConnect(uint32_t verbose = 0)
+    : state(IDLE)
+    , port(0)
+    , verbose(verbose)
+    , deadline(0)
+    , next_attempt(0)
+    , resolution(nullptr)
+    , attempt_count(0)
+    , sck(-1) {
+        this->host[0] = 0;
+    }
+
+    ~AsyncConnect() {
+        this->cancel();
+    }
+
+    State get_state() const {
+        return this->state;
+    }
+
+    bool is_pending() const {
+        return this->state == RESOLVING || this->state == CONNECTING;
+    }
+
+    // Started (and not released nor cancelled) for host:port.
+    bool targets(const char * host, int port) const {
+        return this->state != IDLE && this->port == port && 0 == strcmp(this->host, host);
+    }
+
+    // The connection fails if it is not established after timeout_ms.
+    void start(const char * host, int port, unsigned timeout_ms, const timeval & now) {
+        this->cancel();
+
+        LOG(LOG_INFO, "connecting to %s:%d (async)", host, port);
+        snprintf(this->host, sizeof(this->host), "%s", host);
+        this->port     = port;
+        this->deadline = ustime(now) + uint64_t(timeout_ms) * 1000;
+
+        char service[8];
+        snprintf(service, sizeof(service), "%d", port);
+
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags    = AI_NUMERICHOST | AI_NUMERICSERV;
+
+        // numeric address, nothing to wait for
+        addrinfo * addr_info = nullptr;
+        if (0 == getaddrinfo(host, service, &hints, &addr_info)) {
+            this->set_addresses(addr_info);
+            freeaddrinfo(addr_info);
+            this->state = CONNECTING;
+            this->start_attempts(ustime(now), true);
+            return;
+        }
+
+        Resolution * resolution = new Resolution;
+        memset(resolution, 0, sizeof(*resolution));
+        snprintf(resolution->host, sizeof(resolution->host), "%s", host);
+        memcpy(resolution->service, service, sizeof(service));
+        resolution->hints             = hints;
+        resolution->hints.ai_flags    = AI_NUMERICSERV;
+        resolution->request.ar_name    = resolution->host;
+        resolution->request.ar_service = resolution->service;
+        resolution->request.ar_request = &resolution->hints;
+        resolution->requests[0]        = &resolution->request;
+
+        int result = getaddrinfo_a(GAI_NOWAIT, resolution->requests, 1, nullptr);
+        if (result) {
+            LOG(LOG_ERR, "DNS resolution failed for %s (%s)", host, gai_strerror(result));
+            delete resolution;
+            this->state = FAILED;
+            return;
+        }
+        this->resolution = resolution;
+        this->state      = RESOLVING;
+    }
+
+    // Nothing to wait for once CONNECTED or FAILED, the owner has to pick the
+    // result up.
+    void add_to_fd_set(fd_set & wfds, unsigned & max, timeval & timeout, const timeval & now) const {
+        if (this->state == CONNECTED || this->state == FAILED) {
+            timeout.tv_sec  = 0;
+            timeout.tv_usec = 0;
+            return;
+        }
+        if (this->state == IDLE) {
+            return;
+        }
+
+        const uint64_t now_us = ustime(now);
+        uint64_t wait_us = (this->deadline > now_us) ? this->deadline - now_us : 0;
+        if (this->state == RESOLVING) {
+            wait_us = std::min<uint64_t>(wait_us, RESOLVE_POLL_MS * 1000);
+        }
+        else {
+            bool unstarted = false;
+            for (size_t i = 0; i < this->attempt_count; ++i) {
+                const Attempt & attempt = this->attempts[i];
+                if (attempt.sck != -1) {
+                    FD_SET(attempt.sck, &wfds);
+                    max = std::max(max, static_cast<unsigned>(attempt.sck));
+                }
+                unstarted |= !attempt.started;
+            }
+            if (unstarted) {
+                wait_us = std::min(wait_us, (this->next_attempt > now_us) ? this->next_attempt - now_us : 0);
+            }
+        }
+
+        if (wait_us < ustime(timeout)) {
+            timeout.tv_sec  = wait_us / 1000000;
+            timeout.tv_usec = wait_us % 1000000;
+        }
+    }
+
+    State process(const fd_set & wfds, const timeval & now) {
+        const uint64_t now_us = ustime(now);
+
+        if (this->state == RESOLVING) {
+            const int result = gai_error(&this->resolution->request);
+            if (result == EAI_INPROGRESS) {
+                if (now_us >= this->deadline) {
+                    LOG(LOG_ERR, "DNS resolution of %s timed out", this->host);
+                    this->cancel();
+                    this->state = FAILED;
+                }
+                return this->state;
+            }
+            if (result) {
+                LOG(LOG_ERR, "DNS resolution failed for %s (%s)", this->host, gai_strerror(result));
+                this->cancel();
+                this->state = FAILED;
+                return this->state;
+            }
+            this->set_addresses(this->resolution->request.ar_result);
+            freeaddrinfo(this->resolution->request.ar_result);
+            delete this->resolution;
+            this->resolution = nullptr;
+            this->state = CONNECTING;
+            this->start_attempts(now_us, true);
+        }
+
+        if (this->state != CONNECTING) {
+            return this->state;
+        }
+
+        bool failed = false;
+        for (size_t i = 0; i < this->attempt_count && this->state == CONNECTING; ++i) {
+            Attempt & attempt = this->attempts[i];
+            if (attempt.sck == -1 || !FD_ISSET(attempt.sck, &wfds)) {
+                continue;
+            }
+            int error = 0;
+            socklen_t error_len = sizeof(error);
+            if (getsockopt(attempt.sck, SOL_SOCKET, SO_ERROR, &error, &error_len) || error) {
+                if (this->verbose) {
+                    LOG(LOG_INFO, "Connection to %s failed with errno = %d (%s)", this->host, error, strerror(error));
+                }
+                close(attempt.sck);
+                attempt.sck = -1;
+                failed = true;
+            }
+            else {
+                this->connected(attempt);
+            }
+        }
+
+        if (this->state == CONNECTING) {
+            // a failure starts the next address right away
+            this->start_attempts(now_us, failed);
+        }
+        if (this->state == CONNECTING && now_us >= this->deadline) {
+            LOG(LOG_INFO, "Connection to %s:%d timed out", this->host, this->port);
+            this->cancel();
+            this->state = FAILED;
+        }
+        return this->state;
+    }
+
+    // Connected socket (non blocking, as ip_connect() gives it), the caller
+    // owns it.
+    int release() {
+        const int sck = this->sck;
+        this->sck   = -1;
+        this->state = IDLE;
+        return sck;
+    }
+
+    void cancel() {
+        if (this->resolution) {
+            const int result = gai_cancel(&this->resolution->request);
+            if (result == EAI_CANCELED || result == EAI_ALLDONE) {
+                if (this->resolution->request.ar_result) {
+                    freeaddrinfo(this->resolution->request.ar_result);
+                }
+                delete this->resolution;
+            }
+            this->resolution = nullptr;
+        }
+        for (size_t i = 0; i < this->attempt_count; ++i) {
+            if (this->attempts[i].sck != -1) {
+                close(this->attempts[i].sck);
+            }
+        }
+        this->attempt_count = 0;
+        if (this->sck != -1) {
+            close(this->sck);
+            this->sck = -1;
+        }
+        this->state = IDLE;
+    }
+
+private:
+    // The first family returned by getaddrinfo() is tried first, then the
+    // families alternate.
+    void set_addresses(const addrinfo * addr_info) {
+        const addrinfo * first[MAX_ADDRESSES];
+        const addrinfo * other[MAX_ADDRESSES];
+        size_t first_count = 0;
+        size_t other_count = 0;
+        for (const addrinfo * ai = addr_info; ai; ai = ai->ai_next) {
+            if (ai->ai_family != AF_INET && ai->ai_family != AF_INET6) {
+                continue;
+            }
+            if (ai->ai_family == addr_info->ai_family) {
+                if (first_count < MAX_ADDRESSES) {
+                    first[first_count++] = ai;
+                }
+            }
+            else if (other_count < MAX_ADDRESSES) {
+                other[other_count++] = ai;
+            }
+        }
+
+        this->attempt_count = 0;
+        for (size_t i = 0; i < std::max(first_count, other_count); ++i) {
+            if (i < first_count) {
+                this->add_address(*first[i]);
+            }
+            if (i < other_count) {
+                this->add_address(*other[i]);
+            }
+        }
+    }
+
+    void add_address(const addrinfo & ai) {
+        if (this->attempt_count < MAX_ADDRESSES) {
+            Attempt & attempt = this->attempts[this->attempt_count++];
+            memcpy(&attempt.addr, ai.ai_addr, ai.ai_addrlen);
+            attempt.addrlen = ai.ai_addrlen;
+            attempt.sck     = -1;
+            attempt.started = false;
+        }
+    }
+
+    // Starts the next address when the attempt delay is over (or now),
+    // FAILED when no address is left and none is pending.
+    void start_attempts(uint64_t now_us, bool now) {
+        for (size_t i = 0; i < this->attempt_count && this->state == CONNECTING; ++i) {
+            Attempt & attempt = this->attempts[i];
+            if (attempt.started) {
+                continue;
+            }
+            if (!now && now_us < this->next_attempt) {
+                break;
+            }
+            attempt.started = true;
+            this->next_attempt = now_us + ATTEMPT_DELAY_MS * 1000;
+            now = false;
+
+            attempt.sck = socket(attempt.addr.ss_family, SOCK_STREAM, 0);
+            if (attempt.sck == -1) {
+                now = true;
+                continue;
+            }
+
+            // set snd buffer to at least 32 Kbytes, as ip_connect()
+            int snd_buffer_size = 32768;
+            unsigned int option_len = sizeof(snd_buffer_size);
+            if (0 == getsockopt(attempt.sck, SOL_SOCKET, SO_SNDBUF, &snd_buffer_size, &option_len)
+             && snd_buffer_size < 32768) {
+                snd_buffer_size = 32768;
+                setsockopt(attempt.sck, SOL_SOCKET, SO_SNDBUF, &snd_buffer_size, sizeof(snd_buffer_size));
+            }
+            fcntl(attempt.sck, F_SETFL, fcntl(attempt.sck, F_GETFL) | O_NONBLOCK);
+
+            if (0 == ::connect(attempt.sck, reinterpret_cast<sockaddr *>(&attempt.addr), attempt.addrlen)) {
+                this->connected(attempt);
+            }
+            else if (errno != EINPROGRESS) {
+                if (this->verbose) {
+                    LOG(LOG_INFO, "Connection to %s failed with errno = %d (%s)", this->host, errno, strerror(errno));
+                }
+                close(attempt.sck);
+                attempt.sck = -1;
+                now = true;
+            }
+        }
+
+        if (this->state == CONNECTING) {
+            for (size_t i = 0; i < this->attempt_count; ++i) {
+                if (!this->attempts[i].started || this->attempts[i].sck != -1) {
+                    return;
+                }
+            }
+            LOG(LOG_INFO, "All trials done connecting to %s:%d", this->host, this->port);
+            this->attempt_count = 0;
+            this->state = FAILED;
+        }
+    }
+
+    void connected(Attempt & winner) {
+        this->sck = winner.sck;
+        winner.sck = -1;
+        for (size_t i = 0; i < this->attempt_count; ++i) {
+            if (this->attempts[i].sck != -1) {
+                close(this->attempts[i].sck);
+            }
+        }
+        this->attempt_count = 0;
+        this->state = CONNECTED;
+        LOG(LOG_INFO, "connection to %s:%d succeeded : socket %d", this->host, this->port, this->sck);
+    }
+};
+
+#endif
@@ -392,6 +392,18 @@ public:
         }
     }
 
+    Bitmap(Bitmap && other) noexcept
+    : data_bitmap(other.data_bitmap)
+    {
+        other.data_bitmap = 0;
+    }
+
+    Bitmap & operator=(Bitmap && other) noexcept
+    {
+        this->swap(other);
+        return *this;
+    }
+
     ~Bitmap() {
         this->reset();
     }
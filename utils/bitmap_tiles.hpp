@@ -0,0 +1,125 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Helpers used by Front to cut a MemBlt bitmap into tiles: tile geometry
+   from client bitmap cache cell sizes, detection of uniform tiles, of
+   tiles with the same pixels and of photographic tiles.
+*/
+
+#ifndef _REDEMPTION_UTILS_BITMAP_TILES_HPP_
+#define _REDEMPTION_UTILS_BITMAP_TILES_HPP_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "bitfu.hpp"
+
+namespace bitmap_tiles {
+
+// Largest square tile (64, 32, 16 or 8 pixels) whose bitmap fits in a
+// cache cell of cell_size bytes and in an order of less than max_order_size bytes.
+inline uint16_t max_tile_side(uint8_t Bpp, uint32_t cell_size, uint32_t max_order_size)
+{
+    uint16_t side = 64;
+    while (side > 8 && (uint32_t(Bpp) * side * side > cell_size
+                     || uint32_t(Bpp) * side * side >= max_order_size)) {
+        side /= 2;
+    }
+    return side;
+}
+
+// Tile length used to cut length pixels in as few tiles of at most
+// max_side pixels as possible, all tiles of the same size but the last.
+// A 70 pixels wide bitmap gives two tiles of 36 and 34 pixels instead of
+// 64 and 6. Widths are multiple of 4 (bitmap lines are aligned on 4 pixels).
+inline uint16_t balanced_tile_length(uint16_t length, uint16_t max_side, bool is_width)
+{
+    if (length <= max_side) {
+        return is_width ? std::min<uint16_t>(align4(length), max_side) : length;
+    }
+    const unsigned count = (length + max_side - 1u) / max_side;
+    const uint16_t tile = uint16_t((length + count - 1u) / count);
+    return is_width ? std::min<uint16_t>(align4(tile), max_side) : tile;
+}
+
+// Rows are line_size bytes apart, a tile of cx pixels of Bpp bytes.
+// Sets pixel to the color of the tile if all its pixels have the same color.
+inline bool is_uniform( const uint8_t * first_row, size_t line_size, uint8_t Bpp
+                      , uint16_t cx, uint16_t cy, uint32_t & pixel)
+{
+    if (!cx || !cy) {
+        return false;
+    }
+    const size_t row_size = size_t(cx) * Bpp;
+    // the first row is checked pixel by pixel, the others against the first row
+    for (const uint8_t * p = first_row + Bpp; p != first_row + row_size; p += Bpp) {
+        if (memcmp(p, first_row, Bpp)) {
+            return false;
+        }
+    }
+    for (const uint8_t * row = first_row + line_size; --cy; row += line_size) {
+        if (memcmp(row, first_row, row_size)) {
+            return false;
+        }
+    }
+    pixel = in_uint32_from_nb_bytes_le(Bpp, first_row);
+    return true;
+}
+
+inline bool same_pixels( const uint8_t * first_row1, const uint8_t * first_row2, size_t line_size
+                       , size_t row_size, uint16_t cy)
+{
+    for (; cy; --cy, first_row1 += line_size, first_row2 += line_size) {
+        if (memcmp(first_row1, first_row2, row_size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Few pixels equal to their left neighbour: interleaved RLE gets little
+// out of such a tile (photos, gradients), a codec with color conversion
+// does better.
+inline bool is_photographic( const uint8_t * first_row, ptrdiff_t row_step, uint8_t Bpp
+                           , uint16_t cx, uint16_t cy)
+{
+    if (cx < 2 || !cy) {
+        return false;
+    }
+    const size_t row_size = size_t(cx) * Bpp;
+    const size_t pixels = size_t(cx - 1) * cy;
+    size_t repeated = 0;
+    for (const uint8_t * row = first_row; cy; --cy, row += row_step) {
+        for (const uint8_t * p = row + Bpp; p != row + row_size; p += Bpp) {
+            repeated += !memcmp(p, p - Bpp, Bpp);
+        }
+        // already too many runs
+        if (repeated * 4 >= pixels) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+#endif
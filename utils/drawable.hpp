@@ -29,15 +29,17 @@
 #include "colors.hpp"
 #include "rect.hpp"
 #include "ellipse.hpp"
+#include "rop_kernels.hpp"
 
 using std::size_t;
 
 namespace Ops {
-    using u8 = uint8_t;
+    // operators are bitwise, T is a byte or a vector of bytes (see rop_kernels.hpp)
 
     struct CopySrc
     {
-       u8 operator()(u8 /*target*/, u8 source) const
+       template<class T>
+       T operator()(const T & /*target*/, const T & source) const
        {
            return source;
        }
@@ -45,7 +47,8 @@ namespace Ops {
 
     struct InvertSrc
     {
-       u8 operator()(u8 /*target*/, u8 source) const
+       template<class T>
+       T operator()(const T & /*target*/, const T & source) const
        {
            return ~source;
        }
@@ -53,7 +56,8 @@ namespace Ops {
 
     struct InvertTarget
     {
-       u8 operator()(u8 target, u8 /*source*/) const
+       template<class T>
+       T operator()(const T & target, const T & /*source*/) const
        {
            return ~target;
        }
@@ -62,7 +66,8 @@ namespace Ops {
 
     struct Op_0xB8 // PSDPxax
     {
-        u8 operator()(u8 target, u8 source, u8 pattern) const
+        template<class T>
+        T operator()(const T & target, const T & source, const T & pattern) const
         {
             return ((target ^ pattern) & source) ^ pattern;
         }
@@ -78,15 +83,17 @@ namespace Ops {
 
     struct Op2_0x01 // R2_BLACK 0
     {
-       u8 operator()(u8 /*target*/, u8 /*source*/) const
+       template<class T>
+       T operator()(const T & /*target*/, const T & /*source*/) const
        {
-           return 0x00;
+           return T{};
        }
     };
 
     struct Op2_0x02 // R2_NOTMERGEPEN DPon
     {
-        u8 operator()(u8 target, u8 source) const
+        template<class T>
+        T operator()(const T & target, const T & source) const
         {
             return ~(target | source);
         }
@@ -94,7 +101,8 @@ namespace Ops {
 
     struct Op2_0x03 // R2_MASKNOTPEN DPna
     {
-        u8 operator()(u8 target, u8 source) const
+        template<class T>
+        T operator()(const T & target, const T & source) const
         {
             return (target & ~source);
         }
@@ -104,7 +112,8 @@ namespace Ops {
 
     struct Op2_0x05 // R2_MASKPENNOT PDna
     {
-        u8 operator()(u8 target, u8 source) const
+        template<class T>
+        T operator()(const T & target, const T & source) const
         {
             return (source & ~target);
         }
@@ -114,7 +123,8 @@ namespace Ops {
 
     struct Op2_0x07 // R2_XORPEN DPx
     {
-        u8 operator()(u8 target, u8 source) const
+        template<class T>
+        T operator()(const T & target, const T & source) const
         {
             return (target ^ source);
         }
@@ -122,7 +132,8 @@ namespace Ops {
 
     struct Op2_0x08 // R2_NOTMASKPEN DPan
     {
-        u8 operator()(u8 target, u8 source) const
+        template<class T>
+        T operator()(const T & target, const T & source) const
         {
             return ~(target & source);
         }
@@ -130,7 +141,8 @@ namespace Ops {
 
     struct Op2_0x09 // R2_MASKPEN DPa
     {
-        u8 operator()(u8 target, u8 source) const
+        template<class T>
+        T operator()(const T & target, const T & source) const
         {
             return (target & source);
         }
@@ -138,7 +150,8 @@ namespace Ops {
 
     struct Op2_0x0A // R2_NOTXORPEN DPxn
     {
-        u8 operator()(u8 target, u8 source) const
+        template<class T>
+        T operator()(const T & target, const T & source) const
         {
             return ~(target ^ source);
         }
@@ -146,7 +159,8 @@ namespace Ops {
 
     // struct Op2_0x0B // R2_NOP D
     // {
-    //     u8 operator()(u8 target, u8 source) const
+    //     template<class T>
+    //     T operator()(const T & target, const T & source) const
     //     {
     //         return target;
     //     }
@@ -154,7 +168,8 @@ namespace Ops {
 
     struct Op2_0x0C // R2_MERGENOTPEN DPno
     {
-        u8 operator()(u8 target, u8 source) const
+        template<class T>
+        T operator()(const T & target, const T & source) const
         {
             return (target | ~source);
         }
@@ -164,7 +179,8 @@ namespace Ops {
 
     struct Op2_0x0E // R2_MERGEPENNOT PDno
     {
-        u8 operator()(u8 target, u8 source) const
+        template<class T>
+        T operator()(const T & target, const T & source) const
         {
             return (source | ~target);
         }
@@ -172,7 +188,8 @@ namespace Ops {
 
     struct Op2_0x0F // R2_MERGEPEN PDo
     {
-        u8 operator()(u8 target, u8 source) const
+        template<class T>
+        T operator()(const T & target, const T & source) const
         {
             return (target | source);
         }
@@ -180,9 +197,10 @@ namespace Ops {
 
     struct Op2_0x10 // R2_WHITE 1
     {
-       u8 operator()(u8 /*target*/, u8 /*source*/) const
+       template<class T>
+       T operator()(const T & /*target*/, const T & /*source*/) const
        {
-           return 0xFF;
+           return T(~T{});
        }
     };
 
@@ -201,7 +219,8 @@ namespace Ops {
 
     struct Op_0x11
     {
-        u8 operator()(u8 target, u8 source) const
+        template<class T>
+        T operator()(const T & target, const T & source) const
         {
             return ~(target | ~source);
         }
@@ -345,6 +364,14 @@ struct DrawableTraitColor24
             return {p[0], p[1], p[2]};
         }
     };
+
+    struct toColor32
+    {
+        color_t operator()(const uint8_t * p) const noexcept
+        {
+            return {p[0], p[1], p[2]};
+        }
+    };
 };
 
 template<DepthColor BppIn>
@@ -359,6 +386,7 @@ struct DrawableTrait<DepthColor::color24>
 template<DepthColor BppIn>
 class DrawableImpl
 {
+    TODO("16 and 32 bpp framebuffers need Drawable (timestamp, pointer) and the wrm snapshots to leave 24 bpp first")
     static_assert(BppIn != DepthColor::color8, "8 bit isn't supported");
     static_assert(BppIn != DepthColor::color15, "15 bit isn't supported");
     static_assert(BppIn != DepthColor::color16, "16 bit isn't supported");
@@ -465,7 +493,6 @@ private:
     template<class>
     struct AssignOp;
     struct Assign;
-    struct Invert;
 
 public:
     void opaque_rect(const Rect & rect, const color_t color) noexcept
@@ -498,10 +525,7 @@ public:
         const size_t bmp_line_size = bmp.line_size();
 
         if (bmp_bpp == this->bpp()) {
-            const size_t line_size = this->rowsize();
-            for (cP ep = dest + line_size * rect.cy; dest < ep; dest += line_size, src -= bmp_line_size) {
-                this->copy(dest, src, n, op, c...);
-            }
+            this->copy_rows(dest, this->rowsize(), src, -ptrdiff_t(bmp_line_size), n, rect.cy, op, c...);
         }
         else {
             switch (bmp_bpp) {
@@ -513,6 +537,8 @@ public:
                     bmp_Bpp, bmp_line_size, op, typename traits::toColor16{}, c...); break;
                 case 24: this->spe_mem_blt(dest, src, rect.cx, rect.cy,
                     bmp_Bpp, bmp_line_size, op, typename traits::toColor24{}, c...); break;
+                case 32: this->spe_mem_blt(dest, src, rect.cx, rect.cy,
+                    bmp_Bpp, bmp_line_size, op, typename traits::toColor32{}, c...); break;
                 default: ;
             }
         }
@@ -782,9 +808,9 @@ private:
     template <typename Op>
     void scr_blt_op_nooverlap(Rect const & rect_dest, size_t srcx, size_t srcy, Op op) noexcept
     {
-        this->scr_blt_impl(rect_dest, srcx, srcy, [this, op](P dest, cP src, size_t n) {
-            this->copy(dest, src, n, op);
-        });
+        this->copy_rows( this->first_pixel(rect_dest), this->rowsize()
+                       , this->first_pixel(srcx, srcy), this->rowsize()
+                       , rect_dest.cx * Bpp, rect_dest.cy, op);
     }
 
     template <typename F>
@@ -851,24 +877,27 @@ public:
     }
 
     template <typename Op>
-    void patblt_op(const Rect & rect, color_t color, Op) noexcept
+    void patblt_op(const Rect & rect, color_t color, Op op) noexcept
     {
-        this->apply_for_rect(rect, AssignOp<Op>{color});
+        uint8_t pixel[Bpp];
+        traits::assign(pixel, color);
+        rop_kernels::pattern(this->first_pixel(rect), this->rowsize(), pixel, rect.cx * Bpp, rect.cy, op);
     }
 
     void patblt_op(const Rect & rect, color_t color, Ops::InvertSrc) noexcept
     {
-        this->apply_for_rect(rect, Assign{~color});
+        this->opaque_rect(rect, ~color);
     }
 
     void patblt_op(const Rect & rect, color_t color, Ops::CopySrc) noexcept
     {
-        this->apply_for_rect(rect, Assign{color});
+        this->opaque_rect(rect, color);
     }
 
     void invert_color(const Rect & rect) noexcept
     {
-        this->apply_for_rect(rect, Invert{});
+        const uint8_t pixel[1] = {0xff};
+        rop_kernels::pattern(this->first_pixel(rect), this->rowsize(), pixel, rect.cx * Bpp, rect.cy, Ops::Op2_0x07());
     }
 
 private:
@@ -887,18 +916,10 @@ private:
         { return traits::assign(dest, color, Op()); }
     };
 
-    struct Invert {
-        P operator()(P dest) const noexcept
-        { *dest ^= 0xff; return ++dest; }
-    };
-
     template<class Op>
     void copy(uint8_t * dest, const uint8_t * src, size_t n, Op op) noexcept
     {
-        const uint8_t * e = dest + n;
-        for (; dest != e; ++dest, ++src) {
-            *dest = op(*dest, *src);
-        }
+        rop_kernels::binary(dest, 0, src, 0, n, 1, op);
     }
 
     void copy(uint8_t * dest, const uint8_t * src, size_t n, Ops::CopySrc) noexcept
@@ -907,16 +928,29 @@ private:
     }
 
     template<class Op>
-    void copy(uint8_t * dest, const uint8_t * src, size_t n, Op op, color_t c) noexcept
+    void copy_rows( uint8_t * dest, ptrdiff_t dest_step, const uint8_t * src, ptrdiff_t src_step
+                  , size_t n, size_t cy, Op op) noexcept
     {
-        const uint8_t * e = dest + n;
-        while (dest != e) {
-            *dest = op(*dest, *src, c.red());   ++dest; ++src;
-            *dest = op(*dest, *src, c.green()); ++dest; ++src;
-            *dest = op(*dest, *src, c.blue());  ++dest; ++src;
+        rop_kernels::binary(dest, dest_step, src, src_step, n, cy, op);
+    }
+
+    void copy_rows( uint8_t * dest, ptrdiff_t dest_step, const uint8_t * src, ptrdiff_t src_step
+                  , size_t n, size_t cy, Ops::CopySrc) noexcept
+    {
+        for (; cy; --cy, dest += dest_step, src += src_step) {
+            memcpy(dest, src, n);
         }
     }
 
+    template<class Op>
+    void copy_rows( uint8_t * dest, ptrdiff_t dest_step, const uint8_t * src, ptrdiff_t src_step
+                  , size_t n, size_t cy, Op op, color_t c) noexcept
+    {
+        uint8_t pixel[Bpp];
+        traits::assign(pixel, c);
+        rop_kernels::ternary(dest, dest_step, src, src_step, pixel, n, cy, op);
+    }
+
     template<class F>
     P apply_for_line(P p, size_t n, F f) noexcept
     {
@@ -925,20 +959,6 @@ private:
         }
         return p;
     }
-
-    template<class F>
-    void apply_for_rect(const Rect & rect, F f) noexcept
-    {
-        P p = this->first_pixel(rect);
-        const size_t line_size = this->rowsize();
-        const size_t cx = rect.cx * Bpp;
-        const size_t inc_line = static_cast<size_t>(line_size - cx);
-        for (cP pe = p + rect.cy * line_size; p != pe; p += inc_line) {
-            for (cP pe2 = p + cx; p != pe2; ) {
-                p = f(p);
-            }
-        }
-    }
 };
 
 
@@ -0,0 +1,258 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   FLV writer using the Screen Video codec (FLV codec id 3).
+
+   Screen Video is a lossless codec made for screen captures: image is cut
+   in blocks, each block is deflated independently and blocks unchanged since
+   previous frame are sent empty in inter frames. It only needs zlib and is
+   played by any FLV capable player (ffmpeg, vlc, mplayer, ...).
+
+   Blocks and rows inside blocks are ordered bottom to top, pixels are BGR.
+*/
+
+#ifndef _REDEMPTION_UTILS_FLV_SCREEN_VIDEO_HPP_
+#define _REDEMPTION_UTILS_FLV_SCREEN_VIDEO_HPP_
+
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "error.hpp"
+#include "log.hpp"
+#include "transport.hpp"
+
+struct FlvParams {
+    unsigned frame_rate         = 5;
+    // multiple of 16, from 16 to 256
+    unsigned block_width        = 64;
+    unsigned block_height       = 64;
+    int      zlib_level         = Z_DEFAULT_COMPRESSION;
+    // in frames, 0: only first frame of file is a key frame
+    unsigned key_frame_interval = 100;
+};
+
+class FlvScreenVideoEncoder {
+    enum {
+        FLV_TAG_VIDEO        = 9,
+        FLV_TAG_SCRIPT       = 18,
+        FLV_KEY_FRAME        = 1,
+        FLV_INTER_FRAME      = 2,
+        FLV_CODEC_SCREEN     = 3,
+        FLV_TAG_HEADER_SIZE  = 11
+    };
+
+    Transport & trans;
+    const FlvParams params;
+    const unsigned width;
+    const unsigned height;
+    const unsigned h_blocks;
+    const unsigned v_blocks;
+
+    // last encoded frame, packed bgr rows
+    std::unique_ptr<uint8_t[]> previous;
+    std::unique_ptr<uint8_t[]> raw_block;
+    std::vector<uint8_t> packet;
+    z_stream zstrm;
+
+    // frames since last header
+    unsigned frame_count;
+
+public:
+    // statistics of last written frame
+    unsigned changed_blocks;
+
+    FlvScreenVideoEncoder(Transport & trans, unsigned width, unsigned height, const FlvParams & params)
+    : trans(trans)
+    , params(params)
+    , width(width)
+    , height(height)
+    , h_blocks((width + params.block_width - 1) / params.block_width)
+    , v_blocks((height + params.block_height - 1) / params.block_height)
+    , previous(new uint8_t[width * height * 3])
+    , raw_block(new uint8_t[params.block_width * params.block_height * 3])
+    , frame_count(0)
+    , changed_blocks(0)
+    {
+        if (!width || !height || width > 4095 || height > 4095
+        ||  params.block_width  < 16 || params.block_width  > 256 || (params.block_width  % 16)
+        ||  params.block_height < 16 || params.block_height > 256 || (params.block_height % 16)) {
+            LOG( LOG_ERR, "FlvScreenVideoEncoder: unsupported geometry %ux%u (blocks %ux%u)"
+               , width, height, params.block_width, params.block_height);
+            throw Error(ERR_RECORDER_INVALID_OUTPUT_FORMAT_PARAMETER);
+        }
+
+        memset(&this->zstrm, 0, sizeof(this->zstrm));
+        if (deflateInit(&this->zstrm, params.zlib_level) != Z_OK) {
+            LOG(LOG_ERR, "FlvScreenVideoEncoder: deflateInit failed");
+            throw Error(ERR_RECORDER_INIT_FAILED);
+        }
+    }
+
+    ~FlvScreenVideoEncoder() {
+        deflateEnd(&this->zstrm);
+    }
+
+    // FLV header and stream metadata, called at beginning of each file
+    void write_header() {
+        static const uint8_t header[13] = {
+            'F', 'L', 'V', 1,
+            0x01,           // video only
+            0, 0, 0, 9,     // header size
+            0, 0, 0, 0      // PreviousTagSize0
+        };
+        this->trans.send(header, sizeof(header));
+
+        this->packet.clear();
+        this->amf_string("onMetaData");
+        this->packet.push_back(0x08); // ECMA array
+        this->push_be(4, 4);
+        this->amf_number_property("width",        this->width);
+        this->amf_number_property("height",       this->height);
+        this->amf_number_property("framerate",    this->params.frame_rate);
+        this->amf_number_property("videocodecid", FLV_CODEC_SCREEN);
+        this->push_be(0x000009, 3);   // object end marker
+        this->send_tag(FLV_TAG_SCRIPT, 0);
+
+        this->frame_count = 0;
+    }
+
+    // data: top to bottom bgr rows of width x height pixels
+    // returns false if frame was skipped because nothing changed
+    bool write_frame(const uint8_t * data, size_t rowsize, uint32_t timestamp_ms, bool force = false) {
+        const bool key_frame = (this->frame_count == 0)
+            || (this->params.key_frame_interval && (this->frame_count % this->params.key_frame_interval) == 0);
+
+        this->packet.clear();
+        this->packet.push_back(((key_frame ? FLV_KEY_FRAME : FLV_INTER_FRAME) << 4) | FLV_CODEC_SCREEN);
+        this->push_be((((this->params.block_width  / 16) - 1) << 12) | this->width,  2);
+        this->push_be((((this->params.block_height / 16) - 1) << 12) | this->height, 2);
+
+        this->changed_blocks = 0;
+        const size_t prev_rowsize = this->width * 3;
+        for (unsigned by = 0; by < this->v_blocks; ++by) {
+            // block rows are counted from bottom of image, last one may be partial
+            const unsigned bottom = this->height - by * this->params.block_height;
+            const unsigned bh     = std::min(this->params.block_height, bottom);
+            for (unsigned bx = 0; bx < this->h_blocks; ++bx) {
+                const unsigned left      = bx * this->params.block_width;
+                const unsigned bw        = std::min(this->params.block_width, this->width - left);
+                const size_t   line_size = bw * 3;
+
+                bool changed = key_frame;
+                for (unsigned y = bottom - bh; !changed && y < bottom; ++y) {
+                    changed = memcmp( data + y * rowsize + left * 3
+                                    , this->previous.get() + y * prev_rowsize + left * 3, line_size);
+                }
+                if (!changed) {
+                    this->push_be(0, 2);
+                    continue;
+                }
+
+                uint8_t * raw = this->raw_block.get();
+                for (unsigned y = bottom; y-- > bottom - bh; raw += line_size) {
+                    memcpy(raw, data + y * rowsize + left * 3, line_size);
+                    memcpy(this->previous.get() + y * prev_rowsize + left * 3, raw, line_size);
+                }
+                this->deflate_block(raw - this->raw_block.get());
+                ++this->changed_blocks;
+            }
+        }
+
+        if (!this->changed_blocks && !force) {
+            return false;
+        }
+
+        this->send_tag(FLV_TAG_VIDEO, timestamp_ms);
+        ++this->frame_count;
+        return true;
+    }
+
+private:
+    void deflate_block(size_t raw_size) {
+        const size_t size_pos = this->packet.size();
+        this->packet.resize(size_pos + 2 + deflateBound(&this->zstrm, raw_size));
+
+        deflateReset(&this->zstrm);
+        this->zstrm.next_in   = this->raw_block.get();
+        this->zstrm.avail_in  = raw_size;
+        this->zstrm.next_out  = &this->packet[size_pos + 2];
+        this->zstrm.avail_out = this->packet.size() - size_pos - 2;
+        if (deflate(&this->zstrm, Z_FINISH) != Z_STREAM_END || this->zstrm.total_out > 0xFFFF) {
+            LOG(LOG_ERR, "FlvScreenVideoEncoder: block compression failed");
+            throw Error(ERR_RECORDER_FAILED_TO_WRITE_ENCODED_FRAME);
+        }
+
+        const size_t block_size = this->zstrm.total_out;
+        this->packet[size_pos]     = block_size >> 8;
+        this->packet[size_pos + 1] = block_size;
+        this->packet.resize(size_pos + 2 + block_size);
+    }
+
+    void send_tag(uint8_t type, uint32_t timestamp_ms) {
+        const size_t  data_size = this->packet.size();
+        const uint8_t header[FLV_TAG_HEADER_SIZE] = {
+            type,
+            uint8_t(data_size >> 16), uint8_t(data_size >> 8), uint8_t(data_size),
+            uint8_t(timestamp_ms >> 16), uint8_t(timestamp_ms >> 8), uint8_t(timestamp_ms),
+            uint8_t(timestamp_ms >> 24),  // timestamp extended
+            0, 0, 0                       // stream id
+        };
+        this->trans.send(header, sizeof(header));
+        this->trans.send(this->packet.data(), data_size);
+
+        const size_t tag_size = FLV_TAG_HEADER_SIZE + data_size;
+        const uint8_t previous_tag_size[4] = {
+            uint8_t(tag_size >> 24), uint8_t(tag_size >> 16), uint8_t(tag_size >> 8), uint8_t(tag_size)
+        };
+        this->trans.send(previous_tag_size, sizeof(previous_tag_size));
+    }
+
+    void push_be(uint32_t value, unsigned nb_bytes) {
+        while (nb_bytes--) {
+            this->packet.push_back(value >> (nb_bytes * 8));
+        }
+    }
+
+    void amf_string(const char * s) {
+        this->packet.push_back(0x02);
+        this->amf_property_name(s);
+    }
+
+    void amf_property_name(const char * s) {
+        const size_t len = strlen(s);
+        this->push_be(len, 2);
+        this->packet.insert(this->packet.end(), s, s + len);
+    }
+
+    void amf_number_property(const char * name, double value) {
+        this->amf_property_name(name);
+        this->packet.push_back(0x00);
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        this->push_be(bits >> 32, 4);
+        this->push_be(bits, 4);
+    }
+};
+
+#endif
@@ -0,0 +1,78 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Durations collected by benchmark tools and their percentiles.
+*/
+
+#ifndef _REDEMPTION_UTILS_LATENCY_STATS_HPP_
+#define _REDEMPTION_UTILS_LATENCY_STATS_HPP_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <algorithm>
+#include <vector>
+
+class LatencyStats {
+    std::vector<uint64_t> samples;  // microseconds
+    bool                  sorted;
+    uint64_t              total;
+
+public:
+    LatencyStats() : sorted(true), total(0) {}
+
+    void add(uint64_t us) {
+        this->sorted = this->samples.empty() || (this->sorted && this->samples.back() <= us);
+        this->samples.push_back(us);
+        this->total += us;
+    }
+
+    void merge(const LatencyStats & other) {
+        this->samples.insert(this->samples.end(), other.samples.begin(), other.samples.end());
+        this->sorted = this->samples.size() == other.samples.size() && other.sorted;
+        this->total += other.total;
+    }
+
+    size_t count() const {
+        return this->samples.size();
+    }
+
+    uint64_t mean() const {
+        return this->samples.empty() ? 0 : this->total / this->samples.size();
+    }
+
+    // Nearest rank percentile (0 to 100), 0 when there is no sample.
+    uint64_t percentile(unsigned p) {
+        if (this->samples.empty()) {
+            return 0;
+        }
+        if (!this->sorted) {
+            std::sort(this->samples.begin(), this->samples.end());
+            this->sorted = true;
+        }
+        const size_t rank = (std::min(p, 100u) * this->samples.size() + 99) / 100;
+        return this->samples[rank ? rank - 1 : 0];
+    }
+
+    uint64_t max() {
+        return this->percentile(100);
+    }
+};
+
+#endif
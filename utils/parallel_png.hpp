@@ -0,0 +1,355 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   PNG writer splitting the image in horizontal strips deflated
+   independently on several threads.
+
+   Each strip is a raw deflate stream terminated by a full flush (the last
+   one by a final block), so the strips concatenated behind a single zlib
+   header form one valid IDAT stream. Adler32 of the whole image is
+   computed by combining adler32 of strips. Output only depends on
+   parameters, not on the number of threads.
+*/
+
+#ifndef _REDEMPTION_UTILS_PARALLEL_PNG_HPP_
+#define _REDEMPTION_UTILS_PARALLEL_PNG_HPP_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "error.hpp"
+#include "log.hpp"
+#include "transport.hpp"
+
+struct PngParallelParams {
+    // values are PNG filter types
+    enum {
+        FILTER_NONE,
+        FILTER_SUB,
+        FILTER_UP,
+        FILTER_AVERAGE,
+        FILTER_PAETH
+    };
+
+    int      zlib_level   = Z_DEFAULT_COMPRESSION;
+    uint8_t  filter       = FILTER_SUB;
+    // 0: not used, libpng encoder is used instead (see ImageCapture)
+    unsigned nb_threads   = 0;
+    unsigned strip_height = 64;
+};
+
+struct PngParallelStrip {
+    std::vector<uint8_t> data;  // compressed
+    uLong adler;
+    uLong raw_size;
+    bool  done;
+    bool  ok;
+
+    PngParallelStrip()
+    : adler(1)
+    , raw_size(0)
+    , done(false)
+    , ok(false)
+    {}
+};
+
+static inline void png_parallel_to_rgb(uint8_t * dest, const uint8_t * row, size_t width, bool bgr)
+{
+    if (bgr) {
+        for (size_t x = 0; x < width; ++x, dest += 3, row += 3) {
+            dest[0] = row[2];
+            dest[1] = row[1];
+            dest[2] = row[0];
+        }
+    }
+    else {
+        memcpy(dest, row, width * 3);
+    }
+}
+
+static inline uint8_t png_parallel_paeth(uint8_t a, uint8_t b, uint8_t c)
+{
+    const int p  = a + b - c;
+    const int pa = abs(p - a);
+    const int pb = abs(p - b);
+    const int pc = abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return a;
+    }
+    return (pb <= pc) ? b : c;
+}
+
+// prev is the rgb row above (zeros for the first row of image)
+static inline void png_parallel_filter_row(uint8_t * dest, const uint8_t * cur, const uint8_t * prev,
+                                           size_t size, uint8_t filter)
+{
+    const size_t Bpp = 3;
+    *dest++ = filter;
+    switch (filter) {
+    case PngParallelParams::FILTER_SUB:
+        for (size_t i = 0; i < size; ++i) {
+            dest[i] = cur[i] - ((i >= Bpp) ? cur[i - Bpp] : 0);
+        }
+    break;
+    case PngParallelParams::FILTER_UP:
+        for (size_t i = 0; i < size; ++i) {
+            dest[i] = cur[i] - prev[i];
+        }
+    break;
+    case PngParallelParams::FILTER_AVERAGE:
+        for (size_t i = 0; i < size; ++i) {
+            const unsigned left = (i >= Bpp) ? cur[i - Bpp] : 0;
+            dest[i] = cur[i] - ((left + prev[i]) >> 1);
+        }
+    break;
+    case PngParallelParams::FILTER_PAETH:
+        for (size_t i = 0; i < size; ++i) {
+            const uint8_t left     = (i >= Bpp) ? cur[i - Bpp] : 0;
+            const uint8_t up_left  = (i >= Bpp) ? prev[i - Bpp] : 0;
+            dest[i] = cur[i] - png_parallel_paeth(left, prev[i], up_left);
+        }
+    break;
+    default:
+        memcpy(dest, cur, size);
+    break;
+    }
+}
+
+static inline void png_parallel_encode_strip(PngParallelStrip & strip, const uint8_t * data,
+                                             size_t width, size_t rowsize, bool bgr,
+                                             size_t first_row, size_t nb_rows, bool last,
+                                             const PngParallelParams & params)
+{
+    const size_t rgb_size = width * 3;
+    const size_t raw_size = (rgb_size + 1) * nb_rows;
+    std::unique_ptr<uint8_t[]> raw(new uint8_t[raw_size]);
+    std::unique_ptr<uint8_t[]> rows(new uint8_t[rgb_size * 2]);
+    uint8_t * cur  = rows.get();
+    uint8_t * prev = rows.get() + rgb_size;
+
+    // filters of the first row of a strip use the last row of previous strip
+    if (first_row) {
+        png_parallel_to_rgb(prev, data + (first_row - 1) * rowsize, width, bgr);
+    }
+    else {
+        memset(prev, 0, rgb_size);
+    }
+
+    uint8_t * out = raw.get();
+    for (size_t y = first_row; y < first_row + nb_rows; ++y) {
+        png_parallel_to_rgb(cur, data + y * rowsize, width, bgr);
+        png_parallel_filter_row(out, cur, prev, rgb_size, params.filter);
+        out += rgb_size + 1;
+        std::swap(cur, prev);
+    }
+
+    strip.raw_size = raw_size;
+    strip.adler    = adler32(1, raw.get(), raw_size);
+
+    z_stream zstrm;
+    memset(&zstrm, 0, sizeof(zstrm));
+    // raw deflate, zlib header and adler32 are written once for the whole image
+    if (deflateInit2(&zstrm, params.zlib_level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return;
+    }
+
+    // room for zlib header before first strip and adler32 after last strip
+    const size_t header_size = first_row ? 0 : 2;
+    strip.data.resize(header_size + deflateBound(&zstrm, raw_size) + 64 + (last ? 4 : 0));
+
+    zstrm.next_in   = raw.get();
+    zstrm.avail_in  = raw_size;
+    zstrm.next_out  = strip.data.data() + header_size;
+    zstrm.avail_out = strip.data.size() - header_size - (last ? 4 : 0);
+
+    const int ret = deflate(&zstrm, last ? Z_FINISH : Z_FULL_FLUSH);
+    strip.ok = last ? (ret == Z_STREAM_END)
+                    : (ret == Z_OK && zstrm.avail_in == 0 && zstrm.avail_out > 0);
+    strip.data.resize(strip.data.size() - zstrm.avail_out - (last ? 4 : 0));
+    deflateEnd(&zstrm);
+}
+
+static inline void png_parallel_send_chunk(Transport & trans, const char * type,
+                                           const uint8_t * data, size_t size)
+{
+    uint8_t header[8] = {
+        uint8_t(size >> 24), uint8_t(size >> 16), uint8_t(size >> 8), uint8_t(size),
+        uint8_t(type[0]), uint8_t(type[1]), uint8_t(type[2]), uint8_t(type[3])
+    };
+    uLong crc = crc32(0, header + 4, 4);
+    if (size) {
+        crc = crc32(crc, data, size);
+    }
+    const uint8_t footer[4] = {
+        uint8_t(crc >> 24), uint8_t(crc >> 16), uint8_t(crc >> 8), uint8_t(crc)
+    };
+
+    trans.send(header, sizeof(header));
+    if (size) {
+        trans.send(data, size);
+    }
+    trans.send(footer, sizeof(footer));
+}
+
+static inline void transport_dump_png24_parallel(Transport & trans, const uint8_t * data,
+                            const size_t width,
+                            const size_t height,
+                            const size_t rowsize,
+                            const bool bgr,
+                            const PngParallelParams & params)
+{
+    const size_t strip_height = params.strip_height ? params.strip_height : height;
+    const size_t nb_strips    = height ? (height + strip_height - 1) / strip_height : 0;
+
+    std::vector<PngParallelStrip> strips(nb_strips);
+
+    std::mutex              mutex;
+    std::condition_variable strip_done;
+    size_t                  next_strip = 0;
+
+    auto encode = [&](size_t i) {
+        const size_t first_row = i * strip_height;
+        const size_t nb_rows   = std::min(strip_height, height - first_row);
+        // an exception escaping a worker thread would terminate the process:
+        // the strip is left not ok and the error is raised by the sender
+        try {
+            png_parallel_encode_strip( strips[i], data, width, rowsize, bgr, first_row, nb_rows
+                                     , i + 1 == nb_strips, params);
+        }
+        catch (...) {
+            strips[i].ok = false;
+        }
+    };
+
+    auto worker = [&]() {
+        for (;;) {
+            size_t i;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (next_strip >= nb_strips) {
+                    return;
+                }
+                i = next_strip++;
+            }
+            encode(i);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                strips[i].done = true;
+            }
+            strip_done.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    const size_t nb_threads = std::min<size_t>(params.nb_threads ? params.nb_threads : 1, nb_strips);
+    for (size_t t = 0; nb_threads > 1 && t < nb_threads; ++t) {
+        try {
+            workers.emplace_back(worker);
+        }
+        catch (const std::system_error &) {
+            LOG(LOG_WARNING, "transport_dump_png24_parallel: failed to start encoder thread");
+            break;
+        }
+    }
+
+    auto join_workers = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            next_strip = nb_strips;
+        }
+        for (std::thread & t : workers) {
+            t.join();
+        }
+        workers.clear();
+    };
+
+    try {
+        static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        trans.send(signature, sizeof(signature));
+
+        const uint8_t ihdr[13] = {
+            uint8_t(width >> 24),  uint8_t(width >> 16),  uint8_t(width >> 8),  uint8_t(width),
+            uint8_t(height >> 24), uint8_t(height >> 16), uint8_t(height >> 8), uint8_t(height),
+            8,  // bit depth
+            2,  // color type RGB
+            0,  // compression method
+            0,  // filter method
+            0   // interlace method
+        };
+        png_parallel_send_chunk(trans, "IHDR", ihdr, sizeof(ihdr));
+
+        // strips are sent in order as soon as they are ready
+        uLong adler = adler32(0, nullptr, 0);
+        for (size_t i = 0; i < nb_strips; ++i) {
+            PngParallelStrip & strip = strips[i];
+            if (workers.empty()) {
+                encode(i);
+            }
+            else {
+                std::unique_lock<std::mutex> lock(mutex);
+                strip_done.wait(lock, [&strip]{ return strip.done; });
+            }
+
+            if (!strip.ok) {
+                LOG(LOG_ERR, "transport_dump_png24_parallel: failed to encode strip %u", unsigned(i));
+                throw Error(ERR_BITMAP_PNG_SAVE_FAILED);
+            }
+
+            adler = adler32_combine(adler, strip.adler, strip.raw_size);
+
+            if (i == 0) {
+                const unsigned level = (params.zlib_level < 0) ? 6 : params.zlib_level;
+                const uint8_t cmf    = 0x78;  // deflate, 32K window
+                uint8_t flg          = (level < 2) ? 0 : (level < 6) ? 1 : (level == 6) ? 2 : 3;
+                flg <<= 6;
+                flg  += 31 - ((cmf * 256 + flg) % 31);
+                strip.data[0] = cmf;
+                strip.data[1] = flg;
+            }
+            if (i + 1 == nb_strips) {
+                const uint8_t adler_be[4] = {
+                    uint8_t(adler >> 24), uint8_t(adler >> 16), uint8_t(adler >> 8), uint8_t(adler)
+                };
+                strip.data.insert(strip.data.end(), adler_be, adler_be + 4);
+            }
+
+            png_parallel_send_chunk(trans, "IDAT", strip.data.data(), strip.data.size());
+            std::vector<uint8_t>().swap(strip.data);
+        }
+
+        png_parallel_send_chunk(trans, "IEND", nullptr, 0);
+    }
+    catch (...) {
+        join_workers();
+        throw;
+    }
+    join_workers();
+
+    trans.flush();
+}
+
+#endif
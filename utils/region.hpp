@@ -26,52 +26,196 @@
 #define _REDEMPTION_UTILS_REGION_HPP_
 
 #include <vector>
+#include <algorithm>
 #include "rect.hpp"
 
 /* region */
+// Rects are kept in y-x bands (as X11 and pixman regions):
+// - rects are sorted by y then by x,
+// - rects of a band have the same y and cy, they neither overlap nor touch,
+// - two touching bands never have the same x spans (they are coalesced).
+// Union, intersection and subtraction walk both regions band by band, the
+// cost is linear in the number of rects.
 struct Region {
     std::vector<Rect> rects;
 
     Region() {}
+    explicit Region(const Rect & rect) {
+        if (!rect.isempty()) {
+            this->rects.push_back(rect);
+        }
+    }
     ~Region() {}
 
+    bool isempty() const {
+        return this->rects.empty();
+    }
+
+    Rect bounds() const {
+        if (this->rects.empty()) {
+            return Rect();
+        }
+        int left = this->rects.front().x;
+        int right = this->rects.front().right();
+        for (const Rect & rect : this->rects) {
+            left = std::min<int>(left, rect.x);
+            right = std::max<int>(right, rect.right());
+        }
+        return Rect(left, this->rects.front().y, right - left,
+                    this->rects.back().bottom() - this->rects.front().y);
+    }
+
+    void add_rect(const Rect & rect) {
+        if (!rect.isempty()) {
+            this->combine(Region(rect).rects, keep_union);
+        }
+    }
+
     void subtract_rect(const Rect & rect) {
-        std::vector<Rect> new_rects;
+        if (!rect.isempty()) {
+            this->combine(Region(rect).rects, keep_subtract);
+        }
+    }
+
+    void intersect_rect(const Rect & rect) {
+        this->combine(Region(rect).rects, keep_intersect);
+    }
+
+    void add_region(const Region & other) {
+        this->combine(other.rects, keep_union);
+    }
+
+    void subtract_region(const Region & other) {
+        this->combine(other.rects, keep_subtract);
+    }
+
+    void intersect_region(const Region & other) {
+        this->combine(other.rects, keep_intersect);
+    }
+
+private:
+    // bit n is set if a point is kept when it belongs to this region (n & 1)
+    // and/or to the other one (n & 2)
+    enum {
+        keep_union     = (1 << 1) | (1 << 2) | (1 << 3),
+        keep_intersect = (1 << 3),
+        keep_subtract  = (1 << 1),
+    };
+
+    // first index after the band starting at rects[i]
+    static size_t band_end(const std::vector<Rect> & rects, size_t i) {
+        const int16_t y = rects[i].y;
+        while (i < rects.size() && rects[i].y == y) {
+            ++i;
+        }
+        return i;
+    }
+
+    void combine(const std::vector<Rect> & other, unsigned keep) {
+        const std::vector<Rect> & a = this->rects;
+        const std::vector<Rect> & b = other;
+        std::vector<Rect> result;
+        result.reserve(a.size() + b.size());
 
-        int count = this->rects.size();
-        for (int i = 0; i < count; i++) {
-            Rect rect1 = this->rects[i];
-            if (!rect.contains(rect1)) {
-                const Rect & sect = rect.intersect(rect1);
+        size_t prev_band = 0;
+        size_t ia = 0;
+        size_t ib = 0;
+        int y = std::min<int>(a.empty() ? 0x7fff : a[0].y, b.empty() ? 0x7fff : b[0].y);
+        while (ia < a.size() || ib < b.size()) {
+            const size_t ea = (ia < a.size()) ? band_end(a, ia) : ia;
+            const size_t eb = (ib < b.size()) ? band_end(b, ib) : ib;
+            const bool in_a = ia < a.size() && a[ia].y <= y;
+            const bool in_b = ib < b.size() && b[ib].y <= y;
 
-                if (sect.isempty()) {
-                    new_rects.push_back(rect1);
+            // the band ends where a band of either region starts or ends, when
+            // no region has a band at y, it is the gap up to the next band
+            int bottom = 0x7fff;
+            if (ia < a.size()) {
+                bottom = std::min<int>(bottom, in_a ? a[ia].bottom() : a[ia].y);
+            }
+            if (ib < b.size()) {
+                bottom = std::min<int>(bottom, in_b ? b[ib].bottom() : b[ib].y);
+            }
+
+            if (in_a || in_b) {
+                const size_t band = result.size();
+                this->combine_band( result, y, bottom
+                                  , a, in_a ? ia : ea, ea
+                                  , b, in_b ? ib : eb, eb, keep);
+                if (band != result.size()) {
+                    prev_band = coalesce(result, prev_band, band);
+                }
+            }
+
+            y = bottom;
+            if (in_a && a[ia].bottom() <= y) {
+                ia = ea;
+            }
+            if (in_b && b[ib].bottom() <= y) {
+                ib = eb;
+            }
+        }
+
+        this->rects = std::move(result);
+    }
+
+    // appends the x spans of the band [top, bottom) of a op b to result
+    static void combine_band( std::vector<Rect> & result, int top, int bottom
+                            , const std::vector<Rect> & a, size_t ia, size_t ea
+                            , const std::vector<Rect> & b, size_t ib, size_t eb
+                            , unsigned keep) {
+        const size_t first = result.size();
+        int x = std::min<int>(ia < ea ? a[ia].x : 0x7fff, ib < eb ? b[ib].x : 0x7fff);
+        while (ia < ea || ib < eb) {
+            const unsigned in = ((ia < ea && a[ia].x <= x) ? 1 : 0)
+                              | ((ib < eb && b[ib].x <= x) ? 2 : 0);
+            int next = 0x7fff;
+            if (ia < ea) {
+                next = std::min<int>(next, (in & 1) ? a[ia].right() : a[ia].x);
+            }
+            if (ib < eb) {
+                next = std::min<int>(next, (in & 2) ? b[ib].right() : b[ib].x);
+            }
+
+            if (keep & (1u << in)) {
+                if (result.size() != first && result.back().right() == x) {
+                    result.back().cx += next - x;
                 }
                 else {
-                    const Rect a(rect1.x, rect1.y, rect1.cx, sect.y - rect1.y);
-                    const Rect b(rect1.x, sect.y, sect.x - rect1.x, sect.cy);
-                    const Rect c(sect.right(), sect.y, rect1.right() - sect.right(), sect.cy);
-                    const Rect d(rect1.x, sect.bottom(), rect1.cx, rect1.bottom() - sect.bottom());
-                    if (!a.isempty()) {
-                        new_rects.push_back(a);
-                    }
-                    if (!b.isempty()) {
-                        new_rects.push_back(b);
-                    }
-                    if (!c.isempty()) {
-                        new_rects.push_back(c);
-                    }
-                    if (!d.isempty()) {
-                        new_rects.push_back(d);
-                    }
+                    result.push_back(Rect(x, top, next - x, bottom - top));
                 }
             }
+
+            x = next;
+            if ((in & 1) && a[ia].right() <= x) {
+                ++ia;
+            }
+            if ((in & 2) && b[ib].right() <= x) {
+                ++ib;
+            }
         }
-        this->rects = std::move(new_rects);
     }
 
-    void add_rect(const Rect & rect) {
-        this->rects.push_back(rect);
+    // merges the band starting at result[band] with the previous one if they
+    // touch and have the same x spans, returns the index of the last band
+    static size_t coalesce(std::vector<Rect> & result, size_t prev_band, size_t band) {
+        if (prev_band == band
+         || band - prev_band != result.size() - band
+         || result[prev_band].bottom() != result[band].y) {
+            return band;
+        }
+        for (size_t i = 0; i < band - prev_band; ++i) {
+            if (result[prev_band + i].x != result[band + i].x
+             || result[prev_band + i].cx != result[band + i].cx) {
+                return band;
+            }
+        }
+        const uint16_t cy = result[band].cy;
+        result.resize(band);
+        for (size_t i = prev_band; i < band; ++i) {
+            result[i].cy += cy;
+        }
+        return prev_band;
     }
 };
 
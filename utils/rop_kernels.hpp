@@ -0,0 +1,253 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2014
+   Author(s): Christophe Grosjean
+
+   Kernels applying raster operations (Ops:: functors) to rows of bytes.
+   Raster operations are bitwise, so a functor written for one byte gives
+   the same result on a whole vector of bytes: kernels process rows 16 or
+   32 bytes at a time and finish with bytes. 32 bytes (AVX2) kernels are
+   chosen at run time when the CPU supports them, once per rectangle.
+*/
+
+#ifndef _REDEMPTION_UTILS_ROP_KERNELS_HPP_
+#define _REDEMPTION_UTILS_ROP_KERNELS_HPP_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define REDEMPTION_ROP_KERNELS_AVX2
+#endif
+
+namespace rop_kernels {
+
+typedef uint8_t vec16 __attribute__((vector_size(16)));
+
+// The Ops:: functors are not compiled for AVX: a bare 32 bytes vector given
+// to them or returned by them would change the ABI (-Wpsabi). Wrapped in a
+// struct, it goes through memory, and once the functor is inlined in an avx2
+// kernel the operators below are single 256 bits instructions.
+struct vec32
+{
+    typedef uint8_t type __attribute__((vector_size(32)));
+    type v;
+};
+
+inline vec32 operator~(const vec32 & a) noexcept
+{ return vec32{~a.v}; }
+
+inline vec32 operator&(const vec32 & a, const vec32 & b) noexcept
+{ return vec32{a.v & b.v}; }
+
+inline vec32 operator|(const vec32 & a, const vec32 & b) noexcept
+{ return vec32{a.v | b.v}; }
+
+inline vec32 operator^(const vec32 & a, const vec32 & b) noexcept
+{ return vec32{a.v ^ b.v}; }
+
+inline void load(vec16 & v, const uint8_t * p) noexcept
+{ memcpy(&v, p, sizeof(v)); }
+
+inline void load(vec32 & v, const uint8_t * p) noexcept
+{ memcpy(&v.v, p, sizeof(v.v)); }
+
+inline void store(uint8_t * p, const vec16 & v) noexcept
+{ memcpy(p, &v, sizeof(v)); }
+
+inline void store(uint8_t * p, const vec32 & v) noexcept
+{ memcpy(p, &v.v, sizeof(v.v)); }
+
+// Bpp vectors hold a whole number of pixels, so a pattern of one pixel
+// stays in phase from a block of Bpp vectors to the next.
+template<class V, size_t Bpp>
+struct PatternVectors
+{
+    V v[Bpp];
+
+    explicit PatternVectors(const uint8_t (&pixel)[Bpp]) noexcept
+    {
+        uint8_t bytes[Bpp * sizeof(V)];
+        memcpy(bytes, pixel, Bpp);
+        for (size_t len = Bpp; len < sizeof(bytes); len *= 2) {
+            memcpy(bytes + len, bytes, std::min(len, sizeof(bytes) - len));
+        }
+        memcpy(this->v, bytes, sizeof(bytes));
+    }
+};
+
+// dest = op(dest, src) on cy rows of n bytes
+template<class V, class Op>
+inline void binary_rows( uint8_t * dest, ptrdiff_t dest_step, const uint8_t * src, ptrdiff_t src_step
+                       , size_t n, size_t cy, Op op) noexcept
+{
+    for (; cy; --cy, dest += dest_step, src += src_step) {
+        uint8_t * d = dest;
+        const uint8_t * s = src;
+        size_t i = n;
+        for (; i >= sizeof(V); i -= sizeof(V), d += sizeof(V), s += sizeof(V)) {
+            V vd;
+            V vs;
+            load(vd, d);
+            load(vs, s);
+            vd = op(vd, vs);
+            store(d, vd);
+        }
+        for (; i; --i, ++d, ++s) {
+            *d = op(*d, *s);
+        }
+    }
+}
+
+// dest = op(dest, pattern) on cy rows of n bytes, pattern is one pixel of
+// Bpp bytes repeated
+template<class V, size_t Bpp, class Op>
+inline void pattern_rows( uint8_t * dest, ptrdiff_t dest_step, const uint8_t (&pixel)[Bpp]
+                        , size_t n, size_t cy, Op op) noexcept
+{
+    const PatternVectors<V, Bpp> pattern(pixel);
+    for (; cy; --cy, dest += dest_step) {
+        uint8_t * d = dest;
+        size_t i = n;
+        for (; i >= Bpp * sizeof(V); i -= Bpp * sizeof(V)) {
+            for (V const & p : pattern.v) {
+                V vd;
+                load(vd, d);
+                vd = op(vd, p);
+                store(d, vd);
+                d += sizeof(V);
+            }
+        }
+        for (size_t k = 0; k < i; ++k, ++d) {
+            *d = op(*d, pixel[k % Bpp]);
+        }
+    }
+}
+
+// dest = op(dest, src, pattern) on cy rows of n bytes
+template<class V, size_t Bpp, class Op>
+inline void ternary_rows( uint8_t * dest, ptrdiff_t dest_step, const uint8_t * src, ptrdiff_t src_step
+                        , const uint8_t (&pixel)[Bpp], size_t n, size_t cy, Op op) noexcept
+{
+    const PatternVectors<V, Bpp> pattern(pixel);
+    for (; cy; --cy, dest += dest_step, src += src_step) {
+        uint8_t * d = dest;
+        const uint8_t * s = src;
+        size_t i = n;
+        for (; i >= Bpp * sizeof(V); i -= Bpp * sizeof(V)) {
+            for (V const & p : pattern.v) {
+                V vd;
+                V vs;
+                load(vd, d);
+                load(vs, s);
+                vd = op(vd, vs, p);
+                store(d, vd);
+                d += sizeof(V);
+                s += sizeof(V);
+            }
+        }
+        for (size_t k = 0; k < i; ++k, ++d, ++s) {
+            *d = op(*d, *s, pixel[k % Bpp]);
+        }
+    }
+}
+
+#ifdef REDEMPTION_ROP_KERNELS_AVX2
+template<class Op>
+__attribute__((target("avx2")))
+void binary_rows_avx2( uint8_t * dest, ptrdiff_t dest_step, const uint8_t * src, ptrdiff_t src_step
+                     , size_t n, size_t cy, Op op) noexcept
+{
+    binary_rows<vec32>(dest, dest_step, src, src_step, n, cy, op);
+}
+
+template<size_t Bpp, class Op>
+__attribute__((target("avx2")))
+void pattern_rows_avx2( uint8_t * dest, ptrdiff_t dest_step, const uint8_t (&pixel)[Bpp]
+                      , size_t n, size_t cy, Op op) noexcept
+{
+    pattern_rows<vec32>(dest, dest_step, pixel, n, cy, op);
+}
+
+template<size_t Bpp, class Op>
+__attribute__((target("avx2")))
+void ternary_rows_avx2( uint8_t * dest, ptrdiff_t dest_step, const uint8_t * src, ptrdiff_t src_step
+                      , const uint8_t (&pixel)[Bpp], size_t n, size_t cy, Op op) noexcept
+{
+    ternary_rows<vec32>(dest, dest_step, src, src_step, pixel, n, cy, op);
+}
+
+inline bool has_avx2() noexcept
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+#else
+inline bool has_avx2() noexcept
+{
+    return false;
+}
+#endif
+
+// below this size the 16 bytes kernels win over the cost of the dispatch
+enum { min_avx2_area = 256 };
+
+template<class Op>
+void binary( uint8_t * dest, ptrdiff_t dest_step, const uint8_t * src, ptrdiff_t src_step
+           , size_t n, size_t cy, Op op) noexcept
+{
+#ifdef REDEMPTION_ROP_KERNELS_AVX2
+    if (n * cy >= min_avx2_area && has_avx2()) {
+        binary_rows_avx2(dest, dest_step, src, src_step, n, cy, op);
+        return;
+    }
+#endif
+    binary_rows<vec16>(dest, dest_step, src, src_step, n, cy, op);
+}
+
+template<size_t Bpp, class Op>
+void pattern( uint8_t * dest, ptrdiff_t dest_step, const uint8_t (&pixel)[Bpp]
+            , size_t n, size_t cy, Op op) noexcept
+{
+#ifdef REDEMPTION_ROP_KERNELS_AVX2
+    if (n * cy >= min_avx2_area && has_avx2()) {
+        pattern_rows_avx2(dest, dest_step, pixel, n, cy, op);
+        return;
+    }
+#endif
+    pattern_rows<vec16>(dest, dest_step, pixel, n, cy, op);
+}
+
+template<size_t Bpp, class Op>
+void ternary( uint8_t * dest, ptrdiff_t dest_step, const uint8_t * src, ptrdiff_t src_step
+            , const uint8_t (&pixel)[Bpp], size_t n, size_t cy, Op op) noexcept
+{
+#ifdef REDEMPTION_ROP_KERNELS_AVX2
+    if (n * cy >= min_avx2_area && has_avx2()) {
+        ternary_rows_avx2(dest, dest_step, src, src_step, pixel, n, cy, op);
+        return;
+    }
+#endif
+    ternary_rows<vec16>(dest, dest_step, src, src_step, pixel, n, cy, op);
+}
+
+}
+
+#endif
@@ -60,7 +60,7 @@ private:
         { return !(*this == k); }
     };
 
-    typedef std::array<value_type, 53> trans_t;
+    typedef std::array<value_type, 54> trans_t;
 
     language_t lang;
     trans_t trans;
@@ -135,6 +135,7 @@ private:
                       "Echec du service d'authentification"}},
         {"target_fail", {"Failed to connect to remote TCP host",
                          "Echec de la connexion à la cible distante"}},
+        {"connecting", {"Connecting to", "Connexion à"}},
         {"comment", {"Comment", "Commentaire"}},
         {"no_results", {"No results found", "Aucun résultat"}},
         {"back_selector", {"Back to Selector", "Retour au Sélecteur"}},